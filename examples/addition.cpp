@@ -12,7 +12,7 @@
 
 using namespace lbcrypto;
 
-int main(int argc, char* argv[]) {
+static int runAddition(int argc, char* argv[]) {
     // Parse arguments
     ArgParser parser;
     parser.parse(argc, argv);
@@ -21,26 +21,12 @@ int main(int argc, char* argv[]) {
     bool debug = parser.getDebug();
     setupThreads(parser);
     
-    MeasurementMode mode = parser.getMeasurementMode();
-    MeasurementSystem measurement(mode);
+    MeasurementSystem measurement(parser);
     
     BenchmarkParams params = BenchmarkParams::fromArgs(parser);
 
     // Setup CKKS cryptocontext
-    CCParams<CryptoContextCKKSRNS> ccParams;
-    ccParams.SetMultiplicativeDepth(params.multDepth);
-    ccParams.SetScalingModSize(50);  
-    ccParams.SetRingDim(params.ringDim);
-    ccParams.SetSecurityLevel(params.checkSecurity ? HEStd_128_classic : HEStd_NotSet);
-    
-    ccParams.SetScalingTechnique(FLEXIBLEAUTO);
-    ccParams.SetKeySwitchTechnique(HYBRID);
-    ccParams.SetNumLargeDigits(params.numDigits);
-    
-    CryptoContext<DCRTPoly> cc = GenCryptoContext(ccParams);
-    cc->Enable(PKE);
-    cc->Enable(KEYSWITCH);
-    cc->Enable(LEVELEDSHE);
+    CryptoContext<DCRTPoly> cc = makeCryptoContext(params);
 
     // Generate key pair
     auto keyPair = cc->KeyGen();
@@ -88,28 +74,34 @@ int main(int argc, char* argv[]) {
     // Load input ciphertexts from disk
     Ciphertext<DCRTPoly> c1Loaded, c2Loaded;
     
-    if (!Serial::DeserializeFromFile(cipher1Path, c1Loaded, SerType::BINARY)) {
-        std::cerr << "Failed to load ciphertext 1" << std::endl;
-        return 1;
-    }
+    {
+        ScopedRegion region(measurement, "deserialize-input");
+        if (!Serial::DeserializeFromFile(cipher1Path, c1Loaded, SerType::BINARY)) {
+            std::cerr << "Failed to load ciphertext 1" << std::endl;
+            return 1;
+        }
 
-    if (!Serial::DeserializeFromFile(cipher2Path, c2Loaded, SerType::BINARY)) {
-        std::cerr << "Failed to load ciphertext 2" << std::endl;
-        return 1;
+        if (!Serial::DeserializeFromFile(cipher2Path, c2Loaded, SerType::BINARY)) {
+            std::cerr << "Failed to load ciphertext 2" << std::endl;
+            return 1;
+        }
     }
     
-    // PIN markers around only the FHE operation
-    measurement.startPIN();
-    
-    // Perform homomorphic addition 
-    auto cipherResult = cc->EvalAdd(c1Loaded, c2Loaded);
-    
-    measurement.endPIN();
+    // PIN markers / repeated timing around only the FHE operation
+    Ciphertext<DCRTPoly> cipherResult;
+    measurement.measureKernel([&] {
+        // Perform homomorphic addition
+        ScopedRegion region(measurement, "add");
+        cipherResult = cc->EvalAdd(c1Loaded, c2Loaded);
+    });
         
     // Serialize result
-    if (!Serial::SerializeToFile(resultPath, cipherResult, SerType::BINARY)) {
-        std::cerr << "Failed to save result ciphertext" << std::endl;
-        return 1;
+    {
+        ScopedRegion region(measurement, "serialize-result");
+        if (!Serial::SerializeToFile(resultPath, cipherResult, SerType::BINARY)) {
+            std::cerr << "Failed to save result ciphertext" << std::endl;
+            return 1;
+        }
     }
     
     // Stop DRAM measurement
@@ -134,4 +126,6 @@ int main(int argc, char* argv[]) {
     
     // Verify and return exit code
     return verifyResult(resultVec, expected, debug) ? 0 : 1;
-}
\ No newline at end of file
+}
+
+BENCHMARK_KERNEL("addition", runAddition);
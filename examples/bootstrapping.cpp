@@ -0,0 +1,266 @@
+// examples/bootstrapping.cpp - CKKS bootstrapping with persisted precomputations
+// Times EvalBootstrapSetup (the CoeffsToSlots/SlotsToCoeffs precomputations),
+// key generation (EvalMult and bootstrapping rotation keys) and one
+// EvalBootstrap per kernel run. The context (carrying the precomputations) and
+// keys are saved to disk and loaded back, so every run also reports the
+// warm-start load time; with --bootstrap-persist-dir a later run with the same
+// parameters loads them instead of regenerating.
+#include <openfhe.h>
+#include "utils.hpp"
+#include <iostream>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <iomanip>
+#include <filesystem>
+#include <random>
+#include <cmath>
+
+// Headers needed for serialization
+#include <ciphertext-ser.h>
+#include <cryptocontext-ser.h>
+#include <key/key-ser.h>
+#include <scheme/ckksrns/ckksrns-ser.h>
+
+using namespace lbcrypto;
+
+// Bootstrapping is approximate: the largest slot error accepted by verification
+static constexpr double kBootstrapTolerance = 1e-3;
+
+// Run f() inside a named region and return its wall time. In MEMORY mode the
+// allocation counters are on, so the region line carries its allocations.
+template <typename F>
+static uint64_t timedPhase(MeasurementSystem& measurement, const std::string& name, F&& f) {
+    bool track = measurement.getMode() == MeasurementMode::MEMORY;
+    if (track) allocationCounters.tracking = true;
+    auto start = std::chrono::steady_clock::now();
+    {
+        ScopedRegion region(measurement, name);
+        f();
+    }
+    auto stop = std::chrono::steady_clock::now();
+    if (track) allocationCounters.tracking = false;
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count());
+}
+
+// Context (with its bootstrapping precomputations), key pair, EvalMult key
+// and rotation keys as files in dir
+static bool saveBootstrapState(const std::string& dir, const CryptoContext<DCRTPoly>& cc,
+                               const KeyPair<DCRTPoly>& keyPair) {
+    if (!Serial::SerializeToFile(dir + "context.bin", cc, SerType::BINARY) ||
+        !Serial::SerializeToFile(dir + "public-key.bin", keyPair.publicKey, SerType::BINARY) ||
+        !Serial::SerializeToFile(dir + "secret-key.bin", keyPair.secretKey, SerType::BINARY)) {
+        return false;
+    }
+    
+    std::ofstream multKeyFile(dir + "mult-key.bin", std::ios::binary);
+    if (!cc->SerializeEvalMultKey(multKeyFile, SerType::BINARY)) return false;
+    
+    std::ofstream rotationKeyFile(dir + "rotation-keys.bin", std::ios::binary);
+    return cc->SerializeEvalAutomorphismKey(rotationKeyFile, SerType::BINARY);
+}
+
+// Drop the in-memory context and keys, then rebuild them from dir
+static bool loadBootstrapState(const std::string& dir, CryptoContext<DCRTPoly>& cc, KeyPair<DCRTPoly>& keyPair) {
+    if (cc) {
+        cc->ClearEvalMultKeys();
+        cc->ClearEvalAutomorphismKeys();
+    }
+    keyPair = KeyPair<DCRTPoly>();
+    cc.reset();
+    CryptoContextFactory<DCRTPoly>::ReleaseAllContexts();
+    
+    if (!Serial::DeserializeFromFile(dir + "context.bin", cc, SerType::BINARY) ||
+        !Serial::DeserializeFromFile(dir + "public-key.bin", keyPair.publicKey, SerType::BINARY) ||
+        !Serial::DeserializeFromFile(dir + "secret-key.bin", keyPair.secretKey, SerType::BINARY)) {
+        return false;
+    }
+    
+    std::ifstream multKeyFile(dir + "mult-key.bin", std::ios::binary);
+    if (!cc->DeserializeEvalMultKey(multKeyFile, SerType::BINARY)) return false;
+    
+    std::ifstream rotationKeyFile(dir + "rotation-keys.bin", std::ios::binary);
+    return cc->DeserializeEvalAutomorphismKey(rotationKeyFile, SerType::BINARY);
+}
+
+static int runBootstrapping(int argc, char* argv[]) {
+    // Parse arguments
+    ArgParser parser;
+    parser.parse(argc, argv);
+    
+    // Get parameters
+    bool debug = parser.getDebug();
+    setupThreads(parser);
+    
+    MeasurementSystem measurement(parser);
+    
+    // --mult-depth is the number of levels left after bootstrapping
+    BenchmarkParams params = BenchmarkParams::fromArgs(parser);
+    
+    // --level-budget=<encode>,<decode> (default 4,4): levels spent on
+    // CoeffsToSlots and SlotsToCoeffs; more levels, fewer rotations
+    std::vector<uint32_t> levelBudget = parseCommaList<uint32_t>(parser.getString("level-budget", "4,4"));
+    if (levelBudget.size() != 2 || levelBudget[0] == 0 || levelBudget[1] == 0) {
+        std::cerr << "Error: --level-budget must be <encode>,<decode> with both > 0\n";
+        return 1;
+    }
+    
+    // --slots (default ring-dim / 2, full packing); fewer slots bootstrap sparsely
+    uint32_t slots = parser.getUInt32("slots", params.ringDim / 2);
+    if (slots == 0 || slots > params.ringDim / 2 || (slots & (slots - 1)) != 0) {
+        std::cerr << "Error: --slots (" << slots << ") must be a power of two <= ring-dim / 2\n";
+        return 1;
+    }
+    
+    // --bootstrap-persist-dir=<dir>: keep the precomputations and keys per
+    // parameter set and reuse them across runs
+    std::string persistDir = parser.getString("bootstrap-persist-dir");
+    
+    uint32_t bootstrapDepth = FHECKKSRNS::GetBootstrapDepth(levelBudget, UNIFORM_TERNARY);
+    uint32_t totalDepth = params.multDepth + bootstrapDepth;
+    
+    std::ostringstream description;
+    description << "ring-dim=" << params.ringDim
+                << " mult-depth=" << params.multDepth
+                << " num-digits=" << params.numDigits
+                << " scaling=" << static_cast<int>(params.scaling)
+                << " ks-tech=" << params.keySwitchName() << "-" << params.digitSize
+                << " level-budget=" << levelBudget[0] << "," << levelBudget[1]
+                << " slots=" << slots;
+    
+    TempDirectory tempDir;
+    if (!tempDir.isValid()) {
+        std::cerr << "Failed to create temporary directory" << std::endl;
+        return 1;
+    }
+    std::string stateDir = persistDir.empty() ? tempDir.getFilePath("")
+                                              : persistDir + "/" + fnv1aHex(description.str()) + "/";
+    bool warmStart = !persistDir.empty() && std::filesystem::exists(stateDir + "complete");
+    
+    if (debug) {
+        std::cout << "=== CKKS Bootstrapping ===\n";
+        std::cout << "Ring dimension: " << params.ringDim << ", slots: " << slots << "\n";
+        std::cout << "Level budget: " << levelBudget[0] << "," << levelBudget[1]
+                  << " (bootstrap depth " << bootstrapDepth << ", " << params.multDepth << " levels after)\n";
+        std::cout << (warmStart ? "Loading persisted state from " : "Generating state into ") << stateDir << "\n\n";
+    }
+    
+    // Setup CKKS cryptocontext, precomputations and keys (skipped on a warm start)
+    CryptoContext<DCRTPoly> cc;
+    KeyPair<DCRTPoly> keyPair;
+    uint64_t setupNs = 0;
+    uint64_t keygenNs = 0;
+    uint64_t saveNs = 0;
+    
+    if (!warmStart) {
+        setupNs = timedPhase(measurement, "bootstrap-setup", [&] {
+            cc = makeCryptoContext(params, bootstrapDepth);
+            cc->EvalBootstrapSetup(levelBudget, {0, 0}, slots);
+        });
+        
+        keygenNs = timedPhase(measurement, "bootstrap-keygen", [&] {
+            keyPair = cc->KeyGen();
+            cc->EvalMultKeyGen(keyPair.secretKey);
+            cc->EvalBootstrapKeyGen(keyPair.secretKey, slots);
+        });
+        
+        if (!persistDir.empty()) {
+            std::filesystem::remove_all(stateDir);
+            std::filesystem::create_directories(stateDir);
+        }
+        
+        bool saved = true;
+        saveNs = timedPhase(measurement, "bootstrap-save", [&] {
+            saved = saveBootstrapState(stateDir, cc, keyPair);
+        });
+        if (!saved) {
+            std::cerr << "Failed to save bootstrapping state\n";
+            return 1;
+        }
+        
+        if (!persistDir.empty()) {
+            // Written last, so an interrupted run is regenerated next time
+            std::ofstream marker(stateDir + "complete");
+            marker << description.str() << "\n";
+        }
+    }
+    
+    // Warm start: the state as a later process would see it
+    bool loaded = true;
+    uint64_t loadNs = timedPhase(measurement, "bootstrap-load", [&] {
+        loaded = loadBootstrapState(stateDir, cc, keyPair);
+    });
+    if (!loaded) {
+        std::cerr << "Failed to load bootstrapping state\n";
+        return 1;
+    }
+    
+    // Prepare test data in [-1, 1], encrypted at the last level before bootstrapping
+    std::mt19937 gen(0);  // fixed, so precision is comparable across runs
+    std::uniform_real_distribution<> dis(-1.0, 1.0);
+    std::vector<double> vec(slots);
+    for (auto& value : vec) value = dis(gen);
+    
+    Plaintext ptxt = cc->MakeCKKSPackedPlaintext(vec, 1, totalDepth - 1, nullptr, slots);
+    auto cipher = cc->Encrypt(keyPair.publicKey, ptxt);
+    
+    // PROFILED FHE COMPUTATION
+    
+    // Start DRAM measurement (bootstrap only; setup and load have their own regions)
+    measurement.startDRAM();
+    
+    Ciphertext<DCRTPoly> cipherResult;
+    measurement.measureKernel([&] {
+        ScopedRegion region(measurement, "bootstrap");
+        cipherResult = cc->EvalBootstrap(cipher);
+    });
+    
+    // Stop DRAM measurement
+    measurement.stopDRAM();
+    
+    // Always verify
+    Plaintext result;
+    cc->Decrypt(keyPair.secretKey, cipherResult, &result);
+    result->SetLength(slots);
+    auto resultVec = result->GetRealPackedValue();
+    
+    double maxError = 0.0;
+    for (std::size_t i = 0; i < std::min(resultVec.size(), vec.size()); ++i) {
+        maxError = std::max(maxError, std::abs(resultVec[i] - vec[i]));
+    }
+    bool passed = maxError < kBootstrapTolerance;
+    
+    // Print measurement results
+    measurement.printResults();
+    
+    auto fileBytes = [&](const char* name) { return std::filesystem::file_size(stateDir + name); };
+    std::cout << "BOOT_SLOTS=" << slots << "\n";
+    std::cout << "BOOT_LEVEL_BUDGET_ENCODE=" << levelBudget[0] << "\n";
+    std::cout << "BOOT_LEVEL_BUDGET_DECODE=" << levelBudget[1] << "\n";
+    std::cout << "BOOT_DEPTH=" << bootstrapDepth << "\n";
+    std::cout << "BOOT_LEVELS_AFTER=" << totalDepth - cipherResult->GetLevel() << "\n";
+    std::cout << "BOOT_WARM_START=" << (warmStart ? 1 : 0) << "\n";
+    std::cout << "BOOT_SETUP_NS=" << setupNs << "\n";
+    std::cout << "BOOT_KEYGEN_NS=" << keygenNs << "\n";
+    std::cout << "BOOT_SAVE_NS=" << saveNs << "\n";
+    std::cout << "BOOT_LOAD_NS=" << loadNs << "\n";
+    std::cout << "BOOT_CONTEXT_BYTES=" << fileBytes("context.bin") << "\n";
+    std::cout << "BOOT_MULT_KEY_BYTES=" << fileBytes("mult-key.bin") << "\n";
+    std::cout << "BOOT_ROTATION_KEY_BYTES=" << fileBytes("rotation-keys.bin") << "\n";
+    std::cout << "BOOT_ROTATION_KEYS=" << cc->GetEvalAutomorphismKeyMap(keyPair.secretKey->GetKeyTag()).size() << "\n";
+    std::cout << "BOOT_PRECISION_BITS=" << std::fixed << std::setprecision(2)
+              << (maxError > 0 ? -std::log2(maxError) : 64.0) << std::defaultfloat << "\n";
+    
+    if (debug) {
+        if (passed) {
+            std::cout << "✓ Verification PASSED (max error " << maxError << ")\n";
+        } else {
+            std::cout << "✗ Verification FAILED - Max error: " << maxError << "\n";
+        }
+    }
+    
+    return passed ? 0 : 1;
+}
+
+BENCHMARK_KERNEL("bootstrapping", runBootstrapping);
@@ -19,35 +19,42 @@
 
 using namespace lbcrypto;
 
-int main(int argc, char* argv[]) {
+static int runBsgsDiagonal(int argc, char* argv[]) {
     // Parse arguments
     ArgParser parser;
     parser.parse(argc, argv);
     
     // Get parameters
     bool debug = parser.getDebug();
-    std::size_t matrixDim = static_cast<std::size_t>(parser.getUInt32("matrix-dim", 128));
+    uint32_t batchSize = std::max<uint32_t>(1, parser.getUInt32("batch", 1));
+    bool treeReduction = parser.getString("reduction", "fold") == "tree";  // --reduction=fold|tree
+    bool rescaleAtEnd = parser.getString("rescale", "block") == "end";  // --rescale=block|end (FIXEDMANUAL)
     setupThreads(parser);
     
-    MeasurementMode mode = parser.getMeasurementMode();
-    MeasurementSystem measurement(mode);
+    // Matrix (--matrix-kind; --matrix-dim unless loaded from --matrix-file)
+    BenchmarkMatrix M;
+    try {
+        M = make_benchmark_matrix(parser);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    std::size_t matrixDim = M.dim();
+    
+    MeasurementSystem measurement(parser);
+    measurement.setBatchSize(batchSize);
     
     BenchmarkParams params = BenchmarkParams::fromArgs(parser);
     
+    // --start-level / --mod-switch=min (the plaintext products need one level)
+    LevelControl levels(parser, params, 1);
+    if (!levels.check().empty()) {
+        std::cerr << "Error: " << levels.check() << "\n";
+        return 1;
+    }
+    
     // Setup CKKS cryptocontext
-    CCParams<CryptoContextCKKSRNS> ccParams;
-    ccParams.SetMultiplicativeDepth(params.multDepth);
-    ccParams.SetScalingModSize(50);
-    ccParams.SetRingDim(params.ringDim);
-    ccParams.SetScalingTechnique(FLEXIBLEAUTO);
-    ccParams.SetKeySwitchTechnique(HYBRID);
-    ccParams.SetNumLargeDigits(params.numDigits);
-    ccParams.SetSecurityLevel(params.checkSecurity ? HEStd_128_classic : HEStd_NotSet);
-    
-    CryptoContext<DCRTPoly> cc = GenCryptoContext(ccParams);
-    cc->Enable(PKE);
-    cc->Enable(KEYSWITCH);
-    cc->Enable(LEVELEDSHE);
+    CryptoContext<DCRTPoly> cc = makeCryptoContext(params);
 
     int numSlots = static_cast<int>(cc->GetEncodingParams()->GetBatchSize());
     if (static_cast<int>(matrixDim) > numSlots) {
@@ -57,7 +64,8 @@ int main(int argc, char* argv[]) {
     
     if (debug) {
         std::cout << "=== Baby-Step/Giant-Step (BSGS) Method with Signed Indexing ===\n";
-        std::cout << "Actual matrix dimension: " << matrixDim << "×" << matrixDim << "\n";
+        std::cout << "Actual matrix dimension: " << matrixDim << "×" << matrixDim
+                  << " (" << M.kind << ", " << M.nnz() << " nonzeros)\n";
         std::cout << "Number of slots: " << numSlots << "\n";
         std::cout << "Ring dimension: " << params.ringDim << "\n\n";
     }
@@ -65,46 +73,63 @@ int main(int argc, char* argv[]) {
     // Generate key pair
     auto keyPair = cc->KeyGen();
     
-    // CREATE MATRIX AND VECTOR
-    auto M = make_embedded_random_matrix(matrixDim, numSlots);
-    auto inputVec = make_random_input_vector(matrixDim, numSlots);
-    
-    // EXTRACT DIAGONALS AND CONVERT TO SIGNED INDEXING
-    if (debug) {
-        std::cout << "Extracting diagonals...\n";
+    // CREATE INPUT VECTORS
+    // One independent input vector per ciphertext of the batch (--batch)
+    std::vector<std::vector<double>> inputVecs(batchSize);
+    for (auto& inputVec : inputVecs) {
+        inputVec = make_random_input_vector(matrixDim, numSlots);
     }
     
-    // First extract diagonals with regular indexing [0, numSlots-1]
-    auto diagonalsUnsigned = extract_generalized_diagonals(M, matrixDim);
-    
-    // Convert to signed indexing [-numSlots/2, numSlots/2]
-    std::map<int, std::vector<double>> diagonalsSigned;
-    
-    for (const auto& entry : diagonalsUnsigned) {
-        int kUnsigned = entry.first;
-        int kSigned = normalizeToSignedIndex(kUnsigned, numSlots);
-        diagonalsSigned[kSigned] = entry.second;
+    // DIAGONAL INDICES
+    // Only the offsets are scanned here; the diagonals themselves are extracted
+    // on a plaintext cache miss
+    std::vector<int> diagonalIndices;
+    for (int k : diagonal_offsets(M, numSlots)) {
+        // Convert to signed indexing [-numSlots/2, numSlots/2]
+        diagonalIndices.push_back(normalizeToSignedIndex(k, numSlots));
     }
+    std::sort(diagonalIndices.begin(), diagonalIndices.end());
     
-    int numDiagonals = static_cast<int>(diagonalsSigned.size());
+    int numDiagonals = static_cast<int>(diagonalIndices.size());
     if (debug) {
         std::cout << "Found " << numDiagonals << " non-empty diagonals\n";
-        std::cout << "Diagonal indices range from " << diagonalsSigned.begin()->first 
-                  << " to " << diagonalsSigned.rbegin()->first << "\n";
+        std::cout << "Diagonal indices range from " << diagonalIndices.front() 
+                  << " to " << diagonalIndices.back() << "\n";
     }
     
-    // BSGS PARAMETERS BASED ON ACTUAL DIAGONAL COUNT
-    int n1 = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(numDiagonals))));
-    
-    // Ensure n1 is reasonable
-    if (n1 < 1) n1 = 1;
-    if (n1 > numSlots) n1 = numSlots;
+    // BSGS PARAMETERS (--n1: sqrt of the diagonal count, fixed, or auto-tuned)
+    BsgsPlanner planner(parser, BsgsVariant::PLAIN, batchSize);
+    int n1 = planner.choose(diagonalIndices, numSlots);
     
     int n2_approx = static_cast<int>(std::ceil(static_cast<double>(numSlots) / n1));
     
     if (debug) {
-        std::cout << "BSGS parameters: n1 = " << n1 
-                  << " (based on sqrt(" << numDiagonals << ")), n2 ≈ " << n2_approx << "\n";
+        std::cout << "BSGS parameters: n1 = " << n1 << ", n2 ≈ " << n2_approx
+                  << " (" << planner.split().rotationKeys << " rotation keys, predicted "
+                  << planner.split().predictedNs << " ns per ciphertext)\n";
+    }
+    
+    // DIAGONAL PLAINTEXT CACHE (--ptxt-cache-dir)
+    // On a hit the pre-rotated plaintexts for this n1 are loaded and diagonal
+    // extraction and encoding are skipped
+    DiagonalPlaintextCache ptxtCache(cc, parser, measurement);
+    ptxtCache.describe(matrixHash(M), M.dim(), params, "bsgs-n1-" + std::to_string(n1) + levels.layoutTag());
+    
+    std::map<int, Plaintext> preRotateDiagonals;
+    bool ptxtCached = ptxtCache.load(preRotateDiagonals);
+    
+    // EXTRACT DIAGONALS (cache miss only)
+    DiagonalSet diagonals;
+    std::map<int, std::size_t> diagonalOfIndex;  // signed index -> diagonal in the set
+    if (!ptxtCached) {
+        if (debug) {
+            std::cout << "Extracting diagonals...\n";
+        }
+        
+        diagonals = extract_diagonals(M, numSlots);
+        for (std::size_t d = 0; d < diagonals.size(); ++d) {
+            diagonalOfIndex[normalizeToSignedIndex(diagonals.offsets[d], numSlots)] = d;
+        }
     }
     
     // DECOMPOSE DIAGONALS AND PRE-ROTATE
@@ -112,31 +137,28 @@ int main(int argc, char* argv[]) {
         std::cout << "Pre-rotating diagonals for BSGS decomposition...\n";
     }
 
-    // Track which baby steps and giant steps we actually use
-    std::set<int> usedBabySteps;
-    std::set<int> usedGiantSteps;
-    
-    // Pre-rotate each diagonal by its giant step amount
-    std::map<int, Plaintext> preRotateDiagonals;
+    // Track which baby steps and giant steps we actually use (k = j*n1 + i, i ∈ [0, n1))
+    BsgsSchedule schedule(diagonalIndices, n1);
+    const std::set<int>& usedBabySteps = schedule.babySteps;
+    const std::set<int>& usedGiantSteps = schedule.giantSteps;
+    
+    // Pre-rotate and encode the diagonals (cache miss only)
+    if (!ptxtCached) {
+        preRotateDiagonals = ptxtCache.encode(diagonalIndices, [&](std::size_t n) {
+            // Pre-rotate the diagonal by j*n1 positions
+            int k = diagonalIndices[n];
+            auto diagonal = rotateVectorDown(diagonals.diagonal(diagonalOfIndex.at(k)), schedule.preRotation(k, numSlots));
+            return cc->MakeCKKSPackedPlaintext(diagonal, 1, levels.computeLevel());
+        });
+    }
     
-    for (const auto& entry : diagonalsSigned) {
-        int k = entry.first;
-        
-        // Decompose k = j*n1 + i where i ∈ [0, n1)
-        int j = floorDivision(k, n1);
-        int i = k - j * n1;
-        
-        usedBabySteps.insert(i);
-        usedGiantSteps.insert(j);
-        
-        // Pre-rotate the diagonal by j*n1 positions
-        auto diagonal = entry.second;
-        int rotateAmount = (n1 * j) % numSlots;
-        if (rotateAmount < 0) rotateAmount += numSlots;
-        diagonal = rotateVectorDown(diagonal, rotateAmount);
-        
-        // Store with original signed key k
-        preRotateDiagonals[k] = cc->MakeCKKSPackedPlaintext(diagonal);
+    // --encode-only: the encoding above was the measured kernel
+    if (ptxtCache.encodeOnly()) {
+        measurement.printResults();
+        ptxtCache.printResults();
+        printMatrixResults(M, static_cast<std::size_t>(numDiagonals));
+        planner.printResults();
+        return 0;
     }
     
     if (debug) {
@@ -153,43 +175,40 @@ int main(int argc, char* argv[]) {
         return 1;
     }
     
+    // Rotation keys are saved to and fetched from per-rotation files
+    RotationKeyStore keyStore(cc, tempDir, "bsgs-rot-key-", KeyStoreConfig::fromArgs(parser), measurement);
+    
     // GENERATE AND SAVE ROTATION KEYS
     if (debug) {
         std::cout << "Generating rotation keys...\n";
     }
     
     // Collect all needed rotations
-    std::set<int> rotationIndices;
+    RotationKeyBasis keyBasis(parser, numSlots);
     
-    // Baby rotations (skip i=0 which is identity)
+    // Baby rotations: from the input, or chained from the previous baby step
+    // with a compact basis (--key-basis); i=0 is the identity
+    std::vector<int> babyRotations;
+    int previousBaby = 0;
     for (int i : usedBabySteps) {
-        if (i != 0) rotationIndices.insert(i);
+        babyRotations.push_back(keyBasis.compact() ? i - previousBaby : i);
+        previousBaby = i;
     }
+    keyBasis.plan(babyRotations);
     
-    // Giant rotations (can be negative!)
+    // Giant rotations (can be negative!) keep a key each
+    std::vector<int> giantRotations;
     for (int j : usedGiantSteps) {
-        if (j != 0) {
-            int rotation = n1 * j;
-            rotationIndices.insert(rotation);
-        }
+        if (j != 0) giantRotations.push_back(n1 * j);
     }
+    std::set<int> rotationIndices = keyBasis.planDirect(giantRotations);
     
-    // Generate and save each rotation key
-    for (int rot : rotationIndices) {
-        cc->EvalRotateKeyGen(keyPair.secretKey, {rot});
-        
-        std::stringstream filename;
-        filename << "bsgs-rot-key-" << rot << ".bin";
-        std::string keyPath = tempDir.getFilePath(filename.str());
-        
-        std::ofstream keyFile(keyPath, std::ios::binary);
-        if (!cc->SerializeEvalAutomorphismKey(keyFile, SerType::BINARY)) {
-            std::cerr << "Failed to save rotation key " << rot << "\n";
-            return 1;
-        }
-        keyFile.close();
-        cc->ClearEvalAutomorphismKeys();
+    // Generate and save each rotation key (or reuse a persisted key set)
+    if (!keyStore.generate(keyPair, rotationIndices, params)) {
+        std::cerr << "Failed to generate rotation keys\n";
+        return 1;
     }
+    KeySizeReport keySizes(parser, cc, keyPair, rotationIndices.size());
     
     if (debug) {
         std::cout << "Generated and saved " << rotationIndices.size() << " rotation keys\n";
@@ -200,162 +219,345 @@ int main(int argc, char* argv[]) {
         std::cout << "Encrypting input...\n";
     }
     
-    Plaintext inputPtxt = cc->MakeCKKSPackedPlaintext(inputVec);
-    auto inputCipher = cc->Encrypt(keyPair.publicKey, inputPtxt);
+    CiphertextBatch inputCiphers(batchSize);
+    for (uint32_t b = 0; b < batchSize; ++b) {
+        Plaintext inputPtxt = cc->MakeCKKSPackedPlaintext(inputVecs[b]);
+        inputCiphers[b] = cc->Encrypt(keyPair.publicKey, inputPtxt);
+    }
+    levels.toStartLevel(cc, inputCiphers);
     
-    std::string inputPath = tempDir.getFilePath("input.bin");
-    if (!Serial::SerializeToFile(inputPath, inputCipher, SerType::BINARY)) {
-        std::cerr << "Failed to serialize input\n";
-        return 1;
+    // One input file per ciphertext of the batch
+    auto inputPath = [&](uint32_t b) {
+        return tempDir.getFilePath("input-" + std::to_string(b) + ".bin");
+    };
+    for (uint32_t b = 0; b < batchSize; ++b) {
+        if (!Serial::SerializeToFile(inputPath(b), inputCiphers[b], SerType::BINARY)) {
+            std::cerr << "Failed to serialize input\n";
+            return 1;
+        }
     }
     
-    inputCipher.reset();
+    inputCiphers.clear();
 
     // PROFILED BSGS COMPUTATION
     if (debug) {
         std::cout << "\nStarting profiled BSGS computation...\n";
     }
     
+    // Warm the key cache (no-op with the default --key-cache-mb=0)
+    keyStore.prefill(rotationIndices);
+    
     // Start DRAM measurement
     measurement.startDRAM();
     
-    // Load input
-    Ciphertext<DCRTPoly> cipherInput;
-    if (!Serial::DeserializeFromFile(inputPath, cipherInput, SerType::BINARY)) {
-        std::cerr << "Failed to load input\n";
-        return 1;
-    }
-    
-    // PIN markers around the computation
-    measurement.startPIN();
-    
-    // BSGS COMPUTATION WITH CACHED BABY ROTATIONS
-    
-    // Cache for baby rotations (compute on first use)
-    std::vector<Ciphertext<DCRTPoly>> babyRotationCache(n1);
-    std::vector<bool> babyRotationComputed(n1, false);
+    // Open the key store (bundle index and mapping: the cold-start cost)
+    keyStore.open();
     
-    // Identity rotation is always available
-    babyRotationCache[0] = cipherInput;
-    babyRotationComputed[0] = true;
+    // Load the batch of input ciphertexts
+    CiphertextBatch cipherInputs(batchSize);
+    {
+        ScopedRegion region(measurement, "deserialize-input");
+        for (uint32_t b = 0; b < batchSize; ++b) {
+            if (!Serial::DeserializeFromFile(inputPath(b), cipherInputs[b], SerType::BINARY)) {
+                std::cerr << "Failed to load input\n";
+                return 1;
+            }
+        }
+    }
     
-    // Helper to get/compute baby rotation
-    auto getBabyRotation = [&](int i) -> const Ciphertext<DCRTPoly>& {
-        if (!babyRotationComputed[i]) {
-            // Load rotation key
-            std::stringstream filename;
-            filename << "bsgs-rot-key-" << i << ".bin";
-            std::string keyPath = tempDir.getFilePath(filename.str());
+    // PIN markers / repeated timing around the computation
+    CiphertextBatch results(batchSize);
+    measurement.measureKernel([&] {
+        auto inputs = levels.switchDown(cc, measurement, cipherInputs);
+        
+        // BSGS COMPUTATION WITH CACHED BABY ROTATIONS
+        // Each rotation key is loaded once and applied to the whole batch
+        
+        // Cache for baby rotations (compute on first use)
+        std::vector<CiphertextBatch> babyRotationCache(n1);
+        std::vector<bool> babyRotationComputed(n1, false);
+        
+        // Identity rotation is always available
+        babyRotationCache[0] = inputs;
+        babyRotationComputed[0] = true;
+        
+        // Compact key basis: compute the baby steps in ascending order, each
+        // chained from the previous one
+        if (keyBasis.compact()) {
+            int previous = 0;
+            for (int i : usedBabySteps) {
+                if (i == 0) continue;
+                babyRotationCache[i] = babyRotationCache[previous];
+                rotateBatchByBasis(keyStore, keyBasis, measurement, babyRotationCache[i], i - previous);
+                babyRotationComputed[i] = true;
+                previous = i;
+            }
+        }
+        
+        // Throughput mode (--outer-threads): each group of outer-threads baby
+        // steps is rotated as tasks over (rotation, ciphertext) pairs with the
+        // group's keys installed together
+        bool taskPool = threadSplit().enabled() && !keyBasis.compact();
+        std::size_t groupSize = threadSplit().outer;
+        if (taskPool) {
+            std::vector<int> pending;
+            for (int i : usedBabySteps) {
+                if (!babyRotationComputed[i]) pending.push_back(i);
+            }
+            
+            for (std::size_t start = 0; start < pending.size(); start += groupSize) {
+                std::size_t count = std::min(groupSize, pending.size() - start);
+                for (std::size_t n = start; n < start + count; ++n) {
+                    keyStore.acquire(pending[n]);
+                    babyRotationCache[pending[n]].resize(batchSize);
+                }
+                {
+                    ScopedRegion region(measurement, "rotate");
+                    forEachTask(count * batchSize, [&](std::size_t t) {
+                        int i = pending[start + t / batchSize];
+                        std::size_t b = t % batchSize;
+                        babyRotationCache[i][b] = keyStore.rotate(inputs[b], i);
+                    });
+                }
+                keyStore.releaseAll();
+                
+                for (std::size_t n = start; n < start + count; ++n) {
+                    babyRotationComputed[pending[n]] = true;
+                }
+            }
+        }
+        
+        // Helper to get/compute baby rotation
+        auto getBabyRotation = [&](int i) -> const CiphertextBatch& {
+            if (!babyRotationComputed[i]) {
+                // Fetch rotation key (cached or from disk)
+                keyStore.acquire(i);
+                
+                // Compute and cache rotation
+                babyRotationCache[i].resize(batchSize);
+                {
+                    ScopedRegion region(measurement, "rotate");
+                    forEachInBatch(batchSize, [&](std::size_t b) {
+                        babyRotationCache[i][b] = keyStore.rotate(inputs[b], i);
+                    });
+                }
+                keyStore.release(i);
+                babyRotationComputed[i] = true;
+            }
+            return babyRotationCache[i];
+        };
+        
+        // Process giant steps in sorted order
+        std::vector<int> sortedGiantSteps(usedGiantSteps.begin(), usedGiantSteps.end());
+        std::sort(sortedGiantSteps.begin(), sortedGiantSteps.end());
+        
+        bool first = true;
+        
+        // --reduction=tree: rotated giant blocks, summed after the last one
+        std::vector<CiphertextBatch> giantSums;
+        
+        // Tree-reduce the giant blocks and apply a deferred rescale
+        auto finishResults = [&] {
+            if (!giantSums.empty()) {
+                ScopedRegion region(measurement, "accumulate");
+                treeReduce(cc, giantSums);
+                results = giantSums[0];
+            }
             
-            std::ifstream keyFile(keyPath, std::ios::binary);
-            if (!cc->DeserializeEvalAutomorphismKey(keyFile, SerType::BINARY)) {
-                std::cerr << "Failed to load key for baby step " << i << "\n";
-                throw std::runtime_error("Missing rotation key");
+            // FIXEDMANUAL with --rescale=end: a single rescale of the result
+            if (params.manualRescale() && rescaleAtEnd) {
+                rescaleBatch(cc, measurement, results);
+            }
+        };
+        
+        // Throughput mode: each task computes one ciphertext's block sum and
+        // giant rotation for a group of outer-threads giant steps
+        if (taskPool) {
+            for (std::size_t start = 0; start < sortedGiantSteps.size(); start += groupSize) {
+                std::size_t count = std::min(groupSize, sortedGiantSteps.size() - start);
+                for (std::size_t n = start; n < start + count; ++n) {
+                    if (sortedGiantSteps[n] != 0) keyStore.acquire(n1 * sortedGiantSteps[n]);
+                }
+                
+                std::vector<CiphertextBatch> blockSums(count, CiphertextBatch(batchSize));
+                {
+                    ScopedRegion region(measurement, "giant-block");
+                    forEachTask(count * batchSize, [&](std::size_t t) {
+                        int j = sortedGiantSteps[start + t / batchSize];
+                        std::size_t b = t % batchSize;
+                        blockSums[t / batchSize][b] = bsgsGiantBlock(
+                            cc, params, schedule, preRotateDiagonals, j,
+                            [&](int i) -> const Ciphertext<DCRTPoly>& { return babyRotationCache[i][b]; },
+                            [&](const Ciphertext<DCRTPoly>& ct, int rotation) { return keyStore.rotate(ct, rotation); },
+                            !rescaleAtEnd);
+                    });
+                }
+                keyStore.releaseAll();
+                
+                ScopedRegion region(measurement, "accumulate");
+                for (auto& giantBlockSum : blockSums) {
+                    if (!giantBlockSum[0]) continue;
+                    if (treeReduction) {
+                        giantSums.push_back(giantBlockSum);
+                    } else if (first) {
+                        results = giantBlockSum;
+                        first = false;
+                    } else {
+                        forEachInBatch(batchSize, [&](std::size_t b) {
+                            results[b] = cc->EvalAdd(results[b], giantBlockSum[b]);
+                        });
+                    }
+                }
             }
-            keyFile.close();
             
-            // Compute and cache rotation
-            babyRotationCache[i] = cc->EvalRotate(cipherInput, i);
-            cc->ClearEvalAutomorphismKeys();
-            babyRotationComputed[i] = true;
+            finishResults();
+            return;
         }
-        return babyRotationCache[i];
-    };
-    
-    // Process giant steps in sorted order
-    std::vector<int> sortedGiantSteps(usedGiantSteps.begin(), usedGiantSteps.end());
-    std::sort(sortedGiantSteps.begin(), sortedGiantSteps.end());
-    
-    Ciphertext<DCRTPoly> result;
-    bool first = true;
-    
-    for (int j : sortedGiantSteps) {
-        // Accumulate all baby steps for this giant block
-        Ciphertext<DCRTPoly> giantBlockSum;
-        bool giantBlockFirst = true;
         
-        // Check all possible baby steps for this giant block
-        for (int i = 0; i < n1; ++i) {
-            // Reconstruct the signed diagonal index
-            int k = j * n1 + i;
+        for (int j : sortedGiantSteps) {
+            // Accumulate all baby steps for this giant block
+            CiphertextBatch giantBlockSum(batchSize);
+            bool giantBlockFirst = true;
+            PartialProducts products;
             
-            // Check if this diagonal exists
-            auto diagIter = preRotateDiagonals.find(k);
-            if (diagIter == preRotateDiagonals.end()) continue;
-
-            // Get baby rotation (from cache or compute)
-            const auto& babyRotated = (i == 0) ? cipherInput : getBabyRotation(i);
-
-            // Multiply with pre-rotated diagonal
-            auto partial = cc->EvalMult(babyRotated, diagIter->second);
+            // Check all possible baby steps for this giant block
+            for (int i = 0; i < n1; ++i) {
+                // Reconstruct the signed diagonal index
+                int k = j * n1 + i;
+                
+                // Check if this diagonal exists
+                auto diagIter = preRotateDiagonals.find(k);
+                if (diagIter == preRotateDiagonals.end()) continue;
+                
+                // Get baby rotation (from cache or compute)
+                const auto& babyRotated = getBabyRotation(i);
+                
+                if (treeReduction) {
+                    products.add(babyRotated, diagIter->second);
+                    continue;
+                }
+                
+                // Multiply with pre-rotated diagonal
+                CiphertextBatch partial(batchSize);
+                {
+                    ScopedRegion region(measurement, "ptxt-mult");
+                    forEachInBatch(batchSize, [&](std::size_t b) {
+                        partial[b] = cc->EvalMult(babyRotated[b], diagIter->second);
+                    });
+                }
+                
+                // Accumulate within giant block
+                if (giantBlockFirst) {
+                    giantBlockSum = partial;
+                    giantBlockFirst = false;
+                } else if (params.manualRescale()) {
+                    // Raw products, added in place at scale Δ²
+                    ScopedRegion region(measurement, "accumulate");
+                    forEachInBatch(batchSize, [&](std::size_t b) {
+                        cc->EvalAddInPlace(giantBlockSum[b], partial[b]);
+                    });
+                } else {
+                    ScopedRegion region(measurement, "accumulate");
+                    forEachInBatch(batchSize, [&](std::size_t b) {
+                        giantBlockSum[b] = cc->EvalAdd(giantBlockSum[b], partial[b]);
+                    });
+                }
+            }
             
-            // Accumulate within giant block
-            if (giantBlockFirst) {
-                giantBlockSum = partial;
+            if (!products.empty()) {
+                giantBlockSum = products.sum(cc, measurement);
                 giantBlockFirst = false;
-            } else {
-                giantBlockSum = cc->EvalAdd(giantBlockSum, partial);
             }
-        }
-        
-        // Skip if block is empty
-        if (giantBlockFirst) continue;
-        
-        // Apply giant rotation if j ≠ 0
-        if (j != 0) {
-            int giantRotation = n1 * j;
             
-            // Load rotation key
-            std::stringstream filename;
-            filename << "bsgs-rot-key-" << giantRotation << ".bin";
-            std::string keyPath = tempDir.getFilePath(filename.str());
+            // Skip if block is empty
+            if (giantBlockFirst) continue;
             
-            std::ifstream keyFile(keyPath, std::ios::binary);
-            if (!cc->DeserializeEvalAutomorphismKey(keyFile, SerType::BINARY)) {
-                std::cerr << "Failed to load key for giant step " << giantRotation << "\n";
-                return 1;
+            // FIXEDMANUAL: one rescale per giant block, ahead of its rotation
+            if (params.manualRescale() && !rescaleAtEnd) {
+                rescaleBatch(cc, measurement, giantBlockSum);
             }
-            keyFile.close();
             
-            giantBlockSum = cc->EvalRotate(giantBlockSum, giantRotation);
-            cc->ClearEvalAutomorphismKeys();
+            // Apply giant rotation if j ≠ 0
+            if (j != 0) {
+                int giantRotation = n1 * j;
+                
+                // Fetch rotation key (cached or from disk)
+                keyStore.acquire(giantRotation);
+                
+                {
+                    ScopedRegion region(measurement, "rotate");
+                    forEachInBatch(batchSize, [&](std::size_t b) {
+                        giantBlockSum[b] = keyStore.rotate(giantBlockSum[b], giantRotation);
+                    });
+                }
+                keyStore.release(giantRotation);
+            }
+            
+            if (treeReduction) {
+                giantSums.push_back(giantBlockSum);
+                continue;
+            }
+            
+            // Add to result
+            if (first) {
+                results = giantBlockSum;
+                first = false;
+            } else {
+                ScopedRegion region(measurement, "accumulate");
+                forEachInBatch(batchSize, [&](std::size_t b) {
+                    results[b] = cc->EvalAdd(results[b], giantBlockSum[b]);
+                });
+            }
         }
         
-        // Add to result
-        if (first) {
-            result = giantBlockSum;
-            first = false;
-        } else {
-            result = cc->EvalAdd(result, giantBlockSum);
+        finishResults();
+    });
+    
+    // Save results
+    {
+        ScopedRegion region(measurement, "serialize-result");
+        for (uint32_t b = 0; b < batchSize; ++b) {
+            std::string resultPath = tempDir.getFilePath("result-" + std::to_string(b) + ".bin");
+            if (!Serial::SerializeToFile(resultPath, results[b], SerType::BINARY)) {
+                std::cerr << "Failed to save result\n";
+                return 1;
+            }
         }
     }
     
-    measurement.endPIN();
-    
-    // Save result
-    std::string resultPath = tempDir.getFilePath("result.bin");
-    if (!Serial::SerializeToFile(resultPath, result, SerType::BINARY)) {
-        std::cerr << "Failed to save result\n";
-        return 1;
-    }
-    
     // Stop DRAM measurement
     measurement.stopDRAM();
     
     // Print measurement results
     measurement.printResults();
+    levels.printResults();
+    keyStore.printResults();
+    keyBasis.printResults();
+    if (!rotationIndices.empty()) {
+        auto [sampleKey, sampleBytes] = keyStore.sampleKey(*rotationIndices.begin());
+        keySizes.measureRotation(sampleKey, sampleBytes);
+    }
+    keySizes.printResults();
+    ptxtCache.printResults();
+    printMatrixResults(M, static_cast<std::size_t>(numDiagonals));
+    planner.printResults();
     
     // Always verify
     if (debug) {
         std::cout << "\nDecrypting and verifying result...\n";
     }
     
-    Plaintext resultPtxt;
-    cc->Decrypt(keyPair.secretKey, result, &resultPtxt);
-    resultPtxt->SetLength(numSlots);
-    
-    auto resultVec = resultPtxt->GetRealPackedValue();
-    
-    // Verify and return exit code
-    return verify_matrix_vector_result(resultVec, M, inputVec, matrixDim, debug) ? 0 : 1;
-}
\ No newline at end of file
+    // Verify every ciphertext of the batch and return exit code
+    bool allCorrect = true;
+    for (uint32_t b = 0; b < batchSize; ++b) {
+        Plaintext resultPtxt;
+        cc->Decrypt(keyPair.secretKey, results[b], &resultPtxt);
+        resultPtxt->SetLength(numSlots);
+        
+        auto resultVec = resultPtxt->GetRealPackedValue();
+        allCorrect = verify_matrix_vector_result(resultVec, M, inputVecs[b], debug) && allCorrect;
+    }
+    return allCorrect ? 0 : 1;
+}
+
+BENCHMARK_KERNEL("bsgs-diagonal-method", runBsgsDiagonal);
@@ -0,0 +1,556 @@
+// examples/double-hoisted-bsgs-diagonal-method.cpp - Double-hoisted BSGS diagonal method for matrix-vector multiplication
+//
+// Baby steps share one digit decomposition of the input (as in the single-hoisted
+// method) and additionally stay in the extended basis P·Q: the plaintext products
+// of a giant block are accumulated there and brought back with a single ModDown per
+// giant block. The giant-step key switches are accumulated in P·Q as well and share
+// one final ModDown, so the kernel performs (giant blocks + 1) ModDowns instead of
+// one per rotation.
+#include <openfhe.h>
+#include "utils.hpp"
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include <map>
+#include <set>
+#include <sstream>
+#include <cmath>
+
+// Headers needed for serialization
+#include <ciphertext-ser.h>
+#include <cryptocontext-ser.h>
+#include <key/key-ser.h>
+#include <scheme/ckksrns/ckksrns-ser.h>
+
+using namespace lbcrypto;
+
+static int runDoubleHoistedBsgsDiagonal(int argc, char* argv[]) {
+    // Parse arguments
+    ArgParser parser;
+    parser.parse(argc, argv);
+    
+    // Get parameters
+    bool debug = parser.getDebug();
+    uint32_t batchSize = std::max<uint32_t>(1, parser.getUInt32("batch", 1));
+    setupThreads(parser);
+    
+    // Hoisted rotations all start from the input's digits, so a compact key
+    // basis (--key-basis) cannot compose them
+    if (parser.getString("key-basis", "full") != "full") {
+        std::cerr << "Error: --key-basis requires non-hoisted rotations\n";
+        return 1;
+    }
+    
+    // EvalFastRotationExt reads the context's keys, never rotate()'s per-node copies
+    if (numaConfig().keyReplicas) {
+        std::cerr << "Error: --numa-key-replicas requires non-hoisted rotations\n";
+        return 1;
+    }
+    
+    // Matrix (--matrix-kind; --matrix-dim unless loaded from --matrix-file)
+    BenchmarkMatrix M;
+    try {
+        M = make_benchmark_matrix(parser);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    std::size_t matrixDim = M.dim();
+    
+    MeasurementSystem measurement(parser);
+    measurement.setBatchSize(batchSize);
+    
+    BenchmarkParams params = BenchmarkParams::fromArgs(parser);
+    
+    // Extended-basis accumulation works on HYBRID's P*Q digits; BV has no P
+    if (params.keySwitch != HYBRID) {
+        std::cerr << "Error: double hoisting needs --ks-tech=hybrid\n";
+        return 1;
+    }
+    
+    // --start-level / --mod-switch=min (the plaintext products need one level)
+    LevelControl levels(parser, params, 1);
+    if (!levels.check().empty()) {
+        std::cerr << "Error: " << levels.check() << "\n";
+        return 1;
+    }
+    
+    // Setup CKKS cryptocontext
+    CryptoContext<DCRTPoly> cc = makeCryptoContext(params);
+
+    int numSlots = static_cast<int>(cc->GetEncodingParams()->GetBatchSize());
+    if (static_cast<int>(matrixDim) > numSlots) {
+        std::cerr << "Error: matrixDim (" << matrixDim << ") must be <= numSlots (" << numSlots << ")\n";
+        return 1;
+    }
+    
+    if (debug) {
+        std::cout << "=== Double-Hoisted BSGS Method with On-Demand Key Loading ===\n";
+        std::cout << "Actual matrix dimension: " << matrixDim << "×" << matrixDim
+                  << " (" << M.kind << ", " << M.nnz() << " nonzeros)\n";
+        std::cout << "Number of slots: " << numSlots << "\n";
+        std::cout << "Ring dimension: " << params.ringDim << "\n";
+        std::cout << "Multiplicative depth: " << params.multDepth << "\n\n";
+    }
+
+    // Generate key pair
+    auto keyPair = cc->KeyGen();
+    
+    // CREATE INPUT VECTORS
+    // One independent input vector per ciphertext of the batch (--batch)
+    std::vector<std::vector<double>> inputVecs(batchSize);
+    for (auto& inputVec : inputVecs) {
+        inputVec = make_random_input_vector(matrixDim, numSlots);
+    }
+
+    // DIAGONAL INDICES
+    // Only the offsets are scanned here; the diagonals themselves are extracted
+    // on a plaintext cache miss
+    std::vector<int> diagonalIndices;
+    for (int k : diagonal_offsets(M, numSlots)) {
+        // Convert to signed indexing [-numSlots/2, numSlots/2]
+        diagonalIndices.push_back(normalizeToSignedIndex(k, numSlots));
+    }
+    std::sort(diagonalIndices.begin(), diagonalIndices.end());
+    
+    int numDiagonals = static_cast<int>(diagonalIndices.size());
+    if (debug) {
+        std::cout << "Found " << numDiagonals << " non-empty diagonals\n";
+        std::cout << "Diagonal indices range from " << diagonalIndices.front() 
+                  << " to " << diagonalIndices.back() << "\n";
+    }
+    
+    // BSGS PARAMETERS (--n1: sqrt of the diagonal count, fixed, or auto-tuned)
+    BsgsPlanner planner(parser, BsgsVariant::DOUBLE_HOISTED, batchSize);
+    int n1 = planner.choose(diagonalIndices, numSlots);
+    
+    int n2_approx = static_cast<int>(std::ceil(static_cast<double>(numSlots) / n1));
+    
+    if (debug) {
+        std::cout << "BSGS parameters: n1 = " << n1 << ", n2 ≈ " << n2_approx
+                  << " (" << planner.split().rotationKeys << " rotation keys, predicted "
+                  << planner.split().predictedNs << " ns per ciphertext)\n";
+    }
+    
+    // DIAGONAL PLAINTEXT CACHE (--ptxt-cache-dir)
+    // On a hit the pre-shifted plaintexts for this n1 are loaded and diagonal
+    // extraction and encoding are skipped
+    DiagonalPlaintextCache ptxtCache(cc, parser, measurement);
+    ptxtCache.describe(matrixHash(M), M.dim(), params, "bsgs-extended-basis-n1-" + std::to_string(n1) + levels.layoutTag());
+    
+    std::map<int, Plaintext> preshiftedDiagonals;
+    bool ptxtCached = ptxtCache.load(preshiftedDiagonals);
+    
+    // EXTRACT DIAGONALS (cache miss only)
+    DiagonalSet diagonals;
+    std::map<int, std::size_t> diagonalOfIndex;  // signed index -> diagonal in the set
+    if (!ptxtCached) {
+        if (debug) {
+            std::cout << "Extracting diagonals...\n";
+        }
+        
+        diagonals = extract_diagonals(M, numSlots);
+        for (std::size_t d = 0; d < diagonals.size(); ++d) {
+            diagonalOfIndex[normalizeToSignedIndex(diagonals.offsets[d], numSlots)] = d;
+        }
+    }
+    
+    // DECOMPOSE DIAGONALS AND PRE-SHIFT
+    if (debug) {
+        std::cout << "Pre-shifting diagonals for BSGS decomposition...\n";
+    }
+    
+    BsgsSchedule schedule(diagonalIndices, n1);
+    const std::set<int>& usedBabySteps = schedule.babySteps;
+    const std::set<int>& usedGiantSteps = schedule.giantSteps;
+    
+    if (debug) {
+        std::cout << "Baby steps used: " << usedBabySteps.size() 
+                  << ", Giant steps used: " << usedGiantSteps.size() << "\n";
+        std::cout << "Giant step range: [" << *usedGiantSteps.begin() 
+                  << ", " << *usedGiantSteps.rbegin() << "]\n";
+    }
+    
+    // CREATE TEMPORARY DIRECTORY
+    TempDirectory tempDir;
+    if (!tempDir.isValid()) {
+        std::cerr << "Failed to create temporary directory" << std::endl;
+        return 1;
+    }
+    
+    // Rotation keys are saved to and fetched from per-rotation files
+    RotationKeyStore keyStore(cc, tempDir, "double-hoisted-bsgs-rot-key-", KeyStoreConfig::fromArgs(parser), measurement);
+    
+    // GENERATE AND SAVE ROTATION KEYS INDIVIDUALLY
+    if (debug) {
+        std::cout << "Generating and saving rotation keys individually...\n";
+    }
+    
+    std::set<int> rotationIndices;
+    
+    // Baby rotations
+    for (int i : usedBabySteps) {
+        if (i != 0) rotationIndices.insert(i);
+    }
+    
+    // Giant rotations
+    for (int j : usedGiantSteps) {
+        if (j != 0) {
+            int rotation = n1 * j;
+            rotationIndices.insert(rotation);
+        }
+    }
+    
+    // Generate and save each rotation key separately (or reuse a persisted key set)
+    if (!keyStore.generate(keyPair, rotationIndices, params)) {
+        std::cerr << "Failed to generate rotation keys\n";
+        return 1;
+    }
+    KeySizeReport keySizes(parser, cc, keyPair, rotationIndices.size());
+    
+    if (debug) {
+        std::cout << "Generated and saved " << rotationIndices.size() << " rotation keys\n";
+    }
+    
+    // ENCRYPT AND SERIALIZE INPUT
+    if (debug) {
+        std::cout << "Encrypting and serializing input...\n";
+    }
+    
+    CiphertextBatch inputCiphers(batchSize);
+    for (uint32_t b = 0; b < batchSize; ++b) {
+        Plaintext inputPtxt = cc->MakeCKKSPackedPlaintext(inputVecs[b]);
+        inputCiphers[b] = cc->Encrypt(keyPair.publicKey, inputPtxt);
+    }
+    levels.toStartLevel(cc, inputCiphers);
+    
+    // Encode the pre-shifted diagonals in the extended basis P·Q at the input's level,
+    // so they multiply the baby rotations before ModDown
+    if (!ptxtCached) {
+        auto extParams = extendedElementParams(cc, levels.atComputeLevel(cc, inputCiphers[0]));
+        uint32_t inputLevel = levels.computeLevel();
+        preshiftedDiagonals = ptxtCache.encode(diagonalIndices, [&](std::size_t n) {
+            // Pre-shift the diagonal by its giant step amount
+            int k = diagonalIndices[n];
+            auto diagonal = rotateVectorDown(diagonals.diagonal(diagonalOfIndex.at(k)), schedule.preRotation(k, numSlots));
+            return cc->MakeCKKSPackedPlaintext(diagonal, 1, inputLevel, extParams);
+        });
+    }
+    
+    // --encode-only: the encoding above was the measured kernel
+    if (ptxtCache.encodeOnly()) {
+        measurement.printResults();
+        ptxtCache.printResults();
+        printMatrixResults(M, static_cast<std::size_t>(numDiagonals));
+        planner.printResults();
+        return 0;
+    }
+    
+    // One input file per ciphertext of the batch
+    auto inputPath = [&](uint32_t b) {
+        return tempDir.getFilePath("input-" + std::to_string(b) + ".bin");
+    };
+    for (uint32_t b = 0; b < batchSize; ++b) {
+        if (!Serial::SerializeToFile(inputPath(b), inputCiphers[b], SerType::BINARY)) {
+            std::cerr << "Failed to serialize input\n";
+            return 1;
+        }
+    }
+    
+    inputCiphers.clear();
+
+    // PROFILED DOUBLE-HOISTED BSGS COMPUTATION WITH ON-DEMAND KEY LOADING
+    if (debug) {
+        std::cout << "\nStarting profiled double-hoisted BSGS computation with on-demand key loading...\n\n";
+    }
+    
+    // Giant steps are processed in sorted order
+    std::vector<int> sortedGiantSteps(usedGiantSteps.begin(), usedGiantSteps.end());
+    std::sort(sortedGiantSteps.begin(), sortedGiantSteps.end());
+    
+    // Order in which the kernel acquires rotation keys (for --prefetch-depth):
+    // each giant block first uses its new baby steps, then its giant rotation
+    std::vector<int> keySchedule;
+    std::vector<bool> babyScheduled(n1, false);
+    for (int j : sortedGiantSteps) {
+        bool blockEmpty = true;
+        for (int i = 0; i < n1; ++i) {
+            if (!preshiftedDiagonals.count(j * n1 + i)) continue;
+            blockEmpty = false;
+            if (i != 0 && !babyScheduled[i]) {
+                keySchedule.push_back(i);
+                babyScheduled[i] = true;
+            }
+        }
+        if (!blockEmpty && j != 0) keySchedule.push_back(n1 * j);
+    }
+    
+    // Warm the key cache (no-op with the default --key-cache-mb=0)
+    keyStore.prefill(rotationIndices);
+    
+    // Start DRAM measurement
+    measurement.startDRAM();
+    
+    // Open the key store (bundle index and mapping: the cold-start cost)
+    keyStore.open();
+    
+    // Load the batch of input ciphertexts
+    CiphertextBatch cipherInputs(batchSize);
+    {
+        ScopedRegion region(measurement, "deserialize-input");
+        for (uint32_t b = 0; b < batchSize; ++b) {
+            if (!Serial::DeserializeFromFile(inputPath(b), cipherInputs[b], SerType::BINARY)) {
+                std::cerr << "Failed to load input\n";
+                return 1;
+            }
+        }
+    }
+    
+    // PIN markers / repeated timing around the computation
+    CiphertextBatch results(batchSize);
+    measurement.measureKernel([&] {
+        auto inputs = levels.switchDown(cc, measurement, cipherInputs);
+        
+        // DOUBLE-HOISTED BSGS WITH ON-DEMAND KEY LOADING
+        // Each rotation key is loaded once and applied to the whole batch
+        
+        // Load upcoming keys in the background (no-op without --prefetch-depth)
+        keyStore.startPrefetch(keySchedule);
+        
+        // Step 1: Precompute rotation digits once per ciphertext (hoisting optimization)
+        if (debug) {
+            std::cout << "Precomputing rotation digits for hoisting...\n";
+        }
+        std::vector<std::shared_ptr<std::vector<DCRTPoly>>> precomputedDigits(batchSize);
+        {
+            ScopedRegion region(measurement, "hoist-precompute");
+            forEachInBatch(batchSize, [&](std::size_t b) {
+                precomputedDigits[b] = cc->EvalFastRotationPrecompute(inputs[b]);
+            });
+        }
+        
+        // Step 2: Automorphism parameters for rotating the first element of giant blocks
+        uint32_t ringDim = cc->GetRingDimension();
+        uint32_t cyclotomicOrder = 2 * ringDim;
+        
+        // Step 3: Cache for extended-basis baby rotations with on-demand computation
+        std::vector<CiphertextBatch> babyRotationCache(n1);
+        std::vector<bool> babyRotationComputed(n1, false);
+        
+        // Helper lambda to get/compute baby rotation in P·Q (no ModDown)
+        auto getExtBabyRotation = [&](int i) -> const CiphertextBatch& {
+            if (!babyRotationComputed[i]) {
+                babyRotationCache[i].resize(batchSize);
+                if (i == 0) {
+                    // Identity: lift the input into the extended basis
+                    ScopedRegion region(measurement, "rotate");
+                    forEachInBatch(batchSize, [&](std::size_t b) {
+                        babyRotationCache[0][b] = cc->KeySwitchExt(inputs[b], true);
+                    });
+                } else {
+                    // Fetch rotation key for this baby step (cached or from disk)
+                    keyStore.acquire(i);
+                    
+                    {
+                        ScopedRegion region(measurement, "rotate");
+                        forEachInBatch(batchSize, [&](std::size_t b) {
+                            babyRotationCache[i][b] =
+                                cc->EvalFastRotationExt(inputs[b], i, precomputedDigits[b], true);
+                        });
+                    }
+                    
+                    // Release the key (stays resident if it fits the cache budget)
+                    keyStore.release(i);
+                }
+                babyRotationComputed[i] = true;
+            }
+            return babyRotationCache[i];
+        };
+        
+        // Step 4: Process giant steps in sorted order. Key-switched parts are
+        // accumulated in P·Q (resultExt); first elements are rotated by a plain
+        // automorphism and accumulated in Q (firstElement).
+        CiphertextBatch resultExt(batchSize);
+        std::vector<DCRTPoly> firstElement(batchSize);
+        bool first = true;
+        
+        for (int j : sortedGiantSteps) {
+            // Accumulate all baby steps for this giant block in P·Q
+            CiphertextBatch giantBlockSum(batchSize);
+            bool giantBlockFirst = true;
+            
+            // Check all possible baby steps for this giant block
+            for (int i = 0; i < n1; ++i) {
+                // Reconstruct the signed diagonal index
+                int k = j * n1 + i;
+                
+                // Check if this diagonal exists
+                auto diagIter = preshiftedDiagonals.find(k);
+                if (diagIter == preshiftedDiagonals.end()) continue;
+                
+                const auto& babyRotated = getExtBabyRotation(i);
+                
+                // Multiply with pre-shifted diagonal in the extended basis
+                CiphertextBatch partial(batchSize);
+                {
+                    ScopedRegion region(measurement, "ptxt-mult");
+                    forEachInBatch(batchSize, [&](std::size_t b) {
+                        partial[b] = evalMultExt(babyRotated[b], diagIter->second);
+                    });
+                }
+                
+                // Accumulate within giant block
+                if (giantBlockFirst) {
+                    giantBlockSum = partial;
+                    giantBlockFirst = false;
+                } else {
+                    ScopedRegion region(measurement, "accumulate");
+                    forEachInBatch(batchSize, [&](std::size_t b) {
+                        evalAddExtInPlace(giantBlockSum[b], partial[b]);
+                    });
+                }
+            }
+            
+            // Skip if block is empty
+            if (giantBlockFirst) continue;
+            
+            CiphertextBatch keySwitched(batchSize);
+            std::vector<DCRTPoly> blockFirst(batchSize);
+            
+            if (j == 0) {
+                // No giant rotation: ModDown only the first element and keep the
+                // second one in P·Q for the final ModDown
+                ScopedRegion region(measurement, "mod-down");
+                forEachInBatch(batchSize, [&](std::size_t b) {
+                    blockFirst[b] = cc->KeySwitchDownFirstElement(giantBlockSum[b]);
+                    auto elements = giantBlockSum[b]->GetElements();
+                    elements[0].SetValuesToZero();
+                    giantBlockSum[b]->SetElements(elements);
+                });
+                keySwitched = giantBlockSum;
+            } else {
+                int giantRotation = n1 * j;
+                
+                // One ModDown per giant block
+                {
+                    ScopedRegion region(measurement, "mod-down");
+                    forEachInBatch(batchSize, [&](std::size_t b) {
+                        giantBlockSum[b] = cc->KeySwitchDown(giantBlockSum[b]);
+                    });
+                }
+                
+                // First element: automorphism only, no key switch
+                {
+                    ScopedRegion region(measurement, "rotate");
+                    uint32_t autoIndex = FindAutomorphismIndex2nComplex(giantRotation, cyclotomicOrder);
+                    std::vector<uint32_t> autoMap(ringDim);
+                    PrecomputeAutoMap(ringDim, autoIndex, &autoMap);
+                    forEachInBatch(batchSize, [&](std::size_t b) {
+                        blockFirst[b] = giantBlockSum[b]->GetElements()[0].AutomorphismTransform(autoIndex, autoMap);
+                    });
+                }
+                
+                // Fetch rotation key for this giant step (cached or from disk)
+                keyStore.acquire(giantRotation);
+                
+                // Second element: hoisted key switch left in P·Q
+                std::vector<std::shared_ptr<std::vector<DCRTPoly>>> blockDigits(batchSize);
+                {
+                    ScopedRegion region(measurement, "hoist-precompute");
+                    forEachInBatch(batchSize, [&](std::size_t b) {
+                        blockDigits[b] = cc->EvalFastRotationPrecompute(giantBlockSum[b]);
+                    });
+                }
+                {
+                    ScopedRegion region(measurement, "rotate");
+                    forEachInBatch(batchSize, [&](std::size_t b) {
+                        keySwitched[b] = cc->EvalFastRotationExt(giantBlockSum[b], giantRotation, blockDigits[b], false);
+                    });
+                }
+                
+                // Release the key (stays resident if it fits the cache budget)
+                keyStore.release(giantRotation);
+            }
+            
+            // Add to result (both parts)
+            if (first) {
+                resultExt = keySwitched;
+                firstElement = blockFirst;
+                first = false;
+            } else {
+                ScopedRegion region(measurement, "accumulate");
+                forEachInBatch(batchSize, [&](std::size_t b) {
+                    evalAddExtInPlace(resultExt[b], keySwitched[b]);
+                    firstElement[b] += blockFirst[b];
+                });
+            }
+        }
+        
+        // Step 5: Single final ModDown of the accumulated key switches
+        {
+            ScopedRegion region(measurement, "mod-down");
+            forEachInBatch(batchSize, [&](std::size_t b) {
+                results[b] = cc->KeySwitchDown(resultExt[b]);
+            });
+        }
+        {
+            ScopedRegion region(measurement, "accumulate");
+            forEachInBatch(batchSize, [&](std::size_t b) {
+                auto elements = results[b]->GetElements();
+                elements[0] += firstElement[b];
+                results[b]->SetElements(elements);
+            });
+        }
+        
+        keyStore.finishPrefetch();
+    });
+    
+    // Save results
+    {
+        ScopedRegion region(measurement, "serialize-result");
+        for (uint32_t b = 0; b < batchSize; ++b) {
+            std::string resultPath = tempDir.getFilePath("result-" + std::to_string(b) + ".bin");
+            if (!Serial::SerializeToFile(resultPath, results[b], SerType::BINARY)) {
+                std::cerr << "Failed to save result\n";
+                return 1;
+            }
+        }
+    }
+    
+    // Stop DRAM measurement
+    measurement.stopDRAM();
+    
+    // Print measurement results
+    measurement.printResults();
+    levels.printResults();
+    keyStore.printResults();
+    if (!rotationIndices.empty()) {
+        auto [sampleKey, sampleBytes] = keyStore.sampleKey(*rotationIndices.begin());
+        keySizes.measureRotation(sampleKey, sampleBytes);
+    }
+    keySizes.printResults();
+    ptxtCache.printResults();
+    printMatrixResults(M, static_cast<std::size_t>(numDiagonals));
+    planner.printResults();
+    
+    // Always verify
+    if (debug) {
+        std::cout << "\nDecrypting and verifying result...\n";
+    }
+    
+    // Verify every ciphertext of the batch and return exit code
+    bool allCorrect = true;
+    for (uint32_t b = 0; b < batchSize; ++b) {
+        Plaintext resultPtxt;
+        cc->Decrypt(keyPair.secretKey, results[b], &resultPtxt);
+        resultPtxt->SetLength(numSlots);
+        
+        auto resultVec = resultPtxt->GetRealPackedValue();
+        allCorrect = verify_matrix_vector_result(resultVec, M, inputVecs[b], debug) && allCorrect;
+    }
+    return allCorrect ? 0 : 1;
+}
+
+BENCHMARK_KERNEL("double-hoisted-bsgs-diagonal-method", runDoubleHoistedBsgsDiagonal);
@@ -0,0 +1,128 @@
+// examples/machine-peaks.cpp - Machine peaks for roofline analysis
+// STREAM-like triad for memory bandwidth, NTT-like butterflies for integer throughput
+#include <openfhe.h>
+#include "utils.hpp"
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+
+using namespace lbcrypto;
+
+// Integer operations per NTT butterfly, counted as the instructions of the
+// Shoup multiply and the two modular corrections: 3 multiplies, 4 add/sub,
+// 3 compare/select
+constexpr uint64_t OPS_PER_BUTTERFLY = 10;
+
+// 50-bit modulus, the size of the benchmarks' limbs (scaling mod size 50)
+constexpr uint64_t MODULUS = 1125899906826241ULL;
+
+// Best-of-N wall time of f() in seconds
+template <typename F>
+static double bestSeconds(uint32_t repetitions, F&& f) {
+    double best = std::numeric_limits<double>::max();
+    for (uint32_t r = 0; r < repetitions; ++r) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        auto stop = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double>(stop - start).count());
+    }
+    return best;
+}
+
+// One forward NTT pass structure over x (length n, a power of two) with
+// Shoup butterflies; twiddles are synthetic, only the arithmetic matters
+static void nttLike(std::vector<uint64_t>& x, uint64_t w, uint64_t wShoup) {
+    std::size_t n = x.size();
+    for (std::size_t half = n / 2; half >= 1; half /= 2) {
+        for (std::size_t start = 0; start < n; start += 2 * half) {
+            for (std::size_t j = start; j < start + half; ++j) {
+                uint64_t u = x[j];
+                uint64_t v = x[j + half];
+                uint64_t quotient = static_cast<uint64_t>((static_cast<unsigned __int128>(wShoup) * v) >> 64);
+                uint64_t t = w * v - quotient * MODULUS;
+                if (t >= MODULUS) t -= MODULUS;
+                uint64_t sum = u + t;
+                x[j] = (sum >= MODULUS) ? sum - MODULUS : sum;
+                x[j + half] = (u >= t) ? u - t : u + MODULUS - t;
+            }
+        }
+    }
+}
+
+static int runMachinePeaks(int argc, char* argv[]) {
+    // Parse arguments
+    ArgParser parser;
+    parser.parse(argc, argv);
+    
+    // Get parameters
+    bool debug = parser.getDebug();
+    std::size_t streamElements = std::size_t{std::max<uint32_t>(1, parser.getUInt32("stream-mb", 256))} << 17;
+    uint32_t nttLogN = std::max<uint32_t>(4, parser.getUInt32("ntt-log-n", 12));  // cache-resident
+    uint32_t nttRounds = std::max<uint32_t>(1, parser.getUInt32("ntt-rounds", 256));
+    uint32_t repetitions = std::max<uint32_t>(1, parser.getUInt32("repetitions", 5));
+    setupThreads(parser);
+    
+    int threads = omp_get_max_threads();
+    
+    // STREAM triad a = b + s * c over 64-bit integers; 24 bytes per element
+    std::vector<uint64_t> a(streamElements), b(streamElements), c(streamElements);
+    #pragma omp parallel for schedule(static)
+    for (std::size_t i = 0; i < streamElements; ++i) {
+        a[i] = 0;
+        b[i] = i;
+        c[i] = 2 * i;
+    }
+    
+    double streamSeconds = bestSeconds(repetitions, [&] {
+        const uint64_t scalar = 3;
+        #pragma omp parallel for schedule(static)
+        for (std::size_t i = 0; i < streamElements; ++i) {
+            a[i] = b[i] + scalar * c[i];
+        }
+    });
+    double bandwidth = 3.0 * sizeof(uint64_t) * streamElements / streamSeconds;
+    
+    // NTT-like kernel: every thread transforms its own cache-resident vector
+    std::size_t nttSize = std::size_t{1} << nttLogN;
+    std::vector<std::vector<uint64_t>> vectors(threads, std::vector<uint64_t>(nttSize));
+    for (int t = 0; t < threads; ++t) {
+        for (std::size_t i = 0; i < nttSize; ++i) vectors[t][i] = (i * 2654435761ULL + t) % MODULUS;
+    }
+    const uint64_t w = 1234567891011ULL % MODULUS;
+    const uint64_t wShoup = static_cast<uint64_t>((static_cast<unsigned __int128>(w) << 64) / MODULUS);
+    
+    double nttSeconds = bestSeconds(repetitions, [&] {
+        #pragma omp parallel for schedule(static) num_threads(threads)
+        for (int t = 0; t < threads; ++t) {
+            for (uint32_t round = 0; round < nttRounds; ++round) {
+                nttLike(vectors[t], w, wShoup);
+            }
+        }
+    });
+    uint64_t butterflies = static_cast<uint64_t>(threads) * nttRounds * (nttSize / 2) * nttLogN;
+    double intOps = static_cast<double>(butterflies * OPS_PER_BUTTERFLY) / nttSeconds;
+    
+    // Keep the results observable so neither kernel is optimized away
+    uint64_t checksum = a[streamElements / 2];
+    for (const auto& v : vectors) checksum ^= v[0];
+    
+    if (debug) {
+        std::cout << "=== Machine Peaks ===\n";
+        std::cout << "Threads: " << threads << "\n";
+        std::cout << "STREAM arrays: " << (streamElements * sizeof(uint64_t) >> 20) << " MiB each\n";
+        std::cout << "NTT size: 2^" << nttLogN << " x " << nttRounds << " rounds per thread\n";
+        std::cout << "Checksum: " << checksum << "\n\n";
+    }
+    
+    // Machine-readable KEY=value lines, parsed by plots/benchmarker.py
+    std::cout << "MACHINE_THREADS=" << threads << "\n";
+    std::cout << "MACHINE_BANDWIDTH_BYTES_PER_SEC=" << static_cast<uint64_t>(bandwidth) << "\n";
+    std::cout << "MACHINE_INT_OPS_PER_SEC=" << static_cast<uint64_t>(intOps) << "\n";
+    std::cout << "MACHINE_RIDGE_OPS_PER_BYTE=" << std::fixed << std::setprecision(5)
+              << intOps / bandwidth << std::defaultfloat << "\n";
+    
+    return 0;
+}
+
+BENCHMARK_KERNEL("machine-peaks", runMachinePeaks);
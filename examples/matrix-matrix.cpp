@@ -0,0 +1,352 @@
+// examples/matrix-matrix.cpp - Encrypted matrix-matrix multiplication on the BSGS diagonal kernel
+// Y = M·X for the d×d weight matrix M (--matrix-kind, --matrix-dim) and --columns
+// input columns x_c. Both layouts reduce the product to generalized diagonals
+// y = Σ_r w_r ⊙ rot_r(X) over signed rotations r, evaluated with the BSGS
+// schedule of bsgs-diagonal-method.cpp (pre-rotated weights, one key per step):
+//   --layout=replicated  one ciphertext per column with x_c repeated across the
+//                        slots (d must divide the slot count), so the d cyclic
+//                        diagonals of M apply unchanged; every rotation key is
+//                        loaded once for all columns
+//   --layout=row-packed  slots/s columns per ciphertext in blocks of s (the
+//                        next power of two >= d). A rotation by k inside the
+//                        blocks is rot_k and rot_{k-s} under complementary
+//                        masks; the masks are folded into the weights, so it
+//                        costs rotations but no extra level
+// --weights=plaintext|ciphertext: the weights are encoded, or encrypted and
+// multiplied with relinearization.
+#include <openfhe.h>
+#include "utils.hpp"
+#include <iostream>
+#include <vector>
+#include <iomanip>
+#include <algorithm>
+#include <map>
+#include <set>
+
+using namespace lbcrypto;
+
+static int runMatrixMatrix(int argc, char* argv[]) {
+    // Parse arguments
+    ArgParser parser;
+    parser.parse(argc, argv);
+    
+    // Get parameters
+    bool debug = parser.getDebug();
+    std::string layout = parser.getString("layout", "replicated");  // --layout=replicated|row-packed
+    bool encryptedWeights = parser.getString("weights", "plaintext") == "ciphertext";  // --weights=plaintext|ciphertext
+    uint32_t numColumns = std::max<uint32_t>(1, parser.getUInt32("columns", 4));
+    setupThreads(parser);
+    
+    if (layout != "replicated" && layout != "row-packed") {
+        std::cerr << "Error: unknown --layout '" << layout << "' (replicated or row-packed)\n";
+        return 1;
+    }
+    bool replicated = layout == "replicated";
+    
+    // Weight matrix (--matrix-kind; --matrix-dim unless loaded from --matrix-file)
+    BenchmarkMatrix M;
+    try {
+        M = make_benchmark_matrix(parser);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    int matrixDim = static_cast<int>(M.dim());
+    
+    MeasurementSystem measurement(parser);
+    
+    BenchmarkParams params = BenchmarkParams::fromArgs(parser);
+    
+    // --start-level / --mod-switch=min (the weight products need one level)
+    LevelControl levels(parser, params, 1);
+    if (!levels.check().empty()) {
+        std::cerr << "Error: " << levels.check() << "\n";
+        return 1;
+    }
+    
+    // Setup CKKS cryptocontext
+    CryptoContext<DCRTPoly> cc = makeCryptoContext(params);
+    
+    int numSlots = static_cast<int>(cc->GetEncodingParams()->GetBatchSize());
+    
+    // Slot period of the layout: the replicated vector, or one packed block
+    int blockSize = matrixDim;
+    if (!replicated) {
+        blockSize = 1;
+        while (blockSize < matrixDim) blockSize *= 2;
+    }
+    if (blockSize > numSlots || (replicated && numSlots % matrixDim != 0)) {
+        std::cerr << "Error: --layout=" << layout << " needs matrixDim (" << matrixDim << ")"
+                  << (replicated ? " dividing" : " within") << " numSlots (" << numSlots << ")\n";
+        return 1;
+    }
+    std::size_t columnsPerCipher = replicated ? 1 : static_cast<std::size_t>(numSlots / blockSize);
+    std::size_t numCiphers = (numColumns + columnsPerCipher - 1) / columnsPerCipher;
+    measurement.setBatchSize(static_cast<uint32_t>(numCiphers));
+    
+    if (debug) {
+        std::cout << "=== Matrix-Matrix BSGS (" << layout << ", "
+                  << (encryptedWeights ? "encrypted" : "plaintext") << " weights) ===\n";
+        std::cout << "Weights: " << matrixDim << "×" << matrixDim
+                  << " (" << M.kind << ", " << M.nnz() << " nonzeros)\n";
+        std::cout << "Columns: " << numColumns << " in " << numCiphers << " ciphertexts ("
+                  << columnsPerCipher << " per ciphertext, block size " << blockSize << ")\n";
+        std::cout << "Number of slots: " << numSlots << "\n\n";
+    }
+    
+    // Generate key pair
+    auto keyPair = cc->KeyGen();
+    
+    // INPUT COLUMNS
+    // Column c sits in block c % columnsPerCipher of ciphertext c / columnsPerCipher
+    std::vector<std::vector<double>> columns(numColumns);
+    std::vector<std::vector<double>> packedInputs(numCiphers, std::vector<double>(numSlots, 0.0));
+    for (std::size_t c = 0; c < numColumns; ++c) {
+        columns[c] = make_random_input_vector(matrixDim, matrixDim);
+        auto& packed = packedInputs[c / columnsPerCipher];
+        if (replicated) {
+            for (int t = 0; t < numSlots; ++t) packed[t] = columns[c][t % matrixDim];
+        } else {
+            std::size_t base = (c % columnsPerCipher) * blockSize;
+            std::copy(columns[c].begin(), columns[c].end(), packed.begin() + base);
+        }
+    }
+    
+    // GENERALIZED DIAGONALS
+    // Diagonals of M modulo the block size, tiled across the slots; keep(i)
+    // selects the block positions a weight applies to
+    DiagonalSet diagonals = extract_diagonals(M, blockSize);
+    std::map<int, std::vector<double>> weights;  // signed rotation -> slot weights
+    auto addWeight = [&](int rotation, const double* diagonal, auto keep) {
+        std::vector<double> weight(numSlots, 0.0);
+        bool nonzero = false;
+        for (int t = 0; t < numSlots; ++t) {
+            int i = t % blockSize;
+            if (keep(i) && diagonal[i] != 0.0) {
+                weight[t] = diagonal[i];
+                nonzero = true;
+            }
+        }
+        if (nonzero) weights[rotation] = std::move(weight);
+    };
+    for (std::size_t d = 0; d < diagonals.size(); ++d) {
+        int k = diagonals.offsets[d];
+        if (replicated) {
+            // Every rotation is cyclic in the replicated vector
+            addWeight(normalizeToSignedIndex(k, blockSize), diagonals.data(d), [](int) { return true; });
+        } else {
+            // Positions whose block rotation stays inside the block read rot_k,
+            // the rest wrap around to rot_{k-s}
+            addWeight(k, diagonals.data(d), [&](int i) { return i + k < blockSize; });
+            addWeight(k - blockSize, diagonals.data(d), [&](int i) { return i + k >= blockSize; });
+        }
+    }
+    
+    std::vector<int> rotations;
+    for (const auto& entry : weights) rotations.push_back(entry.first);
+    
+    // BSGS PARAMETERS (--n1: sqrt of the rotation count, fixed, or auto-tuned)
+    BsgsPlanner planner(parser, BsgsVariant::PLAIN, static_cast<uint32_t>(numCiphers));
+    int n1 = planner.choose(rotations, numSlots);
+    BsgsSchedule schedule(rotations, n1);
+    
+    if (debug) {
+        std::cout << rotations.size() << " generalized diagonals, n1 = " << n1 << " ("
+                  << schedule.babySteps.size() << " baby steps, " << schedule.giantSteps.size()
+                  << " giant steps)\n";
+    }
+    
+    // CREATE TEMPORARY DIRECTORY FOR FILES
+    TempDirectory tempDir;
+    if (!tempDir.isValid()) {
+        std::cerr << "Failed to create temporary directory" << std::endl;
+        return 1;
+    }
+    
+    // Rotation keys are saved to and fetched from per-rotation files
+    RotationKeyStore keyStore(cc, tempDir, "matmul-rot-key-", KeyStoreConfig::fromArgs(parser), measurement);
+    
+    std::set<int> rotationIndices;
+    for (int i : schedule.babySteps) {
+        if (i != 0) rotationIndices.insert(i);
+    }
+    for (int j : schedule.giantSteps) {
+        if (j != 0) rotationIndices.insert(n1 * j);
+    }
+    
+    // Generate and save each rotation key (or reuse a persisted key set)
+    if (!keyStore.generate(keyPair, rotationIndices, params)) {
+        std::cerr << "Failed to generate rotation keys\n";
+        return 1;
+    }
+    
+    // Ciphertext weights need the relinearization key
+    if (encryptedWeights) {
+        cc->EvalMultKeyGen(keyPair.secretKey);
+    }
+    
+    // Pre-rotate the weights by their giant step, then encode or encrypt them
+    std::map<int, Plaintext> ptxtWeights;
+    std::map<int, Ciphertext<DCRTPoly>> ctxtWeights;
+    {
+        ScopedRegion region(measurement, "encode-weights");
+        for (const auto& [rotation, weight] : weights) {
+            auto preRotated = rotateVectorDown(weight, schedule.preRotation(rotation, numSlots));
+            Plaintext ptxt = cc->MakeCKKSPackedPlaintext(preRotated, 1, levels.computeLevel());
+            if (encryptedWeights) {
+                ctxtWeights[rotation] = cc->Encrypt(keyPair.publicKey, ptxt);
+            } else {
+                ptxtWeights[rotation] = ptxt;
+            }
+        }
+    }
+    weights.clear();
+    
+    // ENCRYPT INPUT COLUMNS
+    CiphertextBatch inputCiphers(numCiphers);
+    for (std::size_t b = 0; b < numCiphers; ++b) {
+        inputCiphers[b] = cc->Encrypt(keyPair.publicKey, cc->MakeCKKSPackedPlaintext(packedInputs[b]));
+    }
+    levels.toStartLevel(cc, inputCiphers);
+    
+    // PROFILED BSGS COMPUTATION
+    
+    // Warm the key cache (no-op with the default --key-cache-mb=0)
+    keyStore.prefill(rotationIndices);
+    
+    // Start DRAM measurement
+    measurement.startDRAM();
+    
+    // Open the key store (bundle index and mapping: the cold-start cost)
+    keyStore.open();
+    
+    // Rotations and key fetches of one kernel run
+    uint64_t rotationCount = 0;
+    uint64_t keyLoads = 0;
+    
+    CiphertextBatch results;
+    measurement.measureKernel([&] {
+        auto inputs = levels.switchDown(cc, measurement, inputCiphers);
+        rotationCount = 0;
+        keyLoads = 0;
+        
+        // Rotate the whole batch by one key, fetched once
+        auto rotateBatch = [&](const CiphertextBatch& batch, int rotation) {
+            keyStore.acquire(rotation);
+            keyLoads++;
+            CiphertextBatch rotated(batch.size());
+            {
+                ScopedRegion region(measurement, "rotate");
+                forEachInBatch(batch.size(), [&](std::size_t b) {
+                    rotated[b] = keyStore.rotate(batch[b], rotation);
+                });
+            }
+            keyStore.release(rotation);
+            rotationCount += batch.size();
+            return rotated;
+        };
+        
+        // Baby steps: every one is used by some giant block
+        std::map<int, CiphertextBatch> babyRotations;
+        for (int i : schedule.babySteps) {
+            babyRotations[i] = (i == 0) ? inputs : rotateBatch(inputs, i);
+        }
+        
+        results.clear();
+        for (int j : schedule.giantSteps) {
+            // Accumulate the weighted baby steps of this giant block
+            CiphertextBatch giantBlockSum;
+            for (int i : schedule.babySteps) {
+                int rotation = j * n1 + i;
+                if (encryptedWeights ? !ctxtWeights.count(rotation) : !ptxtWeights.count(rotation)) continue;
+                
+                const auto& babyRotated = babyRotations.at(i);
+                CiphertextBatch partial(numCiphers);
+                {
+                    ScopedRegion region(measurement, encryptedWeights ? "ctxt-mult" : "ptxt-mult");
+                    forEachInBatch(numCiphers, [&](std::size_t b) {
+                        partial[b] = encryptedWeights ? cc->EvalMult(babyRotated[b], ctxtWeights.at(rotation))
+                                                      : cc->EvalMult(babyRotated[b], ptxtWeights.at(rotation));
+                    });
+                }
+                
+                if (giantBlockSum.empty()) {
+                    giantBlockSum = partial;
+                } else {
+                    ScopedRegion region(measurement, "accumulate");
+                    forEachInBatch(numCiphers, [&](std::size_t b) {
+                        cc->EvalAddInPlace(giantBlockSum[b], partial[b]);
+                    });
+                }
+            }
+            if (giantBlockSum.empty()) continue;
+            
+            // FIXEDMANUAL: one rescale per giant block, ahead of its rotation
+            if (params.manualRescale()) {
+                rescaleBatch(cc, measurement, giantBlockSum);
+            }
+            
+            if (j != 0) {
+                giantBlockSum = rotateBatch(giantBlockSum, n1 * j);
+            }
+            
+            if (results.empty()) {
+                results = giantBlockSum;
+            } else {
+                ScopedRegion region(measurement, "accumulate");
+                forEachInBatch(numCiphers, [&](std::size_t b) {
+                    cc->EvalAddInPlace(results[b], giantBlockSum[b]);
+                });
+            }
+        }
+    });
+    
+    // Stop DRAM measurement
+    measurement.stopDRAM();
+    
+    // Print measurement results
+    measurement.printResults();
+    levels.printResults();
+    keyStore.printResults();
+    printMatrixResults(M, rotations.size());
+    planner.printResults();
+    
+    // Machine-readable MATMUL_* lines, parsed by plots/benchmarker.py
+    std::cout << "MATMUL_COLUMNS=" << numColumns << "\n";
+    std::cout << "MATMUL_CIPHERTEXTS=" << numCiphers << "\n";
+    std::cout << "MATMUL_COLUMNS_PER_CTXT=" << columnsPerCipher << "\n";
+    std::cout << "MATMUL_BLOCK_SIZE=" << blockSize << "\n";
+    std::cout << "MATMUL_ENCRYPTED_WEIGHTS=" << (encryptedWeights ? 1 : 0) << "\n";
+    std::cout << "MATMUL_ROTATIONS=" << rotationCount << "\n";
+    std::cout << "MATMUL_KEY_LOADS=" << keyLoads << "\n";
+    std::cout << std::fixed << std::setprecision(3)
+              << "MATMUL_ROTATIONS_PER_COLUMN=" << static_cast<double>(rotationCount) / numColumns << "\n"
+              << "MATMUL_KEY_LOADS_PER_COLUMN=" << static_cast<double>(keyLoads) / numColumns << "\n"
+              << std::defaultfloat;
+    if (measurement.medianLatencyNs() > 0) {
+        std::cout << "MATMUL_NS_PER_COLUMN=" << measurement.medianLatencyNs() / numColumns << "\n";
+    }
+    
+    // Always verify
+    if (debug) {
+        std::cout << "\nDecrypting and verifying result...\n";
+    }
+    
+    // Verify every column and return exit code
+    bool allCorrect = true;
+    for (std::size_t b = 0; b < numCiphers; ++b) {
+        Plaintext resultPtxt;
+        cc->Decrypt(keyPair.secretKey, results[b], &resultPtxt);
+        resultPtxt->SetLength(numSlots);
+        auto resultVec = resultPtxt->GetRealPackedValue();
+        
+        for (std::size_t c = b * columnsPerCipher; c < std::min<std::size_t>(numColumns, (b + 1) * columnsPerCipher); ++c) {
+            auto begin = resultVec.begin() + (c % columnsPerCipher) * blockSize;
+            std::vector<double> column(begin, begin + matrixDim);
+            allCorrect = verify_matrix_vector_result(column, M, columns[c], debug) && allCorrect;
+        }
+    }
+    return allCorrect ? 0 : 1;
+}
+
+BENCHMARK_KERNEL("matrix-matrix", runMatrixMatrix);
@@ -12,35 +12,29 @@
 
 using namespace lbcrypto;
 
-int main(int argc, char* argv[]) {
+static int runMultiplication(int argc, char* argv[]) {
     // Parse arguments
     ArgParser parser;
     parser.parse(argc, argv);
     
     // Get parameters
     bool debug = parser.getDebug();
+    bool ptxtOperand = parser.getBool("ptxt-operand", false);  // ciphertext × plaintext
     setupThreads(parser);
     
-    MeasurementMode mode = parser.getMeasurementMode();
-    MeasurementSystem measurement(mode);
+    MeasurementSystem measurement(parser);
     
     BenchmarkParams params = BenchmarkParams::fromArgs(parser);
     
+    // --start-level / --mod-switch=min (the product needs one level)
+    LevelControl levels(parser, params, 1);
+    if (!levels.check().empty()) {
+        std::cerr << "Error: " << levels.check() << "\n";
+        return 1;
+    }
+    
     // Setup CKKS cryptocontext
-    CCParams<CryptoContextCKKSRNS> ccParams;
-    ccParams.SetMultiplicativeDepth(params.multDepth);
-    ccParams.SetScalingModSize(50);
-    ccParams.SetRingDim(params.ringDim);
-    ccParams.SetSecurityLevel(params.checkSecurity ? HEStd_128_classic : HEStd_NotSet);
-    
-    ccParams.SetScalingTechnique(FLEXIBLEAUTO);
-    ccParams.SetKeySwitchTechnique(HYBRID);
-    ccParams.SetNumLargeDigits(params.numDigits);
-    
-    CryptoContext<DCRTPoly> cc = GenCryptoContext(ccParams);
-    cc->Enable(PKE);
-    cc->Enable(KEYSWITCH);
-    cc->Enable(LEVELEDSHE);
+    CryptoContext<DCRTPoly> cc = makeCryptoContext(params);
 
     // Generate key pair
     auto keyPair = cc->KeyGen();
@@ -55,10 +49,15 @@ int main(int argc, char* argv[]) {
     // Encode as plaintexts
     Plaintext ptxt1 = cc->MakeCKKSPackedPlaintext(vec1);
     Plaintext ptxt2 = cc->MakeCKKSPackedPlaintext(vec2);
+    
+    // --ptxt-operand: the operand at the level the product is computed at
+    Plaintext ptxtOperand2 = cc->MakeCKKSPackedPlaintext(vec2, 1, levels.computeLevel());
 
     // Encrypt
     auto cipher1 = cc->Encrypt(keyPair.publicKey, ptxt1);
     auto cipher2 = cc->Encrypt(keyPair.publicKey, ptxt2);
+    levels.toStartLevel(cc, cipher1);
+    levels.toStartLevel(cc, cipher2);
 
     // Serialize to temporary files
     TempDirectory tempDir;
@@ -102,38 +101,56 @@ int main(int argc, char* argv[]) {
     measurement.startDRAM();
 
     // Load multiplication key from disk
-    std::ifstream multKeyIn(multKeyPath, std::ios::binary);
-    if (!cc->DeserializeEvalMultKey(multKeyIn, SerType::BINARY)) {
-        std::cerr << "Failed to load EvalMult key" << std::endl;
-        return 1;
+    {
+        ScopedRegion region(measurement, "load-mult-key");
+        std::ifstream multKeyIn(multKeyPath, std::ios::binary);
+        if (!cc->DeserializeEvalMultKey(multKeyIn, SerType::BINARY)) {
+            std::cerr << "Failed to load EvalMult key" << std::endl;
+            return 1;
+        }
+        multKeyIn.close();
     }
-    multKeyIn.close();
     
     // Load input ciphertexts from disk
     Ciphertext<DCRTPoly> c1Loaded, c2Loaded;
     
-    if (!Serial::DeserializeFromFile(cipher1Path, c1Loaded, SerType::BINARY)) {
-        std::cerr << "Failed to load ciphertext 1" << std::endl;
-        return 1;
-    }
+    {
+        ScopedRegion region(measurement, "deserialize-input");
+        if (!Serial::DeserializeFromFile(cipher1Path, c1Loaded, SerType::BINARY)) {
+            std::cerr << "Failed to load ciphertext 1" << std::endl;
+            return 1;
+        }
 
-    if (!Serial::DeserializeFromFile(cipher2Path, c2Loaded, SerType::BINARY)) {
-        std::cerr << "Failed to load ciphertext 2" << std::endl;
-        return 1;
+        if (!Serial::DeserializeFromFile(cipher2Path, c2Loaded, SerType::BINARY)) {
+            std::cerr << "Failed to load ciphertext 2" << std::endl;
+            return 1;
+        }
     }
     
-    // PIN markers around ONLY the FHE operation
-    measurement.startPIN();
-    
-    // Perform homomorphic multiplication (includes relinearization)
-    auto cipherResult = cc->EvalMult(c1Loaded, c2Loaded);
-    
-    measurement.endPIN();
+    // PIN markers / repeated timing around ONLY the FHE operation
+    Ciphertext<DCRTPoly> cipherResult;
+    measurement.measureKernel([&] {
+        auto inputs = levels.switchDown(cc, measurement, CiphertextBatch{c1Loaded, c2Loaded});
+        
+        if (ptxtOperand) {
+            // Plaintext operand: no relinearization (the diagonal methods' multiply)
+            ScopedRegion region(measurement, "ptxt-mult");
+            cipherResult = cc->EvalMult(inputs[0], ptxtOperand2);
+            return;
+        }
+        
+        // Perform homomorphic multiplication (includes relinearization)
+        ScopedRegion region(measurement, "ctxt-mult");
+        cipherResult = cc->EvalMult(inputs[0], inputs[1]);
+    });
         
     // Serialize result
-    if (!Serial::SerializeToFile(resultPath, cipherResult, SerType::BINARY)) {
-        std::cerr << "Failed to save result ciphertext" << std::endl;
-        return 1;
+    {
+        ScopedRegion region(measurement, "serialize-result");
+        if (!Serial::SerializeToFile(resultPath, cipherResult, SerType::BINARY)) {
+            std::cerr << "Failed to save result ciphertext" << std::endl;
+            return 1;
+        }
     }
     
     // Stop DRAM measurement
@@ -141,6 +158,7 @@ int main(int argc, char* argv[]) {
     
     // Print measurement results
     measurement.printResults();
+    levels.printResults();
     
     // Always verify
     Plaintext result;
@@ -158,4 +176,6 @@ int main(int argc, char* argv[]) {
     
     // Verify and return exit code
     return verifyResult(resultVec, expected, debug) ? 0 : 1;
-}
\ No newline at end of file
+}
+
+BENCHMARK_KERNEL("multiplication", runMultiplication);
@@ -0,0 +1,37 @@
+// examples/openfhe-bench.cpp - All benchmarks in one binary
+// openfhe-bench --kernel=<name> [options] runs the example registered as <name>
+// (BENCHMARK_KERNEL in examples/<name>.cpp) with the remaining options. Without
+// --kernel the name is taken from argv[0], so build/<name> symlinks behave like
+// the per-benchmark executables.
+#include "utils.hpp"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <filesystem>
+
+int main(int argc, char* argv[]) {
+    // Parse arguments
+    ArgParser parser;
+    parser.parse(argc, argv);
+    
+    std::string name = parser.getString("kernel", std::filesystem::path(argv[0]).filename().string());
+    
+    const auto& registry = kernelRegistry();
+    auto it = registry.find(name);
+    if (it == registry.end()) {
+        std::cerr << "Error: unknown kernel '" << name << "'. Use --kernel=<name> with one of:\n";
+        for (const auto& entry : registry) {
+            std::cerr << "  " << entry.first << "\n";
+        }
+        return 1;
+    }
+    
+    // The kernel sees every option except --kernel
+    std::vector<char*> kernelArgv = {argv[0]};
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]).rfind("--kernel=", 0) != 0) kernelArgv.push_back(argv[i]);
+    }
+    kernelArgv.push_back(nullptr);
+    
+    return runKernel(it->second, static_cast<int>(kernelArgv.size() - 1), kernelArgv.data());
+}
@@ -12,7 +12,7 @@
 
 using namespace lbcrypto;
 
-int main(int argc, char* argv[]) {
+static int runRotation(int argc, char* argv[]) {
     // Parse arguments
     ArgParser parser;
     parser.parse(argc, argv);
@@ -20,28 +20,22 @@ int main(int argc, char* argv[]) {
     // Get parameters
     bool debug = parser.getDebug();
     int32_t rotationIndex = static_cast<int32_t>(parser.getUInt32("rotation-index", 1));
+    bool hoisted = parser.getBool("hoisted", false);  // EvalFastRotation instead of EvalRotate
     setupThreads(parser);
     
-    MeasurementMode mode = parser.getMeasurementMode();
-    MeasurementSystem measurement(mode);
+    MeasurementSystem measurement(parser);
     
     BenchmarkParams params = BenchmarkParams::fromArgs(parser);
     
+    // --start-level / --mod-switch=min (a rotation needs no depth)
+    LevelControl levels(parser, params, 0);
+    if (!levels.check().empty()) {
+        std::cerr << "Error: " << levels.check() << "\n";
+        return 1;
+    }
+    
     // Setup CKKS cryptocontext
-    CCParams<CryptoContextCKKSRNS> ccParams;
-    ccParams.SetMultiplicativeDepth(params.multDepth);
-    ccParams.SetScalingModSize(50);
-    ccParams.SetRingDim(params.ringDim);
-    ccParams.SetSecurityLevel(params.checkSecurity ? HEStd_128_classic : HEStd_NotSet);
-    
-    ccParams.SetScalingTechnique(FLEXIBLEAUTO);
-    ccParams.SetKeySwitchTechnique(HYBRID);
-    ccParams.SetNumLargeDigits(params.numDigits);
-    
-    CryptoContext<DCRTPoly> cc = GenCryptoContext(ccParams);
-    cc->Enable(PKE);
-    cc->Enable(KEYSWITCH);
-    cc->Enable(LEVELEDSHE);
+    CryptoContext<DCRTPoly> cc = makeCryptoContext(params);
 
     // Generate key pair
     auto keyPair = cc->KeyGen();
@@ -49,6 +43,7 @@ int main(int argc, char* argv[]) {
     // Generate rotation keys for the specified index
     std::vector<int32_t> rotationIndices = {rotationIndex};
     cc->EvalRotateKeyGen(keyPair.secretKey, rotationIndices);
+    KeySizeReport keySizes(parser, cc, keyPair, rotationIndices.size());
 
     // Get number of slots
     uint32_t numSlots = cc->GetEncodingParams()->GetBatchSize();
@@ -62,6 +57,7 @@ int main(int argc, char* argv[]) {
 
     // Encrypt
     auto cipher = cc->Encrypt(keyPair.publicKey, ptxt);
+    levels.toStartLevel(cc, cipher);
 
     // Serialize to temporary files
     TempDirectory tempDir;
@@ -87,6 +83,9 @@ int main(int argc, char* argv[]) {
         return 1;
     }
     rotKeyFile.close();
+    keySizes.measureRotation(cc->GetEvalAutomorphismKeyMap(keyPair.secretKey->GetKeyTag())
+                                 .at(cc->FindAutomorphismIndex(static_cast<uint32_t>(rotationIndex))),
+                             std::filesystem::file_size(rotKeyPath));
 
     // Clear everything from memory to ensure we're loading from disk
     cc->ClearEvalAutomorphismKeys();
@@ -98,33 +97,54 @@ int main(int argc, char* argv[]) {
     measurement.startDRAM();
 
     // Load rotation key from disk
-    std::ifstream rotKeyIn(rotKeyPath, std::ios::binary);
-    if (!cc->DeserializeEvalAutomorphismKey(rotKeyIn, SerType::BINARY)) {
-        std::cerr << "Failed to load rotation key" << std::endl;
-        return 1;
+    {
+        ScopedRegion region(measurement, "load-rotation-key");
+        std::ifstream rotKeyIn(rotKeyPath, std::ios::binary);
+        if (!cc->DeserializeEvalAutomorphismKey(rotKeyIn, SerType::BINARY)) {
+            std::cerr << "Failed to load rotation key" << std::endl;
+            return 1;
+        }
+        rotKeyIn.close();
     }
-    rotKeyIn.close();
     
     // Load input ciphertext from disk
     Ciphertext<DCRTPoly> cipherLoaded;
     
-    if (!Serial::DeserializeFromFile(cipherPath, cipherLoaded, SerType::BINARY)) {
-        std::cerr << "Failed to load ciphertext" << std::endl;
-        return 1;
+    {
+        ScopedRegion region(measurement, "deserialize-input");
+        if (!Serial::DeserializeFromFile(cipherPath, cipherLoaded, SerType::BINARY)) {
+            std::cerr << "Failed to load ciphertext" << std::endl;
+            return 1;
+        }
     }
     
-    // PIN markers around ONLY the FHE operation
-    measurement.startPIN();
-    
-    // Perform homomorphic rotation (includes key switching)
-    auto cipherResult = cc->EvalRotate(cipherLoaded, rotationIndex);
-    
-    measurement.endPIN();
+    // PIN markers / repeated timing around ONLY the FHE operation
+    Ciphertext<DCRTPoly> cipherResult;
+    measurement.measureKernel([&] {
+        auto input = levels.switchDown(cc, measurement, cipherLoaded);
+        
+        if (hoisted) {
+            // Hoisted rotation: digit decomposition, then the key switch alone
+            auto digits = inRegion(measurement, "hoist-precompute", [&] {
+                return cc->EvalFastRotationPrecompute(input);
+            });
+            ScopedRegion region(measurement, "rotate");
+            cipherResult = cc->EvalFastRotation(input, rotationIndex, 2 * cc->GetRingDimension(), digits);
+            return;
+        }
+        
+        // Perform homomorphic rotation (includes key switching)
+        ScopedRegion region(measurement, "rotate");
+        cipherResult = cc->EvalRotate(input, rotationIndex);
+    });
         
     // Serialize result
-    if (!Serial::SerializeToFile(resultPath, cipherResult, SerType::BINARY)) {
-        std::cerr << "Failed to save result ciphertext" << std::endl;
-        return 1;
+    {
+        ScopedRegion region(measurement, "serialize-result");
+        if (!Serial::SerializeToFile(resultPath, cipherResult, SerType::BINARY)) {
+            std::cerr << "Failed to save result ciphertext" << std::endl;
+            return 1;
+        }
     }
     
     // Stop DRAM measurement
@@ -132,6 +152,8 @@ int main(int argc, char* argv[]) {
     
     // Print measurement results
     measurement.printResults();
+    levels.printResults();
+    keySizes.printResults();
     
     // Always verify
     Plaintext result;
@@ -146,4 +168,6 @@ int main(int argc, char* argv[]) {
     
     // Verify and return exit code
     return verifyResult(resultVec, expected, debug) ? 0 : 1;
-}
\ No newline at end of file
+}
+
+BENCHMARK_KERNEL("rotation", runRotation);
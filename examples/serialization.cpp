@@ -0,0 +1,372 @@
+// examples/serialization.cpp - Serialization throughput of ciphertexts and evaluation keys
+// A ciphertext, the EvalMult key and a set of rotation (automorphism) keys are
+// serialized and deserialized as BINARY, JSON and zlib-compressed BINARY
+// (-DBENCH_HAVE_ZLIB), through an in-memory stream, a tmpfs file and a disk file.
+// One SERIAL record per (object, format, medium) case.
+#include <openfhe.h>
+#include "utils.hpp"
+#include <iostream>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <functional>
+#include <chrono>
+#include <filesystem>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Headers needed for serialization
+#include <ciphertext-ser.h>
+#include <cryptocontext-ser.h>
+#include <key/key-ser.h>
+#include <scheme/ckksrns/ckksrns-ser.h>
+
+#ifdef BENCH_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+using namespace lbcrypto;
+
+// A serializable object: save writes it to a stream, load reads it back
+struct SerialObject {
+    std::string name;
+    std::function<void(std::ostream&, bool json)> save;
+    std::function<void(std::istream&, bool json)> load;
+};
+
+// Where the serialized bytes live: in memory (dir empty) or a file in dir
+struct SerialMedium {
+    std::string name;
+    std::string dir;
+    bool durable = false;  // disk: fdatasync after writing, evict before reading
+    
+    bool inMemory() const { return dir.empty(); }
+};
+
+// Median time and per-operation allocations of one direction
+struct SerialStats {
+    uint64_t medianNs = 0;
+    uint64_t allocations = 0;
+    uint64_t allocatedBytes = 0;
+};
+
+// Calls f with the SerType tag of the format
+template <typename F>
+static void withSerType(bool json, F&& f) {
+    if (json) {
+        f(SerType::JSON);
+    } else {
+        f(SerType::BINARY);
+    }
+}
+
+// Write back and drop a file's page cache, so the next read hits the device
+static void evictFile(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+}
+
+static void syncFile(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    fdatasync(fd);
+    close(fd);
+}
+
+#ifdef BENCH_HAVE_ZLIB
+static std::string readFile(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+static void writeFile(const std::string& path, const std::string& bytes) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+    if (!out) throw std::runtime_error("cannot write " + path);
+}
+
+// Compressed buffer: 8-byte uncompressed size, then the zlib stream
+static std::string compressBuffer(const std::string& raw, int level) {
+    uLongf size = compressBound(raw.size());
+    std::string out(sizeof(uint64_t) + size, '\0');
+    uint64_t rawSize = raw.size();
+    std::memcpy(out.data(), &rawSize, sizeof(rawSize));
+    if (compress2(reinterpret_cast<Bytef*>(out.data() + sizeof(rawSize)), &size,
+                  reinterpret_cast<const Bytef*>(raw.data()), raw.size(), level) != Z_OK) {
+        throw std::runtime_error("zlib compression failed");
+    }
+    out.resize(sizeof(rawSize) + size);
+    return out;
+}
+
+static std::string uncompressBuffer(const std::string& compressed) {
+    uint64_t rawSize = 0;
+    if (compressed.size() < sizeof(rawSize)) throw std::runtime_error("truncated compressed buffer");
+    std::memcpy(&rawSize, compressed.data(), sizeof(rawSize));
+    
+    std::string raw(rawSize, '\0');
+    uLongf size = rawSize;
+    if (uncompress(reinterpret_cast<Bytef*>(raw.data()), &size,
+                   reinterpret_cast<const Bytef*>(compressed.data() + sizeof(rawSize)),
+                   compressed.size() - sizeof(rawSize)) != Z_OK || size != rawSize) {
+        throw std::runtime_error("zlib decompression failed");
+    }
+    return raw;
+}
+#endif
+
+// Untimed run with allocation tracking, warmup, then the median of timed runs;
+// setup (e.g. evicting the file) runs before every run and is not timed
+template <typename Setup, typename Op>
+static SerialStats measureSerialOp(uint32_t warmupRuns, uint32_t timedRuns, Setup&& setup, Op&& op) {
+    SerialStats stats;
+    
+    setup();
+    allocationCounters.reset();
+    allocationCounters.tracking = true;
+    op();
+    allocationCounters.tracking = false;
+    stats.allocations = allocationCounters.allocations;
+    stats.allocatedBytes = allocationCounters.allocatedBytes;
+    
+    for (uint32_t i = 0; i < warmupRuns; ++i) {
+        setup();
+        op();
+    }
+    
+    std::vector<uint64_t> samples;
+    for (uint32_t i = 0; i < timedRuns; ++i) {
+        setup();
+        auto start = std::chrono::steady_clock::now();
+        op();
+        auto stop = std::chrono::steady_clock::now();
+        samples.push_back(static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count()));
+    }
+    std::sort(samples.begin(), samples.end());
+    stats.medianNs = samples[(samples.size() - 1) / 2];
+    return stats;
+}
+
+static double megabytesPerSecond(uint64_t bytes, uint64_t ns) {
+    return ns > 0 ? static_cast<double>(bytes) * 1e3 / static_cast<double>(ns) : 0.0;
+}
+
+static int runSerialization(int argc, char* argv[]) {
+    // Parse arguments
+    ArgParser parser;
+    parser.parse(argc, argv);
+    
+    // Get parameters
+    bool debug = parser.getDebug();
+    uint32_t warmupRuns = parser.getUInt32("warmup", 1);
+    uint32_t timedRuns = std::max<uint32_t>(1, parser.getUInt32("repetitions", 5));
+    uint32_t numRotations = std::max<uint32_t>(1, parser.getUInt32("rotations", 8));
+    [[maybe_unused]] int compressionLevel = static_cast<int>(parser.getUInt32("compression-level", 1));  // zlib 0-9
+    auto objectNames = parseCommaList(parser.getString("objects", "ciphertext,mult-key,rotation-keys"));
+    auto formatNames = parseCommaList(parser.getString("formats", "binary,json,compressed"));
+    auto mediumNames = parseCommaList(parser.getString("media", "memory,tmpfs,disk"));
+    setupThreads(parser);
+    
+    BenchmarkParams params = BenchmarkParams::fromArgs(parser);
+    
+    // Setup CKKS cryptocontext
+    CryptoContext<DCRTPoly> cc = makeCryptoContext(params);
+    
+    uint32_t numSlots = cc->GetEncodingParams()->GetBatchSize();
+    
+    // Objects: a fresh ciphertext, the relinearization key, numRotations rotation keys
+    auto keyPair = cc->KeyGen();
+    cc->EvalMultKeyGen(keyPair.secretKey);
+    std::vector<int32_t> rotationIndices;
+    for (uint32_t r = 1; r <= numRotations; ++r) rotationIndices.push_back(static_cast<int32_t>(r));
+    cc->EvalRotateKeyGen(keyPair.secretKey, rotationIndices);
+    
+    auto inputVec = make_random_input_vector(numSlots, numSlots);
+    auto cipher = cc->Encrypt(keyPair.publicKey, cc->MakeCKKSPackedPlaintext(inputVec));
+    Ciphertext<DCRTPoly> loadedCipher;
+    
+    std::vector<SerialObject> objects = {
+        {"ciphertext",
+         [&](std::ostream& out, bool json) {
+             withSerType(json, [&](const auto& st) { Serial::Serialize(cipher, out, st); });
+         },
+         [&](std::istream& in, bool json) {
+             withSerType(json, [&](const auto& st) { Serial::Deserialize(loadedCipher, in, st); });
+         }},
+        {"mult-key",
+         [&](std::ostream& out, bool json) {
+             withSerType(json, [&](const auto& st) {
+                 if (!cc->SerializeEvalMultKey(out, st)) throw std::runtime_error("SerializeEvalMultKey failed");
+             });
+         },
+         [&](std::istream& in, bool json) {
+             withSerType(json, [&](const auto& st) {
+                 if (!cc->DeserializeEvalMultKey(in, st)) throw std::runtime_error("DeserializeEvalMultKey failed");
+             });
+         }},
+        {"rotation-keys",
+         [&](std::ostream& out, bool json) {
+             withSerType(json, [&](const auto& st) {
+                 if (!cc->SerializeEvalAutomorphismKey(out, st)) {
+                     throw std::runtime_error("SerializeEvalAutomorphismKey failed");
+                 }
+             });
+         },
+         [&](std::istream& in, bool json) {
+             withSerType(json, [&](const auto& st) {
+                 if (!cc->DeserializeEvalAutomorphismKey(in, st)) {
+                     throw std::runtime_error("DeserializeEvalAutomorphismKey failed");
+                 }
+             });
+         }},
+    };
+    
+    // Media: tmpfs under --tmpfs-dir (default /dev/shm), disk under --disk-dir
+    // (default the working directory)
+    std::vector<SerialMedium> media;
+    for (const auto& name : mediumNames) {
+        if (name == "memory") {
+            media.push_back({name, "", false});
+        } else if (name == "tmpfs" || name == "disk") {
+            std::string dir = (name == "tmpfs") ? parser.getString("tmpfs-dir", "/dev/shm")
+                                                : parser.getString("disk-dir", std::filesystem::current_path().string());
+            if (access(dir.c_str(), W_OK) != 0) {
+                std::cerr << "Skipping medium " << name << ": " << dir << " is not writable\n";
+                continue;
+            }
+            media.push_back({name, dir, name == "disk"});
+        } else {
+            std::cerr << "Error: unknown medium " << name << " (memory, tmpfs or disk)\n";
+            return 1;
+        }
+    }
+    
+    for (const auto& format : formatNames) {
+        if (format != "binary" && format != "json" && format != "compressed") {
+            std::cerr << "Error: unknown format " << format << " (binary, json or compressed)\n";
+            return 1;
+        }
+    }
+    
+    if (debug) {
+        std::cout << "=== Serialization Throughput ===\n";
+        std::cout << "Ring dimension: " << params.ringDim << "\n";
+        std::cout << "Multiplicative depth: " << params.multDepth << "\n";
+        std::cout << "Rotation keys: " << numRotations << "\n\n";
+    }
+    
+    uint32_t cases = 0;
+    bool verified = true;
+    
+    for (const auto& object : objects) {
+        if (std::find(objectNames.begin(), objectNames.end(), object.name) == objectNames.end()) continue;
+        
+        for (const auto& format : formatNames) {
+#ifndef BENCH_HAVE_ZLIB
+            if (format == "compressed") {
+                std::cerr << "Skipping format compressed: built without zlib (BENCH_HAVE_ZLIB)\n";
+                continue;
+            }
+#endif
+            bool json = (format == "json");
+            bool compressed = (format == "compressed");
+            
+            for (const auto& medium : media) {
+                std::string path = medium.inMemory() ? "" :
+                    medium.dir + "/openfhe_bench_serial_" + std::to_string(getpid()) + ".bin";
+                std::string wire;  // memory medium / compressed bytes
+                
+                auto serialize = [&] {
+                    if (compressed) {
+#ifdef BENCH_HAVE_ZLIB
+                        std::ostringstream raw;
+                        object.save(raw, false);
+                        wire = compressBuffer(raw.str(), compressionLevel);
+                        if (!medium.inMemory()) writeFile(path, wire);
+#endif
+                    } else if (medium.inMemory()) {
+                        std::ostringstream out;
+                        object.save(out, json);
+                        wire = out.str();
+                    } else {
+                        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+                        object.save(out, json);
+                        out.close();
+                        if (!out) throw std::runtime_error("cannot write " + path);
+                    }
+                    if (medium.durable) syncFile(path);
+                };
+                
+                auto deserialize = [&] {
+                    if (compressed) {
+#ifdef BENCH_HAVE_ZLIB
+                        std::string raw = uncompressBuffer(medium.inMemory() ? wire : readFile(path));
+                        MemoryStreamBuf buf(raw.data(), raw.size());
+                        std::istream in(&buf);
+                        object.load(in, false);
+#endif
+                    } else if (medium.inMemory()) {
+                        MemoryStreamBuf buf(wire.data(), wire.size());
+                        std::istream in(&buf);
+                        object.load(in, json);
+                    } else {
+                        std::ifstream in(path, std::ios::binary);
+                        object.load(in, json);
+                    }
+                };
+                
+                SerialStats save, load;
+                try {
+                    save = measureSerialOp(warmupRuns, timedRuns, [] {}, serialize);
+                    load = measureSerialOp(warmupRuns, timedRuns, [&] {
+                        if (medium.durable) evictFile(path);
+                    }, deserialize);
+                } catch (const std::exception& e) {
+                    std::cerr << "Error: " << object.name << " " << format << " " << medium.name << ": " << e.what() << "\n";
+                    if (!path.empty()) std::filesystem::remove(path);
+                    return 1;
+                }
+                
+                uint64_t bytes = (medium.inMemory() || compressed) ? wire.size() : std::filesystem::file_size(path);
+                if (!path.empty()) std::filesystem::remove(path);
+                
+                // Round trip check of the deserialized ciphertext
+                if (object.name == "ciphertext") {
+                    Plaintext resultPtxt;
+                    cc->Decrypt(keyPair.secretKey, loadedCipher, &resultPtxt);
+                    resultPtxt->SetLength(numSlots);
+                    verified = verifyResult(resultPtxt->GetRealPackedValue(), inputVec, debug) && verified;
+                    loadedCipher.reset();
+                }
+                
+                // Machine-readable record, parsed by plots/benchmarker.py
+                std::cout << "SERIAL object=" << object.name
+                          << " format=" << format
+                          << " medium=" << medium.name
+                          << " bytes=" << bytes
+                          << " serialize_ns=" << save.medianNs
+                          << " deserialize_ns=" << load.medianNs
+                          << std::fixed << std::setprecision(1)
+                          << " serialize_mb_per_sec=" << megabytesPerSecond(bytes, save.medianNs)
+                          << " deserialize_mb_per_sec=" << megabytesPerSecond(bytes, load.medianNs)
+                          << std::defaultfloat
+                          << " serialize_allocations=" << save.allocations
+                          << " serialize_allocated_bytes=" << save.allocatedBytes
+                          << " deserialize_allocations=" << load.allocations
+                          << " deserialize_allocated_bytes=" << load.allocatedBytes << "\n";
+                ++cases;
+            }
+        }
+    }
+    
+    std::cout << "SERIAL_CASES=" << cases << "\n";
+    std::cout << "SERIAL_ROTATION_KEYS=" << numRotations << "\n";
+    
+    return verified ? 0 : 1;
+}
+
+BENCHMARK_KERNEL("serialization", runSerialization);
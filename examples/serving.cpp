@@ -0,0 +1,425 @@
+// examples/serving.cpp - Streaming request serving on the BSGS matrix-vector kernel
+// A load generator sends serialized ciphertexts at an open-loop rate to a
+// three-stage server that shares one CryptoContext and one key cache:
+//   deserialize  one thread (deserialization looks the ciphertext's context up
+//                in OpenFHE's process-wide context list, which is not locked)
+//   compute      a pool of --workers=W threads (default 2), each applying the plain BSGS
+//                kernel of bsgs-diagonal-method.cpp to one request with
+//                --inner-threads OpenMP threads (default 1)
+//   serialize    one thread, writing each response to an in-memory buffer
+// Stages hand requests on through unbounded FIFO queues, so arrivals never
+// wait for the server (open loop) and overload shows up as queueing delay.
+// Every rotation key is acquired once before serving and stays installed, so
+// the workers only read the shared key map (or, with --numa-key-replicas,
+// their node's copies).
+// --rate=R                    offered load in requests/s (default 10)
+// --arrivals=poisson|uniform  exponential or constant inter-arrival times
+// --requests=N                requests per session (default 100); the first
+//                             --warmup-requests (default W) are served but not counted
+// --inputs=I                  distinct client ciphertexts, sent round-robin (default 4)
+// Each session is one run of the measured kernel (--repetitions repeats it);
+// the SERVE_* lines describe the last session.
+#include <openfhe.h>
+#include "utils.hpp"
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <map>
+#include <set>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <random>
+#include <sstream>
+#include <algorithm>
+
+// Headers needed for serialization
+#include <ciphertext-ser.h>
+#include <cryptocontext-ser.h>
+#include <key/key-ser.h>
+#include <scheme/ckksrns/ckksrns-ser.h>
+
+using namespace lbcrypto;
+
+using ServeClock = std::chrono::steady_clock;
+
+// One request's payload and the times it entered and left each stage
+struct ServeRequest {
+    std::size_t input = 0;  // client ciphertext it carries
+    ServeClock::time_point arrival;
+    ServeClock::time_point deserializeStart, deserializeEnd;
+    ServeClock::time_point computeStart, computeEnd;
+    ServeClock::time_point serializeStart, done;
+    Ciphertext<DCRTPoly> ciphertext;
+    std::size_t responseBytes = 0;
+};
+
+// Unbounded FIFO of request ids between two stages; pop() returns false once
+// the queue is closed and drained
+class RequestQueue {
+private:
+    std::deque<std::size_t> ids;
+    bool closed = false;
+    std::mutex mtx;
+    std::condition_variable cv;
+
+public:
+    void push(std::size_t id) {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            ids.push_back(id);
+        }
+        cv.notify_one();
+    }
+    
+    bool pop(std::size_t& id) {
+        std::unique_lock<std::mutex> lock(mtx);
+        cv.wait(lock, [&] { return closed || !ids.empty(); });
+        if (ids.empty()) return false;
+        id = ids.front();
+        ids.pop_front();
+        return true;
+    }
+    
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            closed = true;
+        }
+        cv.notify_all();
+    }
+};
+
+static uint64_t elapsedNs(ServeClock::time_point from, ServeClock::time_point to) {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count());
+}
+
+static int runServing(int argc, char* argv[]) {
+    // Parse arguments
+    ArgParser parser;
+    parser.parse(argc, argv);
+    
+    // Get parameters
+    bool debug = parser.getDebug();
+    uint32_t workers = std::max<uint32_t>(1, parser.getUInt32("workers", 2));
+    int innerThreads = static_cast<int>(std::max<uint32_t>(1, parser.getUInt32("inner-threads", 1)));
+    double rate = std::stod(parser.getString("rate", "10"));
+    bool poisson = parser.getString("arrivals", "poisson") == "poisson";  // --arrivals=poisson|uniform
+    std::size_t numRequests = std::max<uint32_t>(1, parser.getUInt32("requests", 100));
+    std::size_t warmupRequests = std::min<std::size_t>(parser.getUInt32("warmup-requests", workers), numRequests - 1);
+    std::size_t numInputs = std::max<uint32_t>(1, parser.getUInt32("inputs", 4));
+    setupThreads(parser);
+    
+    if (rate <= 0) {
+        std::cerr << "Error: --rate must be positive\n";
+        return 1;
+    }
+    
+    // Matrix (--matrix-kind; --matrix-dim unless loaded from --matrix-file)
+    BenchmarkMatrix M;
+    try {
+        M = make_benchmark_matrix(parser);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    std::size_t matrixDim = M.dim();
+    
+    MeasurementSystem measurement(parser);
+    
+    BenchmarkParams params = BenchmarkParams::fromArgs(parser);
+    
+    // Setup CKKS cryptocontext
+    CryptoContext<DCRTPoly> cc = makeCryptoContext(params);
+    
+    int numSlots = static_cast<int>(cc->GetEncodingParams()->GetBatchSize());
+    if (static_cast<int>(matrixDim) > numSlots) {
+        std::cerr << "Error: matrixDim (" << matrixDim << ") must be <= numSlots (" << numSlots << ")\n";
+        return 1;
+    }
+    
+    if (debug) {
+        std::cout << "=== Streaming BSGS serving ===\n";
+        std::cout << "Matrix: " << matrixDim << "×" << matrixDim
+                  << " (" << M.kind << ", " << M.nnz() << " nonzeros)\n";
+        std::cout << "Load: " << numRequests << " requests at " << rate << "/s ("
+                  << (poisson ? "poisson" : "uniform") << "), " << workers << " workers × "
+                  << innerThreads << " threads\n\n";
+    }
+    
+    // Generate key pair
+    auto keyPair = cc->KeyGen();
+    
+    // DIAGONALS AND BSGS SCHEDULE (as bsgs-diagonal-method.cpp)
+    std::vector<int> diagonalIndices;
+    for (int k : diagonal_offsets(M, numSlots)) {
+        diagonalIndices.push_back(normalizeToSignedIndex(k, numSlots));
+    }
+    std::sort(diagonalIndices.begin(), diagonalIndices.end());
+    
+    // --n1: sqrt of the diagonal count, fixed, or auto-tuned for one ciphertext
+    BsgsPlanner planner(parser, BsgsVariant::PLAIN, 1);
+    int n1 = planner.choose(diagonalIndices, numSlots);
+    BsgsSchedule schedule(diagonalIndices, n1);
+    
+    // Pre-rotated diagonal plaintexts; shares --ptxt-cache-dir entries with
+    // bsgs-diagonal-method at the same n1
+    DiagonalPlaintextCache ptxtCache(cc, parser, measurement);
+    ptxtCache.describe(matrixHash(M), M.dim(), params, "bsgs-n1-" + std::to_string(n1));
+    
+    std::map<int, Plaintext> preRotateDiagonals;
+    if (!ptxtCache.load(preRotateDiagonals)) {
+        DiagonalSet diagonals = extract_diagonals(M, numSlots);
+        std::map<int, std::size_t> diagonalOfIndex;
+        for (std::size_t d = 0; d < diagonals.size(); ++d) {
+            diagonalOfIndex[normalizeToSignedIndex(diagonals.offsets[d], numSlots)] = d;
+        }
+        preRotateDiagonals = ptxtCache.encode(diagonalIndices, [&](std::size_t n) {
+            int k = diagonalIndices[n];
+            auto diagonal = rotateVectorDown(diagonals.diagonal(diagonalOfIndex.at(k)), schedule.preRotation(k, numSlots));
+            return cc->MakeCKKSPackedPlaintext(diagonal, 1, 0);
+        });
+    }
+    
+    // CREATE TEMPORARY DIRECTORY FOR FILES
+    TempDirectory tempDir;
+    if (!tempDir.isValid()) {
+        std::cerr << "Failed to create temporary directory" << std::endl;
+        return 1;
+    }
+    
+    // The server's key cache: every rotation key, installed once
+    RotationKeyStore keyStore(cc, tempDir, "serve-rot-key-", KeyStoreConfig::fromArgs(parser), measurement);
+    
+    std::set<int> rotationIndices;
+    for (int i : schedule.babySteps) {
+        if (i != 0) rotationIndices.insert(i);
+    }
+    for (int j : schedule.giantSteps) {
+        if (j != 0) rotationIndices.insert(n1 * j);
+    }
+    
+    // Generate and save each rotation key (or reuse a persisted key set)
+    if (!keyStore.generate(keyPair, rotationIndices, params)) {
+        std::cerr << "Failed to generate rotation keys\n";
+        return 1;
+    }
+    keyStore.open();
+    for (int rotation : rotationIndices) {
+        keyStore.acquire(rotation);
+    }
+    
+    // CLIENT REQUESTS
+    // numInputs encrypted vectors, serialized once; request r carries input r % numInputs
+    std::vector<std::vector<double>> inputVecs(numInputs);
+    std::vector<std::string> requestBlobs(numInputs);
+    for (std::size_t x = 0; x < numInputs; ++x) {
+        inputVecs[x] = make_random_input_vector(matrixDim, numSlots);
+        auto ciphertext = cc->Encrypt(keyPair.publicKey, cc->MakeCKKSPackedPlaintext(inputVecs[x]));
+        std::ostringstream blob;
+        Serial::Serialize(ciphertext, blob, SerType::BINARY);
+        requestBlobs[x] = blob.str();
+    }
+    
+    // Arrival offsets from the session start (fixed seed: every session sees the same load)
+    std::vector<std::chrono::nanoseconds> arrivalOffsets(numRequests);
+    {
+        std::mt19937_64 rng(12345);
+        std::exponential_distribution<double> gap(rate);
+        double t = 0.0;
+        for (std::size_t r = 0; r < numRequests; ++r) {
+            arrivalOffsets[r] = std::chrono::nanoseconds(static_cast<int64_t>(t * 1e9));
+            t += poisson ? gap(rng) : 1.0 / rate;
+        }
+    }
+    
+    // THE BSGS KERNEL ON ONE CIPHERTEXT (shared with bsgs-diagonal-method)
+    // Read-only on the context, the key map and the plaintexts: safe to run
+    // concurrently from every worker
+    auto evaluate = [&](const Ciphertext<DCRTPoly>& input) {
+        return evaluateBsgs(cc, params, schedule, preRotateDiagonals, input,
+                            [&](const Ciphertext<DCRTPoly>& ct, int rotation) { return keyStore.rotate(ct, rotation); });
+    };
+    
+    // ONE SERVING SESSION
+    std::vector<ServeRequest> requests;
+    std::vector<std::string> responses(numInputs);  // first response per input, for verification
+    bool stageFailed = false;
+    
+    auto session = [&] {
+        requests.assign(numRequests, ServeRequest{});
+        RequestQueue toDeserialize, toCompute, toSerialize;
+        std::mutex failMutex;
+        auto fail = [&](const char* stage, std::size_t id) {
+            std::lock_guard<std::mutex> lock(failMutex);
+            std::cerr << "Failed to " << stage << " request " << id << "\n";
+            stageFailed = true;
+        };
+        
+        std::thread deserializer([&] {
+            std::size_t id;
+            while (toDeserialize.pop(id)) {
+                ServeRequest& request = requests[id];
+                request.deserializeStart = ServeClock::now();
+                std::istringstream in(requestBlobs[request.input]);
+                Serial::Deserialize(request.ciphertext, in, SerType::BINARY);
+                request.deserializeEnd = ServeClock::now();
+                if (!in || !request.ciphertext) {
+                    fail("deserialize", id);
+                }
+                toCompute.push(id);
+            }
+        });
+        
+        std::vector<std::thread> pool;
+        for (uint32_t w = 0; w < workers; ++w) {
+            pool.emplace_back([&] {
+                omp_set_num_threads(innerThreads);
+                std::size_t id;
+                while (toCompute.pop(id)) {
+                    ServeRequest& request = requests[id];
+                    request.computeStart = ServeClock::now();
+                    if (request.ciphertext) request.ciphertext = evaluate(request.ciphertext);
+                    request.computeEnd = ServeClock::now();
+                    toSerialize.push(id);
+                }
+            });
+        }
+        
+        std::thread serializer([&] {
+            std::size_t id;
+            while (toSerialize.pop(id)) {
+                ServeRequest& request = requests[id];
+                request.serializeStart = ServeClock::now();
+                std::ostringstream out;
+                if (request.ciphertext) Serial::Serialize(request.ciphertext, out, SerType::BINARY);
+                std::string response = out.str();
+                request.done = ServeClock::now();
+                
+                request.responseBytes = response.size();
+                if (response.empty()) fail("serialize", id);
+                if (id < numInputs) responses[id] = std::move(response);
+                request.ciphertext = nullptr;
+            }
+        });
+        
+        // Open-loop arrivals: each request is sent at its time, whatever the backlog
+        auto start = ServeClock::now();
+        for (std::size_t r = 0; r < numRequests; ++r) {
+            std::this_thread::sleep_until(start + arrivalOffsets[r]);
+            requests[r].input = r % numInputs;
+            requests[r].arrival = ServeClock::now();
+            toDeserialize.push(r);
+        }
+        
+        toDeserialize.close();
+        deserializer.join();
+        toCompute.close();
+        for (auto& worker : pool) worker.join();
+        toSerialize.close();
+        serializer.join();
+    };
+    
+    // Start DRAM measurement
+    measurement.startDRAM();
+    measurement.measureKernel(session);
+    measurement.stopDRAM();
+    
+    // SESSION STATISTICS (requests after the warmup)
+    std::vector<uint64_t> latencies, queueing, deserializeNs, computeNs, serializeNs;
+    uint64_t computeBusyNs = 0;
+    uint64_t responseBytes = 0;
+    ServeClock::time_point windowStart = requests[warmupRequests].arrival;
+    ServeClock::time_point windowEnd = windowStart;
+    std::vector<std::pair<ServeClock::time_point, int>> backlogEvents;
+    for (std::size_t r = 0; r < numRequests; ++r) {
+        const ServeRequest& request = requests[r];
+        backlogEvents.push_back({request.arrival, 1});
+        backlogEvents.push_back({request.done, -1});
+        if (r < warmupRequests) continue;
+        
+        latencies.push_back(elapsedNs(request.arrival, request.done));
+        queueing.push_back(elapsedNs(request.arrival, request.deserializeStart) +
+                           elapsedNs(request.deserializeEnd, request.computeStart) +
+                           elapsedNs(request.computeEnd, request.serializeStart));
+        deserializeNs.push_back(elapsedNs(request.deserializeStart, request.deserializeEnd));
+        computeNs.push_back(elapsedNs(request.computeStart, request.computeEnd));
+        serializeNs.push_back(elapsedNs(request.serializeStart, request.done));
+        computeBusyNs += computeNs.back();
+        responseBytes += request.responseBytes;
+        windowEnd = std::max(windowEnd, request.done);
+    }
+    for (auto* values : {&latencies, &queueing, &deserializeNs, &computeNs, &serializeNs}) {
+        std::sort(values->begin(), values->end());
+    }
+    
+    // Most requests in the server at once (departures first on ties)
+    std::sort(backlogEvents.begin(), backlogEvents.end());
+    int inSystem = 0;
+    int maxBacklog = 0;
+    for (const auto& event : backlogEvents) {
+        inSystem += event.second;
+        maxBacklog = std::max(maxBacklog, inSystem);
+    }
+    
+    std::size_t measured = numRequests - warmupRequests;
+    double windowSeconds = std::max(1e-9, elapsedNs(windowStart, windowEnd) / 1e9);
+    double arrivalSeconds = elapsedNs(windowStart, requests.back().arrival) / 1e9;
+    
+    // Print measurement results
+    measurement.printResults();
+    keyStore.printResults();
+    ptxtCache.printResults();
+    printMatrixResults(M, diagonalIndices.size());
+    planner.printResults();
+    
+    // Machine-readable SERVE_* lines, parsed by plots/benchmarker.py
+    std::cout << "SERVE_REQUESTS=" << numRequests << "\n";
+    std::cout << "SERVE_MEASURED_REQUESTS=" << measured << "\n";
+    std::cout << "SERVE_WORKERS=" << workers << "\n";
+    std::cout << "SERVE_INNER_THREADS=" << innerThreads << "\n";
+    std::cout << std::fixed << std::setprecision(3)
+              << "SERVE_OFFERED_RATE=" << rate << "\n"
+              << "SERVE_ARRIVAL_RATE=" << (arrivalSeconds > 0 ? (measured - 1) / arrivalSeconds : 0.0) << "\n"
+              << "SERVE_THROUGHPUT=" << measured / windowSeconds << "\n"
+              << "SERVE_COMPUTE_UTILIZATION=" << computeBusyNs / (1e9 * windowSeconds * workers) << "\n"
+              << std::defaultfloat;
+    std::cout << "SERVE_LATENCY_P50_NS=" << nearestRankPercentile(latencies, 0.5) << "\n";
+    std::cout << "SERVE_LATENCY_P99_NS=" << nearestRankPercentile(latencies, 0.99) << "\n";
+    std::cout << "SERVE_LATENCY_P999_NS=" << nearestRankPercentile(latencies, 0.999) << "\n";
+    std::cout << "SERVE_QUEUE_P50_NS=" << nearestRankPercentile(queueing, 0.5) << "\n";
+    std::cout << "SERVE_QUEUE_P99_NS=" << nearestRankPercentile(queueing, 0.99) << "\n";
+    std::cout << "SERVE_QUEUE_P999_NS=" << nearestRankPercentile(queueing, 0.999) << "\n";
+    std::cout << "SERVE_DESERIALIZE_MEDIAN_NS=" << nearestRankPercentile(deserializeNs, 0.5) << "\n";
+    std::cout << "SERVE_COMPUTE_MEDIAN_NS=" << nearestRankPercentile(computeNs, 0.5) << "\n";
+    std::cout << "SERVE_SERIALIZE_MEDIAN_NS=" << nearestRankPercentile(serializeNs, 0.5) << "\n";
+    std::cout << "SERVE_MAX_BACKLOG=" << maxBacklog << "\n";
+    std::cout << "SERVE_REQUEST_BYTES=" << requestBlobs[0].size() << "\n";
+    std::cout << "SERVE_RESPONSE_BYTES=" << (measured > 0 ? responseBytes / measured : 0) << "\n";
+    
+    if (stageFailed) return 1;
+    
+    // Always verify
+    if (debug) {
+        std::cout << "\nDecrypting and verifying the first response of each input...\n";
+    }
+    
+    bool allCorrect = true;
+    for (std::size_t x = 0; x < std::min(numInputs, numRequests); ++x) {
+        std::istringstream in(responses[x]);
+        Ciphertext<DCRTPoly> result;
+        Serial::Deserialize(result, in, SerType::BINARY);
+        
+        Plaintext resultPtxt;
+        cc->Decrypt(keyPair.secretKey, result, &resultPtxt);
+        resultPtxt->SetLength(numSlots);
+        
+        auto resultVec = resultPtxt->GetRealPackedValue();
+        allCorrect = verify_matrix_vector_result(resultVec, M, inputVecs[x], debug) && allCorrect;
+    }
+    return allCorrect ? 0 : 1;
+}
+
+BENCHMARK_KERNEL("serving", runServing);
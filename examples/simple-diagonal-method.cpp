@@ -17,35 +17,39 @@
 
 using namespace lbcrypto;
 
-int main(int argc, char* argv[]) {
+static int runSimpleDiagonal(int argc, char* argv[]) {
     // Parse arguments
     ArgParser parser;
     parser.parse(argc, argv);
     
     // Get parameters
     bool debug = parser.getDebug();
-    std::size_t matrixDim = static_cast<std::size_t>(parser.getUInt32("matrix-dim", 128));
+    bool treeReduction = parser.getString("reduction", "fold") == "tree";  // --reduction=fold|tree
     setupThreads(parser);
     
-    MeasurementMode mode = parser.getMeasurementMode();
-    MeasurementSystem measurement(mode);
+    // Matrix (--matrix-kind; --matrix-dim unless loaded from --matrix-file)
+    BenchmarkMatrix M;
+    try {
+        M = make_benchmark_matrix(parser);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    std::size_t matrixDim = M.dim();
+    
+    MeasurementSystem measurement(parser);
     
     BenchmarkParams params = BenchmarkParams::fromArgs(parser);
+    
+    // --start-level / --mod-switch=min (the plaintext products need one level)
+    LevelControl levels(parser, params, 1);
+    if (!levels.check().empty()) {
+        std::cerr << "Error: " << levels.check() << "\n";
+        return 1;
+    }
         
     // Setup CKKS cryptocontext
-    CCParams<CryptoContextCKKSRNS> ccParams;
-    ccParams.SetMultiplicativeDepth(params.multDepth);
-    ccParams.SetScalingModSize(50);
-    ccParams.SetRingDim(params.ringDim);
-    ccParams.SetScalingTechnique(FLEXIBLEAUTO);
-    ccParams.SetKeySwitchTechnique(HYBRID);
-    ccParams.SetNumLargeDigits(params.numDigits);
-    ccParams.SetSecurityLevel(params.checkSecurity ? HEStd_128_classic : HEStd_NotSet);
-    
-    CryptoContext<DCRTPoly> cc = GenCryptoContext(ccParams);
-    cc->Enable(PKE);
-    cc->Enable(KEYSWITCH);
-    cc->Enable(LEVELEDSHE);
+    CryptoContext<DCRTPoly> cc = makeCryptoContext(params);
 
     uint32_t numSlots = cc->GetEncodingParams()->GetBatchSize();
     if (matrixDim > numSlots) {
@@ -55,7 +59,8 @@ int main(int argc, char* argv[]) {
 
     if (debug) {
         std::cout << "=== Diagonal Method for Matrix-Vector Multiplication ===\n";
-        std::cout << "Matrix dimension: " << matrixDim << "x" << matrixDim << "\n";
+        std::cout << "Matrix dimension: " << matrixDim << "x" << matrixDim
+                  << " (" << M.kind << ", " << M.nnz() << " nonzeros)\n";
         std::cout << "Number of slots: " << numSlots << "\n";
         std::cout << "Ring dimension: " << params.ringDim << "\n\n";
     }
@@ -63,15 +68,32 @@ int main(int argc, char* argv[]) {
     // Generate key pair
     auto keyPair = cc->KeyGen();
     
-    // Create embedded random matrix and input vector
-    auto M = make_embedded_random_matrix(matrixDim, numSlots);
+    // Create input vector
     auto inputVec = make_random_input_vector(matrixDim, numSlots);
 
-    // Extract all non-empty diagonals
-    auto diagonals = extract_generalized_diagonals(M, matrixDim);
+    // Diagonal plaintexts: loaded from --ptxt-cache-dir, or extracted and encoded
+    DiagonalPlaintextCache ptxtCache(cc, parser, measurement);
+    ptxtCache.describe(matrixHash(M), M.dim(), params, "diagonal" + levels.layoutTag());
+    
+    std::map<int, Plaintext> diagonalPlaintexts;
+    if (!ptxtCache.load(diagonalPlaintexts)) {
+        // Extract all non-empty diagonals and encode them as plaintexts
+        auto diagonals = extract_diagonals(M, numSlots);
+        diagonalPlaintexts = ptxtCache.encode(diagonals.offsets, [&](std::size_t d) {
+            return cc->MakeCKKSPackedPlaintext(diagonals.diagonal(d), 1, levels.computeLevel());
+        });
+    }
+    
+    // --encode-only: the encoding above was the measured kernel
+    if (ptxtCache.encodeOnly()) {
+        measurement.printResults();
+        ptxtCache.printResults();
+        printMatrixResults(M, diagonalPlaintexts.size());
+        return 0;
+    }
     
     if (debug) {
-        std::cout << "Found " << diagonals.size() << " non-empty diagonals\n";
+        std::cout << "Found " << diagonalPlaintexts.size() << " non-empty diagonals\n";
     }
     
     // Create temporary directory for files
@@ -81,47 +103,32 @@ int main(int argc, char* argv[]) {
         return 1;
     }
     
-    // Generate and serialize rotation keys individually
-    std::vector<int32_t> rotationIndices;
-    for (const auto& entry : diagonals) {
-        int k = entry.first;
-        if (k != 0) {
-            rotationIndices.push_back(k);
-        }
-    }
+    // Rotation keys are saved to and fetched from per-rotation files
+    RotationKeyStore keyStore(cc, tempDir, "rotation-key-k", KeyStoreConfig::fromArgs(parser), measurement);
     
-    // Generate and save each rotation key separately
-    for (int32_t k : rotationIndices) {
-        // Generate key for this specific rotation
-        cc->EvalRotateKeyGen(keyPair.secretKey, {k});
-        
-        // Save with descriptive filename
-        std::stringstream filename;
-        filename << "rotation-key-k" << k << ".bin";
-        std::string keyPath = tempDir.getFilePath(filename.str());
-        
-        std::ofstream keyFile(keyPath, std::ios::binary);
-        if (!cc->SerializeEvalAutomorphismKey(keyFile, SerType::BINARY)) {
-            std::cerr << "Failed to serialize rotation key for k=" << k << std::endl;
-            return 1;
-        }
-        keyFile.close();
-        
-        // Clear the key from memory immediately after saving
-        cc->ClearEvalAutomorphismKeys();
+    // Generate and serialize rotation keys individually: one per diagonal, or
+    // a compact basis (--key-basis) with each rotation chained from the last
+    RotationKeyBasis keyBasis(parser, static_cast<int>(numSlots));
+    std::vector<int> diagonalRotations;
+    int previousK = 0;
+    for (const auto& entry : diagonalPlaintexts) {
+        int k = entry.first;
+        diagonalRotations.push_back(keyBasis.compact() ? k - previousK : k);
+        previousK = k;
     }
+    const auto& basisKeys = keyBasis.plan(diagonalRotations);
+    std::vector<int32_t> rotationIndices(basisKeys.begin(), basisKeys.end());
     
-    // Encode diagonals as plaintexts
-    std::map<int, Plaintext> diagonalPlaintexts;
-    for (const auto& entry : diagonals) {
-        int k = entry.first;
-        const auto& diag = entry.second;
-        diagonalPlaintexts[k] = cc->MakeCKKSPackedPlaintext(diag);
+    // Generate and save each rotation key separately (or reuse a persisted key set)
+    if (!keyStore.generate(keyPair, rotationIndices, params)) {
+        std::cerr << "Failed to generate rotation keys\n";
+        return 1;
     }
     
     // Encrypt input vector
     Plaintext inputPtxt = cc->MakeCKKSPackedPlaintext(inputVec);
     auto inputCipher = cc->Encrypt(keyPair.publicKey, inputPtxt);
+    levels.toStartLevel(cc, inputCipher);
 
     // Serialize input
     std::string inputPath = tempDir.getFilePath("input.bin");
@@ -134,71 +141,145 @@ int main(int argc, char* argv[]) {
 
     // PROFILED DIAGONAL METHOD COMPUTATION
     
+    // Warm the key cache (no-op with the default --key-cache-mb=0)
+    keyStore.prefill(rotationIndices);
+    
     // Start DRAM measurement
     measurement.startDRAM();
     
+    // Open the key store (bundle index and mapping: the cold-start cost)
+    keyStore.open();
+    
     // Load input
     Ciphertext<DCRTPoly> cipherInput;
-    if (!Serial::DeserializeFromFile(inputPath, cipherInput, SerType::BINARY)) {
-        std::cerr << "Failed to load input" << std::endl;
-        return 1;
+    {
+        ScopedRegion region(measurement, "deserialize-input");
+        if (!Serial::DeserializeFromFile(inputPath, cipherInput, SerType::BINARY)) {
+            std::cerr << "Failed to load input" << std::endl;
+            return 1;
+        }
     }
     
-    // PIN markers around the computation
-    measurement.startPIN();
-    
-    // Diagonal method: result = sum_k diag_k * rotate(input, k)
+    // PIN markers / repeated timing around the computation
     Ciphertext<DCRTPoly> result;
-    bool first = true;
-
-    // Process all non-empty diagonals
-    for (const auto& entry : diagonals) {
-        int k = entry.first;
+    measurement.measureKernel([&] {
+        auto input = levels.switchDown(cc, measurement, cipherInput);
         
-        Ciphertext<DCRTPoly> rotated;
+        // Diagonal method: result = sum_k diag_k * rotate(input, k)
+        bool first = true;
         
-        if (k == 0) {
-            // No rotation needed for main diagonal
-            rotated = cipherInput;
-        } else {
-            // Load the specific rotation key for this k value
-            std::stringstream filename;
-            filename << "rotation-key-k" << k << ".bin";
-            std::string keyPath = tempDir.getFilePath(filename.str());
+        // Throughput mode (--outer-threads): diagonals are independent, so each
+        // group of outer-threads diagonals is rotated and multiplied as tasks
+        // with the group's keys installed together
+        if (threadSplit().enabled() && !keyBasis.compact()) {
+            std::vector<std::pair<int, Plaintext>> entries(diagonalPlaintexts.begin(), diagonalPlaintexts.end());
+            std::size_t groupSize = threadSplit().outer;
+            std::vector<CiphertextBatch> treePartials;
             
-            std::ifstream keyFile(keyPath, std::ios::binary);
-            if (!cc->DeserializeEvalAutomorphismKey(keyFile, SerType::BINARY)) {
-                std::cerr << "Failed to load rotation key for k=" << k << std::endl;
-                return 1;
+            for (std::size_t start = 0; start < entries.size(); start += groupSize) {
+                std::size_t count = std::min(groupSize, entries.size() - start);
+                for (std::size_t n = start; n < start + count; ++n) {
+                    if (entries[n].first != 0) keyStore.acquire(entries[n].first);
+                }
+                
+                std::vector<Ciphertext<DCRTPoly>> partials(count);
+                {
+                    ScopedRegion region(measurement, "rotate-mult");
+                    forEachTask(count, [&](std::size_t t) {
+                        const auto& [k, diagonal] = entries[start + t];
+                        auto rotated = (k == 0) ? input : keyStore.rotate(input, k);
+                        partials[t] = cc->EvalMult(rotated, diagonal);
+                    });
+                }
+                keyStore.releaseAll();
+                
+                if (treeReduction) {
+                    for (const auto& partial : partials) treePartials.push_back({partial});
+                    continue;
+                }
+                
+                ScopedRegion region(measurement, "accumulate");
+                for (const auto& partial : partials) {
+                    result = first ? partial : cc->EvalAdd(result, partial);
+                    first = false;
+                }
             }
-            keyFile.close();
-            
-            // Perform rotation with the loaded key
-            rotated = cc->EvalRotate(cipherInput, k);
             
-            // Clear the key from memory after use
-            cc->ClearEvalAutomorphismKeys();
+            if (treeReduction) {
+                ScopedRegion region(measurement, "accumulate");
+                treeReduce(cc, treePartials);
+                result = treePartials[0][0];
+            }
+            return;
         }
         
-        // Multiply by k-th diagonal
-        auto partial = cc->EvalMult(rotated, diagonalPlaintexts[k]);
+        // Compact key basis: the input rotated by the previous k
+        CiphertextBatch chain = {input};
+        int chainK = 0;
         
-        // Accumulate
-        if (first) {
-            result = partial;
-            first = false;
-        } else {
-            result = cc->EvalAdd(result, partial);
+        // --reduction=tree: products are formed and summed after the rotations
+        PartialProducts products;
+
+        // Process all non-empty diagonals
+        for (const auto& entry : diagonalPlaintexts) {
+            int k = entry.first;
+            
+            Ciphertext<DCRTPoly> rotated;
+            
+            if (keyBasis.compact()) {
+                // Continue from the previous diagonal's rotation
+                rotateBatchByBasis(keyStore, keyBasis, measurement, chain, k - chainK);
+                chainK = k;
+                rotated = chain[0];
+            } else if (k == 0) {
+                // No rotation needed for main diagonal
+                rotated = input;
+            } else {
+                // Fetch the rotation key for this k value (cached or from disk)
+                keyStore.acquire(k);
+                
+                // Perform rotation with the loaded key
+                rotated = inRegion(measurement, "rotate", [&] {
+                    return keyStore.rotate(input, k);
+                });
+                
+                // Release the key (stays resident if it fits the cache budget)
+                keyStore.release(k);
+            }
+            
+            if (treeReduction) {
+                products.add({rotated}, entry.second);
+                continue;
+            }
+            
+            // Multiply by k-th diagonal
+            auto partial = inRegion(measurement, "ptxt-mult", [&] {
+                return cc->EvalMult(rotated, entry.second);
+            });
+            
+            // Accumulate
+            if (first) {
+                result = partial;
+                first = false;
+            } else {
+                ScopedRegion region(measurement, "accumulate");
+                result = cc->EvalAdd(result, partial);
+            }
         }
-    }
-    
-    measurement.endPIN();
+        
+        if (!products.empty()) {
+            result = products.sum(cc, measurement)[0];
+        }
+    });
     
     // Save result
     std::string resultPath = tempDir.getFilePath("result.bin");
-    if (!Serial::SerializeToFile(resultPath, result, SerType::BINARY)) {
-        std::cerr << "Failed to save result" << std::endl;
-        return 1;
+    {
+        ScopedRegion region(measurement, "serialize-result");
+        if (!Serial::SerializeToFile(resultPath, result, SerType::BINARY)) {
+            std::cerr << "Failed to save result" << std::endl;
+            return 1;
+        }
     }
     
     // Stop DRAM measurement
@@ -206,6 +287,11 @@ int main(int argc, char* argv[]) {
     
     // Print measurement results
     measurement.printResults();
+    levels.printResults();
+    keyStore.printResults();
+    keyBasis.printResults();
+    ptxtCache.printResults();
+    printMatrixResults(M, diagonalPlaintexts.size());
     
     // Always verify
     Plaintext resultPtxt;
@@ -215,5 +301,7 @@ int main(int argc, char* argv[]) {
     auto resultVec = resultPtxt->GetRealPackedValue();
     
     // Verify and return exit code
-    return verify_matrix_vector_result(resultVec, M, inputVec, matrixDim, debug) ? 0 : 1;
-}
\ No newline at end of file
+    return verify_matrix_vector_result(resultVec, M, inputVec, debug) ? 0 : 1;
+}
+
+BENCHMARK_KERNEL("simple-diagonal-method", runSimpleDiagonal);
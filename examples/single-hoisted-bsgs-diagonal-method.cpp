@@ -19,35 +19,49 @@
 
 using namespace lbcrypto;
 
-int main(int argc, char* argv[]) {
+static int runSingleHoistedBsgsDiagonal(int argc, char* argv[]) {
     // Parse arguments
     ArgParser parser;
     parser.parse(argc, argv);
     
     // Get parameters
     bool debug = parser.getDebug();
-    std::size_t matrixDim = static_cast<std::size_t>(parser.getUInt32("matrix-dim", 128));
+    uint32_t batchSize = std::max<uint32_t>(1, parser.getUInt32("batch", 1));
+    bool treeReduction = parser.getString("reduction", "fold") == "tree";  // --reduction=fold|tree
+    bool rescaleAtEnd = parser.getString("rescale", "block") == "end";  // --rescale=block|end (FIXEDMANUAL)
     setupThreads(parser);
     
-    MeasurementMode mode = parser.getMeasurementMode();
-    MeasurementSystem measurement(mode);
+    // Hoisted rotations all start from the input's digits, so a compact key
+    // basis (--key-basis) cannot compose them
+    if (parser.getString("key-basis", "full") != "full") {
+        std::cerr << "Error: --key-basis requires non-hoisted rotations\n";
+        return 1;
+    }
+    
+    // Matrix (--matrix-kind; --matrix-dim unless loaded from --matrix-file)
+    BenchmarkMatrix M;
+    try {
+        M = make_benchmark_matrix(parser);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    std::size_t matrixDim = M.dim();
+    
+    MeasurementSystem measurement(parser);
+    measurement.setBatchSize(batchSize);
     
     BenchmarkParams params = BenchmarkParams::fromArgs(parser);
     
+    // --start-level / --mod-switch=min (the plaintext products need one level)
+    LevelControl levels(parser, params, 1);
+    if (!levels.check().empty()) {
+        std::cerr << "Error: " << levels.check() << "\n";
+        return 1;
+    }
+    
     // Setup CKKS cryptocontext
-    CCParams<CryptoContextCKKSRNS> ccParams;
-    ccParams.SetMultiplicativeDepth(params.multDepth);
-    ccParams.SetScalingModSize(50);
-    ccParams.SetRingDim(params.ringDim);
-    ccParams.SetScalingTechnique(FLEXIBLEAUTO);
-    ccParams.SetKeySwitchTechnique(HYBRID);
-    ccParams.SetNumLargeDigits(params.numDigits);
-    ccParams.SetSecurityLevel(params.checkSecurity ? HEStd_128_classic : HEStd_NotSet);
-    
-    CryptoContext<DCRTPoly> cc = GenCryptoContext(ccParams);
-    cc->Enable(PKE);
-    cc->Enable(KEYSWITCH);
-    cc->Enable(LEVELEDSHE);
+    CryptoContext<DCRTPoly> cc = makeCryptoContext(params);
 
     int numSlots = static_cast<int>(cc->GetEncodingParams()->GetBatchSize());
     if (static_cast<int>(matrixDim) > numSlots) {
@@ -57,7 +71,8 @@ int main(int argc, char* argv[]) {
     
     if (debug) {
         std::cout << "=== Single-Hoisted BSGS Method with On-Demand Key Loading ===\n";
-        std::cout << "Actual matrix dimension: " << matrixDim << "×" << matrixDim << "\n";
+        std::cout << "Actual matrix dimension: " << matrixDim << "×" << matrixDim
+                  << " (" << M.kind << ", " << M.nnz() << " nonzeros)\n";
         std::cout << "Number of slots: " << numSlots << "\n";
         std::cout << "Ring dimension: " << params.ringDim << "\n";
         std::cout << "Multiplicative depth: " << params.multDepth << "\n\n";
@@ -66,45 +81,63 @@ int main(int argc, char* argv[]) {
     // Generate key pair
     auto keyPair = cc->KeyGen();
     
-    // CREATE MATRIX AND VECTOR
-    auto M = make_embedded_random_matrix(matrixDim, numSlots);
-    auto inputVec = make_random_input_vector(matrixDim, numSlots);
-
-    // EXTRACT DIAGONALS AND CONVERT TO SIGNED INDEXING
-    if (debug) {
-        std::cout << "Extracting diagonals...\n";
+    // CREATE INPUT VECTORS
+    // One independent input vector per ciphertext of the batch (--batch)
+    std::vector<std::vector<double>> inputVecs(batchSize);
+    for (auto& inputVec : inputVecs) {
+        inputVec = make_random_input_vector(matrixDim, numSlots);
     }
-    
-    // First extract diagonals with regular indexing
-    auto diagonalsUnsigned = extract_generalized_diagonals(M, matrixDim);
-    
-    // Convert to signed indexing
-    std::map<int, std::vector<double>> diagonalsSigned;
-    
-    for (const auto& entry : diagonalsUnsigned) {
-        int kUnsigned = entry.first;
-        int kSigned = normalizeToSignedIndex(kUnsigned, numSlots);
-        diagonalsSigned[kSigned] = entry.second;
+
+    // DIAGONAL INDICES
+    // Only the offsets are scanned here; the diagonals themselves are extracted
+    // on a plaintext cache miss
+    std::vector<int> diagonalIndices;
+    for (int k : diagonal_offsets(M, numSlots)) {
+        // Convert to signed indexing [-numSlots/2, numSlots/2]
+        diagonalIndices.push_back(normalizeToSignedIndex(k, numSlots));
     }
+    std::sort(diagonalIndices.begin(), diagonalIndices.end());
     
-    int numDiagonals = static_cast<int>(diagonalsSigned.size());
+    int numDiagonals = static_cast<int>(diagonalIndices.size());
     if (debug) {
         std::cout << "Found " << numDiagonals << " non-empty diagonals\n";
-        std::cout << "Diagonal indices range from " << diagonalsSigned.begin()->first 
-                  << " to " << diagonalsSigned.rbegin()->first << "\n";
+        std::cout << "Diagonal indices range from " << diagonalIndices.front() 
+                  << " to " << diagonalIndices.back() << "\n";
     }
     
-    // BSGS PARAMETERS
-    int n1 = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(numDiagonals))));
-    
-    if (n1 < 1) n1 = 1;
-    if (n1 > numSlots) n1 = numSlots;
+    // BSGS PARAMETERS (--n1: sqrt of the diagonal count, fixed, or auto-tuned)
+    BsgsPlanner planner(parser, BsgsVariant::SINGLE_HOISTED, batchSize);
+    int n1 = planner.choose(diagonalIndices, numSlots);
     
     int n2_approx = static_cast<int>(std::ceil(static_cast<double>(numSlots) / n1));
     
     if (debug) {
-        std::cout << "BSGS parameters: n1 = " << n1 
-                  << " (based on sqrt(" << numDiagonals << ")), n2 ≈ " << n2_approx << "\n";
+        std::cout << "BSGS parameters: n1 = " << n1 << ", n2 ≈ " << n2_approx
+                  << " (" << planner.split().rotationKeys << " rotation keys, predicted "
+                  << planner.split().predictedNs << " ns per ciphertext)\n";
+    }
+    
+    // DIAGONAL PLAINTEXT CACHE (--ptxt-cache-dir)
+    // On a hit the pre-shifted plaintexts for this n1 are loaded and diagonal
+    // extraction and encoding are skipped
+    DiagonalPlaintextCache ptxtCache(cc, parser, measurement);
+    ptxtCache.describe(matrixHash(M), M.dim(), params, "bsgs-n1-" + std::to_string(n1) + levels.layoutTag());
+    
+    std::map<int, Plaintext> preshiftedDiagonals;
+    bool ptxtCached = ptxtCache.load(preshiftedDiagonals);
+    
+    // EXTRACT DIAGONALS (cache miss only)
+    DiagonalSet diagonals;
+    std::map<int, std::size_t> diagonalOfIndex;  // signed index -> diagonal in the set
+    if (!ptxtCached) {
+        if (debug) {
+            std::cout << "Extracting diagonals...\n";
+        }
+        
+        diagonals = extract_diagonals(M, numSlots);
+        for (std::size_t d = 0; d < diagonals.size(); ++d) {
+            diagonalOfIndex[normalizeToSignedIndex(diagonals.offsets[d], numSlots)] = d;
+        }
     }
     
     // DECOMPOSE DIAGONALS AND PRE-SHIFT
@@ -112,28 +145,27 @@ int main(int argc, char* argv[]) {
         std::cout << "Pre-shifting diagonals for BSGS decomposition...\n";
     }
     
-    std::set<int> usedBabySteps;
-    std::set<int> usedGiantSteps;
-    
-    // Pre-shift each diagonal by its giant step amount
-    std::map<int, Plaintext> preshiftedDiagonals;
+    BsgsSchedule schedule(diagonalIndices, n1);
+    const std::set<int>& usedBabySteps = schedule.babySteps;
+    const std::set<int>& usedGiantSteps = schedule.giantSteps;
+    
+    // Pre-shift and encode the diagonals (cache miss only)
+    if (!ptxtCached) {
+        preshiftedDiagonals = ptxtCache.encode(diagonalIndices, [&](std::size_t n) {
+            // Pre-shift the diagonal by its giant step amount
+            int k = diagonalIndices[n];
+            auto diagonal = rotateVectorDown(diagonals.diagonal(diagonalOfIndex.at(k)), schedule.preRotation(k, numSlots));
+            return cc->MakeCKKSPackedPlaintext(diagonal, 1, levels.computeLevel());
+        });
+    }
     
-    for (const auto& entry : diagonalsSigned) {
-        int k = entry.first;
-        
-        int j = floorDivision(k, n1);
-        int i = k - j * n1;
-        
-        usedBabySteps.insert(i);
-        usedGiantSteps.insert(j);
-        
-        // Pre-shift the diagonal
-        auto diagonal = entry.second;
-        int shiftAmount = (n1 * j) % numSlots;
-        if (shiftAmount < 0) shiftAmount += numSlots;
-        diagonal = rotateVectorDown(diagonal, shiftAmount);
-        
-        preshiftedDiagonals[k] = cc->MakeCKKSPackedPlaintext(diagonal);
+    // --encode-only: the encoding above was the measured kernel
+    if (ptxtCache.encodeOnly()) {
+        measurement.printResults();
+        ptxtCache.printResults();
+        printMatrixResults(M, static_cast<std::size_t>(numDiagonals));
+        planner.printResults();
+        return 0;
     }
     
     if (debug) {
@@ -150,6 +182,9 @@ int main(int argc, char* argv[]) {
         return 1;
     }
     
+    // Rotation keys are saved to and fetched from per-rotation files
+    RotationKeyStore keyStore(cc, tempDir, "hoisted-bsgs-rot-key-", KeyStoreConfig::fromArgs(parser), measurement);
+    
     // GENERATE AND SAVE ROTATION KEYS INDIVIDUALLY
     if (debug) {
         std::cout << "Generating and saving rotation keys individually...\n";
@@ -170,22 +205,16 @@ int main(int argc, char* argv[]) {
         }
     }
     
-    // Generate and save each rotation key separately
-    for (int rot : rotationIndices) {
-        cc->EvalRotateKeyGen(keyPair.secretKey, {rot});
-        
-        std::stringstream filename;
-        filename << "hoisted-bsgs-rot-key-" << rot << ".bin";
-        std::string keyPath = tempDir.getFilePath(filename.str());
-        
-        std::ofstream keyFile(keyPath, std::ios::binary);
-        if (!cc->SerializeEvalAutomorphismKey(keyFile, SerType::BINARY)) {
-            std::cerr << "Failed to save rotation key " << rot << "\n";
-            return 1;
-        }
-        keyFile.close();
-        cc->ClearEvalAutomorphismKeys();
+    // Baby steps are hoisted and keep one copy; giant steps rotate through
+    // keyStore.rotate() and use the per-node copies with --numa-key-replicas
+    keyStore.markHoisted(usedBabySteps);
+    
+    // Generate and save each rotation key separately (or reuse a persisted key set)
+    if (!keyStore.generate(keyPair, rotationIndices, params)) {
+        std::cerr << "Failed to generate rotation keys\n";
+        return 1;
     }
+    KeySizeReport keySizes(parser, cc, keyPair, rotationIndices.size());
     
     if (debug) {
         std::cout << "Generated and saved " << rotationIndices.size() << " rotation keys\n";
@@ -196,176 +225,293 @@ int main(int argc, char* argv[]) {
         std::cout << "Encrypting and serializing input...\n";
     }
     
-    Plaintext inputPtxt = cc->MakeCKKSPackedPlaintext(inputVec);
-    auto inputCipher = cc->Encrypt(keyPair.publicKey, inputPtxt);
+    CiphertextBatch inputCiphers(batchSize);
+    for (uint32_t b = 0; b < batchSize; ++b) {
+        Plaintext inputPtxt = cc->MakeCKKSPackedPlaintext(inputVecs[b]);
+        inputCiphers[b] = cc->Encrypt(keyPair.publicKey, inputPtxt);
+    }
+    levels.toStartLevel(cc, inputCiphers);
     
-    std::string inputPath = tempDir.getFilePath("input.bin");
-    if (!Serial::SerializeToFile(inputPath, inputCipher, SerType::BINARY)) {
-        std::cerr << "Failed to serialize input\n";
-        return 1;
+    // One input file per ciphertext of the batch
+    auto inputPath = [&](uint32_t b) {
+        return tempDir.getFilePath("input-" + std::to_string(b) + ".bin");
+    };
+    for (uint32_t b = 0; b < batchSize; ++b) {
+        if (!Serial::SerializeToFile(inputPath(b), inputCiphers[b], SerType::BINARY)) {
+            std::cerr << "Failed to serialize input\n";
+            return 1;
+        }
     }
     
-    inputCipher.reset();
+    inputCiphers.clear();
 
     // PROFILED HOISTED BSGS COMPUTATION WITH ON-DEMAND KEY LOADING
     if (debug) {
         std::cout << "\nStarting profiled hoisted BSGS computation with on-demand key loading...\n\n";
     }
     
-    // Start DRAM measurement
-    measurement.startDRAM();
+    // Giant steps are processed in sorted order
+    std::vector<int> sortedGiantSteps(usedGiantSteps.begin(), usedGiantSteps.end());
+    std::sort(sortedGiantSteps.begin(), sortedGiantSteps.end());
     
-    // Load input ciphertext
-    Ciphertext<DCRTPoly> cipherInput;
-    if (!Serial::DeserializeFromFile(inputPath, cipherInput, SerType::BINARY)) {
-        std::cerr << "Failed to load input\n";
-        return 1;
+    // Order in which the kernel acquires rotation keys (for --prefetch-depth):
+    // each giant block first uses its new baby steps, then its giant rotation
+    std::vector<int> keySchedule;
+    std::vector<bool> babyScheduled(n1, false);
+    for (int j : sortedGiantSteps) {
+        bool blockEmpty = true;
+        for (int i = 0; i < n1; ++i) {
+            if (!preshiftedDiagonals.count(j * n1 + i)) continue;
+            blockEmpty = false;
+            if (i != 0 && !babyScheduled[i]) {
+                keySchedule.push_back(i);
+                babyScheduled[i] = true;
+            }
+        }
+        if (!blockEmpty && j != 0) keySchedule.push_back(n1 * j);
     }
     
-    // PIN markers around the computation
-    measurement.startPIN();
+    // Warm the key cache (no-op with the default --key-cache-mb=0)
+    keyStore.prefill(rotationIndices);
     
-    // SINGLE-HOISTED BSGS WITH ON-DEMAND KEY LOADING
+    // Start DRAM measurement
+    measurement.startDRAM();
     
-    // Step 1: Precompute rotation digits once (hoisting optimization)
-    if (debug) {
-        std::cout << "Precomputing rotation digits for hoisting...\n";
+    // Open the key store (bundle index and mapping: the cold-start cost)
+    keyStore.open();
+    
+    // Load the batch of input ciphertexts
+    CiphertextBatch cipherInputs(batchSize);
+    {
+        ScopedRegion region(measurement, "deserialize-input");
+        for (uint32_t b = 0; b < batchSize; ++b) {
+            if (!Serial::DeserializeFromFile(inputPath(b), cipherInputs[b], SerType::BINARY)) {
+                std::cerr << "Failed to load input\n";
+                return 1;
+            }
+        }
     }
-    auto precomputedDigits = cc->EvalFastRotationPrecompute(cipherInput);
-    
-    // Step 2: Get cyclotomic order
-    uint32_t cyclotomicOrder = 2 * cc->GetRingDimension();
-    
-    // Step 3: Cache for baby rotations with on-demand computation
-    std::vector<Ciphertext<DCRTPoly>> babyRotationCache(n1);
-    std::vector<bool> babyRotationComputed(n1, false);
-    
-    // Identity rotation is always available
-    babyRotationCache[0] = cipherInput;
-    babyRotationComputed[0] = true;
-    
-    // Helper lambda to get/compute baby rotation with hoisting
-    auto getHoistedBabyRotation = [&](int i) -> const Ciphertext<DCRTPoly>& {
-        if (!babyRotationComputed[i]) {
-            // Load rotation key for this baby step
-            std::stringstream filename;
-            filename << "hoisted-bsgs-rot-key-" << i << ".bin";
-            std::string keyPath = tempDir.getFilePath(filename.str());
+    
+    // PIN markers / repeated timing around the computation
+    CiphertextBatch results(batchSize);
+    measurement.measureKernel([&] {
+        auto inputs = levels.switchDown(cc, measurement, cipherInputs);
+        
+        // SINGLE-HOISTED BSGS WITH ON-DEMAND KEY LOADING
+        // Each rotation key is loaded once and applied to the whole batch
+        
+        // Load upcoming keys in the background (no-op without --prefetch-depth)
+        keyStore.startPrefetch(keySchedule);
+        
+        // Step 1: Precompute rotation digits once per ciphertext (hoisting optimization)
+        if (debug) {
+            std::cout << "Precomputing rotation digits for hoisting...\n";
+        }
+        std::vector<std::shared_ptr<std::vector<DCRTPoly>>> precomputedDigits(batchSize);
+        {
+            ScopedRegion region(measurement, "hoist-precompute");
+            forEachInBatch(batchSize, [&](std::size_t b) {
+                precomputedDigits[b] = cc->EvalFastRotationPrecompute(inputs[b]);
+            });
+        }
+        
+        // Step 2: Get cyclotomic order
+        uint32_t cyclotomicOrder = 2 * cc->GetRingDimension();
+        
+        // Step 3: Cache for baby rotations with on-demand computation
+        std::vector<CiphertextBatch> babyRotationCache(n1);
+        std::vector<bool> babyRotationComputed(n1, false);
+        
+        // Identity rotation is always available
+        babyRotationCache[0] = inputs;
+        babyRotationComputed[0] = true;
+        
+        // Helper lambda to get/compute baby rotation with hoisting
+        auto getHoistedBabyRotation = [&](int i) -> const CiphertextBatch& {
+            if (!babyRotationComputed[i]) {
+                // Fetch rotation key for this baby step (cached or from disk)
+                keyStore.acquire(i);
+                
+                // Compute rotation using hoisting
+                babyRotationCache[i].resize(batchSize);
+                {
+                    ScopedRegion region(measurement, "rotate");
+                    forEachInBatch(batchSize, [&](std::size_t b) {
+                        babyRotationCache[i][b] =
+                            cc->EvalFastRotation(inputs[b], i, cyclotomicOrder, precomputedDigits[b]);
+                    });
+                }
+                
+                // Release the key (stays resident if it fits the cache budget)
+                keyStore.release(i);
+                babyRotationComputed[i] = true;
+            }
+            return babyRotationCache[i];
+        };
+        
+        // Step 4: Process giant steps in sorted order
+        bool first = true;
+        
+        // --reduction=tree: rotated giant blocks, summed after the last one
+        std::vector<CiphertextBatch> giantSums;
+        
+        for (int j : sortedGiantSteps) {
+            // Accumulate all baby steps for this giant block
+            CiphertextBatch giantBlockSum(batchSize);
+            bool giantBlockFirst = true;
+            PartialProducts products;
             
-            std::ifstream keyFile(keyPath, std::ios::binary);
-            if (!cc->DeserializeEvalAutomorphismKey(keyFile, SerType::BINARY)) {
-                std::cerr << "Failed to load key for baby step " << i << "\n";
-                throw std::runtime_error("Missing rotation key");
+            // Check all possible baby steps for this giant block
+            for (int i = 0; i < n1; ++i) {
+                // Reconstruct the signed diagonal index
+                int k = j * n1 + i;
+                
+                // Check if this diagonal exists
+                auto diagIter = preshiftedDiagonals.find(k);
+                if (diagIter == preshiftedDiagonals.end()) continue;
+                
+                // Get baby rotation (identity or compute with hoisting)
+                const auto& babyRotated = getHoistedBabyRotation(i);
+                
+                if (treeReduction) {
+                    products.add(babyRotated, diagIter->second);
+                    continue;
+                }
+                
+                // Multiply with pre-shifted diagonal
+                CiphertextBatch partial(batchSize);
+                {
+                    ScopedRegion region(measurement, "ptxt-mult");
+                    forEachInBatch(batchSize, [&](std::size_t b) {
+                        partial[b] = cc->EvalMult(babyRotated[b], diagIter->second);
+                    });
+                }
+                
+                // Accumulate within giant block
+                if (giantBlockFirst) {
+                    giantBlockSum = partial;
+                    giantBlockFirst = false;
+                } else if (params.manualRescale()) {
+                    // Raw products, added in place at scale Δ²
+                    ScopedRegion region(measurement, "accumulate");
+                    forEachInBatch(batchSize, [&](std::size_t b) {
+                        cc->EvalAddInPlace(giantBlockSum[b], partial[b]);
+                    });
+                } else {
+                    ScopedRegion region(measurement, "accumulate");
+                    forEachInBatch(batchSize, [&](std::size_t b) {
+                        giantBlockSum[b] = cc->EvalAdd(giantBlockSum[b], partial[b]);
+                    });
+                }
             }
-            keyFile.close();
             
-            // Compute rotation using hoisting
-            babyRotationCache[i] = cc->EvalFastRotation(cipherInput, i, cyclotomicOrder, precomputedDigits);
+            if (!products.empty()) {
+                giantBlockSum = products.sum(cc, measurement);
+                giantBlockFirst = false;
+            }
             
-            // Clear the key immediately after use
-            cc->ClearEvalAutomorphismKeys();
-            babyRotationComputed[i] = true;
-        }
-        return babyRotationCache[i];
-    };
-    
-    // Step 4: Process giant steps in sorted order
-    std::vector<int> sortedGiantSteps(usedGiantSteps.begin(), usedGiantSteps.end());
-    std::sort(sortedGiantSteps.begin(), sortedGiantSteps.end());
-    
-    Ciphertext<DCRTPoly> result;
-    bool first = true;
-    
-    for (int j : sortedGiantSteps) {
-        // Accumulate all baby steps for this giant block
-        Ciphertext<DCRTPoly> giantBlockSum;
-        bool giantBlockFirst = true;
-        
-        // Check all possible baby steps for this giant block
-        for (int i = 0; i < n1; ++i) {
-            // Reconstruct the signed diagonal index
-            int k = j * n1 + i;
+            // Skip if block is empty
+            if (giantBlockFirst) continue;
             
-            // Check if this diagonal exists
-            auto diagIter = preshiftedDiagonals.find(k);
-            if (diagIter == preshiftedDiagonals.end()) continue;
+            // FIXEDMANUAL: one rescale per giant block, ahead of its rotation
+            if (params.manualRescale() && !rescaleAtEnd) {
+                rescaleBatch(cc, measurement, giantBlockSum);
+            }
             
-            // Get baby rotation (identity or compute with hoisting)
-            const auto& babyRotated = (i == 0) ? cipherInput : getHoistedBabyRotation(i);
+            // Apply giant rotation if j ≠ 0 (load key on-demand)
+            if (j != 0) {
+                int giantRotation = n1 * j;
+                
+                // Fetch rotation key for this giant step (cached or from disk)
+                keyStore.acquire(giantRotation);
+                
+                // Note: Giant steps use regular rotation (not hoisted)
+                {
+                    ScopedRegion region(measurement, "rotate");
+                    forEachInBatch(batchSize, [&](std::size_t b) {
+                        giantBlockSum[b] = keyStore.rotate(giantBlockSum[b], giantRotation);
+                    });
+                }
+                
+                // Release the key (stays resident if it fits the cache budget)
+                keyStore.release(giantRotation);
+            }
             
-            // Multiply with pre-shifted diagonal
-            auto partial = cc->EvalMult(babyRotated, diagIter->second);
+            if (treeReduction) {
+                giantSums.push_back(giantBlockSum);
+                continue;
+            }
             
-            // Accumulate within giant block
-            if (giantBlockFirst) {
-                giantBlockSum = partial;
-                giantBlockFirst = false;
+            // Add to result
+            if (first) {
+                results = giantBlockSum;
+                first = false;
             } else {
-                giantBlockSum = cc->EvalAdd(giantBlockSum, partial);
+                ScopedRegion region(measurement, "accumulate");
+                forEachInBatch(batchSize, [&](std::size_t b) {
+                    results[b] = cc->EvalAdd(results[b], giantBlockSum[b]);
+                });
             }
         }
         
-        // Skip if block is empty
-        if (giantBlockFirst) continue;
+        if (!giantSums.empty()) {
+            ScopedRegion region(measurement, "accumulate");
+            treeReduce(cc, giantSums);
+            results = giantSums[0];
+        }
         
-        // Apply giant rotation if j ≠ 0 (load key on-demand)
-        if (j != 0) {
-            int giantRotation = n1 * j;
-            
-            // Load rotation key for this giant step
-            std::stringstream filename;
-            filename << "hoisted-bsgs-rot-key-" << giantRotation << ".bin";
-            std::string keyPath = tempDir.getFilePath(filename.str());
-            
-            std::ifstream keyFile(keyPath, std::ios::binary);
-            if (!cc->DeserializeEvalAutomorphismKey(keyFile, SerType::BINARY)) {
-                std::cerr << "Failed to load key for giant step " << giantRotation << "\n";
-                return 1;
-            }
-            keyFile.close();
-            
-            // Note: Giant steps use regular rotation (not hoisted)
-            giantBlockSum = cc->EvalRotate(giantBlockSum, giantRotation);
-            
-            // Clear the key immediately after use
-            cc->ClearEvalAutomorphismKeys();
+        // FIXEDMANUAL with --rescale=end: a single rescale of the result
+        if (params.manualRescale() && rescaleAtEnd) {
+            rescaleBatch(cc, measurement, results);
         }
         
-        // Add to result
-        if (first) {
-            result = giantBlockSum;
-            first = false;
-        } else {
-            result = cc->EvalAdd(result, giantBlockSum);
+        keyStore.finishPrefetch();
+    });
+    
+    // Save results
+    {
+        ScopedRegion region(measurement, "serialize-result");
+        for (uint32_t b = 0; b < batchSize; ++b) {
+            std::string resultPath = tempDir.getFilePath("result-" + std::to_string(b) + ".bin");
+            if (!Serial::SerializeToFile(resultPath, results[b], SerType::BINARY)) {
+                std::cerr << "Failed to save result\n";
+                return 1;
+            }
         }
     }
     
-    measurement.endPIN();
-    
-    // Save result
-    std::string resultPath = tempDir.getFilePath("result.bin");
-    if (!Serial::SerializeToFile(resultPath, result, SerType::BINARY)) {
-        std::cerr << "Failed to save result\n";
-        return 1;
-    }
-    
     // Stop DRAM measurement
     measurement.stopDRAM();
     
     // Print measurement results
     measurement.printResults();
+    levels.printResults();
+    keyStore.printResults();
+    if (!rotationIndices.empty()) {
+        auto [sampleKey, sampleBytes] = keyStore.sampleKey(*rotationIndices.begin());
+        keySizes.measureRotation(sampleKey, sampleBytes);
+    }
+    keySizes.printResults();
+    ptxtCache.printResults();
+    printMatrixResults(M, static_cast<std::size_t>(numDiagonals));
+    planner.printResults();
     
     // Always verify
     if (debug) {
         std::cout << "\nDecrypting and verifying result...\n";
     }
     
-    Plaintext resultPtxt;
-    cc->Decrypt(keyPair.secretKey, result, &resultPtxt);
-    resultPtxt->SetLength(numSlots);
-    
-    auto resultVec = resultPtxt->GetRealPackedValue();
-    
-    // Verify and return exit code
-    return verify_matrix_vector_result(resultVec, M, inputVec, matrixDim, debug) ? 0 : 1;
-}
\ No newline at end of file
+    // Verify every ciphertext of the batch and return exit code
+    bool allCorrect = true;
+    for (uint32_t b = 0; b < batchSize; ++b) {
+        Plaintext resultPtxt;
+        cc->Decrypt(keyPair.secretKey, results[b], &resultPtxt);
+        resultPtxt->SetLength(numSlots);
+        
+        auto resultVec = resultPtxt->GetRealPackedValue();
+        allCorrect = verify_matrix_vector_result(resultVec, M, inputVecs[b], debug) && allCorrect;
+    }
+    return allCorrect ? 0 : 1;
+}
+
+BENCHMARK_KERNEL("single-hoisted-bsgs-diagonal-method", runSingleHoistedBsgsDiagonal);
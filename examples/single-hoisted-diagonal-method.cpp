@@ -17,35 +17,54 @@
 
 using namespace lbcrypto;
 
-int main(int argc, char* argv[]) {
+static int runSingleHoistedDiagonal(int argc, char* argv[]) {
     // Parse arguments
     ArgParser parser;
     parser.parse(argc, argv);
     
     // Get parameters
     bool debug = parser.getDebug();
-    std::size_t matrixDim = static_cast<std::size_t>(parser.getUInt32("matrix-dim", 128));
+    uint32_t batchSize = std::max<uint32_t>(1, parser.getUInt32("batch", 1));
+    bool treeReduction = parser.getString("reduction", "fold") == "tree";  // --reduction=fold|tree
     setupThreads(parser);
     
-    MeasurementMode mode = parser.getMeasurementMode();
-    MeasurementSystem measurement(mode);
+    // Hoisted rotations all start from the input's digits, so a compact key
+    // basis (--key-basis) cannot compose them
+    if (parser.getString("key-basis", "full") != "full") {
+        std::cerr << "Error: --key-basis requires non-hoisted rotations\n";
+        return 1;
+    }
+    
+    // EvalFastRotation reads the context's keys, never rotate()'s per-node copies
+    if (numaConfig().keyReplicas) {
+        std::cerr << "Error: --numa-key-replicas requires non-hoisted rotations\n";
+        return 1;
+    }
+    
+    // Matrix (--matrix-kind; --matrix-dim unless loaded from --matrix-file)
+    BenchmarkMatrix M;
+    try {
+        M = make_benchmark_matrix(parser);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    std::size_t matrixDim = M.dim();
+    
+    MeasurementSystem measurement(parser);
+    measurement.setBatchSize(batchSize);
     
     BenchmarkParams params = BenchmarkParams::fromArgs(parser);
     
+    // --start-level / --mod-switch=min (the plaintext products need one level)
+    LevelControl levels(parser, params, 1);
+    if (!levels.check().empty()) {
+        std::cerr << "Error: " << levels.check() << "\n";
+        return 1;
+    }
+    
     // Setup CKKS cryptocontext
-    CCParams<CryptoContextCKKSRNS> ccParams;
-    ccParams.SetMultiplicativeDepth(params.multDepth);
-    ccParams.SetScalingModSize(50);
-    ccParams.SetRingDim(params.ringDim);
-    ccParams.SetScalingTechnique(FLEXIBLEAUTO);
-    ccParams.SetKeySwitchTechnique(HYBRID);
-    ccParams.SetNumLargeDigits(params.numDigits);
-    ccParams.SetSecurityLevel(params.checkSecurity ? HEStd_128_classic : HEStd_NotSet);
-    
-    CryptoContext<DCRTPoly> cc = GenCryptoContext(ccParams);
-    cc->Enable(PKE);
-    cc->Enable(KEYSWITCH);
-    cc->Enable(LEVELEDSHE);
+    CryptoContext<DCRTPoly> cc = makeCryptoContext(params);
 
     uint32_t numSlots = cc->GetEncodingParams()->GetBatchSize();
     if (matrixDim > numSlots) {
@@ -55,7 +74,8 @@ int main(int argc, char* argv[]) {
     
     if (debug) {
         std::cout << "=== Single-Hoisted Diagonal Method for Matrix-Vector Multiplication ===\n";
-        std::cout << "Actual matrix dimension: " << matrixDim << "×" << matrixDim << "\n";
+        std::cout << "Actual matrix dimension: " << matrixDim << "×" << matrixDim
+                  << " (" << M.kind << ", " << M.nnz() << " nonzeros)\n";
         std::cout << "Number of slots: " << numSlots << "\n";
         std::cout << "Ring dimension: " << params.ringDim << "\n";
         std::cout << "Multiplicative depth: " << params.multDepth << "\n\n";
@@ -64,34 +84,56 @@ int main(int argc, char* argv[]) {
     // Generate key pair
     auto keyPair = cc->KeyGen();
     
-    // Create embedded random matrix and input vector
-    auto M = make_embedded_random_matrix(matrixDim, numSlots);
-    auto inputVec = make_random_input_vector(matrixDim, numSlots);
+    // One independent input vector per ciphertext of the batch (--batch)
+    std::vector<std::vector<double>> inputVecs(batchSize);
+    for (auto& inputVec : inputVecs) {
+        inputVec = make_random_input_vector(matrixDim, numSlots);
+    }
 
-    // Extract all non-empty diagonals
-    auto diagonals = extract_generalized_diagonals(M, matrixDim);
+    // Diagonal plaintexts: loaded from --ptxt-cache-dir, or extracted and encoded
+    DiagonalPlaintextCache ptxtCache(cc, parser, measurement);
+    ptxtCache.describe(matrixHash(M), M.dim(), params, "diagonal" + levels.layoutTag());
+    
+    std::map<int, Plaintext> diagonalPlaintexts;
+    if (!ptxtCache.load(diagonalPlaintexts)) {
+        if (debug) {
+            std::cout << "Extracting diagonals...\n";
+        }
+        
+        // Extract all non-empty diagonals and encode them as plaintexts
+        auto diagonals = extract_diagonals(M, numSlots);
+        diagonalPlaintexts = ptxtCache.encode(diagonals.offsets, [&](std::size_t d) {
+            return cc->MakeCKKSPackedPlaintext(diagonals.diagonal(d), 1, levels.computeLevel());
+        });
+    }
+    
+    // --encode-only: the encoding above was the measured kernel
+    if (ptxtCache.encodeOnly()) {
+        measurement.printResults();
+        ptxtCache.printResults();
+        printMatrixResults(M, diagonalPlaintexts.size());
+        return 0;
+    }
     
     if (debug) {
-        std::cout << "Extracting diagonals...\n";
-        std::cout << "Found " << diagonals.size() << " non-empty diagonals\n";
+        std::cout << "Found " << diagonalPlaintexts.size() << " non-empty diagonals\n";
     }
     
     // Build parallel vectors for efficient access during computation
     std::vector<int32_t> rotationIndexList;
     std::vector<Plaintext> diagonalPlaintextList;
     
-    rotationIndexList.reserve(diagonals.size());
-    diagonalPlaintextList.reserve(diagonals.size());
+    rotationIndexList.reserve(diagonalPlaintexts.size());
+    diagonalPlaintextList.reserve(diagonalPlaintexts.size());
     
     // Also track which rotations we actually need (skip k=0)
     std::vector<int32_t> rotationsNeeded;
     
-    for (const auto& entry : diagonals) {
+    for (const auto& entry : diagonalPlaintexts) {
         int k = entry.first;
-        const auto& diag = entry.second;
         
         rotationIndexList.push_back(k);
-        diagonalPlaintextList.push_back(cc->MakeCKKSPackedPlaintext(diag));
+        diagonalPlaintextList.push_back(entry.second);
         
         if (k != 0) {
             rotationsNeeded.push_back(k);
@@ -105,29 +147,18 @@ int main(int argc, char* argv[]) {
         return 1;
     }
     
+    // Rotation keys are saved to and fetched from per-rotation files
+    RotationKeyStore keyStore(cc, tempDir, "rotation-key-k", KeyStoreConfig::fromArgs(parser), measurement);
+    
     // Generate and save rotation keys individually
     if (debug) {
         std::cout << "Generating and saving " << rotationsNeeded.size() << " rotation keys individually...\n";
     }
     
-    for (int32_t k : rotationsNeeded) {
-        // Generate key for this specific rotation
-        cc->EvalRotateKeyGen(keyPair.secretKey, {k});
-        
-        // Save with descriptive filename
-        std::stringstream filename;
-        filename << "rotation-key-k" << k << ".bin";
-        std::string keyPath = tempDir.getFilePath(filename.str());
-        
-        std::ofstream keyFile(keyPath, std::ios::binary);
-        if (!cc->SerializeEvalAutomorphismKey(keyFile, SerType::BINARY)) {
-            std::cerr << "Failed to serialize rotation key for k=" << k << "\n";
-            return 1;
-        }
-        keyFile.close();
-        
-        // Clear the key from memory immediately after saving
-        cc->ClearEvalAutomorphismKeys();
+    // Generate and save each rotation key separately (or reuse a persisted key set)
+    if (!keyStore.generate(keyPair, rotationsNeeded, params)) {
+        std::cerr << "Failed to generate rotation keys\n";
+        return 1;
     }
     
     if (debug) {
@@ -135,21 +166,30 @@ int main(int argc, char* argv[]) {
     }
     
     // Encrypt input vector
-    Plaintext inputPtxt = cc->MakeCKKSPackedPlaintext(inputVec);
-    auto inputCipher = cc->Encrypt(keyPair.publicKey, inputPtxt);
+    CiphertextBatch inputCiphers(batchSize);
+    for (uint32_t b = 0; b < batchSize; ++b) {
+        Plaintext inputPtxt = cc->MakeCKKSPackedPlaintext(inputVecs[b]);
+        inputCiphers[b] = cc->Encrypt(keyPair.publicKey, inputPtxt);
+    }
+    levels.toStartLevel(cc, inputCiphers);
 
     // Serialize input
     if (debug) {
         std::cout << "Serializing input...\n";
     }
     
-    std::string inputPath = tempDir.getFilePath("input.bin");
-    if (!Serial::SerializeToFile(inputPath, inputCipher, SerType::BINARY)) {
-        std::cerr << "Failed to serialize input\n";
-        return 1;
+    // One input file per ciphertext of the batch
+    auto inputPath = [&](uint32_t b) {
+        return tempDir.getFilePath("input-" + std::to_string(b) + ".bin");
+    };
+    for (uint32_t b = 0; b < batchSize; ++b) {
+        if (!Serial::SerializeToFile(inputPath(b), inputCiphers[b], SerType::BINARY)) {
+            std::cerr << "Failed to serialize input\n";
+            return 1;
+        }
     }
     
-    inputCipher.reset();
+    inputCiphers.clear();
 
     // PROFILED HOISTED DIAGONAL METHOD COMPUTATION
     
@@ -158,81 +198,122 @@ int main(int argc, char* argv[]) {
         std::cout << "Will load rotation keys on-demand during computation...\n\n";
     }
     
+    // Warm the key cache (no-op with the default --key-cache-mb=0)
+    keyStore.prefill(rotationsNeeded);
+    
     // Start DRAM measurement
     measurement.startDRAM();
     
-    // Load input
-    Ciphertext<DCRTPoly> cipherInput;
-    if (!Serial::DeserializeFromFile(inputPath, cipherInput, SerType::BINARY)) {
-        std::cerr << "Failed to load input\n";
-        return 1;
-    }
-    
-    // PIN markers around the computation
-    measurement.startPIN();
+    // Open the key store (bundle index and mapping: the cold-start cost)
+    keyStore.open();
     
-    // SINGLE-HOISTED DIAGONAL METHOD WITH ON-DEMAND KEY LOADING
-    // Step 1: Precompute rotation digits once (hoisting optimization)
-    if (debug) {
-        std::cout << "Precomputing rotation digits for hoisting...\n";
+    // Load the batch of input ciphertexts
+    CiphertextBatch cipherInputs(batchSize);
+    {
+        ScopedRegion region(measurement, "deserialize-input");
+        for (uint32_t b = 0; b < batchSize; ++b) {
+            if (!Serial::DeserializeFromFile(inputPath(b), cipherInputs[b], SerType::BINARY)) {
+                std::cerr << "Failed to load input\n";
+                return 1;
+            }
+        }
     }
-    auto precomputedDigits = cc->EvalFastRotationPrecompute(cipherInput);
-    
-    // Step 2: Get cyclotomic order (needed by EvalFastRotation)
-    uint32_t cyclotomicOrder = 2 * cc->GetRingDimension();
     
-    // Step 3: Compute result = sum_k diag_k * rotate(input, k)
-    Ciphertext<DCRTPoly> result;
-    bool first = true;
-    
-    for (std::size_t idx = 0; idx < rotationIndexList.size(); ++idx) {
-        int32_t k = rotationIndexList[idx];
-        const Plaintext& diagonalPtxt = diagonalPlaintextList[idx];
+    // PIN markers / repeated timing around the computation
+    CiphertextBatch results(batchSize);
+    measurement.measureKernel([&] {
+        auto inputs = levels.switchDown(cc, measurement, cipherInputs);
+        
+        // SINGLE-HOISTED DIAGONAL METHOD WITH ON-DEMAND KEY LOADING
+        // Each rotation key is loaded once and applied to the whole batch
         
-        Ciphertext<DCRTPoly> rotated;
+        // Step 1: Precompute rotation digits once per ciphertext (hoisting optimization)
+        if (debug) {
+            std::cout << "Precomputing rotation digits for hoisting...\n";
+        }
+        std::vector<std::shared_ptr<std::vector<DCRTPoly>>> precomputedDigits(batchSize);
+        {
+            ScopedRegion region(measurement, "hoist-precompute");
+            forEachInBatch(batchSize, [&](std::size_t b) {
+                precomputedDigits[b] = cc->EvalFastRotationPrecompute(inputs[b]);
+            });
+        }
+        
+        // Step 2: Get cyclotomic order (needed by EvalFastRotation)
+        uint32_t cyclotomicOrder = 2 * cc->GetRingDimension();
+        
+        // Step 3: Compute result = sum_k diag_k * rotate(input, k)
+        bool first = true;
         
-        if (k == 0) {
-            // No rotation needed for main diagonal
-            rotated = cipherInput;
-        } else {
-            // Load the specific rotation key for this k value
-            std::stringstream filename;
-            filename << "rotation-key-k" << k << ".bin";
-            std::string keyPath = tempDir.getFilePath(filename.str());
+        // --reduction=tree: products are formed and summed after the rotations
+        PartialProducts products;
+        
+        for (std::size_t idx = 0; idx < rotationIndexList.size(); ++idx) {
+            int32_t k = rotationIndexList[idx];
+            const Plaintext& diagonalPtxt = diagonalPlaintextList[idx];
             
-            std::ifstream keyFile(keyPath, std::ios::binary);
-            if (!cc->DeserializeEvalAutomorphismKey(keyFile, SerType::BINARY)) {
-                std::cerr << "Failed to load rotation key for k=" << k << "\n";
-                return 1;
+            CiphertextBatch rotated(batchSize);
+            
+            if (k == 0) {
+                // No rotation needed for main diagonal
+                rotated = inputs;
+            } else {
+                // Fetch the rotation key for this k value (cached or from disk)
+                keyStore.acquire(k);
+                
+                // Use fast rotation with precomputed digits and loaded key
+                {
+                    ScopedRegion region(measurement, "rotate");
+                    forEachInBatch(batchSize, [&](std::size_t b) {
+                        rotated[b] = cc->EvalFastRotation(inputs[b], k, cyclotomicOrder, precomputedDigits[b]);
+                    });
+                }
+                
+                // Release the key (stays resident if it fits the cache budget)
+                keyStore.release(k);
+            }
+            
+            if (treeReduction) {
+                products.add(rotated, diagonalPtxt);
+                continue;
             }
-            keyFile.close();
             
-            // Use fast rotation with precomputed digits and loaded key
-            rotated = cc->EvalFastRotation(cipherInput, k, cyclotomicOrder, precomputedDigits);
+            // Multiply by k-th diagonal
+            CiphertextBatch partial(batchSize);
+            {
+                ScopedRegion region(measurement, "ptxt-mult");
+                forEachInBatch(batchSize, [&](std::size_t b) {
+                    partial[b] = cc->EvalMult(rotated[b], diagonalPtxt);
+                });
+            }
             
-            // Clear the key from memory after use
-            cc->ClearEvalAutomorphismKeys();
+            // Accumulate
+            if (first) {
+                results = partial;
+                first = false;
+            } else {
+                ScopedRegion region(measurement, "accumulate");
+                forEachInBatch(batchSize, [&](std::size_t b) {
+                    results[b] = cc->EvalAdd(results[b], partial[b]);
+                });
+            }
         }
         
-        // Multiply by k-th diagonal
-        auto partial = cc->EvalMult(rotated, diagonalPtxt);
-        
-        // Accumulate
-        if (first) {
-            result = partial;
-            first = false;
-        } else {
-            result = cc->EvalAdd(result, partial);
+        if (!products.empty()) {
+            results = products.sum(cc, measurement);
+        }
+    });
+    
+    // Save results
+    {
+        ScopedRegion region(measurement, "serialize-result");
+        for (uint32_t b = 0; b < batchSize; ++b) {
+            std::string resultPath = tempDir.getFilePath("result-" + std::to_string(b) + ".bin");
+            if (!Serial::SerializeToFile(resultPath, results[b], SerType::BINARY)) {
+                std::cerr << "Failed to save result\n";
+                return 1;
+            }
         }
-    }
-    
-    measurement.endPIN();
-    
-    // Save result
-    std::string resultPath = tempDir.getFilePath("result.bin");
-    if (!Serial::SerializeToFile(resultPath, result, SerType::BINARY)) {
-        std::cerr << "Failed to save result\n";
-        return 1;
     }
     
     // Stop DRAM measurement
@@ -240,18 +321,27 @@ int main(int argc, char* argv[]) {
     
     // Print measurement results
     measurement.printResults();
+    levels.printResults();
+    keyStore.printResults();
+    ptxtCache.printResults();
+    printMatrixResults(M, diagonalPlaintexts.size());
     
     // Always verify
     if (debug) {
         std::cout << "\nDecrypting and verifying result...\n";
     }
     
-    Plaintext resultPtxt;
-    cc->Decrypt(keyPair.secretKey, result, &resultPtxt);
-    resultPtxt->SetLength(numSlots);
-    
-    auto resultVec = resultPtxt->GetRealPackedValue();
-    
-    // Verify and return exit code
-    return verify_matrix_vector_result(resultVec, M, inputVec, matrixDim, debug) ? 0 : 1;
-}
\ No newline at end of file
+    // Verify every ciphertext of the batch and return exit code
+    bool allCorrect = true;
+    for (uint32_t b = 0; b < batchSize; ++b) {
+        Plaintext resultPtxt;
+        cc->Decrypt(keyPair.secretKey, results[b], &resultPtxt);
+        resultPtxt->SetLength(numSlots);
+        
+        auto resultVec = resultPtxt->GetRealPackedValue();
+        allCorrect = verify_matrix_vector_result(resultVec, M, inputVecs[b], debug) && allCorrect;
+    }
+    return allCorrect ? 0 : 1;
+}
+
+BENCHMARK_KERNEL("single-hoisted-diagonal-method", runSingleHoistedDiagonal);
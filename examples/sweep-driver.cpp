@@ -0,0 +1,265 @@
+// examples/sweep-driver.cpp - Single-process parameter sweep of the matrix-vector kernels
+// Every (ring-dim, limbs, digits) point builds its CryptoContext and key pair once;
+// rotation keys accumulate across matrix-dim points, so each point only generates
+// the rotations it adds. Keys stay resident (no per-rotation loads) and one results
+// row per (ring-dim, limbs, digits, matrix-dim, threads) point is streamed as CSV
+// or JSON lines.
+#include <openfhe.h>
+#include "utils.hpp"
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include <map>
+#include <set>
+#include <sstream>
+#include <chrono>
+
+using namespace lbcrypto;
+
+// Encoded diagonals and rotation plan of one matrix for one kernel
+struct KernelPlan {
+    int n1 = 0;                                   // bsgs only
+    BsgsSchedule schedule{{}, 1};                 // bsgs only
+    std::map<int, Plaintext> diagonals;           // signed index -> plaintext (pre-rotated for bsgs)
+    std::set<int> rotations;                      // keys the kernel needs
+};
+
+static KernelPlan planDiagonal(const CryptoContext<DCRTPoly>& cc, const DenseMatrix& M, int numSlots) {
+    KernelPlan plan;
+    auto diagonals = extract_diagonals(M, numSlots);
+    for (std::size_t d = 0; d < diagonals.size(); ++d) {
+        int k = diagonals.offsets[d];
+        plan.diagonals[k] = cc->MakeCKKSPackedPlaintext(diagonals.diagonal(d));
+        if (k != 0) plan.rotations.insert(k);
+    }
+    return plan;
+}
+
+static KernelPlan planBsgs(const CryptoContext<DCRTPoly>& cc, const ArgParser& parser, const DenseMatrix& M, int numSlots) {
+    KernelPlan plan;
+    auto diagonals = extract_diagonals(M, numSlots);
+    
+    std::vector<int> indices;
+    std::map<int, std::size_t> diagonalOfIndex;
+    for (std::size_t d = 0; d < diagonals.size(); ++d) {
+        int k = normalizeToSignedIndex(diagonals.offsets[d], numSlots);
+        indices.push_back(k);
+        diagonalOfIndex[k] = d;
+    }
+    std::sort(indices.begin(), indices.end());
+    
+    BsgsPlanner planner(parser, BsgsVariant::PLAIN, 1);
+    plan.n1 = planner.choose(indices, numSlots);
+    plan.schedule = BsgsSchedule(indices, plan.n1);
+    
+    for (int k : indices) {
+        plan.diagonals[k] = cc->MakeCKKSPackedPlaintext(
+            rotateVectorDown(diagonals.diagonal(diagonalOfIndex.at(k)), plan.schedule.preRotation(k, numSlots)));
+    }
+    
+    for (int i : plan.schedule.babySteps) {
+        if (i != 0) plan.rotations.insert(i);
+    }
+    for (int j : plan.schedule.giantSteps) {
+        if (j != 0) plan.rotations.insert(plan.n1 * j);
+    }
+    return plan;
+}
+
+// result = sum_k diag_k * rotate(input, k)
+static Ciphertext<DCRTPoly> runDiagonal(const CryptoContext<DCRTPoly>& cc, const KernelPlan& plan,
+                                        const Ciphertext<DCRTPoly>& input) {
+    Ciphertext<DCRTPoly> result;
+    for (const auto& [k, diagonal] : plan.diagonals) {
+        auto rotated = (k == 0) ? input : cc->EvalRotate(input, k);
+        auto partial = cc->EvalMult(rotated, diagonal);
+        result = result ? cc->EvalAdd(result, partial) : partial;
+    }
+    return result;
+}
+
+// The plain BSGS kernel of bsgs-diagonal-method (keys resident in the context)
+static Ciphertext<DCRTPoly> runBsgs(const CryptoContext<DCRTPoly>& cc, const BenchmarkParams& params,
+                                    const KernelPlan& plan, const Ciphertext<DCRTPoly>& input) {
+    return evaluateBsgs(cc, params, plan.schedule, plan.diagonals, input,
+                        [&](const Ciphertext<DCRTPoly>& ct, int rotation) { return cc->EvalRotate(ct, rotation); });
+}
+
+static int runSweepDriver(int argc, char* argv[]) {
+    // Parse arguments
+    ArgParser parser;
+    parser.parse(argc, argv);
+    
+    // Get parameters
+    bool debug = parser.getDebug();
+    std::string method = parser.getString("method", "bsgs");  // bsgs | diagonal
+    std::string format = parser.getString("format", "csv");   // csv | json
+    uint32_t warmupRuns = parser.getUInt32("warmup", 1);
+    uint32_t timedRuns = std::max<uint32_t>(1, parser.getUInt32("repetitions", 5));
+    uint32_t matrixSeed = parser.getUInt32("matrix-seed", 0);
+    
+    // Grid
+    std::vector<uint32_t> ringDims, limbCounts, digitCounts, matrixDims, threadCounts;
+    try {
+        ringDims = parseCommaList<uint32_t>(parser.getString("ring-dims", "8192"));
+        limbCounts = parseCommaList<uint32_t>(parser.getString("limbs", "2"));
+        digitCounts = parseCommaList<uint32_t>(parser.getString("digits", "1"));
+        matrixDims = parseCommaList<uint32_t>(parser.getString("matrix-dims", "128"));
+        threadCounts = parseCommaList<uint32_t>(parser.getString("thread-counts", std::to_string(omp_get_max_threads())));
+    } catch (const std::exception& e) {
+        std::cerr << "Error: invalid grid list (" << e.what() << ")\n";
+        return 1;
+    }
+    if (method != "bsgs" && method != "diagonal") {
+        std::cerr << "Error: unknown --method " << method << " (bsgs or diagonal)\n";
+        return 1;
+    }
+    if (ringDims.empty() || limbCounts.empty() || digitCounts.empty() || matrixDims.empty() || threadCounts.empty()) {
+        std::cerr << "Error: every grid dimension needs at least one value\n";
+        return 1;
+    }
+    // The diagonal products consume one level, so every point needs two limbs
+    if (*std::min_element(limbCounts.begin(), limbCounts.end()) < 2) {
+        std::cerr << "Error: --limbs values must be >= 2\n";
+        return 1;
+    }
+    
+    // Results stream: stdout, or --output=<path>
+    std::ofstream outputFile;
+    std::string outputPath = parser.getString("output");
+    if (!outputPath.empty()) {
+        outputFile.open(outputPath);
+        if (!outputFile) {
+            std::cerr << "Error: cannot open " << outputPath << "\n";
+            return 1;
+        }
+    }
+    std::ostream& out = outputPath.empty() ? std::cout : outputFile;
+    
+    if (format == "csv") {
+        out << "method,ring_dim,num_limbs,num_digits,matrix_dim,threads,n1,diagonals,rotation_keys,"
+               "new_keys,context_ms,keygen_ms,latency_min_ns,latency_median_ns,latency_p99_ns,verified\n";
+    }
+    
+    BenchmarkParams baseParams = BenchmarkParams::fromArgs(parser);
+    bool allVerified = true;
+    
+    for (uint32_t ringDim : ringDims) {
+        for (uint32_t limbs : limbCounts) {
+            for (uint32_t digits : digitCounts) {
+                // One CryptoContext and key pair per (ring-dim, limbs, digits)
+                auto contextStart = std::chrono::steady_clock::now();
+                
+                BenchmarkParams params = baseParams;
+                params.ringDim = ringDim;
+                params.multDepth = limbs - 1;
+                params.numDigits = digits;
+                
+                CryptoContext<DCRTPoly> cc = makeCryptoContext(params);
+                
+                auto keyPair = cc->KeyGen();
+                int numSlots = static_cast<int>(cc->GetEncodingParams()->GetBatchSize());
+                
+                double contextMs = std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - contextStart).count();
+                
+                // Rotation keys generated so far for this context
+                std::set<int> generated;
+                
+                for (uint32_t matrixDim : matrixDims) {
+                    if (static_cast<int>(matrixDim) > numSlots) {
+                        std::cerr << "Skipping matrix-dim " << matrixDim << " > numSlots " << numSlots
+                                  << " (ring-dim " << ringDim << ")\n";
+                        continue;
+                    }
+                    
+                    auto M = make_random_matrix(matrixDim, matrixSeed);
+                    KernelPlan plan = (method == "bsgs") ? planBsgs(cc, parser, M, numSlots)
+                                                         : planDiagonal(cc, M, numSlots);
+                    
+                    // Only the rotations this point adds
+                    std::vector<int32_t> missing;
+                    for (int rot : plan.rotations) {
+                        if (generated.insert(rot).second) missing.push_back(rot);
+                    }
+                    auto keygenStart = std::chrono::steady_clock::now();
+                    if (!missing.empty()) cc->EvalRotateKeyGen(keyPair.secretKey, missing);
+                    double keygenMs = std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - keygenStart).count();
+                    
+                    auto inputVec = make_random_input_vector(matrixDim, numSlots);
+                    auto input = cc->Encrypt(keyPair.publicKey, cc->MakeCKKSPackedPlaintext(inputVec));
+                    
+                    auto evaluatePoint = [&] {
+                        return (method == "bsgs") ? runBsgs(cc, params, plan, input) : runDiagonal(cc, plan, input);
+                    };
+                    
+                    for (uint32_t threads : threadCounts) {
+                        omp_set_num_threads(static_cast<int>(std::max<uint32_t>(1, threads)));
+                        
+                        Ciphertext<DCRTPoly> result;
+                        for (uint32_t i = 0; i < warmupRuns; ++i) {
+                            result = evaluatePoint();
+                        }
+                        
+                        std::vector<uint64_t> samples;
+                        for (uint32_t i = 0; i < timedRuns; ++i) {
+                            auto start = std::chrono::steady_clock::now();
+                            result = evaluatePoint();
+                            auto stop = std::chrono::steady_clock::now();
+                            samples.push_back(static_cast<uint64_t>(
+                                std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count()));
+                        }
+                        std::sort(samples.begin(), samples.end());
+                        
+                        Plaintext resultPtxt;
+                        cc->Decrypt(keyPair.secretKey, result, &resultPtxt);
+                        resultPtxt->SetLength(numSlots);
+                        bool verified = verify_matrix_vector_result(resultPtxt->GetRealPackedValue(), M, inputVec, debug);
+                        allVerified = allVerified && verified;
+                        
+                        if (format == "json") {
+                            out << "{\"method\": \"" << method << "\""
+                                << ", \"ring_dim\": " << ringDim
+                                << ", \"num_limbs\": " << limbs
+                                << ", \"num_digits\": " << digits
+                                << ", \"matrix_dim\": " << matrixDim
+                                << ", \"threads\": " << threads
+                                << ", \"n1\": " << plan.n1
+                                << ", \"diagonals\": " << plan.diagonals.size()
+                                << ", \"rotation_keys\": " << plan.rotations.size()
+                                << ", \"new_keys\": " << missing.size()
+                                << ", \"context_ms\": " << contextMs
+                                << ", \"keygen_ms\": " << keygenMs
+                                << ", \"latency_min_ns\": " << samples.front()
+                                << ", \"latency_median_ns\": " << nearestRankPercentile(samples, 0.5)
+                                << ", \"latency_p99_ns\": " << nearestRankPercentile(samples, 0.99)
+                                << ", \"verified\": " << (verified ? "true" : "false") << "}\n";
+                        } else {
+                            out << method << "," << ringDim << "," << limbs << "," << digits << ","
+                                << matrixDim << "," << threads << "," << plan.n1 << ","
+                                << plan.diagonals.size() << "," << plan.rotations.size() << ","
+                                << missing.size() << "," << contextMs << "," << keygenMs << ","
+                                << samples.front() << "," << nearestRankPercentile(samples, 0.5) << ","
+                                << nearestRankPercentile(samples, 0.99) << "," << (verified ? 1 : 0) << "\n";
+                        }
+                        out.flush();
+                        
+                        // Context and keygen cost are reported once per point that paid them
+                        contextMs = 0;
+                        keygenMs = 0;
+                        missing.clear();
+                    }
+                }
+                
+                cc->ClearEvalAutomorphismKeys();
+            }
+        }
+    }
+    
+    return allVerified ? 0 : 1;
+}
+
+BENCHMARK_KERNEL("sweep-driver", runSweepDriver);
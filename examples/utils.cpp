@@ -0,0 +1,915 @@
+// utils.cpp - Compiled part of the shared benchmark utilities
+// Non-template definitions declared in utils.hpp: the cryptocontext, the
+// measurement wrapper, the rotation key store, the diagonal plaintext cache
+// and the matrix generators. Built once into bench_common (with
+// BENCH_KERNEL_LIBRARY, so the allocator replacement stays with the examples).
+#include "utils.hpp"
+
+// Cryptocontext
+CryptoContext<DCRTPoly> makeCryptoContext(const BenchmarkParams& params, uint32_t bootstrapDepth) {
+    CCParams<CryptoContextCKKSRNS> ccParams;
+    ccParams.SetMultiplicativeDepth(params.multDepth + bootstrapDepth);
+    ccParams.SetScalingModSize(bootstrapDepth > 0 ? 59 : 50);
+    if (bootstrapDepth > 0) {
+        ccParams.SetFirstModSize(60);
+        ccParams.SetSecretKeyDist(UNIFORM_TERNARY);
+    }
+    ccParams.SetRingDim(params.ringDim);
+    ccParams.SetScalingTechnique(params.scaling);
+    ccParams.SetKeySwitchTechnique(params.keySwitch);
+    if (params.keySwitch == HYBRID) {
+        ccParams.SetNumLargeDigits(params.numDigits);
+    } else if (params.digitSize > 0) {
+        ccParams.SetDigitSize(params.digitSize);
+    }
+    ccParams.SetSecurityLevel(params.checkSecurity ? HEStd_128_classic : HEStd_NotSet);
+    
+    CryptoContext<DCRTPoly> cc = GenCryptoContext(ccParams);
+    cc->Enable(PKE);
+    cc->Enable(KEYSWITCH);
+    cc->Enable(LEVELEDSHE);
+    if (bootstrapDepth > 0) {
+        cc->Enable(ADVANCEDSHE);
+        cc->Enable(FHE);
+    }
+    return cc;
+}
+
+// MeasurementSystem
+MeasurementSystem::MeasurementSystem(MeasurementMode m) : mode(m) {
+    if (mode == MeasurementMode::DRAM) {
+        dramInitialized = dramCounter.init();
+        socketDramInitialized = socketDram.init();
+    }
+}
+
+MeasurementSystem::MeasurementSystem(const ArgParser& parser)
+    : MeasurementSystem(parser.getMeasurementMode()) {
+    warmupRuns = parser.getUInt32("warmup", 0);
+    timedRuns = std::max<uint32_t>(1, parser.getUInt32("repetitions", 1));
+    pinRegion = parser.getString("pin-region");
+    perfCounters.addRawEvents(parser.getString("perf-events"));
+}
+
+uint64_t MeasurementSystem::medianLatencyNs() const {
+    if (latencySamples.empty()) return 0;
+    std::vector<uint64_t> sorted = latencySamples;
+    std::sort(sorted.begin(), sorted.end());
+    return sorted[(sorted.size() - 1) / 2];
+}
+
+void MeasurementSystem::startDRAM() {
+    if (mode == MeasurementMode::DRAM && dramInitialized) {
+        dramCounter.start();
+    }
+    if (mode == MeasurementMode::DRAM && socketDramInitialized) {
+        socketDram.start();
+    }
+}
+
+void MeasurementSystem::stopDRAM() {
+    if (mode == MeasurementMode::DRAM && dramInitialized) {
+        dramCounter.stop();
+    }
+    if (mode == MeasurementMode::DRAM && socketDramInitialized) {
+        socketDram.stop();
+    }
+}
+
+void MeasurementSystem::startPIN() {
+    if (mode == MeasurementMode::PIN) {
+        PIN_MARKER_START();
+    }
+    if (mode == MeasurementMode::PERF) {
+        perfCounters.start();
+    }
+}
+
+void MeasurementSystem::endPIN() {
+    if (mode == MeasurementMode::PIN) {
+        PIN_MARKER_END();
+    }
+    if (mode == MeasurementMode::PERF) {
+        perfCounters.stop();
+    }
+}
+
+void MeasurementSystem::beginRegion(const std::string& name) {
+    if (!recordRegions) return;
+    
+    auto it = regions.find(name);
+    if (it == regions.end()) {
+        it = regions.emplace(name, RegionStats{}).first;
+        regionOrder.push_back(name);
+        if (mode == MeasurementMode::DRAM && dramInitialized) {
+            it->second.counter = std::make_unique<DRAMCounter>();
+            if (!it->second.counter->init()) it->second.counter.reset();
+        }
+    }
+    RegionStats& stats = it->second;
+    
+    if (name == pinRegion) startPIN();
+    if (stats.counter) stats.counter->start();
+    if (mode == MeasurementMode::MEMORY) {
+        stats.startAllocatedBytes = allocationCounters.allocatedBytes.load();
+        stats.startAllocations = allocationCounters.allocations.load();
+    }
+    stats.start = std::chrono::steady_clock::now();
+}
+
+void MeasurementSystem::endRegion(const std::string& name) {
+    if (!recordRegions) return;
+    
+    auto stop = std::chrono::steady_clock::now();
+    RegionStats& stats = regions.at(name);
+    
+    if (stats.counter) {
+        stats.counter->stop();
+        stats.readBytes += stats.counter->get_read_bytes();
+        stats.writeBytes += stats.counter->get_write_bytes();
+    }
+    if (mode == MeasurementMode::MEMORY) {
+        stats.allocatedBytes += allocationCounters.allocatedBytes.load() - stats.startAllocatedBytes;
+        stats.allocations += allocationCounters.allocations.load() - stats.startAllocations;
+    }
+    if (name == pinRegion) endPIN();
+    
+    stats.calls++;
+    stats.totalNs += static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(stop - stats.start).count());
+}
+
+void MeasurementSystem::printResults() {
+    if (mode == MeasurementMode::DRAM && dramInitialized) {
+        dramCounter.print_results();
+    }
+    if (mode == MeasurementMode::DRAM && socketDramInitialized) {
+        socketDram.printResults();
+    }
+    if (mode == MeasurementMode::LATENCY && !latencySamples.empty()) {
+        printLatencyResults();
+    }
+    if (mode == MeasurementMode::MEMORY) {
+        printMemoryResults();
+    }
+    if (mode == MeasurementMode::PERF) {
+        perfCounters.printResults();
+    }
+    if (batchSize > 0) {
+        printBatchResults();
+    }
+    if (mode != MeasurementMode::PIN) {
+        printPeakRss();
+    }
+    if (mode != MeasurementMode::PIN && numaConfig().enabled()) {
+        printNumaResults();
+    }
+    if (mode != MeasurementMode::PIN) {
+        printRegionResults();
+    }
+}
+
+uint64_t MeasurementSystem::readPeakRssBytes() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.rfind("VmHWM:", 0) == 0) {
+            return std::stoull(line.substr(6)) * 1024;
+        }
+    }
+    return 0;
+}
+
+void MeasurementSystem::printMemoryResults() const {
+    const AllocationCounters& counters = allocationCounters;
+    std::cout << "MEMORY_PEAK_RSS_BYTES=" << kernelPeakRssBytes << "\n";
+    std::cout << "MEMORY_RSS_RESET=" << (rssPeakReset ? 1 : 0) << "\n";
+    std::cout << "MEMORY_HEAP_PEAK_BYTES=" << std::max<int64_t>(0, counters.peakLiveBytes.load()) << "\n";
+    std::cout << "MEMORY_ALLOCATED_BYTES=" << counters.allocatedBytes.load() << "\n";
+    std::cout << "MEMORY_FREED_BYTES=" << counters.freedBytes.load() << "\n";
+    std::cout << "MEMORY_ALLOCATIONS=" << counters.allocations.load() << "\n";
+    std::cout << "MEMORY_FREES=" << counters.frees.load() << "\n";
+    // Allocations that reached malloc (all of them unless pooled)
+    std::cout << "MEMORY_POOL_HITS=" << counters.poolHits.load() << "\n";
+    std::cout << "MEMORY_SYSTEM_ALLOCATIONS=" << counters.allocations.load() - counters.poolHits.load() << "\n";
+    std::cout << "MEMORY_MINOR_FAULTS=" << kernelMinorFaults << "\n";
+    std::cout << "MEMORY_MAJOR_FAULTS=" << kernelMajorFaults << "\n";
+}
+
+void MeasurementSystem::printNumaResults() const {
+    const NumaConfig& numa = numaConfig();
+    std::size_t numNodes = numaTopology().numNodes();
+    std::cout << "NUMA_NODES=" << numNodes << "\n";
+    std::cout << "NUMA_KEY_REPLICAS=" << (numa.keyReplicas ? numNodes : 1) << "\n";
+    for (std::size_t node = 0; node < numa.nodeThreads.size(); ++node) {
+        std::cout << "NUMA_NODE" << node << "_THREADS=" << numa.nodeThreads[node] << "\n";
+    }
+    
+    std::vector<uint64_t> residentBytes(numNodes, 0);
+    std::ifstream maps("/proc/self/numa_maps");
+    std::string line;
+    while (std::getline(maps, line)) {
+        std::istringstream fields(line);
+        std::string field;
+        uint64_t pageBytes = 4096;
+        std::vector<std::pair<std::size_t, uint64_t>> pages;  // (node, pages)
+        while (fields >> field) {
+            if (field.rfind("kernelpagesize_kB=", 0) == 0) {
+                pageBytes = std::stoull(field.substr(18)) * 1024;
+            } else if (field.size() > 3 && field[0] == 'N' && std::isdigit(static_cast<unsigned char>(field[1]))) {
+                auto eq = field.find('=');
+                if (eq == std::string::npos) continue;
+                pages.emplace_back(std::stoul(field.substr(1, eq - 1)), std::stoull(field.substr(eq + 1)));
+            }
+        }
+        for (const auto& [node, count] : pages) {
+            if (node < numNodes) residentBytes[node] += count * pageBytes;
+        }
+    }
+    for (std::size_t node = 0; node < numNodes; ++node) {
+        std::cout << "NUMA_NODE" << node << "_RESIDENT_BYTES=" << residentBytes[node] << "\n";
+    }
+}
+
+void MeasurementSystem::printLatencyResults() const {
+    std::vector<uint64_t> sorted = latencySamples;
+    std::sort(sorted.begin(), sorted.end());
+    
+    std::cout << "LATENCY_SAMPLES=" << sorted.size() << "\n";
+    std::cout << "LATENCY_MIN_NS=" << sorted.front() << "\n";
+    std::cout << "LATENCY_MEDIAN_NS=" << nearestRankPercentile(sorted, 0.5) << "\n";
+    std::cout << "LATENCY_P99_NS=" << nearestRankPercentile(sorted, 0.99) << "\n";
+    
+    // Raw timed runs in order, for significance tests between runs
+    std::cout << "SAMPLES ns=";
+    for (std::size_t i = 0; i < latencySamples.size(); ++i) {
+        std::cout << (i > 0 ? "," : "") << latencySamples[i];
+    }
+    std::cout << "\n";
+}
+
+void MeasurementSystem::printBatchResults() {
+    std::cout << "BATCH_SIZE=" << batchSize << "\n";
+    if (mode == MeasurementMode::LATENCY && !latencySamples.empty()) {
+        std::vector<uint64_t> sorted = latencySamples;
+        std::sort(sorted.begin(), sorted.end());
+        double medianNs = static_cast<double>(sorted[(sorted.size() - 1) / 2]);
+        std::cout << "BATCH_NS_PER_CTXT=" << static_cast<uint64_t>(medianNs / batchSize) << "\n";
+        std::cout << "BATCH_CTXT_PER_SEC=" << std::fixed << std::setprecision(3)
+                  << batchSize * 1e9 / std::max(medianNs, 1.0) << std::defaultfloat << "\n";
+    }
+    if (mode == MeasurementMode::DRAM && dramInitialized) {
+        std::cout << "BATCH_DRAM_READ_BYTES_PER_CTXT=" << dramCounter.get_read_bytes() / batchSize << "\n";
+        std::cout << "BATCH_DRAM_WRITE_BYTES_PER_CTXT=" << dramCounter.get_write_bytes() / batchSize << "\n";
+    }
+}
+
+void MeasurementSystem::printRegionResults() const {
+    for (const auto& name : regionOrder) {
+        const RegionStats& stats = regions.at(name);
+        std::cout << "REGION name=" << name
+                  << " calls=" << stats.calls
+                  << " ns=" << stats.totalNs;
+        if (stats.counter) {
+            std::cout << " read_bytes=" << stats.readBytes
+                      << " write_bytes=" << stats.writeBytes;
+        }
+        if (mode == MeasurementMode::MEMORY) {
+            std::cout << " allocated_bytes=" << stats.allocatedBytes
+                      << " allocations=" << stats.allocations;
+        }
+        std::cout << "\n";
+    }
+}
+
+// RotationKeyStore
+bool RotationKeyStore::save(int rotation) {
+    if (config.backend == KeyStoreBackend::FILES) {
+        std::ofstream keyFile(keyPath(rotation), std::ios::binary);
+        return cc->SerializeEvalAutomorphismKey(keyFile, SerType::BINARY);
+    }
+    
+    if (!bundleOut.is_open()) {
+        bundleOut.open(bundlePath(), std::ios::binary | std::ios::trunc);
+    }
+    uint64_t offset = static_cast<uint64_t>(bundleOut.tellp());
+    if (!cc->SerializeEvalAutomorphismKey(bundleOut, SerType::BINARY) || !bundleOut) {
+        return false;
+    }
+    uint64_t size = static_cast<uint64_t>(bundleOut.tellp()) - offset;
+    bundleEntries.push_back({rotation, offset, size});
+    return true;
+}
+
+bool RotationKeyStore::finalize() {
+    if (!bundleOut.is_open()) return true;
+    
+    KeyBundleFooter footer;
+    footer.indexOffset = static_cast<uint64_t>(bundleOut.tellp());
+    footer.numEntries = bundleEntries.size();
+    std::memcpy(footer.magic, KEY_BUNDLE_MAGIC, sizeof(footer.magic));
+    
+    bundleOut.write(reinterpret_cast<const char*>(bundleEntries.data()),
+                    bundleEntries.size() * sizeof(KeyBundleEntry));
+    bundleOut.write(reinterpret_cast<const char*>(&footer), sizeof(footer));
+    bundleOut.close();
+    return !bundleOut.fail();
+}
+
+void RotationKeyStore::open() {
+    if (config.backend == KeyStoreBackend::FILES || bundleFd >= 0) return;
+    
+    ScopedRegion region(measurement, "open-key-store");
+    bundleFd = ::open(bundlePath().c_str(), O_RDONLY);
+    if (bundleFd < 0) {
+        throw std::runtime_error("Missing key bundle " + bundlePath());
+    }
+    bundleIndex = readKeyBundleIndex(bundleFd, bundlePath());
+    
+    if (config.backend == KeyStoreBackend::MMAP) {
+        struct stat st;
+        fstat(bundleFd, &st);
+        mappingBytes = static_cast<std::size_t>(st.st_size);
+        void* addr = mmap(nullptr, mappingBytes, PROT_READ, MAP_PRIVATE, bundleFd, 0);
+        if (addr == MAP_FAILED) {
+            throw std::runtime_error("Failed to mmap key bundle " + bundlePath());
+        }
+        mapping = static_cast<const char*>(addr);
+    }
+}
+
+std::pair<EvalKey<DCRTPoly>, std::size_t> RotationKeyStore::sampleKey(int rotation) {
+    open();
+    auto it = cache.find(rotation);
+    AutomorphismKeyMaps keys = (it != cache.end()) ? it->second.keys : readKey(rotation);
+    return {keys.begin()->second->begin()->second, keyBytes(rotation)};
+}
+
+void RotationKeyStore::acquire(int rotation) {
+    auto it = cache.find(rotation);
+    if (it != cache.end()) {
+        hits++;
+        it->second.lastUse = ++tick;
+        it->second.uses++;
+        install(it->second.keys);
+        if (it->second.replicas) installedReplicas[rotation] = it->second.replicas;
+        return;
+    }
+    
+    open();
+    misses++;
+    AutomorphismKeyMaps keys;
+    std::shared_ptr<const KeyReplicas> replicas;
+    {
+        // With prefetching this region only covers the time spent waiting
+        ScopedRegion region(measurement, "load-rotation-key");
+        if (prefetcher && prefetcher->nextIs(rotation)) {
+            auto start = std::chrono::steady_clock::now();
+            PrefetchedKey prefetched = prefetcher->take();
+            auto stop = std::chrono::steady_clock::now();
+            keys = std::move(prefetched.keys);
+            replicas = std::move(prefetched.replicas);
+            prefetchWaitNs += static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count());
+            prefetchedKeys++;
+        } else {
+            try {
+                keys = readKeyPlaced(rotation);
+                replicas = replicate(rotation, keys);
+            } catch (const std::exception&) {
+                std::cerr << "Failed to load rotation key " << rotation << "\n";
+                throw;
+            }
+        }
+    }
+    install(keys);
+    if (replicas) installedReplicas[rotation] = replicas;
+    
+    std::size_t bytes = keyBytes(rotation) * copies(rotation);
+    loadedBytes += bytes;
+    if (bytes > config.budgetBytes) return;
+    
+    while (residentBytes + bytes > config.budgetBytes) {
+        evictOne();
+    }
+    
+    cache[rotation] = CachedKey{std::move(keys), bytes, ++tick, 1, std::move(replicas)};
+    residentBytes += bytes;
+    peakBytes = std::max(peakBytes, residentBytes);
+}
+
+Ciphertext<DCRTPoly> RotationKeyStore::rotate(const ConstCiphertext<DCRTPoly>& ct, int rotation) const {
+    auto it = installedReplicas.find(rotation);
+    if (it == installedReplicas.end()) return cc->EvalRotate(ct, rotation);
+    
+    const KeyReplicas& replicas = *it->second;
+    const AutomorphismKeyMaps& keys = replicas[numaTopology().currentNode() % replicas.size()];
+    return cc->EvalAutomorphism(ct, cc->FindAutomorphismIndex(static_cast<uint32_t>(rotation)),
+                                *keys.at(ct->GetKeyTag()));
+}
+
+void RotationKeyStore::printResults() const {
+    std::size_t keySetBytes = 0;
+    for (int rot : keySet) {
+        keySetBytes += keyBytes(rot);
+    }
+    std::cout << "KEY_SET_KEYS=" << keySet.size() << "\n";
+    std::cout << "KEY_SET_BYTES=" << keySetBytes << "\n";
+    
+    std::cout << "KEY_CACHE_HITS=" << hits << "\n";
+    std::cout << "KEY_CACHE_MISSES=" << misses << "\n";
+    std::cout << "KEY_CACHE_EVICTIONS=" << evictions << "\n";
+    std::cout << "KEY_CACHE_LOADED_BYTES=" << loadedBytes << "\n";
+    std::cout << "KEY_CACHE_PEAK_BYTES=" << peakBytes << "\n";
+    if (numaConfig().keyReplicas) std::cout << "KEY_CACHE_REPLICAS=" << nodeCopies() << "\n";
+    
+    if (config.prefetchDepth > 0) {
+        // Hidden = background load time not spent stalled in acquire()
+        uint64_t hiddenNs = prefetchLoadNs > prefetchWaitNs ? prefetchLoadNs - prefetchWaitNs : 0;
+        std::cout << "KEY_PREFETCH_DEPTH=" << config.prefetchDepth << "\n";
+        std::cout << "KEY_PREFETCH_KEYS=" << prefetchedKeys << "\n";
+        std::cout << "KEY_PREFETCH_LOAD_NS=" << prefetchLoadNs << "\n";
+        std::cout << "KEY_PREFETCH_WAIT_NS=" << prefetchWaitNs << "\n";
+        std::cout << "KEY_PREFETCH_HIDDEN_NS=" << hiddenNs << "\n";
+    }
+}
+
+bool RotationKeyStore::generateSerial(const PrivateKey<DCRTPoly>& secretKey, const std::vector<int>& rotations) {
+    for (int rot : rotations) {
+        cc->EvalRotateKeyGen(secretKey, {rot});
+        bool saved = save(rot);
+        cc->ClearEvalAutomorphismKeys();
+        if (!saved) {
+            std::cerr << "Failed to save rotation key " << rot << "\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+bool RotationKeyStore::generateParallel(const PrivateKey<DCRTPoly>& secretKey, const std::vector<int>& rotations) {
+    bool ok = true;
+    
+    #pragma omp parallel for schedule(dynamic, 1) num_threads(config.keygenThreads)
+    for (std::size_t idx = 0; idx < rotations.size(); ++idx) {
+        int rot = rotations[idx];
+        uint32_t autoIndex = cc->FindAutomorphismIndex(static_cast<uint32_t>(rot));
+        
+        AutomorphismKeyMaps keys;
+        keys[secretKey->GetKeyTag()] = cc->EvalAutomorphismKeyGen(secretKey, {autoIndex});
+        
+        bool saved;
+        if (config.backend == KeyStoreBackend::FILES) {
+            std::ofstream keyFile(keyPath(rot), std::ios::binary);
+            Serial::Serialize(keys, keyFile, SerType::BINARY);
+            saved = keyFile.good();
+        } else {
+            std::ostringstream blob;
+            Serial::Serialize(keys, blob, SerType::BINARY);
+            std::string bytes = blob.str();
+            
+            #pragma omp critical(key_bundle_append)
+            saved = appendToBundle(rot, bytes);
+        }
+        
+        if (!saved) {
+            #pragma omp critical(key_store_log)
+            std::cerr << "Failed to save rotation key " << rot << "\n";
+            #pragma omp atomic write
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+bool RotationKeyStore::appendToBundle(int rotation, const std::string& blob) {
+    if (!bundleOut.is_open()) {
+        bundleOut.open(bundlePath(), std::ios::binary | std::ios::trunc);
+    }
+    uint64_t offset = static_cast<uint64_t>(bundleOut.tellp());
+    bundleOut.write(blob.data(), blob.size());
+    bundleEntries.push_back({rotation, offset, blob.size()});
+    return bundleOut.good();
+}
+
+std::string RotationKeyStore::keySetDescription(const std::vector<int>& rotations, const BenchmarkParams& params) const {
+    std::ostringstream desc;
+    desc << "ring-dim=" << cc->GetRingDimension()
+         << " mult-depth=" << params.multDepth
+         << " num-digits=" << params.numDigits
+         << " scaling=" << static_cast<int>(params.scaling)
+         << " ks-tech=" << params.keySwitchName() << "-" << params.digitSize
+         << " store=" << prefix << static_cast<int>(config.backend)
+         << " rotations=";
+    for (int rot : rotations) desc << rot << ",";
+    return desc.str();
+}
+
+std::size_t RotationKeyStore::keyBytes(int rotation) const {
+    if (config.backend == KeyStoreBackend::FILES) {
+        return std::filesystem::file_size(keyPath(rotation));
+    }
+    return bundleEntry(rotation).size;
+}
+
+const KeyBundleEntry& RotationKeyStore::bundleEntry(int rotation) const {
+    auto it = bundleIndex.find(rotation);
+    if (it == bundleIndex.end()) {
+        throw std::runtime_error("Rotation " + std::to_string(rotation) + " not in key bundle");
+    }
+    return it->second;
+}
+
+AutomorphismKeyMaps RotationKeyStore::readKey(int rotation) const {
+    switch (config.backend) {
+        case KeyStoreBackend::MMAP: {
+            const KeyBundleEntry& entry = bundleEntry(rotation);
+            MemoryStreamBuf buf(mapping + entry.offset, entry.size);
+            std::istream in(&buf);
+            return deserializeAutomorphismKeys(in);
+        }
+        case KeyStoreBackend::BUNDLE: {
+            const KeyBundleEntry& entry = bundleEntry(rotation);
+            std::string blob(entry.size, '\0');
+            if (pread(bundleFd, blob.data(), entry.size, entry.offset) !=
+                static_cast<ssize_t>(entry.size)) {
+                throw std::runtime_error("Short read from key bundle " + bundlePath());
+            }
+            MemoryStreamBuf buf(blob.data(), blob.size());
+            std::istream in(&buf);
+            return deserializeAutomorphismKeys(in);
+        }
+        case KeyStoreBackend::FILES:
+        default:
+            return readAutomorphismKeyFile(keyPath(rotation));
+    }
+}
+
+std::size_t RotationKeyStore::nodeCopies() const {
+    if (!numaConfig().keyReplicas) return 1;
+    const auto& nodeCpus = numaTopology().nodeCpus;
+    return static_cast<std::size_t>(std::count_if(nodeCpus.begin(), nodeCpus.end(),
+                                                  [](const std::vector<int>& cpus) { return !cpus.empty(); }));
+}
+
+std::shared_ptr<const RotationKeyStore::KeyReplicas> RotationKeyStore::replicate(int rotation,
+                                                                                const AutomorphismKeyMaps& keys) const {
+    if (!numaConfig().keyReplicas || hoistedRotations.count(rotation)) return nullptr;
+    
+    const NumaTopology& topology = numaTopology();
+    auto replicas = std::make_shared<KeyReplicas>(topology.numNodes(), keys);
+    for (std::size_t node = 1; node < topology.numNodes(); ++node) {
+        if (topology.nodeCpus[node].empty()) continue;
+        ScopedMemoryPolicy placement(MemoryPolicy::bind(static_cast<int>(node)));
+        (*replicas)[node] = readKey(rotation);
+    }
+    return replicas;
+}
+
+void RotationKeyStore::evictOne() {
+    auto victim = cache.begin();
+    for (auto it = cache.begin(); it != cache.end(); ++it) {
+        bool colder = (config.policy == KeyEvictionPolicy::LFU)
+            ? std::make_pair(it->second.uses, it->second.lastUse) <
+              std::make_pair(victim->second.uses, victim->second.lastUse)
+            : it->second.lastUse < victim->second.lastUse;
+        if (colder) victim = it;
+    }
+    residentBytes -= victim->second.bytes;
+    cache.erase(victim);
+    evictions++;
+}
+
+// DiagonalPlaintextCache
+void DiagonalPlaintextCache::describe(uint64_t matrixHash, std::size_t matrixDim,
+                                      const BenchmarkParams& params, const std::string& layout) {
+    if (cacheDir.empty()) return;
+    
+    std::ostringstream desc;
+    desc << "matrix=" << std::hex << matrixHash << std::dec
+         << " matrix-dim=" << matrixDim
+         << " ring-dim=" << cc->GetRingDimension()
+         << " mult-depth=" << params.multDepth
+         << " num-digits=" << params.numDigits
+         << " scaling=" << static_cast<int>(params.scaling)
+         << " ks-tech=" << params.keySwitchName() << "-" << params.digitSize
+         << " slots=" << cc->GetEncodingParams()->GetBatchSize()
+         << " layout=" << layout;
+    path = cacheDir + "/ptxt-" + fnv1aHex(desc.str()) + ".bin";
+}
+
+bool DiagonalPlaintextCache::load(std::map<int, Plaintext>& plaintexts) {
+    if (path.empty() || encodeOnlyMode) return false;
+    
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) return false;
+    
+    ScopedRegion region(measurement, "load-diagonals");
+    ScopedMemoryPolicy placement(numaConfig().ptxtMembind);
+    auto start = std::chrono::steady_clock::now();
+    
+    char magic[sizeof(MAGIC)] = {};
+    uint64_t count = 0;
+    in.read(magic, sizeof(MAGIC));
+    in.read(reinterpret_cast<char*>(&count), sizeof(count));
+    if (!in || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0) {
+        std::cerr << "Ignoring invalid plaintext cache " << path << "\n";
+        return false;
+    }
+    
+    std::map<int, Plaintext> loaded;
+    for (uint64_t n = 0; n < count; ++n) {
+        EntryHeader header;
+        in.read(reinterpret_cast<char*>(&header), sizeof(header));
+        DCRTPoly element;
+        Serial::Deserialize(element, in, SerType::BINARY);
+        if (!in) {
+            std::cerr << "Ignoring truncated plaintext cache " << path << "\n";
+            return false;
+        }
+        
+        // Rebuild the plaintext around the stored element without re-encoding
+        auto ptxt = std::make_shared<CKKSPackedEncoding>(
+            element.GetParams(), cc->GetEncodingParams(), std::vector<std::complex<double>>(),
+            header.noiseScaleDeg, header.level, header.scalingFactor, header.slots);
+        ptxt->GetElement<DCRTPoly>() = std::move(element);
+        loaded[header.index] = ptxt;
+    }
+    
+    auto stop = std::chrono::steady_clock::now();
+    loadNs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count());
+    fileBytes = static_cast<uint64_t>(std::filesystem::file_size(path));
+    entries = loaded.size();
+    hit = true;
+    plaintexts = std::move(loaded);
+    return true;
+}
+
+std::map<int, Plaintext> DiagonalPlaintextCache::encode(const std::vector<int>& indices,
+                                                        const std::function<Plaintext(std::size_t)>& encodeOne) {
+    std::map<int, Plaintext> plaintexts;
+    auto encodeAll = [&] {
+        ScopedRegion region(measurement, "encode-diagonals");
+        ScopedMemoryPolicy placement(numaConfig().ptxtMembind, true);  // OpenFHE encodes in parallel
+        auto start = std::chrono::steady_clock::now();
+        for (std::size_t n = 0; n < indices.size(); ++n) {
+            Plaintext ptxt = encodeOne(n);
+            ptxt->GetElement<DCRTPoly>().SetFormat(Format::EVALUATION);
+            plaintexts[indices[n]] = ptxt;
+        }
+        auto stop = std::chrono::steady_clock::now();
+        encodeNs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count());
+    };
+    
+    if (encodeOnlyMode) {
+        measurement.startDRAM();
+        measurement.measureKernel(encodeAll);
+        measurement.stopDRAM();
+    } else {
+        encodeAll();
+        save(plaintexts);
+    }
+    entries = plaintexts.size();
+    return plaintexts;
+}
+
+void DiagonalPlaintextCache::printResults() const {
+    std::cout << "PTXT_CACHE_HIT=" << (hit ? 1 : 0) << "\n";
+    std::cout << "PTXT_CACHE_ENTRIES=" << entries << "\n";
+    std::cout << "PTXT_CACHE_BYTES=" << fileBytes << "\n";
+    std::cout << "PTXT_ENCODE_NS=" << encodeNs << "\n";
+    std::cout << "PTXT_LOAD_NS=" << loadNs << "\n";
+}
+
+void DiagonalPlaintextCache::save(const std::map<int, Plaintext>& plaintexts) {
+    if (path.empty()) return;
+    
+    std::filesystem::create_directories(cacheDir);
+    std::string tmpPath = path + ".tmp" + std::to_string(getpid());
+    {
+        std::ofstream out(tmpPath, std::ios::binary);
+        uint64_t count = plaintexts.size();
+        out.write(MAGIC, sizeof(MAGIC));
+        out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+        for (const auto& entry : plaintexts) {
+            const Plaintext& ptxt = entry.second;
+            EntryHeader header = {
+                .index = entry.first,
+                .noiseScaleDeg = static_cast<uint32_t>(ptxt->GetNoiseScaleDeg()),
+                .level = static_cast<uint32_t>(ptxt->GetLevel()),
+                .slots = static_cast<uint32_t>(ptxt->GetSlots()),
+                .scalingFactor = ptxt->GetScalingFactor()
+            };
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            Serial::Serialize(ptxt->GetElement<DCRTPoly>(), out, SerType::BINARY);
+        }
+        if (!out) {
+            std::cerr << "Failed to write plaintext cache " << tmpPath << "\n";
+            std::filesystem::remove(tmpPath);
+            return;
+        }
+    }
+    std::filesystem::rename(tmpPath, path);
+    fileBytes = static_cast<uint64_t>(std::filesystem::file_size(path));
+}
+
+// Matrix/vector utilities
+DenseMatrix make_random_matrix(std::size_t matrixDim, uint32_t seed) {
+    std::random_device rd;
+    std::mt19937 gen(seed != 0 ? seed : rd());
+    std::uniform_real_distribution<> dis(0.1, 2.0);
+    
+    DenseMatrix M;
+    M.dim = matrixDim;
+    M.values.resize(matrixDim * matrixDim);
+    for (auto& value : M.values) {
+        value = dis(gen);
+    }
+    return M;
+}
+
+CsrMatrix make_banded_matrix(std::size_t matrixDim, std::size_t bandWidth, uint32_t seed) {
+    return make_random_csr_matrix(matrixDim, seed, [&](std::size_t i) {
+        return std::make_pair(i > bandWidth ? i - bandWidth : 0, std::min(matrixDim, i + bandWidth + 1));
+    });
+}
+
+CsrMatrix make_block_diagonal_matrix(std::size_t matrixDim, std::size_t blockSize, uint32_t seed) {
+    return make_random_csr_matrix(matrixDim, seed, [&](std::size_t i) {
+        std::size_t lo = i / blockSize * blockSize;
+        return std::make_pair(lo, std::min(matrixDim, lo + blockSize));
+    });
+}
+
+DenseMatrix make_toeplitz_matrix(std::size_t matrixDim, uint32_t seed) {
+    std::random_device rd;
+    std::mt19937 gen(seed != 0 ? seed : rd());
+    std::uniform_real_distribution<> dis(0.1, 2.0);
+    
+    std::vector<double> t(2 * matrixDim - 1);
+    for (auto& value : t) {
+        value = dis(gen);
+    }
+    
+    DenseMatrix M;
+    M.dim = matrixDim;
+    M.values.resize(matrixDim * matrixDim);
+    for (std::size_t i = 0; i < matrixDim; ++i) {
+        for (std::size_t j = 0; j < matrixDim; ++j) {
+            M.values[i * matrixDim + j] = t[j + matrixDim - 1 - i];
+        }
+    }
+    return M;
+}
+
+CsrMatrix coo_to_csr(std::size_t matrixDim, std::vector<CooEntry> entries) {
+    std::sort(entries.begin(), entries.end(), [](const CooEntry& a, const CooEntry& b) {
+        return std::tie(a.row, a.col) < std::tie(b.row, b.col);
+    });
+    
+    CsrMatrix M;
+    M.dim = matrixDim;
+    M.rowPtr.assign(matrixDim + 1, 0);
+    for (std::size_t n = 0; n < entries.size(); ++n) {
+        const auto& e = entries[n];
+        if (n > 0 && e.row == entries[n - 1].row && e.col == entries[n - 1].col) {
+            M.values.back() += e.value;
+            continue;
+        }
+        M.colIdx.push_back(e.col);
+        M.values.push_back(e.value);
+        M.rowPtr[e.row + 1]++;
+    }
+    for (std::size_t i = 0; i < matrixDim; ++i) {
+        M.rowPtr[i + 1] += M.rowPtr[i];
+    }
+    return M;
+}
+
+CsrMatrix load_coo_matrix(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) {
+        throw std::runtime_error("Cannot open matrix file " + path);
+    }
+    
+    bool pattern = false;
+    bool symmetric = false;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.rfind("%%MatrixMarket", 0) == 0) {
+            std::transform(line.begin(), line.end(), line.begin(), ::tolower);
+            if (line.find("coordinate") == std::string::npos || line.find("complex") != std::string::npos) {
+                throw std::runtime_error("Not a real coordinate Matrix Market file " + path);
+            }
+            pattern = line.find("pattern") != std::string::npos;
+            symmetric = line.find("symmetric") != std::string::npos;
+            continue;
+        }
+        if (line.empty() || line[0] == '%') continue;
+        break;
+    }
+    
+    std::size_t rows = 0, cols = 0, nnz = 0;
+    std::istringstream sizeLine(line);
+    if (!(sizeLine >> rows >> cols >> nnz)) {
+        throw std::runtime_error("Missing size line in matrix file " + path);
+    }
+    
+    std::vector<CooEntry> entries;
+    entries.reserve(symmetric ? 2 * nnz : nnz);
+    for (std::size_t n = 0; n < nnz; ++n) {
+        std::size_t i = 0, j = 0;
+        double value = 1.0;
+        if (!(in >> i >> j) || (!pattern && !(in >> value))) {
+            throw std::runtime_error("Truncated matrix file " + path);
+        }
+        if (i == 0 || j == 0 || i > rows || j > cols) {
+            throw std::runtime_error("Entry out of range in matrix file " + path);
+        }
+        entries.push_back({static_cast<uint32_t>(i - 1), static_cast<uint32_t>(j - 1), value});
+        if (symmetric && i != j) {
+            entries.push_back({static_cast<uint32_t>(j - 1), static_cast<uint32_t>(i - 1), value});
+        }
+    }
+    return coo_to_csr(std::max(rows, cols), std::move(entries));
+}
+
+CsrMatrix load_csr_matrix(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) {
+        throw std::runtime_error("Cannot open matrix file " + path);
+    }
+    
+    CsrMatrix M;
+    std::size_t nnz = 0;
+    if (!(in >> M.dim >> nnz)) {
+        throw std::runtime_error("Missing size line in matrix file " + path);
+    }
+    M.rowPtr.resize(M.dim + 1);
+    M.colIdx.resize(nnz);
+    M.values.resize(nnz);
+    for (auto& p : M.rowPtr) in >> p;
+    for (auto& c : M.colIdx) in >> c;
+    for (auto& v : M.values) in >> v;
+    if (!in) {
+        throw std::runtime_error("Truncated matrix file " + path);
+    }
+    
+    bool valid = M.rowPtr.front() == 0 && M.rowPtr.back() == nnz &&
+                 std::is_sorted(M.rowPtr.begin(), M.rowPtr.end()) &&
+                 std::all_of(M.colIdx.begin(), M.colIdx.end(), [&](uint32_t c) { return c < M.dim; });
+    if (!valid) {
+        throw std::runtime_error("Invalid CSR structure in matrix file " + path);
+    }
+    return M;
+}
+
+BenchmarkMatrix make_benchmark_matrix(const ArgParser& parser) {
+    std::size_t matrixDim = static_cast<std::size_t>(parser.getUInt32("matrix-dim", 128));
+    uint32_t seed = parser.getUInt32("matrix-seed", 0);
+    
+    BenchmarkMatrix M;
+    M.kind = parser.getString("matrix-kind", "dense");
+    M.isSparse = M.kind != "dense" && M.kind != "toeplitz";
+    
+    if (M.kind == "dense") {
+        M.dense = make_random_matrix(matrixDim, seed);
+    } else if (M.kind == "toeplitz") {
+        M.dense = make_toeplitz_matrix(matrixDim, seed);
+    } else if (M.kind == "banded") {
+        M.sparse = make_banded_matrix(matrixDim, parser.getUInt32("matrix-band", 1), seed);
+    } else if (M.kind == "block-diagonal") {
+        uint32_t blockSize = parser.getUInt32("matrix-block", 16);
+        if (blockSize == 0) {
+            throw std::runtime_error("--matrix-block must be positive");
+        }
+        M.sparse = make_block_diagonal_matrix(matrixDim, blockSize, seed);
+    } else if (M.kind == "coo" || M.kind == "csr") {
+        std::string path = parser.getString("matrix-file");
+        if (path.empty()) {
+            throw std::runtime_error("--matrix-kind=" + M.kind + " requires --matrix-file");
+        }
+        M.sparse = M.kind == "coo" ? load_coo_matrix(path) : load_csr_matrix(path);
+    } else {
+        throw std::runtime_error("Unknown --matrix-kind " + M.kind);
+    }
+    return M;
+}
+
+void printMatrixResults(const BenchmarkMatrix& M, std::size_t numDiagonals) {
+    std::cout << "MATRIX_DIM=" << M.dim() << "\n";
+    std::cout << "MATRIX_NNZ=" << M.nnz() << "\n";
+    std::cout << "MATRIX_DIAGONALS=" << numDiagonals << "\n";
+}
+
+std::vector<double> make_random_input_vector(std::size_t matrixDim, std::size_t numSlots) {
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    std::uniform_real_distribution<> dis(0.5, 1.5);
+    
+    std::vector<double> vec(numSlots, 0.0);
+    for (std::size_t i = 0; i < matrixDim; ++i) {
+        vec[i] = dis(gen);
+    }
+    return vec;
+}
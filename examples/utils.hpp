@@ -1,31 +1,230 @@
 // utils.hpp - Shared utilities for OpenFHE benchmarks
+// The context, measurement, key store, plaintext cache and matrix helpers
+// declared here are defined in utils.cpp (compiled once, into bench_common)
 #pragma once
 
 #include <openfhe.h>
+#include <ciphertext-ser.h>
+#include <cryptocontext-ser.h>
+#include <key/key-ser.h>
+#include <scheme/ckksrns/ckksrns-ser.h>
 #include <iostream>
 #include <vector>
 #include <random>
 #include <string>
 #include <map>
+#include <set>
+#include <memory>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <limits>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
 #include <cstdlib>
 #include <filesystem>
+#include <chrono>
+#include <algorithm>
+#include <tuple>
+#include <cctype>
+#include <stdexcept>
+#include <cmath>
+#include <type_traits>
+#include <cstring>
+#include <atomic>
+#include <new>
 #include <omp.h>
+#include <malloc.h>
+#include <linux/perf_event.h>
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <dram_counter.hpp>
 
 using namespace lbcrypto;
 
-// PIN markers for integer operation counting
+// PIN markers for integer operation counting (inline: one copy per binary,
+// found by name, also in openfhe-bench)
 extern "C" {
-    void __attribute__((noinline)) PIN_MARKER_START() { asm volatile(""); }
-    void __attribute__((noinline)) PIN_MARKER_END() { asm volatile(""); }
+    inline void __attribute__((noinline, used)) PIN_MARKER_START() { asm volatile(""); }
+    inline void __attribute__((noinline, used)) PIN_MARKER_END() { asm volatile(""); }
 }
 
+// Heap allocation counters for --measure=memory
+// The global operator new/delete below count every C++ heap allocation of
+// the process (OpenFHE's limb buffers included) while tracking is on.
+// Sizes are malloc_usable_size, so freed bytes are comparable to allocated
+// ones. liveBytes is relative to reset() and may go negative when memory
+// allocated earlier is freed.
+struct AllocationCounters {
+    std::atomic<bool> tracking{false};
+    std::atomic<uint64_t> allocations{0};
+    std::atomic<uint64_t> frees{0};
+    std::atomic<uint64_t> allocatedBytes{0};
+    std::atomic<uint64_t> freedBytes{0};
+    std::atomic<int64_t> liveBytes{0};
+    std::atomic<int64_t> peakLiveBytes{0};
+    std::atomic<uint64_t> poolHits{0};  // -DBENCH_ALLOCATOR=pool only
+    
+    void reset() {
+        poolHits = 0;
+        allocations = 0;
+        frees = 0;
+        allocatedBytes = 0;
+        freedBytes = 0;
+        liveBytes = 0;
+        peakLiveBytes = 0;
+    }
+    
+    void recordAllocation(std::size_t bytes) {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        allocatedBytes.fetch_add(bytes, std::memory_order_relaxed);
+        int64_t live = liveBytes.fetch_add(static_cast<int64_t>(bytes), std::memory_order_relaxed) +
+                       static_cast<int64_t>(bytes);
+        int64_t peak = peakLiveBytes.load(std::memory_order_relaxed);
+        while (live > peak && !peakLiveBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+        }
+    }
+    
+    void recordFree(std::size_t bytes) {
+        frees.fetch_add(1, std::memory_order_relaxed);
+        freedBytes.fetch_add(bytes, std::memory_order_relaxed);
+        liveBytes.fetch_sub(static_cast<int64_t>(bytes), std::memory_order_relaxed);
+    }
+};
+
+inline AllocationCounters allocationCounters;
+
+#ifdef BENCH_ALLOCATOR_POOL
+// Size-class block pool behind operator new (-DBENCH_ALLOCATOR=pool)
+// Blocks above 2 KiB are rounded up to a power of two. A freed block goes
+// onto its class's free list (linked through the block itself) and serves
+// the next allocation of that class without malloc or fresh page faults.
+// The diagonal loops free each rotation/product temporary shortly before
+// allocating one of the same size, so their limb buffers get recycled.
+// Retained blocks are never returned to the system.
+class BlockPool {
+public:
+    void* allocate(std::size_t size, bool& reused) {
+        reused = false;
+        if (size <= (std::size_t{1} << (MIN_CLASS - 1))) return std::malloc(size > 0 ? size : 1);
+        
+        int sizeClass = 64 - __builtin_clzll(size - 1);
+        if (sizeClass > MAX_CLASS) return std::malloc(size);
+        
+        FreeList& list = lists[sizeClass];
+        {
+            std::lock_guard<std::mutex> lock(list.mutex);
+            if (list.head) {
+                void* block = list.head;
+                list.head = *static_cast<void**>(block);
+                reused = true;
+                return block;
+            }
+        }
+        return std::malloc(std::size_t{1} << sizeClass);
+    }
+    
+    // usableSize is malloc_usable_size(ptr): at least the class size and
+    // below twice of it, so it identifies the class
+    void release(void* ptr, std::size_t usableSize) {
+        int sizeClass = 63 - __builtin_clzll(usableSize);
+        if (sizeClass < MIN_CLASS || sizeClass > MAX_CLASS) {
+            std::free(ptr);
+            return;
+        }
+        
+        FreeList& list = lists[sizeClass];
+        std::lock_guard<std::mutex> lock(list.mutex);
+        *static_cast<void**>(ptr) = list.head;
+        list.head = ptr;
+    }
+    
+private:
+    static constexpr int MIN_CLASS = 12;  // 4 KiB
+    static constexpr int MAX_CLASS = 40;
+    
+    struct FreeList {
+        std::mutex mutex;
+        void* head = nullptr;
+    };
+    FreeList lists[MAX_CLASS + 1];
+};
+
+inline BlockPool blockPool;
+#endif
+
+// Replaced global allocation functions; the array and sized forms are
+// defined explicitly below and nothrow forms forward to these. Outside
+// --measure=memory they cost one relaxed load.
+// In openfhe-bench they are defined once, by openfhe-bench.cpp; utils.cpp is
+// always built with BENCH_KERNEL_LIBRARY, so bench_common never defines them.
+#ifndef BENCH_KERNEL_LIBRARY
+void* operator new(std::size_t size) {
+#ifdef BENCH_ALLOCATOR_POOL
+    bool reused;
+    void* ptr = blockPool.allocate(size, reused);
+#else
+    void* ptr = std::malloc(size > 0 ? size : 1);
+#endif
+    if (!ptr) throw std::bad_alloc();
+    if (allocationCounters.tracking.load(std::memory_order_relaxed)) {
+        allocationCounters.recordAllocation(malloc_usable_size(ptr));
+#ifdef BENCH_ALLOCATOR_POOL
+        if (reused) allocationCounters.poolHits.fetch_add(1, std::memory_order_relaxed);
+#endif
+    }
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+    if (!ptr) return;
+    std::size_t usableSize = malloc_usable_size(ptr);
+    if (allocationCounters.tracking.load(std::memory_order_relaxed)) {
+        allocationCounters.recordFree(usableSize);
+    }
+#ifdef BENCH_ALLOCATOR_POOL
+    blockPool.release(ptr, usableSize);
+#else
+    std::free(ptr);
+#endif
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void operator delete[](void* ptr) noexcept {
+    operator delete(ptr);
+}
+
+// The class comes from malloc_usable_size, so the size hint is not needed
+void operator delete(void* ptr, std::size_t) noexcept {
+    operator delete(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept {
+    operator delete(ptr);
+}
+#endif
+
 // Measurement modes
 enum class MeasurementMode {
     LATENCY,
     DRAM,
-    PIN
+    PIN,
+    MEMORY,
+    PERF
 };
 
 // Simple command-line argument parser
@@ -46,196 +245,2141 @@ public:
         }
     }
     
-    std::string getString(const std::string& key, const std::string& defaultVal = "") const {
-        auto it = args.find(key);
-        return (it != args.end()) ? it->second : defaultVal;
+    std::string getString(const std::string& key, const std::string& defaultVal = "") const {
+        auto it = args.find(key);
+        return (it != args.end()) ? it->second : defaultVal;
+    }
+    
+    uint32_t getUInt32(const std::string& key, uint32_t defaultVal = 0) const {
+        auto it = args.find(key);
+        return (it != args.end()) ? std::stoul(it->second) : defaultVal;
+    }
+    
+    bool getBool(const std::string& key, bool defaultVal = false) const {
+        auto it = args.find(key);
+        return (it != args.end()) ? (it->second == "true") : defaultVal;
+    }
+    
+    bool getDebug() const {
+        return getBool("debug", false);
+    }
+    
+    MeasurementMode getMeasurementMode() const {
+        std::string mode = getString("measure", "latency");
+        if (mode == "dram") return MeasurementMode::DRAM;
+        if (mode == "pin") return MeasurementMode::PIN;
+        if (mode == "memory") return MeasurementMode::MEMORY;
+        if (mode == "perf") return MeasurementMode::PERF;
+        return MeasurementMode::LATENCY;  // default
+    }
+};
+
+// Comma-separated option value, e.g. --media=memory,tmpfs or (with
+// T = uint32_t) --ring-dims=8192,16384; empty items are skipped
+template <typename T = std::string>
+inline std::vector<T> parseCommaList(const std::string& spec) {
+    std::vector<T> values;
+    std::stringstream list(spec);
+    std::string item;
+    while (std::getline(list, item, ',')) {
+        if (item.empty()) continue;
+        if constexpr (std::is_same_v<T, std::string>) {
+            values.push_back(item);
+        } else {
+            values.push_back(static_cast<T>(std::stoul(item)));
+        }
+    }
+    return values;
+}
+
+// Benchmark parameters
+struct BenchmarkParams {
+    uint32_t ringDim;
+    uint32_t multDepth;
+    uint32_t numDigits;
+    bool checkSecurity;
+    ScalingTechnique scaling;
+    KeySwitchTechnique keySwitch;
+    uint32_t digitSize;  // BV only; 0 lets OpenFHE choose
+    
+    static BenchmarkParams fromArgs(const ArgParser& parser) {
+        return {
+            .ringDim = parser.getUInt32("ring-dim"),
+            .multDepth = parser.getUInt32("mult-depth"),
+            .numDigits = parser.getUInt32("num-digits"),
+            .checkSecurity = parser.getBool("check-security"),
+            .scaling = scalingFromName(parser.getString("scaling", "FLEXIBLEAUTO")),
+            .keySwitch = keySwitchFromName(parser.getString("ks-tech", "hybrid")),
+            .digitSize = parser.getUInt32("digit-size", 0)
+        };
+    }
+    
+    // FIXEDMANUAL: EvalMult leaves products unrescaled; the kernels rescale
+    bool manualRescale() const { return scaling == FIXEDMANUAL; }
+    
+    // --scaling=FIXEDMANUAL|FLEXIBLEAUTO|FLEXIBLEAUTOEXT (any case)
+    static ScalingTechnique scalingFromName(std::string name) {
+        std::transform(name.begin(), name.end(), name.begin(),
+                       [](unsigned char c) { return static_cast<char>(std::toupper(c)); });
+        if (name == "FIXEDMANUAL") return FIXEDMANUAL;
+        if (name == "FLEXIBLEAUTOEXT") return FLEXIBLEAUTOEXT;
+        return FLEXIBLEAUTO;  // default
+    }
+    
+    // --ks-tech=hybrid|bv (any case): HYBRID splits the limbs into
+    // --num-digits digits with extra P primes; BV decomposes every limb
+    // into --digit-size-bit digits and needs no P
+    static KeySwitchTechnique keySwitchFromName(std::string name) {
+        std::transform(name.begin(), name.end(), name.begin(),
+                       [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        return (name == "bv") ? BV : HYBRID;
+    }
+    
+    const char* keySwitchName() const { return keySwitch == BV ? "bv" : "hybrid"; }
+};
+
+// CKKS cryptocontext shared by all benchmarks (50-bit scaling primes, --ks-tech
+// key switching) with PKE, KEYSWITCH and LEVELEDSHE enabled.
+// bootstrapDepth > 0 builds a bootstrappable context instead: that many levels
+// on top of params.multDepth, uniform ternary secrets, the 59/60-bit moduli
+// OpenFHE's bootstrapping precision relies on, and ADVANCEDSHE and FHE enabled
+CryptoContext<DCRTPoly> makeCryptoContext(const BenchmarkParams& params, uint32_t bootstrapDepth = 0);
+
+// Benchmark entry points
+// Each example ends with BENCHMARK_KERNEL("<name>", <entry>). Built alone
+// (-DBENCH_SOURCE) that defines main(); built into openfhe-bench
+// (BENCH_KERNEL_LIBRARY) it registers <entry> for --kernel=<name>.
+using KernelEntry = int (*)(int argc, char* argv[]);
+
+inline std::map<std::string, KernelEntry>& kernelRegistry() {
+    static std::map<std::string, KernelEntry> registry;
+    return registry;
+}
+
+struct KernelRegistration {
+    KernelRegistration(const char* name, KernelEntry entry) {
+        kernelRegistry()[name] = entry;
+    }
+};
+
+// Runs a kernel entry; an exception escaping it (a missing or corrupt key
+// from RotationKeyStore, a bad matrix file) ends the run with exit code 1
+inline int runKernel(KernelEntry entry, int argc, char* argv[]) {
+    try {
+        return entry(argc, argv);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+}
+
+#ifdef BENCH_KERNEL_LIBRARY
+#define BENCHMARK_KERNEL(name, entry) static KernelRegistration entry##Registration(name, entry)
+#else
+#define BENCHMARK_KERNEL(name, entry) \
+    int main(int argc, char* argv[]) { return runKernel(entry, argc, argv); }
+#endif
+
+// Throughput-mode thread split
+// --outer-threads=T  run independent operations (batch ciphertexts, and the
+//                    diagonals / giant blocks of the non-hoisted kernels) as
+//                    OpenMP tasks on T threads; idle threads take queued tasks
+// --inner-threads=I  threads of each operation's OpenFHE loops (default 1)
+// Without --outer-threads all parallelism stays inside OpenFHE (--threads).
+struct ThreadSplit {
+    uint32_t outer = 0;
+    uint32_t inner = 0;
+    
+    bool enabled() const { return outer > 1; }
+};
+
+inline ThreadSplit& threadSplit() {
+    static ThreadSplit split;
+    return split;
+}
+
+// NUMA mode (multi-socket nodes)
+// --numa-pin=none|compact|scatter  bind OpenMP thread t to one node's CPUs:
+//                                  compact fills node 0 before node 1, scatter
+//                                  deals the threads round-robin over the nodes
+// --numa-membind=<policy>          placement of every thread's allocations
+//                                  (ciphertexts and temporaries)
+// --numa-key-membind=<policy>      rotation keys, as the key store loads them
+// --numa-ptxt-membind=<policy>     diagonal plaintexts, as they are encoded or loaded
+//   <policy> is none (first touch), local, interleave (all nodes) or a node number
+// --numa-key-replicas=true         the key store keeps one copy of each key per
+//                                  node and threads rotate with their node's copy
+// Threads are bound to a node's CPU set rather than a single core, so nested
+// --inner-threads teams (which inherit it) stay on their node. libgomp keeps
+// its pool threads, so the binding also holds for OpenFHE's own loops.
+enum class NumaPin { NONE, COMPACT, SCATTER };
+
+// "0-3,8,10-11" (sysfs cpulist format) -> {0, 1, 2, 3, 8, 10, 11}
+inline std::vector<int> parseCpuList(const std::string& list) {
+    std::vector<int> cpus;
+    std::stringstream ranges(list);
+    std::string range;
+    while (std::getline(ranges, range, ',')) {
+        if (range.empty() || !std::isdigit(static_cast<unsigned char>(range[0]))) continue;
+        auto dash = range.find('-');
+        int first = std::stoi(range.substr(0, dash));
+        int last = (dash == std::string::npos) ? first : std::stoi(range.substr(dash + 1));
+        for (int cpu = first; cpu <= last; ++cpu) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+// NUMA nodes (node0..nodeN-1 in /sys/devices/system/node) and the CPUs of
+// each that the process may run on, read once at startup
+struct NumaTopology {
+    std::vector<std::vector<int>> nodeCpus;  // empty for memory-only nodes
+    std::vector<int> cpuNode;                // node of each CPU, -1 if not usable
+    
+    std::size_t numNodes() const { return nodeCpus.size(); }
+    
+    int nodeOf(int cpu) const {
+        return (cpu >= 0 && static_cast<std::size_t>(cpu) < cpuNode.size()) ? cpuNode[cpu] : -1;
+    }
+    
+    // Node of the CPU the calling thread is running on (0 if unknown)
+    int currentNode() const {
+        return std::max(0, nodeOf(sched_getcpu()));
+    }
+};
+
+inline const NumaTopology& numaTopology() {
+    static const NumaTopology topology = [] {
+        NumaTopology t;
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        sched_getaffinity(0, sizeof(allowed), &allowed);
+        
+        auto addCpu = [&](int cpu, int node) {
+            if (cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, &allowed)) return;
+            t.nodeCpus[node].push_back(cpu);
+            if (static_cast<std::size_t>(cpu) >= t.cpuNode.size()) t.cpuNode.resize(cpu + 1, -1);
+            t.cpuNode[cpu] = node;
+        };
+        
+        for (int node = 0;; ++node) {
+            std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+            if (!file.is_open()) break;
+            std::string list;
+            std::getline(file, list);
+            t.nodeCpus.emplace_back();
+            for (int cpu : parseCpuList(list)) {
+                addCpu(cpu, node);
+            }
+        }
+        
+        // Kernel without NUMA support: one node with every usable CPU
+        if (t.nodeCpus.empty()) {
+            t.nodeCpus.emplace_back();
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+                addCpu(cpu, 0);
+            }
+        }
+        return t;
+    }();
+    return topology;
+}
+
+// A set_mempolicy(2) policy for the calling thread's future page faults.
+// The default-constructed policy is inactive (first touch).
+struct MemoryPolicy {
+    int mode = MPOL_DEFAULT;
+    unsigned long nodemask = 0;  // nodes 0..63
+    
+    bool active() const { return mode != MPOL_DEFAULT; }
+    
+    static MemoryPolicy bind(int node) {
+        return {MPOL_BIND, 1UL << node};
+    }
+    
+    // none, local, interleave or a node number; anything else is none
+    static MemoryPolicy parse(const std::string& spec) {
+        if (spec == "local") return {MPOL_LOCAL, 0};
+        if (spec == "interleave") {
+            MemoryPolicy policy{MPOL_INTERLEAVE, 0};
+            for (std::size_t node = 0; node < std::min<std::size_t>(64, numaTopology().numNodes()); ++node) {
+                policy.nodemask |= 1UL << node;
+            }
+            return policy;
+        }
+        if (!spec.empty() && spec.size() <= 2 &&
+            std::all_of(spec.begin(), spec.end(), [](unsigned char c) { return std::isdigit(c); })) {
+            int node = std::stoi(spec);
+            if (node < 64) return bind(node);
+        }
+        return {};
+    }
+    
+    bool apply() const {
+        return syscall(SYS_set_mempolicy, mode, nodemask ? &nodemask : nullptr,
+                       nodemask ? 8 * sizeof(nodemask) : 0) == 0;
+    }
+};
+
+struct NumaConfig {
+    NumaPin pin = NumaPin::NONE;
+    MemoryPolicy membind;
+    MemoryPolicy keyMembind;
+    MemoryPolicy ptxtMembind;
+    bool keyReplicas = false;
+    std::vector<uint32_t> nodeThreads;  // pinned OpenMP threads per node
+    
+    bool enabled() const {
+        return pin != NumaPin::NONE || membind.active() || keyMembind.active() ||
+               ptxtMembind.active() || keyReplicas;
+    }
+};
+
+inline NumaConfig& numaConfig() {
+    static NumaConfig config;
+    return config;
+}
+
+// Apply policy on the calling thread and on every thread of the OpenMP pool
+inline void applyToPool(const MemoryPolicy& policy) {
+    bool ok = policy.apply();
+    #pragma omp parallel reduction(&& : ok)
+    ok = policy.apply();
+    if (!ok) std::cerr << "Warning: set_mempolicy failed, pages stay on first touch\n";
+}
+
+// Places the allocations made during its lifetime with policy, then restores
+// --numa-membind. Covers the calling thread, or the whole OpenMP pool when
+// pool is set (allocations inside OpenFHE's parallel loops). Not for use
+// inside a parallel region.
+class ScopedMemoryPolicy {
+private:
+    bool active;
+    bool pool;
+    
+public:
+    ScopedMemoryPolicy(const MemoryPolicy& policy, bool wholePool = false)
+        : active(policy.active()), pool(wholePool) {
+        if (!active) return;
+        if (pool) {
+            applyToPool(policy);
+        } else {
+            policy.apply();
+        }
+    }
+    
+    ~ScopedMemoryPolicy() {
+        if (!active) return;
+        if (pool) {
+            applyToPool(numaConfig().membind);
+        } else {
+            numaConfig().membind.apply();
+        }
+    }
+    
+    ScopedMemoryPolicy(const ScopedMemoryPolicy&) = delete;
+    ScopedMemoryPolicy& operator=(const ScopedMemoryPolicy&) = delete;
+};
+
+// Bind each OpenMP pool thread to the CPUs of the node the pin policy gives it
+inline void pinThreads(NumaConfig& numa) {
+    const NumaTopology& topology = numaTopology();
+    std::vector<int> nodes;  // nodes with usable CPUs
+    std::size_t totalCpus = 0;
+    for (std::size_t node = 0; node < topology.numNodes(); ++node) {
+        if (topology.nodeCpus[node].empty()) continue;
+        nodes.push_back(static_cast<int>(node));
+        totalCpus += topology.nodeCpus[node].size();
+    }
+    if (nodes.empty()) return;
+    
+    numa.nodeThreads.assign(topology.numNodes(), 0);
+    #pragma omp parallel
+    {
+        std::size_t t = static_cast<std::size_t>(omp_get_thread_num());
+        int node = nodes[t % nodes.size()];
+        if (numa.pin == NumaPin::COMPACT) {
+            std::size_t slot = t % totalCpus;
+            for (int n : nodes) {
+                if (slot < topology.nodeCpus[n].size()) {
+                    node = n;
+                    break;
+                }
+                slot -= topology.nodeCpus[n].size();
+            }
+        }
+        
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        for (int cpu : topology.nodeCpus[node]) {
+            CPU_SET(cpu, &cpus);
+        }
+        sched_setaffinity(0, sizeof(cpus), &cpus);
+        
+        #pragma omp atomic
+        numa.nodeThreads[node]++;
+    }
+}
+
+// Thread setup
+inline void setupThreads(const ArgParser& parser) {
+    uint32_t requested = parser.getUInt32("threads", 0);
+    
+    if (requested > 0) {
+        omp_set_num_threads(requested);
+    }
+    
+    uint32_t outer = parser.getUInt32("outer-threads", 0);
+    if (outer > 0) {
+        threadSplit() = {outer, std::max<uint32_t>(1, parser.getUInt32("inner-threads", 1))};
+        // Level 1: the task pool; level 2: OpenFHE's loops inside each task
+        omp_set_max_active_levels(2);
+    }
+    
+    NumaConfig& numa = numaConfig();
+    std::string pin = parser.getString("numa-pin", "none");
+    numa.pin = (pin == "compact") ? NumaPin::COMPACT
+             : (pin == "scatter") ? NumaPin::SCATTER
+                                  : NumaPin::NONE;
+    numa.membind = MemoryPolicy::parse(parser.getString("numa-membind", "none"));
+    numa.keyMembind = MemoryPolicy::parse(parser.getString("numa-key-membind", "none"));
+    numa.ptxtMembind = MemoryPolicy::parse(parser.getString("numa-ptxt-membind", "none"));
+    numa.keyReplicas = parser.getBool("numa-key-replicas") && numaTopology().numNodes() > 1;
+    
+    // Pin first, so local placement refers to each thread's final node
+    if (numa.pin != NumaPin::NONE) pinThreads(numa);
+    if (numa.membind.active()) applyToPool(numa.membind);
+}
+
+// Run f(t) for independent operations t = 0..count-1. With --outer-threads
+// they are OpenMP tasks on the outer threads, each running OpenFHE with
+// --inner-threads; otherwise (or when already inside a task) they run in
+// order. f must not open measurement regions: the region stack is serial.
+template <typename F>
+void forEachTask(std::size_t count, F&& f) {
+    const ThreadSplit& split = threadSplit();
+    if (!split.enabled() || count <= 1 || omp_in_parallel()) {
+        for (std::size_t t = 0; t < count; ++t) {
+            f(t);
+        }
+        return;
+    }
+    
+    #pragma omp parallel num_threads(split.outer)
+    {
+        omp_set_num_threads(split.inner);
+        #pragma omp single
+        for (std::size_t t = 0; t < count; ++t) {
+            #pragma omp task firstprivate(t)
+            f(t);
+        }
+    }
+}
+
+// Batched ciphertexts (--batch=B): element b holds the b-th input's value
+using CiphertextBatch = std::vector<Ciphertext<DCRTPoly>>;
+
+// Run f(b) for every ciphertext of a batch, in parallel across ciphertexts.
+// A batch of one stays serial so OpenFHE keeps its own OpenMP parallelism.
+// With --outer-threads the ciphertexts become tasks (see forEachTask).
+template <typename F>
+void forEachInBatch(std::size_t batchSize, F&& f) {
+    if (threadSplit().enabled()) {
+        forEachTask(batchSize, f);
+        return;
+    }
+    
+    #pragma omp parallel for schedule(dynamic) if (batchSize > 1)
+    for (std::size_t b = 0; b < batchSize; ++b) {
+        f(b);
+    }
+}
+
+// Hardware counters for --measure=perf (perf_event_open)
+// Each thread of the process gets one counter group led by cycles, opened
+// on the first start() and summed per event at the end. inherit adds the
+// threads a counted thread spawns later. Counts are user-space only (works
+// with perf_event_paranoid <= 2) and scaled by enabled/running time when
+// the PMU multiplexes. Events the CPU or kernel rejects are left out.
+// Default events: cycles, instructions, llc-misses, branch-misses and, on
+// Intel, l2-misses (L2_RQSTS.MISS) and, with AVX-512, avx512-ops
+// (FP_ARITH_INST_RETIRED.512B_PACKED_*; FP only, integer AVX-512 has no
+// architectural event). --perf-events=name:0xconfig,... adds raw events.
+class PerfCounters {
+public:
+    PerfCounters() {
+        addEvent("cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+        addEvent("instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+        addEvent("llc-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+        addEvent("branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+        
+        std::ifstream cpuinfo("/proc/cpuinfo");
+        std::string line;
+        bool intel = false;
+        bool avx512 = false;
+        while (std::getline(cpuinfo, line)) {
+            if (line.rfind("vendor_id", 0) == 0) intel = line.find("GenuineIntel") != std::string::npos;
+            if (line.rfind("flags", 0) == 0) {
+                avx512 = line.find(" avx512f") != std::string::npos;
+                break;
+            }
+        }
+        if (intel) addEvent("l2-misses", PERF_TYPE_RAW, 0x3f24);
+        if (intel && avx512) addEvent("avx512-ops", PERF_TYPE_RAW, 0xc0c7);
+    }
+    
+    ~PerfCounters() {
+        for (auto& thread : threads) {
+            for (int fd : thread.fds) {
+                if (fd >= 0) close(fd);
+            }
+        }
+    }
+    
+    // --perf-events=name:0xconfig,... (raw PMU event encodings)
+    void addRawEvents(const std::string& spec) {
+        for (const std::string& item : parseCommaList(spec)) {
+            auto colon = item.find(':');
+            if (colon == std::string::npos) continue;
+            addEvent(item.substr(0, colon), PERF_TYPE_RAW, std::stoull(item.substr(colon + 1), nullptr, 0));
+        }
+    }
+    
+    void start() {
+        if (!opened) openAll();
+        for (const auto& thread : threads) {
+            if (thread.fds[0] >= 0) ioctl(thread.fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+    }
+    
+    void stop() {
+        for (const auto& thread : threads) {
+            if (thread.fds[0] >= 0) ioctl(thread.fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        }
+    }
+    
+    // PERF_THREADS, PERF_<EVENT> totals, then one record per thread:
+    // THREAD tid=<tid> <event>=<count> ...
+    void printResults() const {
+        std::vector<uint64_t> totals(events.size(), 0);
+        std::vector<bool> counted(events.size(), false);
+        std::vector<std::vector<uint64_t>> perThread;
+        
+        for (const auto& thread : threads) {
+            std::vector<uint64_t> counts(events.size(), 0);
+            for (std::size_t e = 0; e < events.size(); ++e) {
+                if (thread.fds[e] < 0) continue;
+                
+                struct { uint64_t value, enabled, running; } reading{};
+                if (read(thread.fds[e], &reading, sizeof(reading)) != sizeof(reading)) continue;
+                counts[e] = reading.running > 0
+                    ? static_cast<uint64_t>(static_cast<double>(reading.value) * reading.enabled / reading.running)
+                    : 0;
+                totals[e] += counts[e];
+                counted[e] = true;
+            }
+            perThread.push_back(counts);
+        }
+        
+        std::cout << "PERF_THREADS=" << threads.size() << "\n";
+        for (std::size_t e = 0; e < events.size(); ++e) {
+            if (counted[e]) std::cout << "PERF_" << events[e].key << "=" << totals[e] << "\n";
+        }
+        for (std::size_t t = 0; t < threads.size(); ++t) {
+            std::cout << "THREAD tid=" << threads[t].tid;
+            for (std::size_t e = 0; e < events.size(); ++e) {
+                if (counted[e]) std::cout << " " << events[e].name << "=" << perThread[t][e];
+            }
+            std::cout << "\n";
+        }
+    }
+    
+private:
+    struct Event {
+        std::string name;
+        std::string key;  // PERF_<key> output name
+        uint32_t type;
+        uint64_t config;
+    };
+    
+    struct ThreadCounters {
+        pid_t tid;
+        std::vector<int> fds;  // per event, -1 if it could not be opened
+    };
+    
+    std::vector<Event> events;
+    std::vector<ThreadCounters> threads;
+    bool opened = false;
+    
+    void addEvent(const std::string& name, uint32_t type, uint64_t config) {
+        std::string key = name;
+        for (char& c : key) c = (c == '-') ? '_' : static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+        events.push_back({name, key, type, config});
+    }
+    
+    static int openEvent(const Event& event, pid_t tid, int groupFd) {
+        struct perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = event.type;
+        attr.config = event.config;
+        attr.disabled = (groupFd < 0) ? 1 : 0;  // the group follows its leader
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        return static_cast<int>(syscall(SYS_perf_event_open, &attr, tid, -1, groupFd, 0));
+    }
+    
+    // One group per thread of /proc/self/task; threads without a leader
+    // (cycles rejected) carry no counters
+    void openAll() {
+        opened = true;
+        std::error_code error;
+        for (const auto& entry : std::filesystem::directory_iterator("/proc/self/task", error)) {
+            ThreadCounters thread{static_cast<pid_t>(std::stol(entry.path().filename().string())),
+                                  std::vector<int>(events.size(), -1)};
+            thread.fds[0] = openEvent(events[0], thread.tid, -1);
+            if (thread.fds[0] >= 0) {
+                for (std::size_t e = 1; e < events.size(); ++e) {
+                    thread.fds[e] = openEvent(events[e], thread.tid, thread.fds[0]);
+                }
+                ioctl(thread.fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            }
+            threads.push_back(std::move(thread));
+        }
+    }
+};
+
+// Per-socket DRAM traffic for --measure=dram, from the uncore memory
+// controller PMUs (uncore_imc_N under /sys/bus/event_source/devices; CAS
+// read/write counts of 64 bytes each). The counters are system-wide, opened
+// on the CPU of each socket that the PMU's cpumask names and summed per
+// socket over every startDRAM/stopDRAM window. Traffic served by a socket
+// that ran no threads (NUMA_NODE<n>_THREADS) crossed the interconnect.
+// Needs the same system-wide perf access as DRAMCounter; PMUs that cannot be
+// opened are left out, and CPUs without the uncore IMC PMU report nothing.
+class SocketDramCounters {
+public:
+    ~SocketDramCounters() {
+        for (const auto& counter : counters) {
+            close(counter.fd);
+        }
+    }
+    
+    // False if no memory controller counter could be opened
+    bool init() {
+        std::error_code error;
+        for (const auto& entry : std::filesystem::directory_iterator("/sys/bus/event_source/devices", error)) {
+            std::string pmu = entry.path().filename().string();
+            if (pmu.rfind("uncore_imc_", 0) != 0 || pmu.find("free_running") != std::string::npos) continue;
+            
+            uint32_t type = static_cast<uint32_t>(std::stoul("0" + readLine(entry.path() / "type")));
+            std::vector<int> cpus = parseCpuList(readLine(entry.path() / "cpumask"));
+            for (bool write : {false, true}) {
+                uint64_t config = 0;
+                if (!eventConfig(entry.path(), write ? "cas_count_write" : "cas_count_read", config)) continue;
+                for (int cpu : cpus) {
+                    int fd = openCounter(type, config, cpu);
+                    if (fd >= 0) counters.push_back({socketOf(cpu), write, fd, 0});
+                }
+            }
+        }
+        return !counters.empty();
+    }
+    
+    void start() {
+        for (const auto& counter : counters) {
+            ioctl(counter.fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(counter.fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+    
+    void stop() {
+        for (auto& counter : counters) {
+            ioctl(counter.fd, PERF_EVENT_IOC_DISABLE, 0);
+            uint64_t value = 0;
+            if (read(counter.fd, &value, sizeof(value)) == sizeof(value)) counter.casCount += value;
+        }
+    }
+    
+    // DRAM_SOCKET<s>_READ_BYTES / _WRITE_BYTES / _TOTAL_BYTES per socket
+    void printResults() const {
+        std::map<int, std::pair<uint64_t, uint64_t>> bytes;  // socket -> (read, write)
+        for (const auto& counter : counters) {
+            auto& socket = bytes[counter.socket];
+            (counter.write ? socket.second : socket.first) += counter.casCount * 64;
+        }
+        for (const auto& [socket, rw] : bytes) {
+            std::cout << "DRAM_SOCKET" << socket << "_READ_BYTES=" << rw.first << "\n";
+            std::cout << "DRAM_SOCKET" << socket << "_WRITE_BYTES=" << rw.second << "\n";
+            std::cout << "DRAM_SOCKET" << socket << "_TOTAL_BYTES=" << rw.first + rw.second << "\n";
+        }
+    }
+    
+private:
+    struct Counter {
+        int socket;
+        bool write;
+        int fd;
+        uint64_t casCount;
+    };
+    
+    std::vector<Counter> counters;
+    
+    static std::string readLine(const std::filesystem::path& path) {
+        std::ifstream file(path);
+        std::string line;
+        std::getline(file, line);
+        return line;
+    }
+    
+    static int socketOf(int cpu) {
+        std::string id = readLine("/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/physical_package_id");
+        return id.empty() ? 0 : std::stoi(id);
+    }
+    
+    // Encodes events/<event> ("event=0x04,umask=0x03") through the PMU's
+    // format/<term> bit ranges ("config:8-15")
+    static bool eventConfig(const std::filesystem::path& pmu, const std::string& event, uint64_t& config) {
+        std::string terms = readLine(pmu / "events" / event);
+        if (terms.empty()) return false;
+        
+        config = 0;
+        std::stringstream list(terms);
+        std::string term;
+        while (std::getline(list, term, ',')) {
+            auto eq = term.find('=');
+            std::string name = term.substr(0, eq);
+            uint64_t value = (eq == std::string::npos) ? 1 : std::stoull(term.substr(eq + 1), nullptr, 0);
+            
+            std::string format = readLine(pmu / "format" / name);
+            if (format.rfind("config:", 0) != 0) return false;
+            config |= value << std::stoi(format.substr(7));
+        }
+        return true;
+    }
+    
+    static int openCounter(uint32_t type, uint64_t config, int cpu) {
+        struct perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = 1;
+        return static_cast<int>(syscall(SYS_perf_event_open, &attr, -1, cpu, -1, 0));
+    }
+};
+
+// Nearest-rank percentile of sorted samples (0 when there are none)
+inline uint64_t nearestRankPercentile(const std::vector<uint64_t>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    std::size_t rank = static_cast<std::size_t>(std::ceil(p * sorted.size()));
+    return sorted[std::min(sorted.size() - 1, rank > 0 ? rank - 1 : 0)];
+}
+
+// Measurement wrapper
+class MeasurementSystem {
+private:
+    MeasurementMode mode;
+    DRAMCounter dramCounter;
+    bool dramInitialized = false;
+    SocketDramCounters socketDram;  // DRAM mode only
+    bool socketDramInitialized = false;
+    PerfCounters perfCounters;  // PERF mode only
+    
+    // In-process latency harness (LATENCY mode only)
+    uint32_t warmupRuns = 0;
+    uint32_t timedRuns = 1;
+    std::vector<uint64_t> latencySamples;
+    
+    // Named regions, printed in first-entry order
+    struct RegionStats {
+        uint64_t calls = 0;
+        uint64_t totalNs = 0;
+        uint64_t readBytes = 0;
+        uint64_t writeBytes = 0;
+        uint64_t allocatedBytes = 0;  // MEMORY mode only
+        uint64_t allocations = 0;
+        uint64_t startAllocatedBytes = 0;
+        uint64_t startAllocations = 0;
+        std::chrono::steady_clock::time_point start;
+        std::unique_ptr<DRAMCounter> counter;  // DRAM mode only
+    };
+    std::map<std::string, RegionStats> regions;
+    std::vector<std::string> regionOrder;
+    bool recordRegions = true;  // false during warmup runs
+    std::string pinRegion;      // if set, PIN markers (and PERF counters) wrap only this region
+    uint32_t batchSize = 0;     // ciphertexts per kernel run; 0 if not batched
+    
+    // MEMORY mode: peak RSS and page faults of the measured kernel
+    uint64_t kernelPeakRssBytes = 0;
+    uint64_t kernelMinorFaults = 0;
+    uint64_t kernelMajorFaults = 0;
+    bool rssPeakReset = false;
+    
+public:
+    MeasurementSystem(MeasurementMode m);
+    
+    // Reads --measure, --warmup and --repetitions
+    explicit MeasurementSystem(const ArgParser& parser);
+    
+    MeasurementMode getMode() const { return mode; }
+    
+    // Median of the timed runs (LATENCY mode; 0 before measureKernel)
+    uint64_t medianLatencyNs() const;
+    
+    // Batched benchmarks report throughput and DRAM bytes per ciphertext
+    void setBatchSize(uint32_t ciphertexts) { batchSize = ciphertexts; }
+    
+    void startDRAM();
+    void stopDRAM();
+    
+    // PIN markers; in PERF mode the hardware counters run between them
+    void startPIN();
+    void endPIN();
+    
+    // Run the measured kernel. In LATENCY mode it is run warmupRuns times
+    // untimed, then timedRuns times with a steady clock around each call.
+    // In DRAM/PIN/PERF mode it runs exactly once between the PIN markers, and in
+    // MEMORY mode exactly once with the allocation counters on.
+    // The kernel must be repeatable: it may not consume its own inputs.
+    template <typename Kernel>
+    void measureKernel(Kernel&& kernel) {
+        if (mode == MeasurementMode::MEMORY) {
+            // Writing 5 to clear_refs resets the kernel's peak RSS (VmHWM)
+            std::ofstream clearRefs("/proc/self/clear_refs");
+            rssPeakReset = static_cast<bool>(clearRefs << "5" << std::flush);
+            clearRefs.close();
+            
+            struct rusage before, after;
+            getrusage(RUSAGE_SELF, &before);
+            allocationCounters.reset();
+            allocationCounters.tracking = true;
+            kernel();
+            allocationCounters.tracking = false;
+            getrusage(RUSAGE_SELF, &after);
+            
+            kernelPeakRssBytes = readPeakRssBytes();
+            kernelMinorFaults = static_cast<uint64_t>(after.ru_minflt - before.ru_minflt);
+            kernelMajorFaults = static_cast<uint64_t>(after.ru_majflt - before.ru_majflt);
+            return;
+        }
+        
+        if (mode != MeasurementMode::LATENCY) {
+            if (pinRegion.empty()) startPIN();
+            kernel();
+            if (pinRegion.empty()) endPIN();
+            return;
+        }
+        
+        recordRegions = false;
+        for (uint32_t i = 0; i < warmupRuns; ++i) {
+            kernel();
+        }
+        recordRegions = true;
+        
+        latencySamples.clear();
+        latencySamples.reserve(timedRuns);
+        for (uint32_t i = 0; i < timedRuns; ++i) {
+            auto start = std::chrono::steady_clock::now();
+            kernel();
+            auto stop = std::chrono::steady_clock::now();
+            latencySamples.push_back(static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count()));
+        }
+    }
+    
+    // Named phase regions; use ScopedRegion rather than calling these directly.
+    // Every entry adds to the region's call count, latency, (DRAM mode)
+    // read/write bytes and (MEMORY mode) allocated bytes and allocations. Regions may nest but must not be entered recursively
+    // or from worker threads.
+    void beginRegion(const std::string& name);
+    void endRegion(const std::string& name);
+    
+    void printResults();
+    
+private:
+    // VmHWM from /proc/self/status (0 if unavailable)
+    static uint64_t readPeakRssBytes();
+    
+    // MEMORY_PEAK_RSS_BYTES is the kernel's own peak when MEMORY_RSS_RESET=1,
+    // the process peak otherwise; MEMORY_HEAP_PEAK_BYTES is the highest heap
+    // growth over the kernel's starting point
+    void printMemoryResults() const;
+    
+    // High-water mark of the resident set (keys, plaintexts and ciphertexts)
+    void printPeakRss() const {
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        std::cout << "PEAK_RSS_BYTES=" << static_cast<uint64_t>(usage.ru_maxrss) * 1024 << "\n";
+    }
+    
+    // NUMA mode: NUMA_NODES, NUMA_KEY_REPLICAS, the pinned threads per node and
+    // where the process's resident pages ended up (/proc/self/numa_maps)
+    void printNumaResults() const;
+    
+    // Machine-readable KEY=value lines, parsed by plots/benchmarker.py
+    void printLatencyResults() const;
+    
+    // BATCH_CTXT_PER_SEC uses the median kernel latency; BATCH_DRAM_* cover the
+    // whole startDRAM/stopDRAM window (key and input loads included)
+    void printBatchResults();
+    
+    // One line per region: REGION name=<name> calls=N ns=T [read_bytes=R write_bytes=W]
+    // [allocated_bytes=A allocations=C]
+    // Totals cover every recorded entry (all timed repetitions in LATENCY mode)
+    void printRegionResults() const;
+};
+
+// RAII phase marker: ScopedRegion region(measurement, "rotate");
+class ScopedRegion {
+private:
+    MeasurementSystem& measurement;
+    std::string name;
+    
+public:
+    ScopedRegion(MeasurementSystem& m, std::string regionName)
+        : measurement(m), name(std::move(regionName)) {
+        measurement.beginRegion(name);
+    }
+    
+    ~ScopedRegion() {
+        measurement.endRegion(name);
+    }
+    
+    ScopedRegion(const ScopedRegion&) = delete;
+    ScopedRegion& operator=(const ScopedRegion&) = delete;
+};
+
+// Evaluate f() inside a named region and return its result:
+// auto rotated = inRegion(measurement, "rotate", [&] { return cc->EvalRotate(ct, k); });
+template <typename F>
+auto inRegion(MeasurementSystem& measurement, const std::string& name, F&& f) -> decltype(f()) {
+    ScopedRegion region(measurement, name);
+    return f();
+}
+
+// Sum partials[0] + partials[1] + ... with a pairwise tree of in-place adds.
+// Level s adds partials[i + s] into partials[i] for i = 0, 2s, 4s, ..., all
+// pairs and batch ciphertexts of a level in parallel, and frees the addends.
+// The sum is left in partials[0].
+inline void treeReduce(const CryptoContext<DCRTPoly>& cc, std::vector<CiphertextBatch>& partials) {
+    std::size_t batchSize = partials.empty() ? 0 : partials[0].size();
+    for (std::size_t stride = 1; stride < partials.size(); stride *= 2) {
+        std::size_t pairs = (partials.size() - stride + 2 * stride - 1) / (2 * stride);
+        forEachInBatch(pairs * batchSize, [&](std::size_t t) {
+            std::size_t i = (t / batchSize) * 2 * stride;
+            std::size_t b = t % batchSize;
+            cc->EvalAddInPlace(partials[i][b], partials[i + stride][b]);
+            partials[i + stride][b].reset();
+        });
+    }
+}
+
+// Accumulation of diagonal products with --reduction=tree (default: fold,
+// adding each product into the running sum as it is produced). Operands
+// are queued with add(); sum() multiplies all of them in parallel across
+// diagonals and batch ciphertexts, then combines the products by treeReduce.
+// Holding every product at once is the memory cost of the tree.
+class PartialProducts {
+public:
+    void add(const CiphertextBatch& operand, const Plaintext& diagonal) {
+        operands.push_back(operand);
+        diagonals.push_back(diagonal);
+    }
+    
+    bool empty() const { return operands.empty(); }
+    
+    CiphertextBatch sum(const CryptoContext<DCRTPoly>& cc, MeasurementSystem& measurement) {
+        std::size_t batchSize = operands[0].size();
+        std::vector<CiphertextBatch> partials(operands.size(), CiphertextBatch(batchSize));
+        {
+            ScopedRegion region(measurement, "ptxt-mult");
+            forEachInBatch(operands.size() * batchSize, [&](std::size_t t) {
+                std::size_t n = t / batchSize;
+                std::size_t b = t % batchSize;
+                partials[n][b] = cc->EvalMult(operands[n][b], diagonals[n]);
+            });
+        }
+        operands.clear();
+        diagonals.clear();
+        
+        ScopedRegion region(measurement, "accumulate");
+        treeReduce(cc, partials);
+        return partials[0];
+    }
+    
+private:
+    std::vector<CiphertextBatch> operands;
+    std::vector<Plaintext> diagonals;
+};
+
+// Rescale every ciphertext of a batch in place (--scaling=FIXEDMANUAL; the
+// FLEXIBLEAUTO techniques rescale on their own)
+inline void rescaleBatch(const CryptoContext<DCRTPoly>& cc, MeasurementSystem& measurement, CiphertextBatch& batch) {
+    ScopedRegion region(measurement, "rescale");
+    forEachInBatch(batch.size(), [&](std::size_t b) {
+        cc->RescaleInPlace(batch[b]);
+    });
+}
+
+// Input level (rotation, multiplication and diagonal benchmarks)
+// --start-level=L   drop the encrypted input by L levels before the measured
+//                   section, as if L multiplications had already consumed
+//                   them; its rotations, key switches and products then run
+//                   on L fewer limbs
+// --mod-switch=min  inside the measured section, right before the rotations,
+//                   drop the input to the lowest level that still leaves the
+//                   kernel its own depth (region "mod-switch")
+// Plaintexts that multiply the input are encoded at computeLevel(). Limbs are
+// dropped with Compress, which works under every scaling technique.
+class LevelControl {
+public:
+    LevelControl(const ArgParser& parser, const BenchmarkParams& params, uint32_t kernelDepth)
+        : start(parser.getUInt32("start-level", 0)),
+          toMin(parser.getString("mod-switch", "off") == "min"),
+          maxLevel(params.multDepth > kernelDepth ? params.multDepth - kernelDepth : 0) {}
+    
+    // Empty if the kernel still has its depth at --start-level, else the error
+    std::string check() const {
+        if (start <= maxLevel) return "";
+        return "--start-level=" + std::to_string(start) + " leaves too few levels (at most " +
+               std::to_string(maxLevel) + " for this kernel and --mult-depth)";
+    }
+    
+    uint32_t startLevel() const { return start; }
+    uint32_t computeLevel() const { return toMin ? maxLevel : start; }
+    
+    // Plaintext cache layout suffix; empty at level 0 so existing caches stay valid
+    std::string layoutTag() const {
+        return computeLevel() == 0 ? "" : "-level-" + std::to_string(computeLevel());
+    }
+    
+    // Setup (not measured): freshly encrypted inputs down to the start level
+    void toStartLevel(const CryptoContext<DCRTPoly>& cc, Ciphertext<DCRTPoly>& ciphertext) const {
+        ciphertext = dropTo(cc, ciphertext, start);
+    }
+    
+    void toStartLevel(const CryptoContext<DCRTPoly>& cc, CiphertextBatch& batch) const {
+        for (auto& ciphertext : batch) toStartLevel(cc, ciphertext);
+    }
+    
+    // Copy of the ciphertext at the compute level (the ciphertext itself if
+    // it is already there)
+    Ciphertext<DCRTPoly> atComputeLevel(const CryptoContext<DCRTPoly>& cc, const Ciphertext<DCRTPoly>& ciphertext) const {
+        return dropTo(cc, ciphertext, computeLevel());
+    }
+    
+    // Measured: the kernel's inputs, switched down with --mod-switch=min
+    CiphertextBatch switchDown(const CryptoContext<DCRTPoly>& cc, MeasurementSystem& measurement,
+                               const CiphertextBatch& batch) {
+        CiphertextBatch inputs = batch;
+        if (toMin) {
+            ScopedRegion region(measurement, "mod-switch");
+            forEachInBatch(inputs.size(), [&](std::size_t b) {
+                inputs[b] = atComputeLevel(cc, inputs[b]);
+            });
+        }
+        if (!inputs.empty()) limbs = inputs[0]->GetElements()[0].GetNumOfElements();
+        return inputs;
+    }
+    
+    Ciphertext<DCRTPoly> switchDown(const CryptoContext<DCRTPoly>& cc, MeasurementSystem& measurement,
+                                    const Ciphertext<DCRTPoly>& ciphertext) {
+        return switchDown(cc, measurement, CiphertextBatch{ciphertext})[0];
+    }
+    
+    // Machine-readable LEVEL_* lines, parsed by plots/benchmarker.py
+    void printResults() const {
+        std::cout << "LEVEL_START=" << start << "\n";
+        std::cout << "LEVEL_COMPUTE=" << computeLevel() << "\n";
+        std::cout << "LEVEL_LIMBS=" << limbs << "\n";
+    }
+    
+private:
+    uint32_t start;
+    bool toMin;
+    uint32_t maxLevel;
+    std::size_t limbs = 0;  // limbs of the kernel's input, seen by switchDown
+    
+    static Ciphertext<DCRTPoly> dropTo(const CryptoContext<DCRTPoly>& cc, const Ciphertext<DCRTPoly>& ciphertext,
+                                       uint32_t level) {
+        std::size_t current = ciphertext->GetLevel();
+        if (level <= current) return ciphertext;
+        std::size_t towers = ciphertext->GetElements()[0].GetNumOfElements();
+        return cc->Compress(ciphertext, static_cast<uint32_t>(towers - (level - current)));
+    }
+};
+
+// Evaluation key sizes (rotation and BSGS benchmarks), for choosing the
+// key-switching technique and digit count: serialized bytes, and in-memory
+// bytes (limbs x ring dim x 8 over the key's digit components). The rotation
+// key is one the benchmark already generated and loaded, sized as stored.
+// --key-size-relin  also generate and measure the relinearization key (the
+//                   rotation and BSGS kernels do not use one otherwise)
+class KeySizeReport {
+public:
+    KeySizeReport(const ArgParser& parser, const CryptoContext<DCRTPoly>& cc, const KeyPair<DCRTPoly>& keyPair,
+                  std::size_t rotationKeys)
+        : rotationKeys(rotationKeys), withRelin(parser.getBool("key-size-relin", false)) {
+        if (!withRelin) return;
+        cc->EvalMultKeyGen(keyPair.secretKey);
+        const auto& relinKey = cc->GetEvalMultKeyVector(keyPair.secretKey->GetKeyTag()).at(0);
+        std::ostringstream out;
+        Serial::Serialize(relinKey, out, SerType::BINARY);
+        relin = measure(relinKey, out.str().size());
+    }
+    
+    // A loaded rotation key and the size of its serialized form
+    void measureRotation(const EvalKey<DCRTPoly>& key, std::size_t serializedBytes) {
+        rotation = measure(key, serializedBytes);
+    }
+    
+    // Machine-readable KEY_SIZE_* lines, parsed by plots/benchmarker.py
+    void printResults() const {
+        std::cout << "KEY_SIZE_DIGITS=" << rotation.digits << "\n";
+        std::cout << "KEY_SIZE_ROTATION_SERIALIZED_BYTES=" << rotation.serializedBytes << "\n";
+        std::cout << "KEY_SIZE_ROTATION_MEMORY_BYTES=" << rotation.memoryBytes << "\n";
+        std::cout << "KEY_SIZE_ROTATION_KEYS=" << rotationKeys << "\n";
+        std::cout << "KEY_SIZE_ROTATION_TOTAL_MEMORY_BYTES=" << rotation.memoryBytes * rotationKeys << "\n";
+        if (withRelin) {
+            std::cout << "KEY_SIZE_RELIN_SERIALIZED_BYTES=" << relin.serializedBytes << "\n";
+            std::cout << "KEY_SIZE_RELIN_MEMORY_BYTES=" << relin.memoryBytes << "\n";
+        }
+    }
+    
+private:
+    struct KeySize {
+        std::size_t digits = 0;
+        std::size_t serializedBytes = 0;
+        std::size_t memoryBytes = 0;
+    };
+    
+    std::size_t rotationKeys;
+    bool withRelin;
+    KeySize rotation;
+    KeySize relin;
+    
+    static KeySize measure(const EvalKey<DCRTPoly>& key, std::size_t serializedBytes) {
+        KeySize size;
+        size.serializedBytes = serializedBytes;
+        
+        auto relinKey = std::dynamic_pointer_cast<EvalKeyRelinImpl<DCRTPoly>>(key);
+        if (relinKey) {
+            size.digits = relinKey->GetAVector().size();
+            for (const auto* polys : {&relinKey->GetAVector(), &relinKey->GetBVector()}) {
+                for (const auto& poly : *polys) {
+                    size.memoryBytes += poly.GetNumOfElements() * poly.GetRingDimension() * sizeof(uint64_t);
+                }
+            }
+        }
+        return size;
+    }
+};
+
+// Temporary directory for serialization
+class TempDirectory {
+private:
+    std::string path;
+    
+public:
+    TempDirectory() {
+        char tmpTemplate[] = "/tmp/openfhe_bench_XXXXXX";
+        char* tmpDir = mkdtemp(tmpTemplate);
+        if (tmpDir) {
+            path = std::string(tmpDir);
+            std::filesystem::create_directories(path + "/data");
+        }
+    }
+    
+    ~TempDirectory() {
+        if (!path.empty()) {
+            std::filesystem::remove_all(path);
+        }
+    }
+    
+    bool isValid() const { return !path.empty(); }
+    std::string getFilePath(const std::string& filename) const {
+        return path + "/" + filename;
+    }
+};
+
+// Automorphism keys as held by the context: key tag -> (automorphism index -> key)
+using AutomorphismKeyMaps = std::map<std::string, std::shared_ptr<std::map<uint32_t, EvalKey<DCRTPoly>>>>;
+
+// Read-only stream over a memory range (no copy), for deserializing
+// straight out of a buffer or an mmap'd file
+class MemoryStreamBuf : public std::streambuf {
+public:
+    MemoryStreamBuf(const char* data, std::size_t size) {
+        char* begin = const_cast<char*>(data);
+        setg(begin, begin, begin + size);
+    }
+};
+
+// Deserializing an EvalKey looks its CryptoContext up in OpenFHE's global
+// context list, which has no lock of its own; every key read takes this one
+inline std::mutex& keyDeserializationMutex() {
+    static std::mutex mutex;
+    return mutex;
+}
+
+inline AutomorphismKeyMaps deserializeAutomorphismKeys(std::istream& in) {
+    AutomorphismKeyMaps keys;
+    std::lock_guard<std::mutex> lock(keyDeserializationMutex());
+    Serial::Deserialize(keys, in, SerType::BINARY);
+    return keys;
+}
+
+// Read a file written by SerializeEvalAutomorphismKey without touching the
+// context's key maps; safe to call from a background thread (the
+// deserialization itself is serialized by keyDeserializationMutex())
+inline AutomorphismKeyMaps readAutomorphismKeyFile(const std::string& path) {
+    std::ifstream keyFile(path, std::ios::binary);
+    if (!keyFile.is_open()) {
+        throw std::runtime_error("Missing rotation key file " + path);
+    }
+    return deserializeAutomorphismKeys(keyFile);
+}
+
+// Key bundle: all rotation keys of a benchmark in one file
+//   [key blob]...[index entry]...[footer]
+// Each blob is exactly what SerializeEvalAutomorphismKey writes for one
+// rotation. Index entries are {int64 rotation, uint64 offset, uint64 size};
+// the fixed-size footer at the end locates the index.
+struct KeyBundleEntry {
+    int64_t rotation;
+    uint64_t offset;
+    uint64_t size;
+};
+
+struct KeyBundleFooter {
+    uint64_t indexOffset;
+    uint64_t numEntries;
+    char magic[8];
+};
+
+constexpr char KEY_BUNDLE_MAGIC[8] = {'O', 'F', 'H', 'E', 'K', 'B', 'N', '1'};
+
+// Parse the index of a bundle from its file descriptor
+inline std::map<int, KeyBundleEntry> readKeyBundleIndex(int fd, const std::string& path) {
+    struct stat st;
+    KeyBundleFooter footer;
+    if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(footer)) ||
+        pread(fd, &footer, sizeof(footer), st.st_size - sizeof(footer)) != sizeof(footer) ||
+        std::memcmp(footer.magic, KEY_BUNDLE_MAGIC, sizeof(footer.magic)) != 0) {
+        throw std::runtime_error("Invalid key bundle " + path);
+    }
+    
+    std::vector<KeyBundleEntry> entries(footer.numEntries);
+    ssize_t indexBytes = static_cast<ssize_t>(entries.size() * sizeof(KeyBundleEntry));
+    if (pread(fd, entries.data(), indexBytes, footer.indexOffset) != indexBytes) {
+        throw std::runtime_error("Truncated key bundle index " + path);
+    }
+    
+    std::map<int, KeyBundleEntry> index;
+    for (const auto& entry : entries) {
+        index[static_cast<int>(entry.rotation)] = entry;
+    }
+    return index;
+}
+
+// One key as the prefetcher hands it over: the key maps and, with
+// --numa-key-replicas, their per-node copies
+struct PrefetchedKey {
+    AutomorphismKeyMaps keys;
+    std::shared_ptr<const std::vector<AutomorphismKeyMaps>> replicas;
+};
+
+// Background key loader for a known acquisition order
+// A worker thread loads keys in schedule order into a queue of at most
+// depth entries; take() blocks until the next scheduled key is ready.
+class KeyPrefetcher {
+private:
+    std::vector<int> schedule;
+    std::size_t depth;
+    std::function<PrefetchedKey(int)> load;
+    
+    std::deque<PrefetchedKey> ready;
+    std::size_t next = 0;  // schedule position of the next take()
+    bool stopping = false;
+    std::exception_ptr error;
+    uint64_t loadNs = 0;
+    
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::thread worker;
+    
+public:
+    KeyPrefetcher(std::vector<int> keySchedule, std::size_t queueDepth,
+                  std::function<PrefetchedKey(int)> loader)
+        : schedule(std::move(keySchedule)), depth(std::max<std::size_t>(1, queueDepth)),
+          load(std::move(loader)) {
+        worker = std::thread([this] { run(); });
+    }
+    
+    ~KeyPrefetcher() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stopping = true;
+        }
+        cv.notify_all();
+        worker.join();
+    }
+    
+    KeyPrefetcher(const KeyPrefetcher&) = delete;
+    KeyPrefetcher& operator=(const KeyPrefetcher&) = delete;
+    
+    bool nextIs(int rotation) const {
+        return next < schedule.size() && schedule[next] == rotation;
+    }
+    
+    // Rethrows the worker's exception if the next key failed to load
+    PrefetchedKey take() {
+        std::unique_lock<std::mutex> lock(mtx);
+        cv.wait(lock, [&] { return !ready.empty() || error; });
+        if (ready.empty()) std::rethrow_exception(error);
+        
+        PrefetchedKey keys = std::move(ready.front());
+        ready.pop_front();
+        next++;
+        lock.unlock();
+        cv.notify_all();
+        return keys;
+    }
+    
+    // Total time the worker spent loading keys
+    uint64_t loadNanoseconds() {
+        std::lock_guard<std::mutex> lock(mtx);
+        return loadNs;
+    }
+    
+private:
+    void run() {
+        for (int rotation : schedule) {
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                cv.wait(lock, [&] { return stopping || ready.size() < depth; });
+                if (stopping) return;
+            }
+            
+            auto start = std::chrono::steady_clock::now();
+            PrefetchedKey keys;
+            try {
+                keys = load(rotation);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mtx);
+                error = std::current_exception();
+                cv.notify_all();
+                return;
+            }
+            auto stop = std::chrono::steady_clock::now();
+            
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                ready.push_back(std::move(keys));
+                loadNs += static_cast<uint64_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count());
+            }
+            cv.notify_all();
+        }
+    }
+};
+
+// FNV-1a (64-bit), used to name persisted key sets and plaintext caches
+inline uint64_t fnv1a64(const void* data, std::size_t size, uint64_t hash = 14695981039346656037ULL) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (std::size_t i = 0; i < size; ++i) {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+inline std::string fnv1aHex(const std::string& text) {
+    std::ostringstream hex;
+    hex << std::hex << std::setw(16) << std::setfill('0') << fnv1a64(text.data(), text.size());
+    return hex.str();
+}
+
+// Rotation key store
+// Owns the per-rotation key files of a benchmark and keeps up to
+// budgetBytes of deserialized keys resident. Budget 0 reproduces the
+// original behavior: every acquire() deserializes the key file and every
+// release() drops it. Key size is accounted as its serialized file size.
+enum class KeyEvictionPolicy {
+    LRU,
+    LFU
+};
+
+// Where keys live on disk and how they are read back
+// FILES:  one file per rotation, opened and deserialized on every load
+// BUNDLE: one indexed bundle file, each key pread into a buffer
+// MMAP:   the bundle mapped once, each key deserialized in place
+enum class KeyStoreBackend {
+    FILES,
+    BUNDLE,
+    MMAP
+};
+
+struct KeyStoreConfig {
+    std::size_t budgetBytes;
+    KeyEvictionPolicy policy;
+    std::size_t prefetchDepth;
+    KeyStoreBackend backend;
+    uint32_t keygenThreads;
+    std::string persistDir;
+    
+    // --key-cache-mb=<MB>|all (default 0), --key-cache-policy=lru|lfu,
+    // --prefetch-depth=K (default 0, synchronous loads),
+    // --key-store=files|bundle|mmap (default files),
+    // --keygen-threads=N (default 1, serial setup) and
+    // --key-persist-dir=<dir> (reuse generated key sets across runs)
+    static KeyStoreConfig fromArgs(const ArgParser& parser) {
+        std::string mb = parser.getString("key-cache-mb", "0");
+        std::string policy = parser.getString("key-cache-policy", "lru");
+        std::string backend = parser.getString("key-store", "files");
+        return {
+            .budgetBytes = (mb == "all") ? std::numeric_limits<std::size_t>::max()
+                                         : static_cast<std::size_t>(std::stoull(mb)) << 20,
+            .policy = (policy == "lfu") ? KeyEvictionPolicy::LFU : KeyEvictionPolicy::LRU,
+            .prefetchDepth = parser.getUInt32("prefetch-depth", 0),
+            .backend = (backend == "mmap")   ? KeyStoreBackend::MMAP
+                     : (backend == "bundle") ? KeyStoreBackend::BUNDLE
+                                             : KeyStoreBackend::FILES,
+            .keygenThreads = std::max<uint32_t>(1, parser.getUInt32("keygen-threads", 1)),
+            .persistDir = parser.getString("key-persist-dir")
+        };
+    }
+};
+
+class RotationKeyStore {
+private:
+    using KeyMap = std::map<uint32_t, EvalKey<DCRTPoly>>;
+    using KeyReplicas = std::vector<AutomorphismKeyMaps>;  // indexed by NUMA node
+    
+    struct CachedKey {
+        AutomorphismKeyMaps keys;
+        std::size_t bytes = 0;  // of all replicas
+        uint64_t lastUse = 0;
+        uint64_t uses = 0;
+        std::shared_ptr<const KeyReplicas> replicas;  // --numa-key-replicas only
+    };
+    
+    CryptoContext<DCRTPoly> cc;
+    std::string keyDir;  // temporary directory, or the persisted key set
+    std::string prefix;
+    KeyStoreConfig config;
+    MeasurementSystem& measurement;
+    
+    std::vector<int> keySet;  // rotations passed to generate()
+    std::map<int, CachedKey> cache;
+    std::map<int, std::shared_ptr<const KeyReplicas>> installedReplicas;  // acquired, not released
+    std::set<int> hoistedRotations;  // applied outside rotate(): never replicated
+    std::size_t residentBytes = 0;
+    uint64_t tick = 0;
+    
+    std::unique_ptr<KeyPrefetcher> prefetcher;
+    
+    // Bundle backends
+    std::ofstream bundleOut;                 // while saving
+    std::vector<KeyBundleEntry> bundleEntries;
+    int bundleFd = -1;                       // after open()
+    std::map<int, KeyBundleEntry> bundleIndex;
+    const char* mapping = nullptr;
+    std::size_t mappingBytes = 0;
+    
+    // Statistics
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    uint64_t loadedBytes = 0;
+    std::size_t peakBytes = 0;
+    uint64_t prefetchedKeys = 0;
+    uint64_t prefetchLoadNs = 0;
+    uint64_t prefetchWaitNs = 0;
+    
+public:
+    RotationKeyStore(CryptoContext<DCRTPoly> context, const TempDirectory& tempDir,
+                     std::string filePrefix, KeyStoreConfig cfg, MeasurementSystem& m)
+        : cc(std::move(context)), keyDir(tempDir.getFilePath("")), prefix(std::move(filePrefix)),
+          config(cfg), measurement(m) {}
+    
+    ~RotationKeyStore() {
+        prefetcher.reset();
+        if (mapping) munmap(const_cast<char*>(mapping), mappingBytes);
+        if (bundleFd >= 0) close(bundleFd);
+    }
+    
+    RotationKeyStore(const RotationKeyStore&) = delete;
+    RotationKeyStore& operator=(const RotationKeyStore&) = delete;
+    
+    std::string keyPath(int rotation) const {
+        return keyDir + prefix + std::to_string(rotation) + ".bin";
+    }
+    
+    std::string bundlePath() const {
+        return keyDir + prefix + "bundle.bin";
+    }
+    
+    // Generate and save the keys for all rotations (in parallel with
+    // --keygen-threads), then finalize. With --key-persist-dir, a key set
+    // is stored per (ring dim, depth, digits, rotations) together with the
+    // key pair it belongs to; a later run with the same parameters loads
+    // that key pair into keyPair and skips keygen entirely.
+    template <typename Rotations>
+    bool generate(KeyPair<DCRTPoly>& keyPair, const Rotations& rotations,
+                  const BenchmarkParams& params) {
+        std::vector<int> rots(rotations.begin(), rotations.end());
+        keySet = rots;
+        
+        std::string description = keySetDescription(rots, params);
+        std::string persistedSet;
+        if (!config.persistDir.empty()) {
+            persistedSet = config.persistDir + "/" + fnv1aHex(description) + "/";
+            
+            if (std::filesystem::exists(persistedSet + "complete")) {
+                keyDir = persistedSet;
+                return Serial::DeserializeFromFile(keyDir + "public-key.bin", keyPair.publicKey, SerType::BINARY) &&
+                       Serial::DeserializeFromFile(keyDir + "secret-key.bin", keyPair.secretKey, SerType::BINARY);
+            }
+            
+            std::filesystem::remove_all(persistedSet);
+            std::filesystem::create_directories(persistedSet);
+            keyDir = persistedSet;
+        }
+        
+        bool ok = (config.keygenThreads > 1) ? generateParallel(keyPair.secretKey, rots)
+                                             : generateSerial(keyPair.secretKey, rots);
+        ok = ok && finalize();
+        
+        if (ok && !persistedSet.empty()) {
+            ok = Serial::SerializeToFile(keyDir + "public-key.bin", keyPair.publicKey, SerType::BINARY) &&
+                 Serial::SerializeToFile(keyDir + "secret-key.bin", keyPair.secretKey, SerType::BINARY);
+            // Written last, so an interrupted run is regenerated next time
+            std::ofstream marker(persistedSet + "complete");
+            marker << description << "\n";
+            ok = ok && marker.good();
+        }
+        return ok;
+    }
+    
+    // Serialize the keys currently held by the context as the key for rotation
+    bool save(int rotation);
+    
+    // Finish saving: write the bundle index and footer (no-op for FILES)
+    bool finalize();
+    
+    // Open the bundle and parse its index (and map it for MMAP). This is
+    // the backend's cold-start cost; it runs on first use if not called.
+    void open();
+    
+    // One stored key as loaded (the cached copy if resident) and its
+    // serialized size, for KeySizeReport::measureRotation
+    std::pair<EvalKey<DCRTPoly>, std::size_t> sampleKey(int rotation);
+    
+    // Rotations the kernel applies through EvalFastRotation, which reads the
+    // context's key map rather than rotate()'s per-node copies: their keys are
+    // never replicated under --numa-key-replicas. Call before prefill().
+    template <typename Rotations>
+    void markHoisted(const Rotations& rotations) {
+        hoistedRotations.insert(rotations.begin(), rotations.end());
+    }
+    
+    // Load keys into the cache before measurement, in the given order,
+    // until the budget is full
+    template <typename Rotations>
+    void prefill(const Rotations& rotations) {
+        if (config.budgetBytes == 0) return;
+        open();
+        for (int rot : rotations) {
+            if (cache.count(rot)) continue;
+            std::size_t bytes = keyBytes(rot) * copies(rot);
+            if (residentBytes + bytes > config.budgetBytes) break;
+            
+            AutomorphismKeyMaps keys = readKeyPlaced(rot);
+            auto replicas = replicate(rot, keys);
+            cache[rot] = CachedKey{std::move(keys), bytes, ++tick, 0, std::move(replicas)};
+            residentBytes += bytes;
+            peakBytes = std::max(peakBytes, residentBytes);
+        }
+    }
+    
+    // Start loading the non-resident keys of schedule in the background
+    // (no-op without --prefetch-depth). schedule must list the rotations
+    // in the order acquire() will be called for them.
+    template <typename Rotations>
+    void startPrefetch(const Rotations& schedule) {
+        if (config.prefetchDepth == 0) return;
+        open();
+        
+        std::vector<int> misses;
+        for (int rot : schedule) {
+            if (!cache.count(rot)) misses.push_back(rot);
+        }
+        prefetcher = std::make_unique<KeyPrefetcher>(
+            std::move(misses), config.prefetchDepth,
+            [this](int rot) {
+                // The per-node copies load here too, off the compute thread
+                PrefetchedKey key{readKeyPlaced(rot), nullptr};
+                key.replicas = replicate(rot, key.keys);
+                return key;
+            });
+    }
+    
+    // Stop the background loader and collect its statistics
+    void finishPrefetch() {
+        if (!prefetcher) return;
+        prefetchLoadNs += prefetcher->loadNanoseconds();
+        prefetcher.reset();
     }
     
-    uint32_t getUInt32(const std::string& key, uint32_t defaultVal = 0) const {
-        auto it = args.find(key);
-        return (it != args.end()) ? std::stoul(it->second) : defaultVal;
+    // Make the key for rotation available to the context (and to rotate())
+    // Throws std::runtime_error if its file cannot be deserialized; runKernel()
+    // turns that into exit code 1
+    void acquire(int rotation);
+    
+    // Drop the key from the context (it stays cached if it fit the budget).
+    // The context's automorphism key maps can only be cleared as a whole, so
+    // this drops every installed key; callers acquire one key (or one group)
+    // at a time.
+    void release(int /*rotation*/) {
+        releaseAll();
     }
     
-    bool getBool(const std::string& key, bool defaultVal = false) const {
-        auto it = args.find(key);
-        return (it != args.end()) ? (it->second == "true") : defaultVal;
+    // Drop every installed key, e.g. after acquiring a group together
+    void releaseAll() {
+        cc->ClearEvalAutomorphismKeys();
+        installedReplicas.clear();
     }
     
-    bool getDebug() const {
-        return getBool("debug", false);
+    // EvalRotate with an acquired key. With --numa-key-replicas the key switch
+    // reads the copy on the calling thread's node.
+    Ciphertext<DCRTPoly> rotate(const ConstCiphertext<DCRTPoly>& ct, int rotation) const;
+    
+    // Call after open(): bundle key sizes come from its index
+    void printResults() const;
+    
+private:
+    bool generateSerial(const PrivateKey<DCRTPoly>& secretKey, const std::vector<int>& rotations);
+    
+    // Each task generates its key into its own map (EvalAutomorphismKeyGen
+    // does not touch the context's key maps) and serializes it privately;
+    // bundle appends are serialized in rotation-completion order
+    bool generateParallel(const PrivateKey<DCRTPoly>& secretKey, const std::vector<int>& rotations);
+    
+    bool appendToBundle(int rotation, const std::string& blob);
+    
+    std::string keySetDescription(const std::vector<int>& rotations, const BenchmarkParams& params) const;
+    
+    
+    // Serialized size of a key
+    std::size_t keyBytes(int rotation) const;
+    
+    const KeyBundleEntry& bundleEntry(int rotation) const;
+    
+    // Deserialize one key from the active backend. Safe to call concurrently
+    // once open() has run: reads use pread/mmap (no shared stream) and the
+    // deserialization itself holds keyDeserializationMutex().
+    AutomorphismKeyMaps readKey(int rotation) const;
+    
+    // readKey() placed per --numa-key-membind, or on node 0 when replicating
+    AutomorphismKeyMaps readKeyPlaced(int rotation) const {
+        const NumaConfig& numa = numaConfig();
+        ScopedMemoryPolicy placement(numa.keyReplicas ? MemoryPolicy::bind(0) : numa.keyMembind);
+        return readKey(rotation);
     }
     
-    MeasurementMode getMeasurementMode() const {
-        std::string mode = getString("measure", "latency");
-        if (mode == "dram") return MeasurementMode::DRAM;
-        if (mode == "pin") return MeasurementMode::PIN;
-        return MeasurementMode::LATENCY;  // default
+    // Copies of a replicated key: one per NUMA node with CPUs
+    std::size_t nodeCopies() const;
+    
+    // Copies held of the key for rotation
+    std::size_t copies(int rotation) const {
+        return hoistedRotations.count(rotation) ? 1 : nodeCopies();
     }
-};
-
-// Benchmark parameters
-struct BenchmarkParams {
-    uint32_t ringDim;
-    uint32_t multDepth;
-    uint32_t numDigits;
-    bool checkSecurity;
     
-    static BenchmarkParams fromArgs(const ArgParser& parser) {
-        return {
-            .ringDim = parser.getUInt32("ring-dim"),
-            .multDepth = parser.getUInt32("mult-depth"),
-            .numDigits = parser.getUInt32("num-digits"),
-            .checkSecurity = parser.getBool("check-security")
-        };
+    // --numa-key-replicas: keys (read onto node 0) plus a copy read onto every
+    // other node with CPUs; nullptr when not replicating
+    std::shared_ptr<const KeyReplicas> replicate(int rotation, const AutomorphismKeyMaps& keys) const;
+    
+    // Insert copies of the key maps so the context never mutates cached ones
+    void install(const AutomorphismKeyMaps& keys) {
+        for (const auto& tagged : keys) {
+            cc->InsertEvalAutomorphismKey(std::make_shared<KeyMap>(*tagged.second), tagged.first);
+        }
     }
+    
+    void evictOne();
 };
 
-// Thread setup
-inline void setupThreads(const ArgParser& parser) {
-    uint32_t requested = parser.getUInt32("threads", 0);
-    
-    if (requested > 0) {
-        omp_set_num_threads(requested);
-    }
-}
+// Rotation key basis
+// --key-basis=full  one key per rotation amount (default)
+// --key-basis=pow2  keys for 2^e only; an amount r (mod numSlots) is applied
+//                   as one rotation per set bit
+// --key-basis=naf   keys for ±2^e only; r is applied along its non-adjacent
+//                   form (no two adjacent nonzero digits, so at most about
+//                   half as many steps as bits)
+// With a compact basis the benchmarks chain rotations through an already
+// rotated ciphertext, so reaching r from r' only costs the digits of r - r'.
+// Every extra step is a key switch and adds its (small) noise.
+enum class KeyBasis { FULL, POW2, NAF };
 
-// Measurement wrapper
-class MeasurementSystem {
+class RotationKeyBasis {
 private:
-    MeasurementMode mode;
-    DRAMCounter dramCounter;
-    bool dramInitialized = false;
+    KeyBasis basis;
+    int numSlots;
+    std::set<int> keys;
+    std::size_t rotations = 0;
     
 public:
-    MeasurementSystem(MeasurementMode m) : mode(m) {
-        if (mode == MeasurementMode::DRAM) {
-            dramInitialized = dramCounter.init();
-        }
+    RotationKeyBasis(const ArgParser& parser, int slots) : numSlots(slots) {
+        std::string name = parser.getString("key-basis", "full");
+        basis = (name == "pow2") ? KeyBasis::POW2
+              : (name == "naf")  ? KeyBasis::NAF
+                                 : KeyBasis::FULL;
     }
     
-    void startDRAM() {
-        if (mode == MeasurementMode::DRAM && dramInitialized) {
-            dramCounter.start();
+    bool compact() const { return basis != KeyBasis::FULL; }
+    
+    // Rotation steps with one key each whose sum is delta (mod numSlots)
+    std::vector<int> decompose(int delta) const {
+        int r = delta % numSlots;
+        if (r < 0) r += numSlots;
+        if (r == 0) return {};
+        
+        std::vector<int> steps;
+        switch (basis) {
+            case KeyBasis::FULL:
+                steps.push_back(delta);
+                break;
+            case KeyBasis::POW2:
+                for (int bit = 1; bit < numSlots; bit <<= 1) {
+                    if (r & bit) steps.push_back(bit);
+                }
+                break;
+            case KeyBasis::NAF: {
+                // Signed amount in [-numSlots/2, numSlots/2], then its NAF digits
+                long long n = (r > numSlots / 2) ? r - numSlots : r;
+                for (long long bit = 1; n != 0; bit <<= 1, n /= 2) {
+                    if (n & 1) {
+                        long long digit = 2 - (((n % 4) + 4) % 4);  // ±1
+                        steps.push_back(static_cast<int>(digit * bit));
+                        n -= digit;
+                    }
+                }
+                break;
+            }
         }
+        return steps;
     }
     
-    void stopDRAM() {
-        if (mode == MeasurementMode::DRAM && dramInitialized) {
-            dramCounter.stop();
+    // Registers the rotations of one kernel run (each applied once per
+    // ciphertext) and returns the keys they need
+    template <typename Deltas>
+    const std::set<int>& plan(const Deltas& deltas) {
+        for (int delta : deltas) {
+            for (int step : decompose(delta)) {
+                keys.insert(step);
+                rotations++;
+            }
         }
+        return keys;
     }
     
-    void startPIN() {
-        if (mode == MeasurementMode::PIN) {
-            PIN_MARKER_START();
+    // Registers rotations that keep a key of their own (BSGS giant steps)
+    template <typename Rotations>
+    const std::set<int>& planDirect(const Rotations& direct) {
+        for (int rotation : direct) {
+            if (rotation % numSlots == 0) continue;
+            keys.insert(rotation);
+            rotations++;
         }
+        return keys;
     }
     
-    void endPIN() {
-        if (mode == MeasurementMode::PIN) {
-            PIN_MARKER_END();
+    // Machine-readable KEY_BASIS_* lines, parsed by plots/benchmarker.py
+    void printResults() const {
+        std::cout << "KEY_BASIS_KEYS=" << keys.size() << "\n";
+        std::cout << "KEY_BASIS_ROTATIONS=" << rotations << "\n";
+    }
+};
+
+// Rotates every ciphertext of the batch by delta along the basis steps,
+// fetching each step's key once for the whole batch
+inline void rotateBatchByBasis(RotationKeyStore& keyStore, const RotationKeyBasis& basis,
+                               MeasurementSystem& measurement, CiphertextBatch& batch, int delta) {
+    for (int step : basis.decompose(delta)) {
+        keyStore.acquire(step);
+        {
+            ScopedRegion region(measurement, "rotate");
+            forEachInBatch(batch.size(), [&](std::size_t b) {
+                batch[b] = keyStore.rotate(batch[b], step);
+            });
         }
+        keyStore.release(step);
     }
+}
+
+// Compact matrix formats. The matrix occupies the top-left dim×dim block of the
+// numSlots×numSlots operator; nothing outside it is stored.
+
+// Row-major dense matrix: entry (i, j) is values[i * dim + j]
+struct DenseMatrix {
+    std::size_t dim = 0;
+    std::vector<double> values;
     
-    void printResults() {
-        if (mode == MeasurementMode::DRAM && dramInitialized) {
-            dramCounter.print_results();
-        }
+    double operator()(std::size_t i, std::size_t j) const { return values[i * dim + j]; }
+};
+
+// Compressed sparse rows: row i holds colIdx/values[rowPtr[i], rowPtr[i + 1])
+struct CsrMatrix {
+    std::size_t dim = 0;
+    std::vector<std::size_t> rowPtr;
+    std::vector<uint32_t> colIdx;
+    std::vector<double> values;
+};
+
+// Benchmark matrix (--matrix-kind): dense and Toeplitz matrices are stored
+// row-major, banded, block-diagonal and file-loaded ones as CSR
+struct BenchmarkMatrix {
+    std::string kind;
+    bool isSparse = false;
+    DenseMatrix dense;
+    CsrMatrix sparse;
+    
+    std::size_t dim() const { return isSparse ? sparse.dim : dense.dim; }
+    std::size_t nnz() const {
+        if (isSparse) return sparse.values.size();
+        return static_cast<std::size_t>(std::count_if(dense.values.begin(), dense.values.end(),
+                                                      [](double v) { return v != 0.0; }));
     }
 };
 
-// Temporary directory for serialization
-class TempDirectory {
+// Non-empty generalized diagonals in one contiguous buffer. Diagonal d has
+// offset offsets[d] (ascending, in [0, numSlots)) and occupies
+// values[d * numSlots, (d + 1) * numSlots); slot i holds M(i, (i + k) mod numSlots).
+struct DiagonalSet {
+    std::size_t numSlots = 0;
+    std::vector<int> offsets;
+    std::vector<double> values;
+    
+    std::size_t size() const { return offsets.size(); }
+    const double* data(std::size_t d) const { return values.data() + d * numSlots; }
+    std::vector<double> diagonal(std::size_t d) const { return {data(d), data(d) + numSlots}; }
+};
+
+// Hash of the matrix entries (names plaintext cache files)
+inline uint64_t matrixHash(const DenseMatrix& M) {
+    uint64_t hash = fnv1a64(&M.dim, sizeof(M.dim));
+    return fnv1a64(M.values.data(), M.values.size() * sizeof(double), hash);
+}
+inline uint64_t matrixHash(const CsrMatrix& M) {
+    uint64_t hash = fnv1a64(&M.dim, sizeof(M.dim));
+    hash = fnv1a64(M.rowPtr.data(), M.rowPtr.size() * sizeof(std::size_t), hash);
+    hash = fnv1a64(M.colIdx.data(), M.colIdx.size() * sizeof(uint32_t), hash);
+    return fnv1a64(M.values.data(), M.values.size() * sizeof(double), hash);
+}
+inline uint64_t matrixHash(const BenchmarkMatrix& M) {
+    return M.isSparse ? matrixHash(M.sparse) : matrixHash(M.dense);
+}
+
+// Pre-encoded diagonal plaintexts
+// --ptxt-cache-dir=<dir>  reuse plaintexts encoded by an earlier run. Files are named
+//                         by a hash of the matrix, the CKKS parameters and the
+//                         benchmark's diagonal layout; elements are stored in
+//                         evaluation (NTT) form, so a hit skips extraction,
+//                         encoding and the NTT.
+// --encode-only=true      measure encoding as the kernel (warmup/repetitions,
+//                         DRAM, PIN) instead of the matrix-vector product; the
+//                         cache is bypassed.
+class DiagonalPlaintextCache {
 private:
-    std::string path;
+    CryptoContext<DCRTPoly> cc;
+    MeasurementSystem& measurement;
+    std::string cacheDir;
+    bool encodeOnlyMode;
+    std::string path;  // cache file for the current description
+    
+    // Statistics (PTXT_* lines)
+    bool hit = false;
+    std::size_t entries = 0;
+    uint64_t fileBytes = 0;
+    uint64_t encodeNs = 0;
+    uint64_t loadNs = 0;
     
+    static constexpr char MAGIC[9] = "OFHEPTC1";
+    
+    struct EntryHeader {
+        int32_t index;
+        uint32_t noiseScaleDeg;
+        uint32_t level;
+        uint32_t slots;
+        double scalingFactor;
+    };
+
 public:
-    TempDirectory() {
-        char tmpTemplate[] = "/tmp/openfhe_bench_XXXXXX";
-        char* tmpDir = mkdtemp(tmpTemplate);
-        if (tmpDir) {
-            path = std::string(tmpDir);
-            std::filesystem::create_directories(path + "/data");
-        }
-    }
+    DiagonalPlaintextCache(const CryptoContext<DCRTPoly>& cc, const ArgParser& parser, MeasurementSystem& measurement)
+        : cc(cc), measurement(measurement),
+          cacheDir(parser.getString("ptxt-cache-dir")),
+          encodeOnlyMode(parser.getBool("encode-only")) {}
     
-    ~TempDirectory() {
-        if (!path.empty()) {
-            std::filesystem::remove_all(path);
-        }
-    }
+    bool encodeOnly() const { return encodeOnlyMode; }
     
-    bool isValid() const { return !path.empty(); }
-    std::string getFilePath(const std::string& filename) const {
-        return path + "/" + filename;
-    }
+    // Names the cache file: matrix contents, CKKS parameters and a layout tag
+    // for how the benchmark shifts and encodes its diagonals
+    void describe(uint64_t matrixHash, std::size_t matrixDim,
+                  const BenchmarkParams& params, const std::string& layout);
+    
+    // Loads the plaintexts for the current description (region "load-diagonals").
+    // Returns false on a miss, or when caching is off or bypassed.
+    bool load(std::map<int, Plaintext>& plaintexts);
+    
+    // Encodes the n-th diagonal with encodeOne(n) and stores it under indices[n]
+    // (region "encode-diagonals"), then saves the result for the current
+    // description. In --encode-only mode this is the measured kernel.
+    std::map<int, Plaintext> encode(const std::vector<int>& indices,
+                                    const std::function<Plaintext(std::size_t)>& encodeOne);
+    
+    // Machine-readable KEY=value lines, parsed by plots/benchmarker.py
+    void printResults() const;
+
+private:
+    // Written to a temporary name and renamed, so concurrent runs never see a partial file
+    void save(const std::map<int, Plaintext>& plaintexts);
 };
 
+// Extended-basis (P·Q) helpers for double hoisting, mirroring OpenFHE's internal
+// FHECKKSRNS::EvalMultExt / EvalAddExtInPlace. Operands come from EvalFastRotationExt
+// or KeySwitchExt and stay in the extended basis until cc->KeySwitchDown (ModDown).
+
+// Plaintext multiply in the extended basis; ptxt must be encoded with the extended
+// element parameters (see extendedElementParams)
+inline Ciphertext<DCRTPoly> evalMultExt(ConstCiphertext<DCRTPoly> ciphertext, ConstPlaintext ptxt) {
+    Ciphertext<DCRTPoly> result = ciphertext->Clone();
+    DCRTPoly pt = ptxt->GetElement<DCRTPoly>();
+    pt.SetFormat(Format::EVALUATION);
+    
+    std::vector<DCRTPoly>& elements = result->GetElements();
+    for (auto& element : elements) {
+        element *= pt;
+    }
+    result->SetNoiseScaleDeg(result->GetNoiseScaleDeg() + ptxt->GetNoiseScaleDeg());
+    result->SetScalingFactor(result->GetScalingFactor() * ptxt->GetScalingFactor());
+    return result;
+}
+
+// Ciphertext addition in the extended basis (no level or scale adjustment)
+inline void evalAddExtInPlace(Ciphertext<DCRTPoly>& accumulator, ConstCiphertext<DCRTPoly> ciphertext) {
+    std::vector<DCRTPoly>& accElements = accumulator->GetElements();
+    const std::vector<DCRTPoly>& elements = ciphertext->GetElements();
+    for (std::size_t i = 0; i < accElements.size(); ++i) {
+        accElements[i] += elements[i];
+    }
+}
+
+// Element parameters of the extended basis P·Q_l at the ciphertext's level,
+// for encoding plaintexts that multiply extended-basis ciphertexts
+inline std::shared_ptr<DCRTPoly::Params> extendedElementParams(const CryptoContext<DCRTPoly>& cc,
+                                                               ConstCiphertext<DCRTPoly> ciphertext) {
+    return cc->KeySwitchExt(ciphertext, true)->GetElements()[0].GetParams();
+}
+
 // Matrix/vector utilities
-inline std::vector<std::vector<double>> make_embedded_random_matrix(
-    std::size_t matrixDim, std::size_t numSlots) 
-{
+// seed 0 draws a fresh matrix; a fixed --matrix-seed gives a reproducible one
+DenseMatrix make_random_matrix(std::size_t matrixDim, uint32_t seed = 0);
+
+// Structured and sparse benchmark matrices (--matrix-kind). Generated entries
+// use the distribution and --matrix-seed of make_random_matrix.
+
+// Random CSR matrix whose row i holds the columns [lo, hi) returned by cols(i)
+template <typename F>
+inline CsrMatrix make_random_csr_matrix(std::size_t matrixDim, uint32_t seed, F&& cols) {
     std::random_device rd;
-    std::mt19937 gen(rd());
+    std::mt19937 gen(seed != 0 ? seed : rd());
     std::uniform_real_distribution<> dis(0.1, 2.0);
     
-    std::vector<std::vector<double>> M(numSlots, std::vector<double>(numSlots, 0.0));
+    CsrMatrix M;
+    M.dim = matrixDim;
+    M.rowPtr.reserve(matrixDim + 1);
+    M.rowPtr.push_back(0);
     for (std::size_t i = 0; i < matrixDim; ++i) {
-        for (std::size_t j = 0; j < matrixDim; ++j) {
-            M[i][j] = dis(gen);
+        auto [lo, hi] = cols(i);
+        for (std::size_t j = lo; j < hi; ++j) {
+            M.colIdx.push_back(static_cast<uint32_t>(j));
+            M.values.push_back(dis(gen));
         }
+        M.rowPtr.push_back(M.colIdx.size());
     }
     return M;
 }
 
-inline std::vector<double> make_random_input_vector(
-    std::size_t matrixDim, std::size_t numSlots) 
-{
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_real_distribution<> dis(0.5, 1.5);
-    
-    std::vector<double> vec(numSlots, 0.0);
-    for (std::size_t i = 0; i < matrixDim; ++i) {
-        vec[i] = dis(gen);
+// Entries with |i - j| <= bandWidth: 2·bandWidth + 1 diagonals
+CsrMatrix make_banded_matrix(std::size_t matrixDim, std::size_t bandWidth, uint32_t seed = 0);
+
+// Dense blockSize×blockSize blocks along the diagonal (the last one may be
+// smaller): 2·blockSize - 1 diagonals
+CsrMatrix make_block_diagonal_matrix(std::size_t matrixDim, std::size_t blockSize, uint32_t seed = 0);
+
+// M(i, j) = t[j - i]: dense, but each diagonal is constant
+DenseMatrix make_toeplitz_matrix(std::size_t matrixDim, uint32_t seed = 0);
+
+// Coordinate entry of a sparse matrix file
+struct CooEntry {
+    uint32_t row;
+    uint32_t col;
+    double value;
+};
+
+// Sorts the entries by (row, col) and sums duplicates
+CsrMatrix coo_to_csr(std::size_t matrixDim, std::vector<CooEntry> entries);
+
+// Matrix Market coordinate file: a "%%MatrixMarket matrix coordinate
+// real|integer|pattern general|symmetric" banner, '%' comments, a
+// "rows cols nnz" line and one 1-based "row col [value]" line per entry.
+// Non-square matrices are padded to max(rows, cols).
+CsrMatrix load_coo_matrix(const std::string& path);
+
+// CSR text file: "dim nnz", then dim + 1 row pointers, nnz column indices and
+// nnz values (0-based, whitespace separated)
+CsrMatrix load_csr_matrix(const std::string& path);
+
+// --matrix-kind=<kind>  matrix of the diagonal benchmarks (default dense)
+//   dense            random --matrix-dim square matrix: 2·dim - 1 diagonals
+//   banded           |i - j| <= --matrix-band (default 1): 2·band + 1 diagonals
+//   block-diagonal   --matrix-block sized blocks (default 16): 2·block - 1 diagonals
+//   toeplitz         constant diagonals: 2·dim - 1 diagonals
+//   coo, csr         loaded from --matrix-file (Matrix Market coordinate or CSR
+//                    text); the dimension comes from the file
+// Throws std::runtime_error on an unknown kind or a malformed file
+BenchmarkMatrix make_benchmark_matrix(const ArgParser& parser);
+
+// Machine-readable MATRIX_* lines, parsed by plots/benchmarker.py
+void printMatrixResults(const BenchmarkMatrix& M, std::size_t numDiagonals);
+
+std::vector<double> make_random_input_vector(std::size_t matrixDim, std::size_t numSlots);
+
+// Generalized diagonal k holds M(i, j) with (j - i) mod numSlots = k at slot i.
+// An entry lies on exactly one diagonal, so extraction is a single O(dim²)
+// pass (O(nnz) for CSR) into the contiguous DiagonalSet buffer; only
+// diagonals with a nonzero entry are kept. Both passes are OpenMP-parallel
+// and write disjoint slots.
+
+// Calls f(i, j) for every in-matrix entry of diagonal k
+template <typename F>
+inline void forEachOnDiagonal(std::size_t dim, std::size_t numSlots, std::size_t k, F&& f) {
+    // j - i = k
+    for (std::size_t i = 0; i + k < dim; ++i) {
+        f(i, i + k);
+    }
+    // j - i = k - numSlots (wraps around when dim > numSlots - k)
+    for (std::size_t i = numSlots - k; k > 0 && i < dim; ++i) {
+        f(i, i + k - numSlots);
     }
-    return vec;
 }
 
-std::map<int, std::vector<double>> extract_generalized_diagonals(
-    const std::vector<std::vector<double>>& M, 
-    std::size_t matrixDim) 
-{
-    std::size_t numSlots = M.size();
-    std::map<int, std::vector<double>> diagonals;
+// Pass 1: ascending offsets of the diagonals with a nonzero entry. BSGS
+// planning only needs these, so a plaintext cache hit skips pass 2.
+inline std::vector<int> diagonal_offsets(const DenseMatrix& M, std::size_t numSlots) {
+    const std::size_t dim = M.dim;
     
-    // For each possible diagonal offset k
+    // Candidate offsets: k < dim (upper part) and k > numSlots - dim (lower part)
+    std::vector<int> candidates;
     for (std::size_t k = 0; k < numSlots; ++k) {
-        std::vector<double> diag(numSlots, 0.0);
-        bool hasNonZero = false;
-        
-        // Extract the k-th generalized diagonal
-        for (std::size_t j = 0; j < matrixDim; ++j) {
-            for (std::size_t i = 0; i < matrixDim; ++i) {
-                // Generalized diagonal: elements where (j - i) mod numSlots = k
-                if ((j + numSlots - i) % numSlots == k) {
-                    diag[i] = M[i][j];  // FIX: Place at position i, not (i+k)
-                    if (M[i][j] != 0.0) {
-                        hasNonZero = true;
-                    }
-                }
+        if (k < dim || numSlots - k < dim) candidates.push_back(static_cast<int>(k));
+    }
+    
+    std::vector<char> nonEmpty(candidates.size(), 0);
+    #pragma omp parallel for schedule(dynamic, 16)
+    for (std::size_t c = 0; c < candidates.size(); ++c) {
+        bool found = false;
+        forEachOnDiagonal(dim, numSlots, candidates[c], [&](std::size_t i, std::size_t j) {
+            found = found || M(i, j) != 0.0;
+        });
+        nonEmpty[c] = found;
+    }
+    
+    std::vector<int> offsets;
+    for (std::size_t c = 0; c < candidates.size(); ++c) {
+        if (nonEmpty[c]) offsets.push_back(candidates[c]);
+    }
+    return offsets;
+}
+
+inline std::vector<int> diagonal_offsets(const CsrMatrix& M, std::size_t numSlots) {
+    // Per-thread flags, merged
+    std::vector<char> nonEmpty(numSlots, 0);
+    #pragma omp parallel
+    {
+        std::vector<char> local(numSlots, 0);
+        #pragma omp for schedule(static) nowait
+        for (std::size_t i = 0; i < M.dim; ++i) {
+            for (std::size_t n = M.rowPtr[i]; n < M.rowPtr[i + 1]; ++n) {
+                if (M.values[n] != 0.0) local[(M.colIdx[n] + numSlots - i) % numSlots] = 1;
             }
         }
-        
-        // Only store non-empty diagonals
-        if (hasNonZero) {
-            diagonals[k] = diag;
+        #pragma omp critical(diagonal_offsets)
+        for (std::size_t k = 0; k < numSlots; ++k) {
+            nonEmpty[k] |= local[k];
+        }
+    }
+    
+    std::vector<int> offsets;
+    for (std::size_t k = 0; k < numSlots; ++k) {
+        if (nonEmpty[k]) offsets.push_back(static_cast<int>(k));
+    }
+    return offsets;
+}
+
+inline std::vector<int> diagonal_offsets(const BenchmarkMatrix& M, std::size_t numSlots) {
+    return M.isSparse ? diagonal_offsets(M.sparse, numSlots) : diagonal_offsets(M.dense, numSlots);
+}
+
+// Pass 2: copy entries into their diagonal's slot
+inline DiagonalSet extract_diagonals(const DenseMatrix& M, std::size_t numSlots) {
+    DiagonalSet diagonals;
+    diagonals.numSlots = numSlots;
+    diagonals.offsets = diagonal_offsets(M, numSlots);
+    diagonals.values.assign(diagonals.size() * numSlots, 0.0);
+    
+    #pragma omp parallel for schedule(dynamic, 16)
+    for (std::size_t d = 0; d < diagonals.size(); ++d) {
+        double* out = diagonals.values.data() + d * numSlots;
+        forEachOnDiagonal(M.dim, numSlots, diagonals.offsets[d], [&](std::size_t i, std::size_t j) {
+            out[i] = M(i, j);
+        });
+    }
+    
+    return diagonals;
+}
+
+inline DiagonalSet extract_diagonals(const CsrMatrix& M, std::size_t numSlots) {
+    DiagonalSet diagonals;
+    diagonals.numSlots = numSlots;
+    diagonals.offsets = diagonal_offsets(M, numSlots);
+    diagonals.values.assign(diagonals.size() * numSlots, 0.0);
+    
+    std::vector<int> slotOf(numSlots, -1);
+    for (std::size_t d = 0; d < diagonals.size(); ++d) {
+        slotOf[diagonals.offsets[d]] = static_cast<int>(d);
+    }
+    
+    // Row i only writes slot i of each diagonal
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (std::size_t i = 0; i < M.dim; ++i) {
+        for (std::size_t n = M.rowPtr[i]; n < M.rowPtr[i + 1]; ++n) {
+            int d = slotOf[(M.colIdx[n] + numSlots - i) % numSlots];
+            if (d >= 0) diagonals.values[static_cast<std::size_t>(d) * numSlots + i] = M.values[n];
         }
     }
     
     return diagonals;
 }
 
+inline DiagonalSet extract_diagonals(const BenchmarkMatrix& M, std::size_t numSlots) {
+    return M.isSparse ? extract_diagonals(M.sparse, numSlots) : extract_diagonals(M.dense, numSlots);
+}
+
 // Simple verification - returns bool, prints only if debug
 inline bool verifyResult(const std::vector<double>& result, 
                         const std::vector<double>& expected,
@@ -262,21 +2406,46 @@ inline bool verifyResult(const std::vector<double>& result,
 // Matrix-vector verification - returns bool, prints only if debug
 inline bool verify_matrix_vector_result(
     const std::vector<double>& result,
-    const std::vector<std::vector<double>>& M,
+    const DenseMatrix& M,
     const std::vector<double>& input,
-    std::size_t matrixDim,
     bool debug = false) 
 {
-    std::vector<double> expected(M.size(), 0.0);
-    for (std::size_t i = 0; i < matrixDim; ++i) {
-        for (std::size_t j = 0; j < matrixDim; ++j) {
-            expected[i] += M[i][j] * input[j];
+    std::vector<double> expected(input.size(), 0.0);
+    for (std::size_t i = 0; i < M.dim; ++i) {
+        for (std::size_t j = 0; j < M.dim; ++j) {
+            expected[i] += M(i, j) * input[j];
+        }
+    }
+    
+    return verifyResult(result, expected, debug);
+}
+
+inline bool verify_matrix_vector_result(
+    const std::vector<double>& result,
+    const CsrMatrix& M,
+    const std::vector<double>& input,
+    bool debug = false) 
+{
+    std::vector<double> expected(input.size(), 0.0);
+    for (std::size_t i = 0; i < M.dim; ++i) {
+        for (std::size_t n = M.rowPtr[i]; n < M.rowPtr[i + 1]; ++n) {
+            expected[i] += M.values[n] * input[M.colIdx[n]];
         }
     }
     
     return verifyResult(result, expected, debug);
 }
 
+inline bool verify_matrix_vector_result(
+    const std::vector<double>& result,
+    const BenchmarkMatrix& M,
+    const std::vector<double>& input,
+    bool debug = false) 
+{
+    return M.isSparse ? verify_matrix_vector_result(result, M.sparse, input, debug)
+                      : verify_matrix_vector_result(result, M.dense, input, debug);
+}
+
 // Rotate vector (matches OpenFHE's EvalRotate direction)
 // Positive index = rotate left, negative index = rotate right
 inline std::vector<double> rotate(const std::vector<double>& vec, int k) {
@@ -304,7 +2473,7 @@ inline std::vector<double> rotateVectorDown(const std::vector<double>& vec, int
 // Convert diagonal index from [0, slots-1] to signed range [-slots/2, slots/2]
 // This treats the second half of slots as negative indices
 // Example: in 64 slots, index 63 becomes -1 (one step backwards)
-int normalizeToSignedIndex(int k, int numSlots) {
+inline int normalizeToSignedIndex(int k, int numSlots) {
     int halfSlots = numSlots / 2;
     if (k <= halfSlots) {
         return k;  // First half stays positive
@@ -316,7 +2485,7 @@ int normalizeToSignedIndex(int k, int numSlots) {
 // Floor division that works correctly for negative numbers
 // Regular C++ division truncates toward zero, but we need true floor division
 // Example: -5 / 3 = -2 (floor), not -1 (truncation)
-int floorDivision(int a, int b) {
+inline int floorDivision(int a, int b) {
     int quotient = a / b;
     int remainder = a % b;
     // Adjust if remainder is nonzero and signs differ
@@ -324,4 +2493,272 @@ int floorDivision(int a, int b) {
         quotient--;
     }
     return quotient;
-}
\ No newline at end of file
+}
+
+// BSGS split planning
+// A diagonal k is computed as rot_{n1·j}(diag'_k ⊙ rot_i(x)) with k = j·n1 + i,
+// so n1 fixes the distinct baby steps i, giant steps j and rotation keys.
+
+enum class BsgsVariant { PLAIN, SINGLE_HOISTED, DOUBLE_HOISTED };
+
+// Nanoseconds per operation on one ciphertext
+// --cost-model=<file>  KEY=value lines written by Benchmarker.calibrate_bsgs_cost_model
+//                      from the rotation, multiplication and addition benchmarks;
+//                      missing keys keep the defaults below (relative weights)
+struct BsgsCostModel {
+    double rotateNs = 1000.0;           // COST_ROTATE_NS: EvalRotate
+    double hoistPrecomputeNs = 400.0;   // COST_HOIST_PRECOMPUTE_NS: EvalFastRotationPrecompute
+    double hoistedRotateNs = 600.0;     // COST_HOISTED_ROTATE_NS: EvalFastRotation
+    double ptxtMultNs = 30.0;           // COST_PTXT_MULT_NS: ciphertext-plaintext EvalMult
+    double addNs = 15.0;                // COST_ADD_NS: EvalAdd
+    double keyLoadNs = 1000.0;          // COST_KEY_LOAD_NS: loading one rotation key
+    
+    static BsgsCostModel fromArgs(const ArgParser& parser) {
+        BsgsCostModel model;
+        std::string path = parser.getString("cost-model");
+        if (path.empty()) return model;
+        
+        std::ifstream in(path);
+        if (!in) {
+            throw std::runtime_error("Cannot open cost model " + path);
+        }
+        std::map<std::string, double*> fields = {
+            {"COST_ROTATE_NS", &model.rotateNs},
+            {"COST_HOIST_PRECOMPUTE_NS", &model.hoistPrecomputeNs},
+            {"COST_HOISTED_ROTATE_NS", &model.hoistedRotateNs},
+            {"COST_PTXT_MULT_NS", &model.ptxtMultNs},
+            {"COST_ADD_NS", &model.addNs},
+            {"COST_KEY_LOAD_NS", &model.keyLoadNs},
+        };
+        std::string line;
+        while (std::getline(in, line)) {
+            std::size_t pos = line.find('=');
+            if (pos == std::string::npos) continue;
+            auto field = fields.find(line.substr(0, pos));
+            if (field != fields.end()) *field->second = std::stod(line.substr(pos + 1));
+        }
+        return model;
+    }
+};
+
+// Baby and giant steps of the ascending signed diagonal indices for one n1:
+// k = j·n1 + i with i ∈ [0, n1), and diagonal k pre-rotated down by n1·j
+struct BsgsSchedule {
+    int n1 = 1;
+    std::set<int> babySteps;   // i, including 0 when used
+    std::set<int> giantSteps;  // j, including 0 when used
+    
+    BsgsSchedule(const std::vector<int>& indices, int n1) : n1(n1) {
+        for (int k : indices) {
+            int j = floorDivision(k, n1);
+            babySteps.insert(k - j * n1);
+            giantSteps.insert(j);
+        }
+    }
+    
+    // rotateVectorDown amount in [0, numSlots) for diagonal k
+    int preRotation(int k, int numSlots) const {
+        int amount = (n1 * floorDivision(k, n1)) % numSlots;
+        return amount < 0 ? amount + numSlots : amount;
+    }
+};
+
+// Giant block j of the plain BSGS kernel for one ciphertext:
+// rotate(sum_i diag'_{j*n1+i} * baby(i), j*n1), or nullptr when the block has
+// no diagonal. diagonals are pre-rotated per BsgsSchedule::preRotation;
+// baby(i) returns the input rotated by i and rotate(ct, r) applies rotation r
+// with an acquired key (RotationKeyStore::rotate in the benchmarks). Under
+// FIXEDMANUAL the raw products are added in place and, with rescale, the
+// block is rescaled once ahead of its rotation.
+template <typename BabyRotation, typename Rotate>
+inline Ciphertext<DCRTPoly> bsgsGiantBlock(const CryptoContext<DCRTPoly>& cc, const BenchmarkParams& params,
+                                           const BsgsSchedule& schedule, const std::map<int, Plaintext>& diagonals,
+                                           int j, BabyRotation&& baby, Rotate&& rotate, bool rescale) {
+    Ciphertext<DCRTPoly> sum;
+    for (int i : schedule.babySteps) {
+        auto diagIter = diagonals.find(j * schedule.n1 + i);
+        if (diagIter == diagonals.end()) continue;
+        
+        auto partial = cc->EvalMult(baby(i), diagIter->second);
+        if (!sum) {
+            sum = partial;
+        } else if (params.manualRescale()) {
+            cc->EvalAddInPlace(sum, partial);
+        } else {
+            sum = cc->EvalAdd(sum, partial);
+        }
+    }
+    if (!sum) return sum;
+    
+    if (params.manualRescale() && rescale) cc->RescaleInPlace(sum);
+    if (j != 0) sum = rotate(sum, schedule.n1 * j);
+    return sum;
+}
+
+// The plain BSGS kernel on one ciphertext, block by block
+// result = sum_j rotate(sum_i diag'_{j*n1+i} * rotate(input, i), j*n1)
+template <typename Rotate>
+inline Ciphertext<DCRTPoly> evaluateBsgs(const CryptoContext<DCRTPoly>& cc, const BenchmarkParams& params,
+                                         const BsgsSchedule& schedule, const std::map<int, Plaintext>& diagonals,
+                                         const Ciphertext<DCRTPoly>& input, Rotate&& rotate) {
+    std::map<int, Ciphertext<DCRTPoly>> babyRotations;
+    for (int i : schedule.babySteps) {
+        babyRotations[i] = (i == 0) ? input : rotate(input, i);
+    }
+    
+    Ciphertext<DCRTPoly> result;
+    for (int j : schedule.giantSteps) {
+        auto block = bsgsGiantBlock(cc, params, schedule, diagonals, j,
+                                    [&](int i) -> const Ciphertext<DCRTPoly>& { return babyRotations.at(i); },
+                                    rotate, true);
+        if (!block) continue;
+        result = result ? cc->EvalAdd(result, block) : block;
+    }
+    return result;
+}
+
+// Operation counts of one n1 and their predicted latency per ciphertext
+struct BsgsSplit {
+    int n1 = 1;
+    std::size_t babySteps = 0;      // distinct nonzero baby rotations
+    std::size_t giantSteps = 0;     // distinct nonzero giant rotations
+    std::size_t giantBlocks = 0;    // non-empty giant blocks (including j = 0)
+    std::size_t rotationKeys = 0;   // distinct rotation amounts mod numSlots
+    double predictedNs = 0.0;
+};
+
+// --n1=<n>|auto         baby-step count; default ceil(sqrt(numDiagonals)). auto
+//                       evaluates every candidate n1 under the cost model and
+//                       keeps the best for --n1-objective=latency (default) or
+//                       keys (fewest rotation keys, then latency).
+// --n1-candidates=K     with --n1=auto, print the K best splits (default 5) as
+//                       N1_CANDIDATE records; Benchmarker.tune_n1 confirms them
+//                       with short timed runs.
+class BsgsPlanner {
+public:
+    BsgsPlanner(const ArgParser& parser, BsgsVariant variant, uint32_t batchSize)
+        : n1Spec(parser.getString("n1")),
+          objective(parser.getString("n1-objective", "latency")),
+          numCandidates(parser.getUInt32("n1-candidates", 5)),
+          model(BsgsCostModel::fromArgs(parser)),
+          variant(variant),
+          batchSize(std::max<uint32_t>(1, batchSize)) {}
+    
+    // Chooses n1 for the ascending signed diagonal indices
+    int choose(const std::vector<int>& indices, int numSlots) {
+        ranked.clear();
+        int n1;
+        if (n1Spec == "auto") {
+            // Baby steps beyond the index span only add empty rotations
+            int span = indices.empty() ? 1 : indices.back() - indices.front() + 1;
+            int sqrtSpan = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(span))));
+            int maxN1 = std::min({numSlots, span, 16 * sqrtSpan});
+            for (int candidate = 1; candidate <= maxN1; ++candidate) {
+                ranked.push_back(evaluate(indices, candidate, numSlots));
+            }
+            std::stable_sort(ranked.begin(), ranked.end(), [&](const BsgsSplit& a, const BsgsSplit& b) {
+                if (objective == "keys" && a.rotationKeys != b.rotationKeys) {
+                    return a.rotationKeys < b.rotationKeys;
+                }
+                return a.predictedNs < b.predictedNs;
+            });
+            n1 = ranked.front().n1;
+        } else if (!n1Spec.empty()) {
+            n1 = static_cast<int>(std::stoul(n1Spec));
+        } else {
+            n1 = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(indices.size()))));
+        }
+        
+        n1 = std::clamp(n1, 1, numSlots);
+        chosen = evaluate(indices, n1, numSlots);
+        return n1;
+    }
+    
+    const BsgsSplit& split() const { return chosen; }
+    
+    // Machine-readable BSGS_* lines and N1_CANDIDATE records, parsed by plots/benchmarker.py
+    void printResults() const {
+        std::cout << "BSGS_N1=" << chosen.n1 << "\n";
+        std::cout << "BSGS_BABY_STEPS=" << chosen.babySteps << "\n";
+        std::cout << "BSGS_GIANT_STEPS=" << chosen.giantSteps << "\n";
+        std::cout << "BSGS_ROTATION_KEYS=" << chosen.rotationKeys << "\n";
+        std::cout << "BSGS_PREDICTED_NS=" << static_cast<uint64_t>(chosen.predictedNs) << "\n";
+        
+        for (std::size_t c = 0; c < std::min<std::size_t>(numCandidates, ranked.size()); ++c) {
+            const auto& split = ranked[c];
+            std::cout << "N1_CANDIDATE n1=" << split.n1
+                      << " predicted_ns=" << static_cast<uint64_t>(split.predictedNs)
+                      << " baby_steps=" << split.babySteps
+                      << " giant_steps=" << split.giantSteps
+                      << " rotation_keys=" << split.rotationKeys << "\n";
+        }
+    }
+    
+private:
+    std::string n1Spec;
+    std::string objective;
+    uint32_t numCandidates;
+    BsgsCostModel model;
+    BsgsVariant variant;
+    uint32_t batchSize;
+    BsgsSplit chosen;
+    std::vector<BsgsSplit> ranked;
+    
+    // O(numDiagonals + n1): indices are sorted, so equal giant steps are adjacent
+    BsgsSplit evaluate(const std::vector<int>& indices, int n1, int numSlots) const {
+        BsgsSplit split;
+        split.n1 = n1;
+        
+        std::vector<char> babyUsed(n1, 0);
+        std::vector<int> giantAmounts;
+        bool first = true;
+        int lastGiant = 0;
+        for (int k : indices) {
+            int j = floorDivision(k, n1);
+            babyUsed[k - j * n1] = 1;
+            if (first || j != lastGiant) {
+                split.giantBlocks++;
+                if (j != 0) {
+                    int amount = (n1 * j) % numSlots;
+                    giantAmounts.push_back(amount < 0 ? amount + numSlots : amount);
+                }
+                lastGiant = j;
+                first = false;
+            }
+        }
+        split.babySteps = static_cast<std::size_t>(std::count(babyUsed.begin() + 1, babyUsed.end(), 1));
+        split.giantSteps = giantAmounts.size();
+        
+        // A giant amount that wraps below n1 reuses the baby step's key
+        std::sort(giantAmounts.begin(), giantAmounts.end());
+        giantAmounts.erase(std::unique(giantAmounts.begin(), giantAmounts.end()), giantAmounts.end());
+        std::size_t sharedKeys = static_cast<std::size_t>(std::count_if(giantAmounts.begin(), giantAmounts.end(),
+            [&](int amount) { return amount == 0 || (amount < n1 && babyUsed[amount]); }));
+        split.rotationKeys = split.babySteps + giantAmounts.size() - sharedKeys;
+        
+        double baby = 0.0;
+        double giant = 0.0;
+        switch (variant) {
+            case BsgsVariant::PLAIN:
+                baby = split.babySteps * model.rotateNs;
+                giant = split.giantSteps * model.rotateNs;
+                break;
+            case BsgsVariant::SINGLE_HOISTED:
+                baby = model.hoistPrecomputeNs + split.babySteps * model.hoistedRotateNs;
+                giant = split.giantSteps * model.rotateNs;
+                break;
+            case BsgsVariant::DOUBLE_HOISTED:
+                // Giant steps decompose the block sum once and key-switch it hoisted
+                baby = model.hoistPrecomputeNs + split.babySteps * model.hoistedRotateNs;
+                giant = split.giantSteps * (model.hoistPrecomputeNs + model.hoistedRotateNs);
+                break;
+        }
+        double mults = indices.size() * model.ptxtMultNs;
+        double adds = (indices.empty() ? 0 : indices.size() - 1) * model.addNs;
+        
+        // Keys are loaded once per kernel and shared by the whole batch
+        double keyLoads = split.rotationKeys * model.keyLoadNs / batchSize;
+        split.predictedNs = baby + giant + mults + adds + keyLoads;
+        return split;
+    }
+};
@@ -6,15 +6,14 @@ Provides comprehensive performance analysis including:
 - Execution latency measurements
 - DRAM traffic analysis
 - Integer operation counting via Intel PIN
+- Per-phase (named region) latency, DRAM traffic and arithmetic intensity
 """
 
 import json
 import re
 import os
 import subprocess
-import time
 from pathlib import Path
-from statistics import mean, stdev
 
 
 class Benchmarker:
@@ -28,6 +27,9 @@ class Benchmarker:
     def __init__(self, debug=False):
         """Initialize the benchmarker with debug control."""
         self._debug = debug
+        # Prepended to every measured command, e.g. ["taskset", "-c", "2-9"]
+        # to run on isolated CPUs
+        self.launch_prefix = []
         self._setup_paths()
         self._setup_default_config()
     
@@ -40,6 +42,7 @@ class Benchmarker:
             self.repo_root = current_file.parent
         
         self.build_dir = self.repo_root / "build"
+        self._built = set()  # allocators whose openfhe-bench is built
         self.pin_path = Path("/opt/intel/pin/pin")
         self.pintool_path = Path("/opt/profiling-tools/lib/pintool.so")
     
@@ -51,38 +54,71 @@ class Benchmarker:
             "num_digits": 1,
             "matrix_dim": 128,
             "threads": 1,
-            "timing_runs": 5,
+            "warmup": 1,
+            "repetitions": 5,
+            "key_cache_mb": 0,
+            "key_cache_policy": "lru",
+            "prefetch_depth": 0,
+            "key_store": "files",
+            "keygen_threads": 1,
+            "batch": 1,
+            "matrix_seed": 0,
+            "matrix_kind": "dense",
+            "key_basis": "full",
+            "reduction": "fold",
+            "scaling": "FLEXIBLEAUTO",
+            "ks_tech": "hybrid",
+            "digit_size": 0,
+            "numa_pin": "none",
+            "numa_membind": "none",
+            "numa_key_membind": "none",
+            "numa_ptxt_membind": "none",
+            "numa_key_replicas": False,
+            "rescale": "block",
+            "start_level": 0,
+            "mod_switch": "off",
+            "allocator": "system",
             "check_security": False,
+            "phase_opcounts": False,
+            "measure_encode": False,
+            "measure_memory": False,
+            "measure_perf": False,
             "build": True,
             "debug": False,
         }
     
-    def build(self, benchmark, clean=False):
+    def build(self, benchmark, clean=False, allocator="system"):
         """
-        Build a benchmark executable from source.
+        Build openfhe-bench, which holds every benchmark as a kernel.
+        
+        The binary is configured and built once per allocator and session;
+        later calls only return the benchmark's path. Each allocator has
+        its own build directory, so switching allocators never reconfigures.
         
         Args:
-            benchmark: Name of the benchmark to build
+            benchmark: Name of the benchmark (kernel) to run
             clean: If True, force a clean rebuild
+            allocator: Heap allocator (-DBENCH_ALLOCATOR): system,
+                jemalloc or pool
             
         Returns:
-            Path to the built executable
+            Path to the benchmark's executable (build/<benchmark>, a
+            symlink that selects the kernel of openfhe-bench)
         """
-        self.build_dir.mkdir(exist_ok=True)
+        build_dir = self._binary_dir(allocator)
+        if allocator in self._built and not clean:
+            return build_dir / benchmark
         
-        # Optionally remove existing binary
-        if clean:
-            binary_path = self.build_dir / benchmark
-            if binary_path.exists():
-                binary_path.unlink()
+        build_dir.mkdir(exist_ok=True)
         
         subprocess.run(
             [
                 "cmake",
                 "-S", str(self.repo_root),
-                "-B", str(self.build_dir),
-                f"-DBENCH_SOURCE=examples/{benchmark}.cpp",
-                "-DCMAKE_BUILD_TYPE=Release"
+                "-B", str(build_dir),
+                "-UBENCH_SOURCE",
+                "-DCMAKE_BUILD_TYPE=Release",
+                f"-DBENCH_ALLOCATOR={allocator}"
             ],
             check=True,
             capture_output=not self._debug
@@ -91,43 +127,578 @@ class Benchmarker:
         # Add --clean-first to force rebuild
         build_cmd = [
             "cmake",
-            "--build", str(self.build_dir),
+            "--build", str(build_dir),
             "-j", str(os.cpu_count())
         ]
         if clean:
             build_cmd.insert(2, "--clean-first")
         
         subprocess.run(build_cmd, check=True, capture_output=not self._debug)
+        self._built.add(allocator)
         
-        return self.build_dir / benchmark
+        return build_dir / benchmark
+    
+    def _binary_dir(self, allocator="system"):
+        """Build directory of one allocator (build/, build-jemalloc/, build-pool/)."""
+        return self.build_dir if allocator == "system" else self.repo_root / f"build-{allocator}"
     
-    def measure_latency(self, target, args, runs=3):
+    def measure_latency(self, target, args):
         """
-        Measure execution time over multiple runs.
+        Measure in-process kernel latency.
+        
+        The executable times only its measured kernel with a steady clock,
+        repeating it --warmup times untimed and --repetitions times timed,
+        and prints LATENCY_* lines (nanoseconds).
         
         Args:
             target: Path to the executable
             args: Command line arguments
-            runs: Number of timing runs to perform
             
         Returns:
-            Tuple of (mean_time, standard_deviation) or (None, None) on failure
+            Dictionary with LATENCY_SAMPLES/MIN/MEDIAN/P99 values and
+            PEAK_RSS_BYTES, plus KEY_SET_*, KEY_BASIS_*, KEY_CACHE_* and
+            KEY_PREFETCH_* statistics for benchmarks using the rotation
+            key store, BATCH_* throughput for batched
+            benchmarks, MATRIX_* (dimension, nonzeros, diagonals) for
+            the diagonal benchmarks, BSGS_* (n1, step and key counts,
+            predicted latency) for the BSGS benchmarks, LEVEL_* (start
+            and compute level, input limbs) for the level-aware benchmarks
+            and KEY_SIZE_* (serialized and in-memory bytes of one rotation
+            key, and of the relin key with key_size_relin) for the rotation and BSGS
+            benchmarks, BOOT_* (setup, keygen, save and warm-start load
+            times, state sizes, precision) for the bootstrapping benchmark
+            MATMUL_* (columns, rotations, key loads and latency per
+            output column) for the matrix-matrix benchmark, SERVE_*
+            (throughput, latency and queueing percentiles, stage medians)
+            for the serving benchmark and NUMA_* (nodes, pinned threads
+            and resident bytes per node) with any --numa-* option, or
+            None on failure. The raw timed runs (ns, in
+            order) are under "samples".
+        """
+        cmd = [*self.launch_prefix, str(target), *args, "--measure=latency"]
+        
+        result = subprocess.run(cmd, capture_output=True, text=True)
+        
+        if self._debug:
+            print(result.stdout, end="")
+        
+        if result.returncode != 0:
+            return None
+        
+        latency = self._parse_counters(result.stdout, "LATENCY_")
+        if latency is not None:
+            latency.update(self._parse_counters(result.stdout, "KEY_CACHE_") or {})
+            latency.update(self._parse_counters(result.stdout, "KEY_SET_") or {})
+            latency.update(self._parse_counters(result.stdout, "KEY_BASIS_") or {})
+            latency.update(self._parse_counters(result.stdout, "PEAK_RSS_") or {})
+            latency.update(self._parse_counters(result.stdout, "KEY_PREFETCH_") or {})
+            latency.update(self._parse_counters(result.stdout, "BATCH_") or {})
+            latency.update(self._parse_counters(result.stdout, "PTXT_") or {})
+            latency.update(self._parse_counters(result.stdout, "MATRIX_") or {})
+            latency.update(self._parse_counters(result.stdout, "BSGS_") or {})
+            latency.update(self._parse_counters(result.stdout, "LEVEL_") or {})
+            latency.update(self._parse_counters(result.stdout, "KEY_SIZE_") or {})
+            latency.update(self._parse_counters(result.stdout, "BOOT_") or {})
+            latency.update(self._parse_counters(result.stdout, "MATMUL_") or {})
+            latency.update(self._parse_counters(result.stdout, "SERVE_") or {})
+            latency.update(self._parse_counters(result.stdout, "NUMA_") or {})
+            latency["samples"] = self._parse_samples(result.stdout)
+        
+        return latency
+    
+    def measure_encode(self, target, args):
+        """
+        Measure diagonal plaintext encoding separately from the kernel.
+        
+        Runs the benchmark with --encode-only=true, which times only the
+        encoding of its diagonal plaintexts (--warmup/--repetitions)
+        and skips the matrix-vector product.
+        
+        Args:
+            target: Path to the executable
+            args: Command line arguments
+            
+        Returns:
+            Dictionary with LATENCY_* values of the encoding and PTXT_*
+            statistics, or None on failure
+        """
+        cmd = [str(target), *args, "--encode-only=true", "--measure=latency"]
+        
+        result = subprocess.run(cmd, capture_output=True, text=True)
+        
+        if self._debug:
+            print(result.stdout, end="")
+        
+        if result.returncode != 0:
+            return None
+        
+        encode = self._parse_counters(result.stdout, "LATENCY_")
+        if encode is not None:
+            encode.update(self._parse_counters(result.stdout, "PTXT_") or {})
+        
+        return encode
+    
+    def calibrate_bsgs_cost_model(self, path, **kwargs):
+        """
+        Calibrate the cost model used by the BSGS benchmarks' --n1=auto.
+        
+        Runs the rotation (plain and --hoisted=true), multiplication
+        (--ptxt-operand=true) and addition benchmarks with the given
+        parameters and writes their per-call region latencies as COST_*
+        lines, the format read by --cost-model.
+        
+        Args:
+            path: Output file for the cost model
+            **kwargs: Override parameters for these runs
+            
+        Returns:
+            Dictionary of COST_* values (nanoseconds), or None on failure
+        """
+        params = self.base_config.copy()
+        params.update(kwargs)
+        params["debug"] = self._debug
+        args = self._prepare_arguments(params)
+        
+        def region_ns(benchmark, extra_args):
+            target = self.build(benchmark, allocator=params["allocator"]) if params["build"] else self._binary_dir(params["allocator"]) / benchmark
+            cmd = [str(target), *args, *extra_args, "--measure=latency"]
+            result = subprocess.run(cmd, capture_output=True, text=True)
+            if result.returncode != 0:
+                return None
+            return {
+                name: record["ns"] / record["calls"]
+                for name, record in self._parse_regions(result.stdout).items()
+                if record.get("calls", 0) > 0
+            }
+        
+        rotation = region_ns("rotation", [])
+        hoisted = region_ns("rotation", ["--hoisted=true"])
+        mult = region_ns("multiplication", ["--ptxt-operand=true"])
+        add = region_ns("addition", [])
+        if None in (rotation, hoisted, mult, add):
+            return None
+        
+        model = {
+            "COST_ROTATE_NS": rotation.get("rotate"),
+            "COST_KEY_LOAD_NS": rotation.get("load-rotation-key"),
+            "COST_HOIST_PRECOMPUTE_NS": hoisted.get("hoist-precompute"),
+            "COST_HOISTED_ROTATE_NS": hoisted.get("rotate"),
+            "COST_PTXT_MULT_NS": mult.get("ptxt-mult"),
+            "COST_ADD_NS": add.get("add"),
+        }
+        model = {key: value for key, value in model.items() if value is not None}
+        
+        with open(path, "w") as f:
+            for key, value in model.items():
+                f.write(f"{key}={value:.1f}\n")
+        
+        return model
+    
+    def tune_n1(self, benchmark, top=3, repetitions=2, **kwargs):
+        """
+        Choose the BSGS baby-step count n1 for a benchmark.
+        
+        Runs the benchmark once with --n1=auto to rank candidate n1 values
+        by predicted latency (pass cost_model=<file> from
+        calibrate_bsgs_cost_model for calibrated costs), then confirms the
+        best `top` candidates with short timed runs.
+        
+        Args:
+            benchmark: Name of a BSGS benchmark
+            top: Number of predicted candidates to time
+            repetitions: Timed repetitions per candidate
+            **kwargs: Override parameters for these runs
+            
+        Returns:
+            Dictionary with the predicted "candidates", the "measured"
+            median latency per candidate n1 and the fastest "best_n1",
+            or None on failure
+        """
+        params = self.base_config.copy()
+        params.update(kwargs)
+        params.update({"warmup": 0, "repetitions": repetitions})
+        params["debug"] = self._debug
+        
+        target = self.build(benchmark, allocator=params["allocator"]) if params["build"] else self._binary_dir(params["allocator"]) / benchmark
+        
+        params["n1"] = "auto"
+        params["n1_candidates"] = top
+        cmd = [str(target), *self._prepare_arguments(params), "--measure=latency"]
+        result = subprocess.run(cmd, capture_output=True, text=True)
+        if result.returncode != 0:
+            return None
+        candidates = self._parse_candidates(result.stdout)
+        
+        measured = {}
+        for candidate in candidates:
+            params["n1"] = candidate["n1"]
+            latency = self.measure_latency(target, self._prepare_arguments(params))
+            if latency is not None:
+                measured[candidate["n1"]] = latency["LATENCY_MEDIAN_NS"]
+        
+        return {
+            "candidates": candidates,
+            "measured": measured,
+            "best_n1": min(measured, key=measured.get) if measured else None
+        }
+    
+    def compare_key_bases(self, benchmark, bases=("full", "pow2", "naf"), **kwargs):
+        """
+        Compare rotation key bases (--key-basis) on one benchmark.
+        
+        A compact basis trades key memory for extra key switches; this
+        reports both sides of the trade for each basis.
+        
+        Args:
+            benchmark: Name of a non-hoisted diagonal benchmark
+            bases: Key bases to run
+            **kwargs: Override parameters for these runs
+            
+        Returns:
+            Dictionary mapping each basis to its key count, key set bytes,
+            loaded key bytes, key switches per ciphertext, peak RSS and
+            median latency (None for failed runs)
+        """
+        params = self.base_config.copy()
+        params.update(kwargs)
+        params["debug"] = self._debug
+        
+        target = self.build(benchmark, allocator=params["allocator"]) if params["build"] else self._binary_dir(params["allocator"]) / benchmark
+        
+        comparison = {}
+        for basis in bases:
+            params["key_basis"] = basis
+            latency = self.measure_latency(target, self._prepare_arguments(params))
+            if latency is None:
+                comparison[basis] = None
+                continue
+            comparison[basis] = {
+                "keys": latency.get("KEY_SET_KEYS"),
+                "key_set_bytes": latency.get("KEY_SET_BYTES"),
+                "loaded_key_bytes": latency.get("KEY_CACHE_LOADED_BYTES"),
+                "rotations": latency.get("KEY_BASIS_ROTATIONS"),
+                "peak_rss_bytes": latency.get("PEAK_RSS_BYTES"),
+                "latency_median_ns": latency.get("LATENCY_MEDIAN_NS"),
+            }
+        
+        return comparison
+    
+    def compare_reductions(self, benchmark, reductions=("fold", "tree"), **kwargs):
+        """
+        Compare partial-product accumulation (--reduction) on one benchmark.
+        
+        The tree forms all products of a block before summing them, so it
+        trades peak memory for parallel multiplies and in-place adds.
+        
+        Args:
+            benchmark: Name of a diagonal benchmark
+            reductions: Reductions to run
+            **kwargs: Override parameters for these runs
+            
+        Returns:
+            Dictionary mapping each reduction to its median latency and peak
+            RSS (None for failed runs)
+        """
+        params = self.base_config.copy()
+        params.update(kwargs)
+        params["debug"] = self._debug
+        
+        target = self.build(benchmark, allocator=params["allocator"]) if params["build"] else self._binary_dir(params["allocator"]) / benchmark
+        
+        comparison = {}
+        for reduction in reductions:
+            params["reduction"] = reduction
+            latency = self.measure_latency(target, self._prepare_arguments(params))
+            if latency is None:
+                comparison[reduction] = None
+                continue
+            comparison[reduction] = {
+                "latency_median_ns": latency.get("LATENCY_MEDIAN_NS"),
+                "peak_rss_bytes": latency.get("PEAK_RSS_BYTES"),
+            }
+        
+        return comparison
+    
+    def compare_levels(self, benchmark, start_levels=None, **kwargs):
+        """
+        Compare a benchmark at reduced input levels (--start-level), and with
+        the input switched down to its minimum level inside the kernel
+        (--mod-switch=min).
+        
+        Isolates the limb count of the rotations and key switches from the
+        prime count the context is built with (num_limbs).
+        
+        Args:
+            benchmark: rotation, multiplication or a diagonal benchmark
+            start_levels: Levels to run (default: 0 .. num_limbs - 2)
+            **kwargs: Override parameters for these runs
+            
+        Returns:
+            Dictionary mapping each start level, and "min", to its median
+            latency and input limb count (None for failed runs)
+        """
+        params = self.base_config.copy()
+        params.update(kwargs)
+        params["debug"] = self._debug
+        if start_levels is None:
+            start_levels = range(max(1, params["num_limbs"] - 1))
+        
+        target = self.build(benchmark, allocator=params["allocator"]) if params["build"] else self._binary_dir(params["allocator"]) / benchmark
+        
+        points = [(level, {"start_level": level, "mod_switch": "off"}) for level in start_levels]
+        points.append(("min", {"start_level": 0, "mod_switch": "min"}))
+        
+        comparison = {}
+        for label, overrides in points:
+            latency = self.measure_latency(target, self._prepare_arguments({**params, **overrides}))
+            if latency is None:
+                comparison[label] = None
+                continue
+            comparison[label] = {
+                "latency_median_ns": latency.get("LATENCY_MEDIAN_NS"),
+                "limbs": latency.get("LEVEL_LIMBS"),
+            }
+        
+        return comparison
+    
+    def compare_key_switching(self, benchmark, digit_counts=None, **kwargs):
+        """
+        Compare HYBRID key switching over its digit count (dnum) against BV.
+        
+        Each point reports latency next to the evaluation key sizes, the
+        trade-off the digit count controls.
+        
+        Args:
+            benchmark: rotation or a BSGS benchmark
+            digit_counts: HYBRID digit counts (default: 1 .. num_limbs)
+            **kwargs: Override parameters for these runs
+            
+        Returns:
+            Dictionary mapping ("hybrid", digits) and ("bv", digits) to its
+            median latency and KEY_SIZE_* values (None for failed runs)
+        """
+        params = self.base_config.copy()
+        params["key_size_relin"] = True  # KEY_SIZE_RELIN_* for the relin key column
+        params.update(kwargs)
+        params["debug"] = self._debug
+        if digit_counts is None:
+            digit_counts = range(1, params["num_limbs"] + 1)
+        
+        target = self.build(benchmark, allocator=params["allocator"]) if params["build"] else self._binary_dir(params["allocator"]) / benchmark
+        
+        points = [{"ks_tech": "hybrid", "num_digits": digits} for digits in digit_counts]
+        points.append({"ks_tech": "bv"})
+        
+        comparison = {}
+        for overrides in points:
+            latency = self.measure_latency(target, self._prepare_arguments({**params, **overrides}))
+            if latency is None:
+                label = (overrides["ks_tech"], overrides.get("num_digits"))
+                comparison[label] = None
+                continue
+            # BV's digit count follows from --digit-size; report the key's own
+            label = (overrides["ks_tech"], overrides.get("num_digits", latency.get("KEY_SIZE_DIGITS")))
+            comparison[label] = {
+                "latency_median_ns": latency.get("LATENCY_MEDIAN_NS"),
+                **{key: value for key, value in latency.items() if key.startswith("KEY_SIZE_")},
+            }
+        
+        return comparison
+    
+    def compare_allocators(self, benchmark, allocators=("system", "jemalloc", "pool"), **kwargs):
+        """
+        Compare heap allocators (-DBENCH_ALLOCATOR) on one benchmark.
+        
+        Each allocator has its own build (and build directory).
+        
+        Args:
+            benchmark: Name of the benchmark to run
+            allocators: Allocators to build and run
+            **kwargs: Override parameters for these runs
+            
+        Returns:
+            Dictionary mapping each allocator to its median latency and
+            MEMORY_* values (allocations reaching malloc, pool hits, page
+            faults, peak RSS), or None if its build or runs failed
+        """
+        params = self.base_config.copy()
+        params.update(kwargs)
+        params["debug"] = self._debug
+        
+        comparison = {}
+        for allocator in allocators:
+            try:
+                target = self.build(benchmark, allocator=allocator)
+            except subprocess.CalledProcessError:
+                comparison[allocator] = None
+                continue
+            
+            args = self._prepare_arguments(params)
+            latency = self.measure_latency(target, args)
+            memory = self.measure_memory(target, args)
+            if latency is None or memory is None:
+                comparison[allocator] = None
+                continue
+            
+            memory.pop("regions", None)
+            comparison[allocator] = {"latency_median_ns": latency.get("LATENCY_MEDIAN_NS"), **memory}
+        
+        return comparison
+    
+    def sweep_thread_splits(self, benchmark, total_threads=64, **kwargs):
+        """
+        Sweep outer/inner thread splits (--outer-threads/--inner-threads).
+        
+        Every split uses all total_threads: outer runs independent operations
+        as tasks, inner is the OpenFHE parallelism inside each of them.
+        
+        Args:
+            benchmark: Name of the benchmark to run
+            total_threads: Threads to divide between the two levels
+            **kwargs: Override parameters for these runs (e.g. batch=64)
+            
+        Returns:
+            Tuple (results, best): results is a list of dictionaries with
+            outer, inner, median latency and throughput (ciphertexts per
+            second) sorted by throughput; best is its first entry (None if
+            every run failed)
+        """
+        params = self.base_config.copy()
+        params.update(kwargs)
+        params["debug"] = self._debug
+        
+        target = self.build(benchmark, allocator=params["allocator"]) if params["build"] else self._binary_dir(params["allocator"]) / benchmark
+        
+        results = []
+        for outer in range(1, total_threads + 1):
+            if total_threads % outer != 0:
+                continue
+            inner = total_threads // outer
+            
+            run_params = params.copy()
+            run_params.update(threads=inner, outer_threads=outer, inner_threads=inner)
+            latency = self.measure_latency(target, self._prepare_arguments(run_params))
+            if latency is None or not latency.get("LATENCY_MEDIAN_NS"):
+                continue
+            
+            median_ns = latency["LATENCY_MEDIAN_NS"]
+            results.append({
+                "outer": outer,
+                "inner": inner,
+                "latency_median_ns": median_ns,
+                "throughput": run_params["batch"] * 1e9 / median_ns,
+            })
+        
+        results.sort(key=lambda r: r["throughput"], reverse=True)
+        return results, (results[0] if results else None)
+    
+    def measure_machine_peaks(self, threads=None, build=True, **args):
+        """
+        Measure machine peaks for roofline analysis (machine-peaks).
+        
+        Args:
+            threads: OpenMP threads (default: base_config["threads"])
+            build: Build the microbenchmark first
+            **args: Extra microbenchmark options (stream_mb, ntt_log_n,
+                ntt_rounds, repetitions)
+            
+        Returns:
+            Dictionary with MACHINE_BANDWIDTH_BYTES_PER_SEC (STREAM triad),
+            MACHINE_INT_OPS_PER_SEC (NTT butterflies), MACHINE_RIDGE_OPS_PER_BYTE
+            and MACHINE_THREADS, or None on failure
         """
-        cmd = [str(target), *args, "--measure=latency"]
+        target = self.build("machine-peaks") if build else self.build_dir / "machine-peaks"
+        
+        params = {"threads": threads if threads is not None else self.base_config["threads"], **args}
+        cmd = [str(target), *[f"--{key.replace('_', '-')}={value}" for key, value in params.items()]]
+        
+        result = subprocess.run(cmd, capture_output=True, text=True)
         
-        times = []
-        for _ in range(runs):
-            start = time.perf_counter()
-            result = subprocess.run(cmd, capture_output=not self._debug)
+        if result.returncode != 0:
+            return None
+        
+        return self._parse_counters(result.stdout, "MACHINE_")
+    
+    def run_sweep_driver(self, ring_dims, num_limbs, num_digits, matrix_dims,
+                         threads=None, method="bsgs", build=True, **args):
+        """
+        Run a parameter grid in one process (sweep-driver).
+        
+        Each (ring_dim, num_limbs, num_digits) point builds its CryptoContext
+        and keys once; rotation keys accumulate across matrix_dims and stay
+        resident, and every thread count reuses the encoded matrix.
+        
+        Args:
+            ring_dims, num_limbs, num_digits, matrix_dims: Lists of grid values
+            threads: List of OpenMP thread counts (default: [base_config["threads"]])
+            method: "bsgs" or "diagonal"
+            build: Build the driver first
+            **args: Extra driver options (warmup, repetitions, n1, scaling, ...)
             
-            if result.returncode == 0:
-                elapsed = time.perf_counter() - start
-                times.append(elapsed)
+        Returns:
+            List of row dictionaries (one per grid point, numeric fields as
+            numbers), or None if the driver failed before producing rows.
+            A row whose result did not verify has verified=0.
+        """
+        target = self.build("sweep-driver") if build else self.build_dir / "sweep-driver"
         
-        if not times:
-            return (None, None)
+        grid = {
+            "ring_dims": ring_dims,
+            "limbs": num_limbs,
+            "digits": num_digits,
+            "matrix_dims": matrix_dims,
+            "thread_counts": threads if threads is not None else [self.base_config["threads"]],
+        }
+        params = {**{key: ",".join(str(v) for v in values) for key, values in grid.items()},
+                  "method": method, "format": "csv", **args}
+        cmd = [str(target), *[f"--{key.replace('_', '-')}={value}" for key, value in params.items()]]
+        
+        result = subprocess.run(cmd, capture_output=True, text=True)
+        
+        lines = [line for line in result.stdout.splitlines() if line.strip()]
+        if len(lines) < 2:
+            return None
+        
+        header = lines[0].split(",")
+        rows = []
+        for line in lines[1:]:
+            row = {}
+            for key, value in zip(header, line.split(",")):
+                try:
+                    row[key] = int(value)
+                except ValueError:
+                    try:
+                        row[key] = float(value)
+                    except ValueError:
+                        row[key] = value
+            rows.append(row)
+        return rows
+    
+    def measure_serialization(self, **kwargs):
+        """
+        Measure (de)serialization throughput (serialization benchmark).
+        
+        Args:
+            **kwargs: Override base_config (ring_dim, num_limbs, num_digits,
+                threads, ...) and benchmark options: objects, formats, media
+                (comma lists), rotations, compression_level, tmpfs_dir, disk_dir
             
-        return (mean(times), stdev(times) if len(times) > 1 else 0.0)
+        Returns:
+            List of case dictionaries (object, format, medium, bytes, median
+            serialize/deserialize ns and MB/s, per-operation allocations),
+            or None on failure
+        """
+        params = {**self.base_config, **kwargs}
+        target = self.build("serialization", allocator=params["allocator"]) if params["build"] else self._binary_dir(params["allocator"]) / "serialization"
+        
+        cmd = [str(target), *self._prepare_arguments(params)]
+        
+        result = subprocess.run(cmd, capture_output=True, text=True)
+        
+        if result.returncode != 0:
+            return None
+        
+        return self._parse_serial(result.stdout)
     
     def measure_dram(self, target, args):
         """
@@ -138,36 +709,112 @@ class Benchmarker:
             args: Command line arguments
             
         Returns:
-            Dictionary with READ/WRITE/TOTAL bytes, or None on failure
+            Dictionary with READ/WRITE/TOTAL bytes (and BATCH_DRAM_*
+            bytes per ciphertext for batched benchmarks), or None on failure.
+            DRAM_SOCKET<s>_* bytes are included where the uncore memory
+            controller counters are available, and NUMA_* lines with any
+            --numa-* option. Per-phase records, if the benchmark tags any,
+            are under "regions".
         """
-        cmd = ["sudo", "-n", str(target), *args, "--measure=dram"]
+        cmd = ["sudo", "-n", *self.launch_prefix, str(target), *args, "--measure=dram"]
         
         result = subprocess.run(cmd, capture_output=True, text=True)
         
         if result.returncode != 0:
             return None
         
-        data = {}
-        for line in result.stdout.split('\n'):
-            if 'DRAM_' in line and '=' in line:
-                key, value = line.split('=', 1)
-                data[key] = int(value)
+        data = self._parse_counters(result.stdout, "DRAM_")
+        if data is not None:
+            data.update(self._parse_counters(result.stdout, "NUMA_") or {})
+        regions = self._parse_regions(result.stdout)
+        if data is not None and regions:
+            data["regions"] = regions
         
-        return data if data else None
+        return data
+    
+    def measure_memory(self, target, args):
+        """
+        Measure peak memory and heap allocation churn of the kernel.
+        
+        Args:
+            target: Path to the executable
+            args: Command line arguments
+            
+        Returns:
+            Dictionary with MEMORY_* values (kernel peak RSS, peak heap
+            growth, allocated/freed bytes, allocation/free counts, page
+            faults), or None on failure. Per-phase records, if the benchmark
+            tags any, are under "regions" with allocated_bytes/allocations.
+        """
+        cmd = [*self.launch_prefix, str(target), *args, "--measure=memory"]
+        
+        result = subprocess.run(cmd, capture_output=True, text=True)
+        
+        if result.returncode != 0:
+            return None
+        
+        data = self._parse_counters(result.stdout, "MEMORY_")
+        regions = self._parse_regions(result.stdout)
+        if data is not None and regions:
+            data["regions"] = regions
+        
+        return data
+    
+    def measure_perf(self, target, args):
+        """
+        Measure hardware performance counters (perf_event) of the kernel.
+        
+        Near-zero overhead alternative to PIN: one run with counters for
+        cycles, instructions, cache and branch misses (and the L2/AVX-512
+        events where the CPU supports them).
+        
+        Args:
+            target: Path to the executable
+            args: Command line arguments
+            
+        Returns:
+            Dictionary with PERF_* totals, "ipc" (instructions per cycle),
+            "llc_miss_intensity" (instructions per LLC-missed byte, 64-byte
+            lines) and per-thread counts under "threads", or None on failure
+        """
+        cmd = [*self.launch_prefix, str(target), *args, "--measure=perf"]
+        
+        result = subprocess.run(cmd, capture_output=True, text=True)
+        
+        if result.returncode != 0:
+            return None
+        
+        data = self._parse_counters(result.stdout, "PERF_")
+        if data is None:
+            return None
+        
+        cycles = data.get("PERF_CYCLES", 0)
+        instructions = data.get("PERF_INSTRUCTIONS", 0)
+        llc_misses = data.get("PERF_LLC_MISSES", 0)
+        data["ipc"] = instructions / cycles if cycles > 0 else None
+        data["llc_miss_intensity"] = instructions / (llc_misses * 64) if llc_misses > 0 else None
+        data["threads"] = self._parse_threads(result.stdout)
+        
+        return data
     
-    def measure_opcounts(self, target, args):
+    def measure_opcounts(self, target, args, region=None):
         """
         Measure integer operations using Intel PIN instrumentation.
         
         Args:
             target: Path to the executable
             args: Command line arguments
+            region: If given, count only inside this named region
             
         Returns:
             Dictionary with operation counts, or None on failure
         """
+        if region is not None:
+            args = [*args, f"--pin-region={region}"]
+        
         cmd = [
             "sudo", "-n",
+            *self.launch_prefix,
             str(self.pin_path),
             "-t", str(self.pintool_path),
             "--",
@@ -211,17 +858,20 @@ class Benchmarker:
         
         if params["build"]:
             clean = params.get("clean_build", False)
-            target = self.build(benchmark, clean=clean)
+            target = self.build(benchmark, clean=clean, allocator=params["allocator"])
         else:
-            target = self.build_dir / benchmark
+            target = self._binary_dir(params["allocator"]) / benchmark
         
         args = self._prepare_arguments(params)
         
-        latency = self.measure_latency(target, args, params["timing_runs"])
+        latency = self.measure_latency(target, args)
         dram = self.measure_dram(target, args)
+        # One extra launch each (context and keys rebuilt): opt-in
+        memory = self.measure_memory(target, args) if params["measure_memory"] else None
+        perf = self.measure_perf(target, args) if params["measure_perf"] else None
         opcounts = self.measure_opcounts(target, args)
         
-        success = latency[0] is not None
+        success = latency is not None
         
         ai = None
         if dram and opcounts:
@@ -230,16 +880,57 @@ class Benchmarker:
             if total_bytes > 0:
                 ai = total_ops / total_bytes
         
+        phases = self.measure_phases(target, args, dram, params["phase_opcounts"])
+        encode = self.measure_encode(target, args) if params["measure_encode"] else None
+        
         return {
             "benchmark": benchmark,
             "parameters": params,
             "success": success,
             "latency": latency,
             "dram": dram,
+            "memory": memory,
+            "perf": perf,
             "opcounts": opcounts,
-            "ai": ai
+            "ai": ai,
+            "phases": phases,
+            "encode": encode
         }
     
+    def measure_phases(self, target, args, dram, with_opcounts=False):
+        """
+        Combine per-region DRAM records with optional per-region op counts.
+        
+        Args:
+            target: Path to the executable
+            args: Command line arguments
+            dram: Result of measure_dram (its "regions" entry is used)
+            with_opcounts: If True, run PIN once per region to get its ops
+            
+        Returns:
+            Dictionary mapping region name to its record (calls, ns,
+            read_bytes, write_bytes, and opcounts/ai when measured),
+            or None if the benchmark reported no regions
+        """
+        if not dram or "regions" not in dram:
+            return None
+        
+        phases = {}
+        for name, record in dram["regions"].items():
+            phase = dict(record)
+            phase["ai"] = None
+            
+            if with_opcounts:
+                opcounts = self.measure_opcounts(target, args, region=name)
+                phase["opcounts"] = opcounts
+                total_bytes = record.get("read_bytes", 0) + record.get("write_bytes", 0)
+                if opcounts and total_bytes > 0:
+                    phase["ai"] = opcounts.get("total", 0) / total_bytes
+            
+            phases[name] = phase
+        
+        return phases
+    
     def _prepare_arguments(self, params):
         """
         Convert parameter dictionary to command line arguments.
@@ -250,7 +941,8 @@ class Benchmarker:
         Returns:
             List of command line argument strings
         """
-        skip_keys = {"timing_runs", "build", "num_limbs", "clean_build"}
+        skip_keys = {"build", "num_limbs", "clean_build", "phase_opcounts", "measure_encode",
+                     "measure_memory", "measure_perf", "allocator"}
         
         args = []
         
@@ -266,4 +958,149 @@ class Benchmarker:
                 else:
                     args.append(f"--{arg_name}={value}")
         
-        return args
\ No newline at end of file
+        return args
+    
+    @staticmethod
+    def _parse_counters(output, prefix):
+        """
+        Parse machine-readable KEY=value lines printed by a benchmark.
+        
+        Args:
+            output: Captured stdout of the benchmark
+            prefix: Only keys starting with this prefix are collected
+            
+        Returns:
+            Dictionary of integer (or float, e.g. rates) values, or None if
+            no line matched
+        """
+        data = {}
+        for line in output.split('\n'):
+            if prefix in line and '=' in line:
+                key, value = line.split('=', 1)
+                try:
+                    data[key] = int(value)
+                except ValueError:
+                    data[key] = float(value)
+        
+        return data if data else None
+    
+    @staticmethod
+    def _parse_samples(output):
+        """
+        Parse the raw latency samples line: SAMPLES ns=<t0>,<t1>,...
+        
+        Args:
+            output: Captured stdout of the benchmark
+            
+        Returns:
+            List of integer nanoseconds (empty if the line is missing)
+        """
+        for line in output.split('\n'):
+            if line.startswith("SAMPLES ns="):
+                return [int(value) for value in line[len("SAMPLES ns="):].split(',') if value]
+        return []
+    
+    @staticmethod
+    def _parse_candidates(output):
+        """
+        Parse the N1_CANDIDATE records printed by a BSGS benchmark with --n1=auto.
+        
+        Each record is one line: N1_CANDIDATE n1=<n1> key=value ...
+        
+        Args:
+            output: Captured stdout of the benchmark
+            
+        Returns:
+            List of dictionaries of integer fields, best prediction first
+        """
+        candidates = []
+        for line in output.split('\n'):
+            fields = line.split()
+            if not fields or fields[0] != "N1_CANDIDATE":
+                continue
+            candidates.append({key: int(value) for key, value in
+                               (field.split('=', 1) for field in fields[1:] if '=' in field)})
+        
+        return candidates
+    
+    @staticmethod
+    def _parse_threads(output):
+        """
+        Parse per-thread counter records printed with --measure=perf.
+        
+        Each record is one line: THREAD tid=<tid> <event>=<count> ...
+        
+        Args:
+            output: Captured stdout of the benchmark
+            
+        Returns:
+            Dictionary mapping thread id to a dictionary of event counts
+        """
+        threads = {}
+        for line in output.split('\n'):
+            fields = line.split()
+            if not fields or fields[0] != "THREAD":
+                continue
+            
+            record = dict(field.split('=', 1) for field in fields[1:] if '=' in field)
+            tid = record.pop("tid", None)
+            if tid is not None:
+                threads[int(tid)] = {key: int(value) for key, value in record.items()}
+        
+        return threads
+    
+    @staticmethod
+    def _parse_serial(output):
+        """
+        Parse the SERIAL records printed by the serialization benchmark.
+        
+        Each record is one line: SERIAL object=<name> format=<name> medium=<name> key=value ...
+        
+        Args:
+            output: Captured stdout of the benchmark
+            
+        Returns:
+            List of dictionaries; object, format and medium stay strings, other
+            fields are integers (or floats for the MB/s rates)
+        """
+        cases = []
+        for line in output.split('\n'):
+            fields = line.split()
+            if not fields or fields[0] != "SERIAL":
+                continue
+            
+            case = {}
+            for key, value in (field.split('=', 1) for field in fields[1:] if '=' in field):
+                if key in ("object", "format", "medium"):
+                    case[key] = value
+                else:
+                    case[key] = float(value) if '.' in value else int(value)
+            cases.append(case)
+        
+        return cases
+    
+    @staticmethod
+    def _parse_regions(output):
+        """
+        Parse per-region records printed by a benchmark.
+        
+        Each record is one line: REGION name=<name> key=value ...
+        
+        Args:
+            output: Captured stdout of the benchmark
+            
+        Returns:
+            Dictionary mapping region name to a dictionary of integer fields
+        """
+        regions = {}
+        for line in output.split('\n'):
+            fields = line.split()
+            if not fields or fields[0] != "REGION":
+                continue
+            
+            record = dict(field.split('=', 1) for field in fields[1:] if '=' in field)
+            name = record.pop("name", None)
+            if name is not None:
+                regions[name] = {key: int(value) for key, value in record.items()}
+        
+        return regions
\ No newline at end of file
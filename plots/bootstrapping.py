@@ -0,0 +1,98 @@
+#!/usr/bin/env python3
+"""
+CKKS bootstrapping across slot counts and level budgets.
+Runs the bootstrapping benchmark at every grid point: setup and keygen time
+(regeneration) against warm-start load time of the persisted state, and
+per-bootstrap latency, DRAM traffic and arithmetic intensity. Writes
+bootstrapping.csv.
+"""
+
+from benchmarker import Benchmarker
+import csv
+import sys
+from datetime import datetime
+
+# Configuration
+RING_DIM = 4096
+SLOTS = [8, 64, 512, 2048]
+LEVEL_BUDGETS = [(1, 1), (2, 2), (3, 3), (4, 4)]
+
+CSV_PATH = "bootstrapping.csv"
+
+COLUMNS = [
+    "ring_dim", "slots", "level_budget", "depth", "levels_after", "rotation_keys",
+    "setup_ns", "keygen_ns", "save_ns", "load_ns", "context_bytes", "rotation_key_bytes",
+    "latency_median_ns", "dram_bytes", "ai", "precision_bits",
+]
+
+
+def main():
+    print("=" * 60)
+    print("CKKS BOOTSTRAPPING")
+    print(f"Started: {datetime.now().strftime('%Y-%m-%d %H:%M:%S')}")
+    print("=" * 60)
+    
+    # Create benchmarker with debug off for cleaner output
+    b = Benchmarker(debug=False)
+    
+    # Configure parameters (num_limbs - 1 levels are left after bootstrapping)
+    b.base_config["ring_dim"]    = RING_DIM
+    b.base_config["num_limbs"]   = 2
+    b.base_config["num_digits"]  = 3
+    b.base_config["repetitions"] = 3
+    
+    print(f"\n{'Slots':<7} {'Budget':<8} {'Depth':<6} {'Rot keys':<9} {'Setup (s)':<10} "
+          f"{'Keygen (s)':<11} {'Load (s)':<9} {'Boot (ms)':<10} {'AI':<9} {'Bits':<6}")
+    print("-" * 92)
+    
+    rows = []
+    for slots in SLOTS:
+        for budget in LEVEL_BUDGETS:
+            budget_str = f"{budget[0]},{budget[1]}"
+            result = b.run("bootstrapping", slots=slots, level_budget=budget_str)
+            if not result["success"]:
+                print(f"{slots:<7} {budget_str:<8} FAILED")
+                continue
+            
+            latency = result["latency"]
+            row = {
+                "ring_dim": RING_DIM,
+                "slots": slots,
+                "level_budget": budget_str,
+                "depth": latency["BOOT_DEPTH"],
+                "levels_after": latency["BOOT_LEVELS_AFTER"],
+                "rotation_keys": latency["BOOT_ROTATION_KEYS"],
+                "setup_ns": latency["BOOT_SETUP_NS"],
+                "keygen_ns": latency["BOOT_KEYGEN_NS"],
+                "save_ns": latency["BOOT_SAVE_NS"],
+                "load_ns": latency["BOOT_LOAD_NS"],
+                "context_bytes": latency["BOOT_CONTEXT_BYTES"],
+                "rotation_key_bytes": latency["BOOT_ROTATION_KEY_BYTES"],
+                "latency_median_ns": latency["LATENCY_MEDIAN_NS"],
+                "dram_bytes": (result["dram"] or {}).get("DRAM_TOTAL_BYTES"),
+                "ai": result["ai"],
+                "precision_bits": latency["BOOT_PRECISION_BITS"],
+            }
+            ai_str = f"{row['ai']:.5f}" if row["ai"] is not None else "-"
+            print(f"{slots:<7} {budget_str:<8} {row['depth']:<6} {row['rotation_keys']:<9} "
+                  f"{row['setup_ns'] / 1e9:<10.2f} {row['keygen_ns'] / 1e9:<11.2f} "
+                  f"{row['load_ns'] / 1e9:<9.2f} {row['latency_median_ns'] / 1e6:<10.1f} "
+                  f"{ai_str:<9} {row['precision_bits']:<6.1f}")
+            rows.append(row)
+    
+    print("-" * 92)
+    
+    if not rows:
+        print("\n⚠ No bootstrapping point completed")
+        sys.exit(1)
+    
+    with open(CSV_PATH, "w", newline="") as f:
+        writer = csv.DictWriter(f, fieldnames=COLUMNS)
+        writer.writeheader()
+        writer.writerows(rows)
+    print(f"\nWrote {len(rows)} points to {CSV_PATH}")
+    
+    return 0
+
+if __name__ == "__main__":
+    sys.exit(main())
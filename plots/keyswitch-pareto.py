@@ -0,0 +1,162 @@
+#!/usr/bin/env python3
+"""
+Key-switching technique comparison: HYBRID over its digit count (dnum)
+against BV, on the rotation and BSGS benchmarks.
+Records latency and evaluation key sizes per point, marks the points on the
+latency / key-size Pareto frontier and writes keyswitch.csv (and
+keyswitch.png when matplotlib is available).
+"""
+
+from benchmarker import Benchmarker
+import csv
+import sys
+from datetime import datetime
+
+# Configuration
+BENCHMARKS = [
+    "rotation",
+    "bsgs-diagonal-method",
+    "single-hoisted-bsgs-diagonal-method",
+]
+
+NUM_LIMBS = [4, 8]
+
+CSV_PATH = "keyswitch.csv"
+PLOT_PATH = "keyswitch.png"
+
+COLUMNS = [
+    "benchmark", "num_limbs", "ks_tech", "num_digits", "latency_median_ns",
+    "rotation_key_bytes", "rotation_key_serialized_bytes", "rotation_keys",
+    "rotation_keys_total_bytes", "relin_key_bytes", "relin_key_serialized_bytes", "pareto",
+]
+
+
+def mark_pareto(points):
+    """Flag the points no other point beats on both latency and key memory."""
+    for p in points:
+        p["pareto"] = not any(
+            q is not p
+            and q["latency_median_ns"] <= p["latency_median_ns"]
+            and q["rotation_keys_total_bytes"] <= p["rotation_keys_total_bytes"]
+            and (q["latency_median_ns"], q["rotation_keys_total_bytes"])
+                != (p["latency_median_ns"], p["rotation_keys_total_bytes"])
+            for q in points
+        )
+
+
+def plot_pareto(points, path):
+    """Latency against rotation key memory, one panel per benchmark; skipped without matplotlib."""
+    try:
+        import matplotlib
+        matplotlib.use("Agg")
+        import matplotlib.pyplot as plt
+    except ImportError:
+        print("matplotlib not available, skipping plot")
+        return False
+    
+    benchmarks = list(dict.fromkeys(p["benchmark"] for p in points))
+    fig, axes = plt.subplots(1, len(benchmarks), figsize=(6 * len(benchmarks), 5), squeeze=False)
+    
+    for ax, benchmark in zip(axes[0], benchmarks):
+        for num_limbs in dict.fromkeys(p["num_limbs"] for p in points):
+            selected = [p for p in points if p["benchmark"] == benchmark and p["num_limbs"] == num_limbs]
+            if not selected:
+                continue
+            
+            scatter = ax.scatter([p["rotation_keys_total_bytes"] / 1e6 for p in selected],
+                                 [p["latency_median_ns"] / 1e6 for p in selected],
+                                 label=f"{num_limbs} limbs")
+            for p in selected:
+                label = "BV" if p["ks_tech"] == "bv" else f"dnum={p['num_digits']}"
+                ax.annotate(label, (p["rotation_keys_total_bytes"] / 1e6, p["latency_median_ns"] / 1e6),
+                            fontsize="x-small", textcoords="offset points", xytext=(4, 4))
+            
+            frontier = sorted((p for p in selected if p["pareto"]), key=lambda p: p["rotation_keys_total_bytes"])
+            ax.plot([p["rotation_keys_total_bytes"] / 1e6 for p in frontier],
+                    [p["latency_median_ns"] / 1e6 for p in frontier],
+                    "--", color=scatter.get_facecolor()[0])
+        
+        ax.set_xlabel("Rotation key memory (MB)")
+        ax.set_ylabel("Median latency (ms)")
+        ax.set_title(benchmark)
+        ax.legend(fontsize="small")
+    
+    fig.tight_layout()
+    fig.savefig(path)
+    return True
+
+
+def main():
+    print("=" * 60)
+    print("KEY-SWITCHING TECHNIQUE COMPARISON")
+    print(f"Started: {datetime.now().strftime('%Y-%m-%d %H:%M:%S')}")
+    print("=" * 60)
+    
+    # Create benchmarker with debug off for cleaner output
+    b = Benchmarker(debug=False)
+    
+    # Configure parameters
+    b.base_config["ring_dim"]   = 8192
+    b.base_config["matrix_dim"] = 64
+    
+    print(f"\n{'Benchmark':<40} {'Limbs':<6} {'Tech':<7} {'Digits':<7} "
+          f"{'Latency (ms)':<13} {'Rot key MB':<11} {'Relin key MB':<12}")
+    print("-" * 100)
+    
+    points = []
+    for benchmark in BENCHMARKS:
+        for num_limbs in NUM_LIMBS:
+            comparison = b.compare_key_switching(benchmark, num_limbs=num_limbs)
+            for (ks_tech, num_digits), result in comparison.items():
+                if result is None:
+                    print(f"{benchmark:<40} {num_limbs:<6} {ks_tech:<7} {str(num_digits):<7} FAILED")
+                    continue
+                
+                point = {
+                    "benchmark": benchmark,
+                    "num_limbs": num_limbs,
+                    "ks_tech": ks_tech,
+                    "num_digits": num_digits,
+                    "latency_median_ns": result["latency_median_ns"],
+                    "rotation_key_bytes": result["KEY_SIZE_ROTATION_MEMORY_BYTES"],
+                    "rotation_key_serialized_bytes": result["KEY_SIZE_ROTATION_SERIALIZED_BYTES"],
+                    "rotation_keys": result["KEY_SIZE_ROTATION_KEYS"],
+                    "rotation_keys_total_bytes": result["KEY_SIZE_ROTATION_TOTAL_MEMORY_BYTES"],
+                    "relin_key_bytes": result["KEY_SIZE_RELIN_MEMORY_BYTES"],
+                    "relin_key_serialized_bytes": result["KEY_SIZE_RELIN_SERIALIZED_BYTES"],
+                }
+                print(f"{benchmark:<40} {num_limbs:<6} {ks_tech:<7} {str(num_digits):<7} "
+                      f"{point['latency_median_ns'] / 1e6:<13.3f} {point['rotation_key_bytes'] / 1e6:<11.2f} "
+                      f"{point['relin_key_bytes'] / 1e6:<12.2f}")
+                points.append(point)
+    
+    print("-" * 100)
+    
+    if not points:
+        print("\n⚠ No key-switching point completed")
+        sys.exit(1)
+    
+    # Pareto frontier per benchmark and limb count
+    for benchmark in BENCHMARKS:
+        for num_limbs in NUM_LIMBS:
+            mark_pareto([p for p in points if p["benchmark"] == benchmark and p["num_limbs"] == num_limbs])
+    
+    print("\nPareto-optimal points (latency vs rotation key memory):")
+    for p in points:
+        if p["pareto"]:
+            label = "bv" if p["ks_tech"] == "bv" else f"hybrid dnum={p['num_digits']}"
+            print(f"  {p['benchmark']:<40} {p['num_limbs']} limbs: {label}")
+    
+    with open(CSV_PATH, "w", newline="") as f:
+        writer = csv.DictWriter(f, fieldnames=COLUMNS)
+        writer.writeheader()
+        writer.writerows(points)
+    print(f"\nWrote {len(points)} points to {CSV_PATH}")
+    
+    if plot_pareto(points, PLOT_PATH):
+        print(f"Wrote {PLOT_PATH}")
+    
+    return 0
+
+if __name__ == "__main__":
+    sys.exit(main())
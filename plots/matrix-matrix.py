@@ -0,0 +1,87 @@
+#!/usr/bin/env python3
+"""
+Encrypted matrix-matrix multiplication: layouts and weight encryption.
+Runs the matrix-matrix benchmark for every (layout, weights, columns) point
+and reports latency, rotations and key loads per output column. Writes
+matrix-matrix.csv.
+"""
+
+from benchmarker import Benchmarker
+import csv
+import sys
+from datetime import datetime
+
+# Configuration
+LAYOUTS = ["replicated", "row-packed"]
+WEIGHTS = ["plaintext", "ciphertext"]
+COLUMNS_SWEEP = [1, 4, 16, 64]
+
+CSV_PATH = "matrix-matrix.csv"
+
+COLUMNS = [
+    "layout", "weights", "columns", "ciphertexts", "latency_median_ns", "ns_per_column",
+    "rotations_per_column", "key_loads_per_column",
+]
+
+
+def main():
+    print("=" * 60)
+    print("MATRIX-MATRIX MULTIPLICATION")
+    print(f"Started: {datetime.now().strftime('%Y-%m-%d %H:%M:%S')}")
+    print("=" * 60)
+    
+    # Create benchmarker with debug off for cleaner output
+    b = Benchmarker(debug=False)
+    
+    # Configure parameters
+    b.base_config["ring_dim"]   = 8192
+    b.base_config["matrix_dim"] = 64
+    b.base_config["num_limbs"]  = 3
+    
+    print(f"\n{'Layout':<12} {'Weights':<11} {'Columns':<8} {'Ctxts':<6} "
+          f"{'ms/column':<10} {'Rot/column':<11} {'Keys/column':<11}")
+    print("-" * 75)
+    
+    target = b.build("matrix-matrix")
+    
+    rows = []
+    for layout in LAYOUTS:
+        for weights in WEIGHTS:
+            for columns in COLUMNS_SWEEP:
+                params = {**b.base_config, "layout": layout, "weights": weights, "columns": columns}
+                latency = b.measure_latency(target, b._prepare_arguments(params))
+                if latency is None:
+                    print(f"{layout:<12} {weights:<11} {columns:<8} FAILED")
+                    continue
+                
+                row = {
+                    "layout": layout,
+                    "weights": weights,
+                    "columns": columns,
+                    "ciphertexts": latency["MATMUL_CIPHERTEXTS"],
+                    "latency_median_ns": latency["LATENCY_MEDIAN_NS"],
+                    "ns_per_column": latency["MATMUL_NS_PER_COLUMN"],
+                    "rotations_per_column": latency["MATMUL_ROTATIONS_PER_COLUMN"],
+                    "key_loads_per_column": latency["MATMUL_KEY_LOADS_PER_COLUMN"],
+                }
+                print(f"{layout:<12} {weights:<11} {columns:<8} {row['ciphertexts']:<6} "
+                      f"{row['ns_per_column'] / 1e6:<10.3f} {row['rotations_per_column']:<11.2f} "
+                      f"{row['key_loads_per_column']:<11.2f}")
+                rows.append(row)
+    
+    print("-" * 75)
+    
+    if not rows:
+        print("\n⚠ No matrix-matrix point completed")
+        sys.exit(1)
+    
+    with open(CSV_PATH, "w", newline="") as f:
+        writer = csv.DictWriter(f, fieldnames=COLUMNS)
+        writer.writeheader()
+        writer.writerows(rows)
+    print(f"\nWrote {len(rows)} points to {CSV_PATH}")
+    
+    return 0
+
+if __name__ == "__main__":
+    sys.exit(main())
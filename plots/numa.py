@@ -0,0 +1,118 @@
+#!/usr/bin/env python3
+"""
+NUMA placement on multi-socket nodes.
+Runs the BSGS benchmark at a large ring dimension under each thread pinning
+and memory binding configuration and reports the latency spread across
+repetitions and the DRAM traffic served by each socket. With compact pinning
+the traffic of a socket that ran no threads crossed the interconnect.
+Writes numa.csv.
+"""
+
+from benchmarker import Benchmarker
+import csv
+import os
+import sys
+from datetime import datetime
+
+# Configuration
+BENCHMARK = "bsgs-diagonal-method"
+THREADS = os.cpu_count() or 1
+
+CONFIGS = [
+    ("first-touch", {}),
+    ("compact", {"numa_pin": "compact"}),
+    ("compact+local", {"numa_pin": "compact", "numa_membind": "local"}),
+    ("scatter", {"numa_pin": "scatter"}),
+    ("scatter+interleave", {"numa_pin": "scatter", "numa_membind": "interleave"}),
+    ("scatter+local+keys-il", {"numa_pin": "scatter", "numa_membind": "local",
+                               "numa_key_membind": "interleave", "numa_ptxt_membind": "interleave"}),
+    ("scatter+local+replicas", {"numa_pin": "scatter", "numa_membind": "local",
+                                "numa_key_replicas": True}),
+]
+
+CSV_PATH = "numa.csv"
+
+COLUMNS = [
+    "config", "threads", "latency_min_ns", "latency_median_ns", "latency_p99_ns", "spread",
+    "dram_total_bytes", "socket0_bytes", "socket1_bytes", "remote_bytes",
+]
+
+
+def remote_bytes(dram):
+    """DRAM bytes served by sockets no pinned thread ran on (None without pinning)."""
+    sockets = sorted({int(key[len("DRAM_SOCKET"):].split("_")[0])
+                      for key in dram if key.startswith("DRAM_SOCKET")})
+    if not sockets or not any(f"NUMA_NODE{s}_THREADS" in dram for s in sockets):
+        return None
+    return sum(dram[f"DRAM_SOCKET{s}_TOTAL_BYTES"] for s in sockets
+               if dram.get(f"NUMA_NODE{s}_THREADS", 0) == 0)
+
+
+def main():
+    print("=" * 60)
+    print("NUMA PLACEMENT")
+    print(f"Started: {datetime.now().strftime('%Y-%m-%d %H:%M:%S')}")
+    print("=" * 60)
+    
+    # Create benchmarker with debug off for cleaner output
+    b = Benchmarker(debug=False)
+    
+    # Configure parameters (keys stay cached so replicas are reused)
+    b.base_config["ring_dim"]     = 65536
+    b.base_config["num_limbs"]    = 12
+    b.base_config["num_digits"]   = 3
+    b.base_config["matrix_dim"]   = 256
+    b.base_config["threads"]      = THREADS
+    b.base_config["repetitions"]  = 10
+    b.base_config["key_cache_mb"] = "all"
+    
+    print(f"\n{'Config':<24} {'Median (ms)':<12} {'Spread':<8} {'DRAM (GB)':<10} "
+          f"{'Socket0 GB':<11} {'Socket1 GB':<11} {'Remote GB':<10}")
+    print("-" * 90)
+    
+    target = b.build(BENCHMARK)
+    
+    rows = []
+    for name, overrides in CONFIGS:
+        args = b._prepare_arguments({**b.base_config, **overrides})
+        latency = b.measure_latency(target, args)
+        if latency is None:
+            print(f"{name:<24} FAILED")
+            continue
+        dram = b.measure_dram(target, args) or {}
+        
+        remote = remote_bytes(dram)
+        row = {
+            "config": name,
+            "threads": THREADS,
+            "latency_min_ns": latency["LATENCY_MIN_NS"],
+            "latency_median_ns": latency["LATENCY_MEDIAN_NS"],
+            "latency_p99_ns": latency["LATENCY_P99_NS"],
+            "spread": (latency["LATENCY_P99_NS"] - latency["LATENCY_MIN_NS"]) / latency["LATENCY_MEDIAN_NS"],
+            "dram_total_bytes": dram.get("DRAM_TOTAL_BYTES"),
+            "socket0_bytes": dram.get("DRAM_SOCKET0_TOTAL_BYTES"),
+            "socket1_bytes": dram.get("DRAM_SOCKET1_TOTAL_BYTES"),
+            "remote_bytes": remote,
+        }
+        gb = lambda value: f"{value / 1e9:.2f}" if value is not None else "-"
+        print(f"{name:<24} {row['latency_median_ns'] / 1e6:<12.1f} {row['spread']:<8.3f} "
+              f"{gb(row['dram_total_bytes']):<10} {gb(row['socket0_bytes']):<11} "
+              f"{gb(row['socket1_bytes']):<11} {gb(remote):<10}")
+        rows.append(row)
+    
+    print("-" * 90)
+    
+    if not rows:
+        print("\n⚠ No NUMA configuration completed")
+        sys.exit(1)
+    
+    with open(CSV_PATH, "w", newline="") as f:
+        writer = csv.DictWriter(f, fieldnames=COLUMNS)
+        writer.writeheader()
+        writer.writerows(rows)
+    print(f"\nWrote {len(rows)} points to {CSV_PATH}")
+    
+    return 0
+
+if __name__ == "__main__":
+    sys.exit(main())
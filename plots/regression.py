@@ -0,0 +1,524 @@
+#!/usr/bin/env python3
+"""
+Performance regression tracking against stored baselines.
+`record` measures a benchmark (every timed latency run of several
+invocations, DRAM bytes of several --measure=dram runs and, optionally, PIN
+op counts) and appends it to a JSON-lines store, keyed by benchmark,
+parameters, repo commit, OpenFHE version and host fingerprint, together with
+the measurement conditions (CPU governors, turbo, frequencies, isolation,
+load). `compare` tests a candidate record against a baseline with the same
+benchmark, parameters and host: a Mann-Whitney U test and a bootstrap
+confidence interval of the median ratio for latency and DRAM bytes, and the
+relative change of op counts (which are deterministic). It exits with status
+1 if any metric regressed significantly, so it can gate upgrades.
+
+    python3 regression.py record bsgs-diagonal-method --param ring_dim=16384 --cpus 2-9 --label openfhe-1.2
+    python3 regression.py compare bsgs-diagonal-method --param ring_dim=16384 --baseline openfhe-1.2
+    python3 regression.py list
+"""
+
+from benchmarker import Benchmarker
+import argparse
+import hashlib
+import json
+import math
+import os
+import platform
+import random
+import re
+import socket
+import statistics
+import subprocess
+import sys
+from datetime import datetime
+from pathlib import Path
+
+# Configuration
+STORE_PATH = Path(__file__).resolve().parent / "regression.jsonl"
+INVOCATIONS = 3            # processes per record; their timed runs are pooled
+DRAM_RUNS = 5              # --measure=dram processes (one sample each)
+ALPHA = 0.05               # significance level of the Mann-Whitney test
+THRESHOLD = 0.02           # smallest median change flagged (2%)
+OPCOUNT_THRESHOLD = 0.001  # op counts are deterministic: any change above 0.1%
+BOOTSTRAP_ITERATIONS = 10000
+CONFIDENCE = 0.95
+
+
+def read_text(path, default=None):
+    try:
+        return Path(path).read_text().strip()
+    except OSError:
+        return default
+
+
+def parse_cpu_list(text):
+    """'0-3,8' -> {0, 1, 2, 3, 8} (sysfs and taskset format)."""
+    cpus = set()
+    for part in (text or "").split(","):
+        part = part.strip()
+        if not part:
+            continue
+        first, _, last = part.partition("-")
+        cpus.update(range(int(first), int(last or first) + 1))
+    return cpus
+
+
+# Host, software and measurement conditions
+
+def host_fingerprint():
+    """Stable description of the machine and its short hash (part of the store key)."""
+    cpu_model = "unknown"
+    for line in (read_text("/proc/cpuinfo", "") or "").splitlines():
+        if line.startswith("model name"):
+            cpu_model = line.split(":", 1)[1].strip()
+            break
+    
+    memory_kb = None
+    for line in (read_text("/proc/meminfo", "") or "").splitlines():
+        if line.startswith("MemTotal:"):
+            memory_kb = int(line.split()[1])
+            break
+    
+    info = {
+        "hostname": socket.gethostname(),
+        "cpu_model": cpu_model,
+        "cpus": os.cpu_count(),
+        "numa_nodes": len(list(Path("/sys/devices/system/node").glob("node[0-9]*"))),
+        "memory_kb": memory_kb,
+        "kernel": platform.release(),
+    }
+    digest = hashlib.sha1(json.dumps(info, sort_keys=True).encode()).hexdigest()[:12]
+    return digest, info
+
+
+def software_versions(b, allocator):
+    """Repo commit (with -dirty for uncommitted changes) and the OpenFHE version CMake found."""
+    def git(*args):
+        result = subprocess.run(["git", "-C", str(b.repo_root), *args], capture_output=True, text=True)
+        return result.stdout.strip() if result.returncode == 0 else ""
+    
+    commit = git("rev-parse", "HEAD") or "unknown"
+    if git("status", "--porcelain", "--untracked-files=no"):
+        commit += "-dirty"
+    
+    # OpenFHE_DIR from the CMake cache, then the version its package config declares
+    openfhe = "unknown"
+    cache = read_text(b._binary_dir(allocator) / "CMakeCache.txt", "")
+    match = re.search(r"^OpenFHE_DIR:\w+=(.*)$", cache, re.MULTILINE)
+    if match:
+        for name in ("OpenFHEConfigVersion.cmake", "OpenFHEConfig.cmake"):
+            config = read_text(Path(match.group(1)) / name, "")
+            version = re.search(r'(?:PACKAGE_VERSION|BASE_OPENFHE_VERSION)\s+"?([0-9][0-9.]*)', config)
+            if version:
+                openfhe = version.group(1)
+                break
+    
+    return {"git": commit, "openfhe": openfhe}
+
+
+def measurement_conditions(cpus=None):
+    """CPU frequency scaling, turbo, SMT, isolation and load of the measured CPUs."""
+    cpu_dirs = [d for d in Path("/sys/devices/system/cpu").glob("cpu[0-9]*")
+                if cpus is None or int(d.name[3:]) in cpus]
+    
+    governors = set()
+    frequencies = []
+    for d in cpu_dirs:
+        governor = read_text(d / "cpufreq" / "scaling_governor")
+        if governor:
+            governors.add(governor)
+        frequency = read_text(d / "cpufreq" / "scaling_cur_freq")
+        if frequency:
+            frequencies.append(int(frequency))
+    
+    # intel_pstate's no_turbo, or the generic cpufreq boost switch
+    no_turbo = read_text("/sys/devices/system/cpu/intel_pstate/no_turbo")
+    boost = read_text("/sys/devices/system/cpu/cpufreq/boost")
+    turbo = (no_turbo == "0") if no_turbo is not None else (boost == "1") if boost is not None else None
+    
+    return {
+        "governors": sorted(governors),
+        "turbo": turbo,
+        "min_freq_khz": min(frequencies) if frequencies else None,
+        "max_freq_khz": max(frequencies) if frequencies else None,
+        "smt": read_text("/sys/devices/system/cpu/smt/active"),
+        "isolated_cpus": read_text("/sys/devices/system/cpu/isolated", ""),
+        "load_avg": os.getloadavg()[0],
+    }
+
+
+def condition_warnings(conditions, cpus):
+    """Reasons the measurement may not be reproducible enough to gate on."""
+    warnings = []
+    if conditions["governors"] and conditions["governors"] != ["performance"]:
+        warnings.append(f"CPU governor is {'/'.join(conditions['governors'])}, not performance")
+    if conditions["turbo"]:
+        warnings.append("turbo boost is on (clock depends on temperature and active cores)")
+    if conditions["min_freq_khz"] and conditions["max_freq_khz"] > 1.1 * conditions["min_freq_khz"]:
+        warnings.append(f"CPU clocks range from {conditions['min_freq_khz'] / 1e3:.0f} to "
+                        f"{conditions['max_freq_khz'] / 1e3:.0f} MHz across the measured CPUs")
+    if cpus is None:
+        warnings.append("no --cpus given: the benchmark shares CPUs with the rest of the system")
+    elif not cpus <= parse_cpu_list(conditions["isolated_cpus"]):
+        warnings.append("the --cpus are not isolated (isolcpus=)")
+    if conditions["load_avg"] > 0.1 * (len(cpus) if cpus else os.cpu_count() or 1):
+        warnings.append(f"system load average is {conditions['load_avg']:.2f}")
+    return warnings
+
+
+# Results store
+
+def load_records(path):
+    if not Path(path).exists():
+        return []
+    with open(path) as f:
+        return [json.loads(line) for line in f if line.strip()]
+
+
+def append_record(path, record):
+    with open(path, "a") as f:
+        f.write(json.dumps(record, sort_keys=True) + "\n")
+
+
+def params_key(args):
+    """Hash of the benchmark's command line (argument order does not matter)."""
+    return hashlib.sha1(" ".join(sorted(args)).encode()).hexdigest()[:12]
+
+
+def parse_params(items):
+    """--param key=value pairs, with numbers and true/false converted."""
+    params = {}
+    for item in items or []:
+        key, _, value = item.partition("=")
+        if value in ("true", "false"):
+            params[key] = value == "true"
+        elif re.fullmatch(r"-?[0-9]+", value):
+            params[key] = int(value)
+        else:
+            params[key] = value
+    return params
+
+
+# Statistics
+
+def _exact_u_counts(n1, n2):
+    """Number of orderings giving each U (no ties), counts[n1][n2][u]."""
+    counts = [[None] * (n2 + 1) for _ in range(n1 + 1)]
+    for i in range(n1 + 1):
+        for j in range(n2 + 1):
+            if i == 0 or j == 0:
+                counts[i][j] = [1]
+                continue
+            # The largest value comes from the first sample (adds j to U) or the second
+            size = i * j + 1
+            row = [0] * size
+            for u, c in enumerate(counts[i - 1][j]):
+                row[u + j] += c
+            for u, c in enumerate(counts[i][j - 1]):
+                row[u] += c
+            counts[i][j] = row
+    return counts[n1][n2]
+
+
+def mann_whitney_u(a, b):
+    """
+    Two-sided Mann-Whitney U test of samples a and b.
+    
+    Exact for small samples without ties, otherwise the normal approximation
+    with tie and continuity correction.
+    
+    Returns:
+        p-value
+    """
+    n1, n2 = len(a), len(b)
+    combined = sorted([(value, 0) for value in a] + [(value, 1) for value in b])
+    
+    # Midranks for ties
+    rank_sum = 0.0
+    tie_term = 0
+    i = 0
+    while i < len(combined):
+        j = i
+        while j + 1 < len(combined) and combined[j + 1][0] == combined[i][0]:
+            j += 1
+        rank = (i + j) / 2 + 1
+        rank_sum += rank * sum(1 for k in range(i, j + 1) if combined[k][1] == 0)
+        tie_term += (j - i + 1) ** 3 - (j - i + 1)
+        i = j + 1
+    u = rank_sum - n1 * (n1 + 1) / 2
+    
+    if tie_term == 0 and n1 * n2 <= 400:
+        counts = _exact_u_counts(n1, n2)
+        total = sum(counts)
+        u = int(round(u))
+        lower = sum(counts[:u + 1]) / total
+        upper = sum(counts[u:]) / total
+        return min(1.0, 2 * min(lower, upper))
+    
+    n = n1 + n2
+    variance = n1 * n2 / 12 * ((n + 1) - tie_term / (n * (n - 1)))
+    if variance <= 0:
+        return 1.0
+    z = max(0.0, abs(u - n1 * n2 / 2) - 0.5) / math.sqrt(variance)
+    return min(1.0, math.erfc(z / math.sqrt(2)))
+
+
+def bootstrap_ratio_ci(baseline, candidate, iterations=BOOTSTRAP_ITERATIONS, confidence=CONFIDENCE):
+    """Percentile bootstrap interval of median(candidate) / median(baseline)."""
+    rng = random.Random(0)  # fixed seed: the same records always give the same interval
+    ratios = []
+    for _ in range(iterations):
+        base = statistics.median(rng.choices(baseline, k=len(baseline)))
+        cand = statistics.median(rng.choices(candidate, k=len(candidate)))
+        if base > 0:
+            ratios.append(cand / base)
+    if not ratios:
+        return None, None
+    ratios.sort()
+    low = ratios[int((1 - confidence) / 2 * len(ratios))]
+    high = ratios[min(len(ratios) - 1, int((1 + confidence) / 2 * len(ratios)))]
+    return low, high
+
+
+def compare_samples(metric, baseline, candidate, alpha=ALPHA, threshold=THRESHOLD):
+    """
+    Compare two samples of a lower-is-better metric.
+    
+    A regression needs all three: a median increase above threshold, a
+    Mann-Whitney p-value below alpha and a bootstrap interval above 1.
+    
+    Returns:
+        Dictionary with medians, ratio, interval, p-value and verdict
+        (regression, improvement, ok or insufficient)
+    """
+    result = {"metric": metric, "baseline": None, "candidate": None, "ratio": None,
+              "ci": (None, None), "p": None, "verdict": "insufficient"}
+    if len(baseline) < 2 or len(candidate) < 2:
+        return result
+    
+    base_median = statistics.median(baseline)
+    cand_median = statistics.median(candidate)
+    result.update(baseline=base_median, candidate=cand_median)
+    if base_median <= 0:
+        return result
+    
+    ratio = cand_median / base_median
+    low, high = bootstrap_ratio_ci(baseline, candidate)
+    p = mann_whitney_u(baseline, candidate)
+    
+    verdict = "ok"
+    if p < alpha and low is not None:
+        if ratio > 1 + threshold and low > 1:
+            verdict = "regression"
+        elif ratio < 1 - threshold and high < 1:
+            verdict = "improvement"
+    result.update(ratio=ratio, ci=(low, high), p=p, verdict=verdict)
+    return result
+
+
+def compare_opcounts(baseline, candidate, threshold=OPCOUNT_THRESHOLD):
+    """Relative change of every op count both records have (no test: PIN counts are exact)."""
+    results = []
+    for key in sorted(set(baseline) & set(candidate)):
+        base, cand = baseline[key], candidate[key]
+        if not isinstance(base, (int, float)) or not isinstance(cand, (int, float)) or base <= 0:
+            continue
+        ratio = cand / base
+        verdict = ("regression" if ratio > 1 + threshold
+                   else "improvement" if ratio < 1 - threshold else "ok")
+        results.append({"metric": f"ops.{key}", "baseline": base, "candidate": cand, "ratio": ratio,
+                        "ci": (None, None), "p": None, "verdict": verdict})
+    return results
+
+
+# Commands
+
+def cmd_record(args):
+    b = Benchmarker(debug=False)
+    params = {**b.base_config, **parse_params(args.param)}
+    cpus = parse_cpu_list(args.cpus) if args.cpus else None
+    if args.cpus:
+        b.launch_prefix = ["taskset", "-c", args.cpus]
+    
+    conditions = measurement_conditions(cpus)
+    warnings = condition_warnings(conditions, cpus)
+    for warning in warnings:
+        print(f"⚠ {warning}")
+    if warnings and args.strict:
+        print("Not recording under these conditions (--strict)")
+        return 2
+    
+    if params["build"]:
+        target = b.build(args.benchmark, allocator=params["allocator"])
+    else:
+        target = b._binary_dir(params["allocator"]) / args.benchmark
+    cmd_args = b._prepare_arguments(params)
+    
+    latency_samples = []
+    for i in range(args.invocations):
+        latency = b.measure_latency(target, cmd_args)
+        if latency is None:
+            print(f"{args.benchmark} FAILED (latency run {i + 1})")
+            return 1
+        latency_samples.extend(latency["samples"])
+    
+    # DRAM needs sudo; without it the record simply has no DRAM samples
+    dram_samples = []
+    for _ in range(args.dram_runs):
+        dram = b.measure_dram(target, cmd_args)
+        if dram is None or "DRAM_TOTAL_BYTES" not in dram:
+            break
+        dram_samples.append(dram["DRAM_TOTAL_BYTES"])
+    
+    opcounts = b.measure_opcounts(target, cmd_args) if args.opcounts else None
+    
+    host_id, host_info = host_fingerprint()
+    record = {
+        "timestamp": datetime.now().isoformat(timespec="seconds"),
+        "benchmark": args.benchmark,
+        "label": args.label,
+        "params": cmd_args,
+        "params_key": params_key(cmd_args),
+        **software_versions(b, params["allocator"]),
+        "host": host_id,
+        "host_info": host_info,
+        "cpus": args.cpus,
+        "conditions": conditions,
+        "conditions_after": measurement_conditions(cpus),
+        "warnings": warnings,
+        "latency_ns": latency_samples,
+        "dram_bytes": dram_samples,
+        "opcounts": opcounts,
+    }
+    append_record(args.store, record)
+    
+    print(f"Recorded {args.benchmark} ({len(latency_samples)} latency samples, "
+          f"{len(dram_samples)} DRAM samples{', op counts' if opcounts else ''}) "
+          f"git={record['git'][:12]} openfhe={record['openfhe']} host={host_id} to {args.store}")
+    return 0
+
+
+def _matches(record, selector):
+    return selector in (record.get("label"), record["openfhe"]) or record["git"].startswith(selector)
+
+
+def cmd_compare(args):
+    b = Benchmarker(debug=False)
+    params = {**b.base_config, **parse_params(args.param)}
+    key = params_key(b._prepare_arguments(params))
+    host_id, _ = host_fingerprint()
+    
+    records = [r for r in load_records(args.store)
+               if r["benchmark"] == args.benchmark and r["params_key"] == key
+               and (r["host"] == host_id or args.any_host)]
+    if args.candidate:
+        candidates = [r for r in records if _matches(r, args.candidate)]
+    else:
+        candidates = records
+    if not candidates:
+        print(f"No candidate record for {args.benchmark} with these parameters on this host")
+        return 2
+    candidate = candidates[-1]
+    
+    earlier = records[:records.index(candidate)]
+    if args.baseline:
+        baselines = [r for r in earlier if _matches(r, args.baseline)]
+    else:
+        # The latest earlier record of a different version, else the one before
+        baselines = ([r for r in earlier if (r["git"], r["openfhe"]) != (candidate["git"], candidate["openfhe"])]
+                     or earlier)
+    if not baselines:
+        print("No baseline record to compare against")
+        return 2
+    baseline = baselines[-1]
+    
+    for name, record in (("Baseline", baseline), ("Candidate", candidate)):
+        print(f"{name:<10} {record['timestamp']}  label={record.get('label') or '-'}  "
+              f"git={record['git'][:12]}  openfhe={record['openfhe']}  host={record['host']}")
+    for field in ("governors", "turbo"):
+        if baseline["conditions"].get(field) != candidate["conditions"].get(field):
+            print(f"⚠ {field} differs: {baseline['conditions'].get(field)} -> {candidate['conditions'].get(field)}")
+    
+    results = [
+        compare_samples("latency_ns", baseline["latency_ns"], candidate["latency_ns"], args.alpha, args.threshold),
+        compare_samples("dram_bytes", baseline["dram_bytes"], candidate["dram_bytes"], args.alpha, args.threshold),
+    ]
+    if baseline.get("opcounts") and candidate.get("opcounts"):
+        results.extend(compare_opcounts(baseline["opcounts"], candidate["opcounts"]))
+    
+    print(f"\n{'Metric':<20} {'Baseline':>16} {'Candidate':>16} {'Ratio':>8} "
+          f"{f'{CONFIDENCE:.0%} CI':>17} {'p':>8}  Verdict")
+    print("-" * 100)
+    for r in results:
+        if r["baseline"] is None:
+            print(f"{r['metric']:<20} {'-':>16} {'-':>16} {'-':>8} {'-':>17} {'-':>8}  {r['verdict']}")
+            continue
+        ratio = f"{r['ratio']:.4f}" if r["ratio"] is not None else "-"
+        ci = f"[{r['ci'][0]:.4f}, {r['ci'][1]:.4f}]" if r["ci"][0] is not None else "-"
+        p = f"{r['p']:.4f}" if r["p"] is not None else "-"
+        flag = "  <-- REGRESSION" if r["verdict"] == "regression" else ""
+        print(f"{r['metric']:<20} {r['baseline']:>16.0f} {r['candidate']:>16.0f} {ratio:>8} "
+              f"{ci:>17} {p:>8}  {r['verdict']}{flag}")
+    print("-" * 100)
+    
+    regressions = [r["metric"] for r in results if r["verdict"] == "regression"]
+    if regressions:
+        print(f"\n✗ Significant regression in {', '.join(regressions)}")
+        return 1
+    print("\n✓ No significant regression")
+    return 0
+
+
+def cmd_list(args):
+    records = load_records(args.store)
+    if args.benchmark:
+        records = [r for r in records if r["benchmark"] == args.benchmark]
+    
+    print(f"{'Timestamp':<20} {'Benchmark':<36} {'Label':<14} {'Git':<13} {'OpenFHE':<9} "
+          f"{'Params':<13} {'Host':<13} {'Median (ms)':>11}")
+    print("-" * 135)
+    for r in records:
+        median = statistics.median(r["latency_ns"]) / 1e6 if r["latency_ns"] else float("nan")
+        print(f"{r['timestamp']:<20} {r['benchmark']:<36} {(r.get('label') or '-'):<14} {r['git'][:12]:<13} "
+              f"{r['openfhe']:<9} {r['params_key']:<13} {r['host']:<13} {median:>11.3f}")
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Record benchmark baselines and test for regressions.")
+    parser.add_argument("--store", default=str(STORE_PATH), help="JSON-lines results store")
+    commands = parser.add_subparsers(dest="command", required=True)
+    
+    record = commands.add_parser("record", help="measure a benchmark and store the result")
+    record.add_argument("benchmark")
+    record.add_argument("--param", action="append", metavar="KEY=VALUE",
+                        help="override a Benchmarker.base_config entry (repeatable)")
+    record.add_argument("--label", help="name to select this record by (e.g. openfhe-1.2)")
+    record.add_argument("--cpus", help="run under taskset on these CPUs, ideally isolated (e.g. 2-9)")
+    record.add_argument("--invocations", type=int, default=INVOCATIONS)
+    record.add_argument("--dram-runs", type=int, default=DRAM_RUNS)
+    record.add_argument("--opcounts", action="store_true", help="also count ops with PIN")
+    record.add_argument("--strict", action="store_true",
+                        help="refuse to record when frequency, turbo, isolation or load checks fail")
+    record.set_defaults(func=cmd_record)
+    
+    compare = commands.add_parser("compare", help="test the latest record against a baseline")
+    compare.add_argument("benchmark")
+    compare.add_argument("--param", action="append", metavar="KEY=VALUE")
+    compare.add_argument("--baseline", help="label, git commit prefix or OpenFHE version "
+                                            "(default: the latest earlier record of another version)")
+    compare.add_argument("--candidate", help="same selectors (default: the latest record)")
+    compare.add_argument("--alpha", type=float, default=ALPHA)
+    compare.add_argument("--threshold", type=float, default=THRESHOLD)
+    compare.add_argument("--any-host", action="store_true", help="also match records of other hosts")
+    compare.set_defaults(func=cmd_compare)
+    
+    listing = commands.add_parser("list", help="show stored records")
+    listing.add_argument("benchmark", nargs="?")
+    listing.set_defaults(func=cmd_list)
+    
+    args = parser.parse_args()
+    return args.func(args)
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,182 @@
+#!/usr/bin/env python3
+"""
+Roofline analysis of all benchmarks and of a parameter sweep.
+Measures machine peaks, places each run on the roofline and writes
+roofline.csv (and roofline.png when matplotlib is available).
+"""
+
+from benchmarker import Benchmarker
+import csv
+import sys
+from datetime import datetime
+
+# Configuration
+BENCHMARKS = [
+    "addition",
+    "multiplication",
+    "rotation",
+    "simple-diagonal-method",
+    "single-hoisted-diagonal-method",
+    "bsgs-diagonal-method",
+    "single-hoisted-bsgs-diagonal-method",
+    "double-hoisted-bsgs-diagonal-method",
+]
+
+# Sweep points: one parameter varied at a time around the base configuration
+SWEEP_BENCHMARKS = [
+    "bsgs-diagonal-method",
+    "single-hoisted-bsgs-diagonal-method",
+    "double-hoisted-bsgs-diagonal-method",
+]
+SWEEP = {
+    "ring_dim": [128, 256, 512, 1024],
+    "num_limbs": [2, 3, 4, 6],
+    "num_digits": [1, 2, 3],
+    "matrix_dim": [8, 16, 32, 64],
+}
+
+CSV_PATH = "roofline.csv"
+PLOT_PATH = "roofline.png"
+
+COLUMNS = [
+    "benchmark", "ring_dim", "num_limbs", "num_digits", "matrix_dim",
+    "ai", "ops_per_sec", "attainable_ops_per_sec", "efficiency", "bound",
+]
+
+
+def roofline_point(benchmark, result, peaks):
+    """Place one Benchmarker.run result on the roofline (None if incomplete)."""
+    if not result["success"] or result["ai"] is None or not result["opcounts"]:
+        return None
+    
+    latency_ns = result["latency"]["LATENCY_MEDIAN_NS"]
+    if latency_ns <= 0:
+        return None
+    
+    peak_ops = peaks["MACHINE_INT_OPS_PER_SEC"]
+    peak_bw = peaks["MACHINE_BANDWIDTH_BYTES_PER_SEC"]
+    
+    ai = result["ai"]
+    ops_per_sec = result["opcounts"]["total"] / (latency_ns * 1e-9)
+    attainable = min(peak_ops, ai * peak_bw)
+    params = result["parameters"]
+    
+    return {
+        "benchmark": benchmark,
+        "ring_dim": params["ring_dim"],
+        "num_limbs": params["num_limbs"],
+        "num_digits": params["num_digits"],
+        "matrix_dim": params["matrix_dim"],
+        "ai": ai,
+        "ops_per_sec": ops_per_sec,
+        "attainable_ops_per_sec": attainable,
+        "efficiency": ops_per_sec / attainable,
+        "bound": "compute" if ai >= peak_ops / peak_bw else "bandwidth",
+    }
+
+
+def plot_roofline(points, peaks, path):
+    """Log-log roofline with one marker per point; skipped without matplotlib."""
+    try:
+        import matplotlib
+        matplotlib.use("Agg")
+        import matplotlib.pyplot as plt
+    except ImportError:
+        print("matplotlib not available, skipping plot")
+        return False
+    
+    peak_ops = peaks["MACHINE_INT_OPS_PER_SEC"]
+    peak_bw = peaks["MACHINE_BANDWIDTH_BYTES_PER_SEC"]
+    ridge = peak_ops / peak_bw
+    
+    ais = [p["ai"] for p in points]
+    lo = min(ais + [ridge]) / 10
+    hi = max(ais + [ridge]) * 10
+    
+    fig, ax = plt.subplots(figsize=(9, 6))
+    ax.plot([lo, ridge, hi], [lo * peak_bw, peak_ops, peak_ops], "k-", label="roofline")
+    
+    for benchmark in dict.fromkeys(p["benchmark"] for p in points):
+        selected = [p for p in points if p["benchmark"] == benchmark]
+        ax.scatter([p["ai"] for p in selected], [p["ops_per_sec"] for p in selected], label=benchmark)
+    
+    ax.set_xscale("log")
+    ax.set_yscale("log")
+    ax.set_xlabel("Arithmetic intensity (integer ops / DRAM byte)")
+    ax.set_ylabel("Integer ops / s")
+    ax.set_title(f"Roofline ({peaks['MACHINE_THREADS']} threads)")
+    ax.legend(fontsize="small")
+    fig.tight_layout()
+    fig.savefig(path)
+    return True
+
+
+def main():
+    print("=" * 60)
+    print("ROOFLINE ANALYSIS")
+    print(f"Started: {datetime.now().strftime('%Y-%m-%d %H:%M:%S')}")
+    print("=" * 60)
+    
+    # Create benchmarker with debug off for cleaner output
+    b = Benchmarker(debug=False)
+    
+    # Configure parameters
+    b.base_config["ring_dim"]   = 128
+    b.base_config["matrix_dim"] = 16
+    b.base_config["num_limbs"]  = 4
+    b.base_config["num_digits"] = 2
+    
+    # Machine peaks
+    peaks = b.measure_machine_peaks()
+    if peaks is None:
+        print("\n⚠ Failed to measure machine peaks")
+        sys.exit(1)
+    
+    print("\nMachine peaks:")
+    print(f"  Memory bandwidth: {peaks['MACHINE_BANDWIDTH_BYTES_PER_SEC'] / 1e9:.2f} GB/s")
+    print(f"  Integer throughput: {peaks['MACHINE_INT_OPS_PER_SEC'] / 1e9:.2f} Gops/s")
+    print(f"  Ridge point: {peaks['MACHINE_RIDGE_OPS_PER_BYTE']:.5f} ops/byte")
+    print()
+    
+    # Every benchmark at the base configuration, then the sweep points
+    runs = [(benchmark, {}) for benchmark in BENCHMARKS]
+    for benchmark in SWEEP_BENCHMARKS:
+        for key, values in SWEEP.items():
+            for value in values:
+                if value != b.base_config[key]:
+                    runs.append((benchmark, {key: value}))
+    
+    print(f"{'Benchmark':<40} {'Point':<18} {'AI':<10} {'Gops/s':<10} {'Bound':<10}")
+    print("-" * 88)
+    
+    points = []
+    for benchmark, overrides in runs:
+        point_str = ", ".join(f"{k}={v}" for k, v in overrides.items()) or "base"
+        point = roofline_point(benchmark, b.run(benchmark, **overrides), peaks)
+        if point is None:
+            print(f"{benchmark:<40} {point_str:<18} {'FAILED':<10}")
+            continue
+        
+        print(f"{benchmark:<40} {point_str:<18} {point['ai']:<10.5f} "
+              f"{point['ops_per_sec'] / 1e9:<10.3f} {point['bound']:<10}")
+        points.append(point)
+    
+    print("-" * 88)
+    
+    if not points:
+        print("\n⚠ No benchmark produced a roofline point")
+        sys.exit(1)
+    
+    with open(CSV_PATH, "w", newline="") as f:
+        writer = csv.DictWriter(f, fieldnames=COLUMNS)
+        writer.writeheader()
+        writer.writerows(points)
+    print(f"\nWrote {len(points)} points to {CSV_PATH}")
+    
+    if plot_roofline(points, peaks, PLOT_PATH):
+        print(f"Wrote {PLOT_PATH}")
+    
+    return 0
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,75 @@
+#!/usr/bin/env python3
+"""
+Serialization throughput across ring dimensions and limb counts.
+Runs the serialization benchmark (ciphertext, EvalMult key, rotation keys;
+BINARY / JSON / compressed; memory / tmpfs / disk) at every grid point and
+writes serialization.csv.
+"""
+
+from benchmarker import Benchmarker
+import csv
+import sys
+from datetime import datetime
+
+# Configuration
+RING_DIMS = [4096, 8192, 16384]
+NUM_LIMBS = [2, 4, 8]
+
+CSV_PATH = "serialization.csv"
+
+COLUMNS = [
+    "ring_dim", "num_limbs", "object", "format", "medium", "bytes",
+    "serialize_ns", "deserialize_ns", "serialize_mb_per_sec", "deserialize_mb_per_sec",
+    "serialize_allocations", "serialize_allocated_bytes",
+    "deserialize_allocations", "deserialize_allocated_bytes",
+]
+
+
+def main():
+    print("=" * 60)
+    print("SERIALIZATION THROUGHPUT")
+    print(f"Started: {datetime.now().strftime('%Y-%m-%d %H:%M:%S')}")
+    print("=" * 60)
+    
+    # Create benchmarker with debug off for cleaner output
+    b = Benchmarker(debug=False)
+    
+    # Configure parameters
+    b.base_config["num_digits"] = 1
+    b.base_config["repetitions"] = 5
+    
+    print(f"\n{'Ring':<7} {'Limbs':<6} {'Object':<14} {'Format':<11} {'Medium':<7} "
+          f"{'MB':<9} {'Ser MB/s':<10} {'Deser MB/s':<11} {'Deser allocs':<12}")
+    print("-" * 92)
+    
+    rows = []
+    for ring_dim in RING_DIMS:
+        for num_limbs in NUM_LIMBS:
+            cases = b.measure_serialization(ring_dim=ring_dim, num_limbs=num_limbs)
+            if cases is None:
+                print(f"{ring_dim:<7} {num_limbs:<6} FAILED")
+                continue
+            
+            for case in cases:
+                print(f"{ring_dim:<7} {num_limbs:<6} {case['object']:<14} {case['format']:<11} "
+                      f"{case['medium']:<7} {case['bytes'] / 1e6:<9.2f} "
+                      f"{case['serialize_mb_per_sec']:<10.1f} {case['deserialize_mb_per_sec']:<11.1f} "
+                      f"{case['deserialize_allocations']:<12}")
+                rows.append({"ring_dim": ring_dim, "num_limbs": num_limbs, **case})
+    
+    print("-" * 92)
+    
+    if not rows:
+        print("\n⚠ No serialization case completed")
+        sys.exit(1)
+    
+    with open(CSV_PATH, "w", newline="") as f:
+        writer = csv.DictWriter(f, fieldnames=COLUMNS)
+        writer.writeheader()
+        writer.writerows(rows)
+    print(f"\nWrote {len(rows)} cases to {CSV_PATH}")
+    
+    return 0
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,93 @@
+#!/usr/bin/env python3
+"""
+Streaming request serving: sustained throughput and tail latency under load.
+Runs the serving benchmark for every (workers, offered rate) point and reports
+throughput, p50/p99/p999 latency and p99 queueing delay. Past saturation the
+throughput stops following the offered rate and the queueing delay dominates
+the tail. Writes serving.csv.
+"""
+
+from benchmarker import Benchmarker
+import csv
+import sys
+from datetime import datetime
+
+# Configuration
+WORKERS = [1, 2, 4]
+RATES = [2, 5, 10, 20, 40]  # requests/s
+REQUESTS = 200
+
+CSV_PATH = "serving.csv"
+
+COLUMNS = [
+    "workers", "offered_rate", "throughput", "latency_p50_ns", "latency_p99_ns",
+    "latency_p999_ns", "queue_p99_ns", "compute_median_ns", "compute_utilization", "max_backlog",
+]
+
+
+def main():
+    print("=" * 60)
+    print("STREAMING REQUEST SERVING")
+    print(f"Started: {datetime.now().strftime('%Y-%m-%d %H:%M:%S')}")
+    print("=" * 60)
+    
+    # Create benchmarker with debug off for cleaner output
+    b = Benchmarker(debug=False)
+    
+    # Configure parameters (one session per point; it warms up on its own requests)
+    b.base_config["ring_dim"]    = 8192
+    b.base_config["matrix_dim"]  = 64
+    b.base_config["num_limbs"]   = 3
+    b.base_config["warmup"]      = 0
+    b.base_config["repetitions"] = 1
+    b.base_config["requests"]    = REQUESTS
+    
+    print(f"\n{'Workers':<8} {'Offered/s':<10} {'Served/s':<9} {'p50 (ms)':<9} "
+          f"{'p99 (ms)':<9} {'p999 (ms)':<10} {'Queue p99':<10} {'Util':<6}")
+    print("-" * 80)
+    
+    target = b.build("serving")
+    
+    rows = []
+    for workers in WORKERS:
+        for rate in RATES:
+            params = {**b.base_config, "workers": workers, "rate": rate}
+            latency = b.measure_latency(target, b._prepare_arguments(params))
+            if latency is None:
+                print(f"{workers:<8} {rate:<10} FAILED")
+                continue
+            
+            row = {
+                "workers": workers,
+                "offered_rate": rate,
+                "throughput": latency["SERVE_THROUGHPUT"],
+                "latency_p50_ns": latency["SERVE_LATENCY_P50_NS"],
+                "latency_p99_ns": latency["SERVE_LATENCY_P99_NS"],
+                "latency_p999_ns": latency["SERVE_LATENCY_P999_NS"],
+                "queue_p99_ns": latency["SERVE_QUEUE_P99_NS"],
+                "compute_median_ns": latency["SERVE_COMPUTE_MEDIAN_NS"],
+                "compute_utilization": latency["SERVE_COMPUTE_UTILIZATION"],
+                "max_backlog": latency["SERVE_MAX_BACKLOG"],
+            }
+            print(f"{workers:<8} {rate:<10} {row['throughput']:<9.2f} "
+                  f"{row['latency_p50_ns'] / 1e6:<9.1f} {row['latency_p99_ns'] / 1e6:<9.1f} "
+                  f"{row['latency_p999_ns'] / 1e6:<10.1f} {row['queue_p99_ns'] / 1e6:<10.1f} "
+                  f"{row['compute_utilization']:<6.2f}")
+            rows.append(row)
+    
+    print("-" * 80)
+    
+    if not rows:
+        print("\n⚠ No serving point completed")
+        sys.exit(1)
+    
+    with open(CSV_PATH, "w", newline="") as f:
+        writer = csv.DictWriter(f, fieldnames=COLUMNS)
+        writer.writeheader()
+        writer.writerows(rows)
+    print(f"\nWrote {len(rows)} points to {CSV_PATH}")
+    
+    return 0
+
+if __name__ == "__main__":
+    sys.exit(main())
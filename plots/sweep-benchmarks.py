@@ -1,7 +1,7 @@
 #!/usr/bin/env python3
 """
 Test suite for all benchmarks with default parameters.
-Verifies correctness and reports arithmetic intensity.
+Verifies correctness and reports arithmetic intensity and peak heap use.
 """
 
 from benchmarker import Benchmarker
@@ -17,6 +17,7 @@ BENCHMARKS = [
     "single-hoisted-diagonal-method",
     "bsgs-diagonal-method",
     "single-hoisted-bsgs-diagonal-method",
+    "double-hoisted-bsgs-diagonal-method",
 ]
 
 def main():
@@ -46,16 +47,16 @@ def main():
     failed = []
     
     # Header for results table
-    print(f"{'Benchmark':<40} {'Status':<10} {'AI (ops/byte)':<15}")
-    print("-" * 65)
+    print(f"{'Benchmark':<40} {'Status':<10} {'AI (ops/byte)':<15} {'Heap peak (MiB)':<15}")
+    print("-" * 81)
     
     for benchmark in BENCHMARKS:
         # Run benchmark
-        result = b.run(benchmark)
+        result = b.run(benchmark, measure_memory=True)
         
         # Check success
         if not result['success']:
-            print(f"{benchmark:<40} {'FAILED':<10} {'---':<15}")
+            print(f"{benchmark:<40} {'FAILED':<10} {'---':<15} {'---':<15}")
             failed.append(benchmark)
             continue
         
@@ -63,16 +64,22 @@ def main():
         ai = result['ai']
         ai_str = f"{ai:.5f}" if ai else "N/A"
         
-        print(f"{benchmark:<40} {'✓ OK':<10} {ai_str:<15}")
+        # Get peak heap growth of the kernel
+        memory = result['memory'] or {}
+        heap_peak = memory.get('MEMORY_HEAP_PEAK_BYTES')
+        heap_str = f"{heap_peak / 2**20:.2f}" if heap_peak is not None else "N/A"
+        
+        print(f"{benchmark:<40} {'✓ OK':<10} {ai_str:<15} {heap_str:<15}")
         
         results.append({
             'name': benchmark,
             'ai': ai,
-            'latency': result['latency'][0]
+            'heap_peak': heap_peak,
+            'latency': result['latency']['LATENCY_MEDIAN_NS']
         })
     
     # Summary
-    print("-" * 65)
+    print("-" * 81)
     print(f"\nSummary: {len(results)}/{len(BENCHMARKS)} passed")
     
     if failed: